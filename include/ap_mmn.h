@@ -519,6 +519,18 @@
  *                         ap_mpm_unregister_poll_callback. Add
  *                         AP_MPMQ_CAN_POLL.
  * 20160315.1 (2.5.0-dev)  Add AP_IMPLEMENT_OPTIONAL_HOOK_RUN_FIRST.
+ * 20160315.2 (2.5.0-dev)  Add timers_pending, timers_fired, timers_late_avg
+ *                         and timers_late_max to process_score.
+ * 20160315.3 (2.5.0-dev)  Add io_uring to core_server_config.
+ * 20160315.4 (2.5.0-dev)  Add AP_MPM_THREAD_ALLOCATOR_KEY.
+ * 20160315.5 (2.5.0-dev)  Add ap_acquire_brigade(), ap_release_brigade(),
+ *                         ap_reuse_brigade_from_pool() and
+ *                         spare_brigades to conn_rec.
+ * 20160315.6 (2.5.0-dev)  Add output_coalescing to core_server_config.
+ * 20160315.7 (2.5.0-dev)  Add AP_SCOREBOARD_CACHE_LINE and cache_line_pad
+ *                         to worker_score.
+ * 20160315.8 (2.5.0-dev)  Add ap_sb_get_child_thread().
+ * 20160315.9 (2.5.0-dev)  Add sb_copy to core_request_config.
  */
 
 #define MODULE_MAGIC_COOKIE 0x41503235UL /* "AP25" */
@@ -526,7 +538,7 @@
 #ifndef MODULE_MAGIC_NUMBER_MAJOR
 #define MODULE_MAGIC_NUMBER_MAJOR 20160315
 #endif
-#define MODULE_MAGIC_NUMBER_MINOR 1                 /* 0...n */
+#define MODULE_MAGIC_NUMBER_MINOR 9                 /* 0...n */
 
 /**
  * Determine if the server's current MODULE_MAGIC_NUMBER is at least a
@@ -199,6 +199,15 @@ AP_DECLARE(apr_status_t) ap_mpm_query(int query_code, int *result);
 
 /** @} */
 
+/**
+ * Key of the thread data (see apr_thread_data_set()) where an MPM can put
+ * an apr_allocator_t for the requests processed by a worker thread, instead
+ * of the connection's allocator.  The allocator must be thread-safe (have a
+ * mutex) since the request may be finished by another thread, and must
+ * outlive the threads.
+ */
+#define AP_MPM_THREAD_ALLOCATOR_KEY "ap_mpm_thread_allocator"
+
 typedef void (ap_mpm_callback_fn_t)(void *baton);
 
 /* only added support in the Event MPM....  check for APR_ENOTIMPL */
@@ -433,6 +433,11 @@ typedef struct {
     /** Should addition of charset= be suppressed for this request?
      */
     int suppress_charset;
+
+    /** What of this request was last copied to the scoreboard with
+     *  ExtendedStatus (private to scoreboard.c)
+     */
+    struct ap_sb_copy_t *sb_copy;
 } core_request_config;
 
 /* Standard entries that are guaranteed to be accessible via
@@ -750,11 +755,21 @@ typedef struct {
 #define AP_HTTP_EXPECT_STRICT_DISABLE  2
     int http_expect_strict;
 
+#define AP_IO_URING_UNSET    0
+#define AP_IO_URING_ENABLE   1
+#define AP_IO_URING_DISABLE  2
+    int io_uring;
 
     apr_array_header_t *protocols;
     int protocols_honor_order;
     int async_filter;
     unsigned int async_filter_set:1;
+
+#define AP_OUTPUT_COALESCING_UNSET    0
+#define AP_OUTPUT_COALESCING_OFF      1
+#define AP_OUTPUT_COALESCING_LATENCY  2
+#define AP_OUTPUT_COALESCING_PACKETS  3
+    int output_coalescing;
 } core_server_config;
 
 /* for AddOutputFiltersByType in core.c */
@@ -775,6 +790,26 @@ apr_status_t ap_core_input_filter(ap_filter_t *f, apr_bucket_brigade *b,
                                   ap_input_mode_t mode, apr_read_type_e block,
                                   apr_off_t readbytes);
 apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *b);
+/* Per child setup of the core output filter (io_uring backend, stats) */
+void ap_core_output_filter_child_init(apr_pool_t *pchild, server_rec *s);
+int ap_core_output_status_hook(request_rec *r, int flags);
+/* Per child cache of merged per-dir configs (request.c); not exported. */
+void ap_merge_cache_child_init(apr_pool_t *pchild, server_rec *s,
+                               unsigned int max);
+/* Per child cache of stat() results for the walks (request.c); not
+ * exported.  ap_statcache_stat() is apr_stat() when the cache is disabled.
+ */
+void ap_statcache_child_init(apr_pool_t *pchild, server_rec *s,
+                             apr_interval_time_t ttl, unsigned int max,
+                             int use_inotify);
+apr_status_t ap_statcache_stat(apr_finfo_t *finfo, const char *fname,
+                               apr_int32_t wanted, apr_pool_t *p);
+int ap_statcache_absent(const char *fname, apr_status_t *rv);
+void ap_statcache_set_absent(const char *fname, apr_status_t rv);
+int ap_statcache_status_hook(request_rec *r, int flags);
+/* Per child cache of parsed .htaccess files (config.c); not exported. */
+void ap_htaccess_cache_child_init(apr_pool_t *pchild, unsigned int max,
+                                  apr_size_t max_bytes);
 
 
 AP_DECLARE(const char*) ap_get_server_protocol(server_rec* s);
@@ -1217,6 +1217,10 @@ struct conn_rec {
 
     /** The minimum level of filter type to allow setaside buckets */
     int async_filter;
+
+    /** Empty brigades released for reuse, see ap_acquire_brigade(); must
+     *  be reset by whatever copies the conn_rec */
+    apr_array_header_t *spare_brigades;
 };
 
 struct conn_slave_rec {
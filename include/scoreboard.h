@@ -85,6 +85,15 @@ typedef enum {
     SB_SHARED = 2
 } ap_scoreboard_e;
 
+/* A worker_score ends with a cache line which nobody writes, so that the
+ * thread updating its slot never writes to a cache line where the thread
+ * of the next slot writes too (false sharing).  Build with
+ * -DAP_SCOREBOARD_CACHE_LINE=0 for the packed layout.
+ */
+#ifndef AP_SCOREBOARD_CACHE_LINE
+#define AP_SCOREBOARD_CACHE_LINE 64
+#endif
+
 /* stuff which is worker specific */
 typedef struct worker_score worker_score;
 struct worker_score {
@@ -116,6 +125,9 @@ struct worker_score {
     char request[64];           /* We just want an idea... */
     char vhost[32];             /* What virtual host is being accessed? */
     char protocol[16];          /* What protocol is used on the connection? */
+#if AP_SCOREBOARD_CACHE_LINE > 0
+    char cache_line_pad[AP_SCOREBOARD_CACHE_LINE];
+#endif
 };
 
 typedef struct {
@@ -144,6 +156,10 @@ struct process_score {
     apr_uint32_t keep_alive;        /* async connections in keep alive */
     apr_uint32_t suspended;         /* connections suspended by some module */
     int bucket;             /* Listener bucket used by this child */
+    apr_uint32_t timers_pending;    /* timed callbacks scheduled (for async MPMs) */
+    apr_uint32_t timers_fired;      /* timed callbacks fired so far */
+    apr_uint32_t timers_late_avg;   /* average firing lateness (usecs) */
+    apr_uint32_t timers_late_max;   /* worst firing lateness (usecs) */
 };
 
 /* Scoreboard is now in 'local' memory, since it isn't updated once created,
@@ -177,6 +193,14 @@ AP_DECLARE(int) ap_calc_scoreboard_size(void);
 AP_DECLARE(void) ap_create_sb_handle(ap_sb_handle_t **new_sbh, apr_pool_t *p,
                                      int child_num, int thread_num);
 
+/** Return the child and thread numbers of a scoreboard handle.
+ * @param sbh The scoreboard handle.
+ * @param child_num Output parameter, the child number.
+ * @param thread_num Output parameter, the thread number.
+ */
+AP_DECLARE(void) ap_sb_get_child_thread(ap_sb_handle_t *sbh, int *child_num,
+                                        int *thread_num);
+
 AP_DECLARE(int) ap_find_child_by_pid(apr_proc_t *pid);
 AP_DECLARE(int) ap_update_child_status(ap_sb_handle_t *sbh, int status, request_rec *r);
 AP_DECLARE(int) ap_update_child_status_from_indexes(int child_num, int thread_num,
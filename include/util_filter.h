@@ -556,6 +556,39 @@ AP_DECLARE(apr_status_t) ap_save_brigade(ap_filter_t *f,
                                          apr_bucket_brigade **save_to,
                                          apr_bucket_brigade **b, apr_pool_t *p);
 
+/**
+ * Get an empty brigade from the connection's spare brigades, or create
+ * one in the connection pool.  Use this for short lived brigades, such as
+ * one created for each invocation of a filter, and give it back with
+ * ap_release_brigade() when done so that the connection pool does not
+ * grow with every call.
+ * @param c The connection
+ * @return An empty brigade using c->pool and c->bucket_alloc
+ */
+AP_DECLARE(apr_bucket_brigade *) ap_acquire_brigade(conn_rec *c);
+
+/**
+ * Give back a brigade obtained with ap_acquire_brigade().  The brigade is
+ * cleaned up (its buckets destroyed) and kept for reuse by the connection.
+ * @param c The connection
+ * @param bb The brigade, which must not be used afterwards
+ */
+AP_DECLARE(void) ap_release_brigade(conn_rec *c, apr_bucket_brigade *bb);
+
+/**
+ * Get the brigade stored in the pool under the given key, or create and
+ * store it.  A brigade returned again is cleaned up first.  This lets a
+ * filter use a single brigade per request for all of its invocations
+ * instead of creating one each time.
+ * @param key The key, unique to the caller (e.g. the filter name)
+ * @param pool The pool holding the brigade, usually the request pool
+ * @param ba The bucket allocator for a new brigade
+ * @return The empty brigade
+ */
+AP_DECLARE(apr_bucket_brigade *) ap_reuse_brigade_from_pool(const char *key,
+                                                      apr_pool_t *pool,
+                                                      apr_bucket_alloc_t *ba);
+
 /**
  * Prepare the filter to allow brigades to be set aside. This can be used
  * within an input filter to allocate space to set aside data in the input
@@ -572,6 +605,8 @@ AP_DECLARE(int) ap_filter_prepare_brigade(ap_filter_t *f, apr_pool_t **p);
 /**
  * Prepare a bucket brigade to be setaside, creating a dedicated pool if
  * necessary within the filter to handle the lifetime of the setaside brigade.
+ * Runs of small in-memory buckets are coalesced into heap buckets of
+ * APR_BUCKET_BUFF_SIZE bytes from the connection's bucket allocator.
  * @param f The current filter
  * @param bb The bucket brigade to set aside.  This brigade is always empty
  *          on return
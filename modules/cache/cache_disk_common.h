@@ -26,8 +26,17 @@
 #ifndef CACHE_DIST_COMMON_H
 #define CACHE_DIST_COMMON_H
 
-#define VARY_FORMAT_VERSION 5
-#define DISK_FORMAT_VERSION 6
+#define VARY_FORMAT_VERSION 7
+#define DISK_FORMAT_VERSION 8
+
+/* The formats with the headers stored as text lines, still read */
+#define VARY_FORMAT_VERSION_TEXT 5
+#define DISK_FORMAT_VERSION_TEXT 6
+
+#define VARY_FORMAT_KNOWN(format) ((format) == VARY_FORMAT_VERSION || \
+                                   (format) == VARY_FORMAT_VERSION_TEXT)
+#define DISK_FORMAT_KNOWN(format) ((format) == DISK_FORMAT_VERSION || \
+                                   (format) == DISK_FORMAT_VERSION_TEXT)
 
 #define CACHE_HEADER_SUFFIX ".header"
 #define CACHE_DATA_SUFFIX   ".data"
@@ -64,5 +73,22 @@ typedef struct {
     cache_control_t control;
 } disk_cache_info_t;
 
+/*
+ * A block of strings: this struct, the length of each string as an
+ * apr_uint32_t, then the strings, each followed by a NUL.
+ *
+ * A DISK_FORMAT_VERSION file holds a disk_cache_info_t, the entity name,
+ * then two blocks: the response headers and the request headers, as key
+ * and value pairs.  A VARY_FORMAT_VERSION file holds the format, the
+ * expiry time as an apr_time_t, then a block of the Vary header names,
+ * sorted, as they make up the key of each variant.
+ */
+typedef struct {
+    /* The number of strings. */
+    apr_uint32_t count;
+    /* The size of the lengths and strings that follow. */
+    apr_uint32_t len;
+} disk_cache_strings_t;
+
 #endif /* CACHE_DIST_COMMON_H */
 /** @} */
@@ -17,8 +17,12 @@
 #include "mod_cache.h"
 
 #include "cache_util.h"
+#include "cache_storage.h"
 #include <ap_provider.h>
 
+#include "apr_hash.h"
+#include "apr_shm.h"
+
 APLOG_USE_MODULE(cache);
 
 /* -------------------------------------------------------------- */
@@ -27,6 +31,17 @@ extern APR_OPTIONAL_FN_TYPE(ap_cache_generate_key) *cache_generate_key;
 
 extern module AP_MODULE_DECLARE_DATA cache_module;
 
+/* Lock generations shared by the children, one slot per hash of the key */
+#define CACHE_LOCK_SLOTS 4096
+
+/* Waiters stat the lock file after 1ms, then back off up to 32ms */
+#define CACHE_LOCK_POLL_MIN apr_time_from_msec(1)
+#define CACHE_LOCK_POLL_MAX apr_time_from_msec(32)
+
+static apr_uint32_t *lock_generations;
+
+cache_refresh_counters_t cache_refresh_counters;
+
 /* Determine if "url" matches the hostname, scheme and port and path
  * in "filter". All but the path comparisons are case-insensitive.
  */
@@ -356,6 +371,27 @@ apr_status_t cache_try_lock(cache_server_conf *conf, cache_request_rec *cache,
 
 }
 
+static apr_uint32_t *cache_lock_slot(const char *key)
+{
+    apr_ssize_t len = APR_HASH_KEY_STRING;
+
+    if (!lock_generations || !key) {
+        return NULL;
+    }
+    return &lock_generations[apr_hashfunc_default(key, &len)
+                             % CACHE_LOCK_SLOTS];
+}
+
+/* Tell the requests waiting for the lock on this key that it is gone */
+static void cache_lock_wake(cache_request_rec *cache)
+{
+    apr_uint32_t *slot = cache_lock_slot(cache->key);
+
+    if (slot) {
+        apr_atomic_inc32(slot);
+    }
+}
+
 /**
  * Remove the cache lock, if present.
  *
@@ -373,6 +409,7 @@ apr_status_t cache_remove_lock(cache_server_conf *conf,
 {
     void *dummy;
     const char *lockname;
+    apr_status_t status;
 
     if (!conf || !conf->lock || !conf->lockpath) {
         /* no locks configured, leave */
@@ -399,7 +436,9 @@ apr_status_t cache_remove_lock(cache_server_conf *conf,
     }
     apr_pool_userdata_get(&dummy, CACHE_LOCKFILE_KEY, r->pool);
     if (dummy) {
-        return apr_file_close((apr_file_t *)dummy);
+        status = apr_file_close((apr_file_t *)dummy);
+        cache_lock_wake(cache);
+        return status;
     }
     apr_pool_userdata_get(&dummy, CACHE_LOCKNAME_KEY, r->pool);
     lockname = (const char *)dummy;
@@ -425,7 +464,136 @@ apr_status_t cache_remove_lock(cache_server_conf *conf,
 
         lockname = apr_pstrcat(r->pool, conf->lockpath, dir, "/", lockname, NULL);
     }
-    return apr_file_remove(lockname, r->pool);
+    status = apr_file_remove(lockname, r->pool);
+    cache_lock_wake(cache);
+    return status;
+}
+
+static apr_status_t cache_lock_wait_cleanup(void *dummy)
+{
+    lock_generations = NULL;
+    return APR_SUCCESS;
+}
+
+apr_status_t cache_lock_wait_init(apr_pool_t *p)
+{
+    apr_shm_t *shm;
+    apr_size_t size = CACHE_LOCK_SLOTS * sizeof(apr_uint32_t);
+    apr_status_t status;
+
+    status = apr_shm_create(&shm, size, NULL, p);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    lock_generations = apr_shm_baseaddr_get(shm);
+    memset(lock_generations, 0, size);
+
+    /* registered after the shm's own cleanup, so run before it */
+    apr_pool_cleanup_register(p, NULL, cache_lock_wait_cleanup,
+                              apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+apr_status_t cache_wait_lock(cache_server_conf *conf,
+        cache_request_rec *cache, request_rec *r)
+{
+    apr_status_t status;
+    apr_finfo_t finfo;
+    apr_uint32_t *slot = cache_lock_slot(cache->key);
+    apr_uint32_t generation = 0;
+    apr_interval_time_t poll = CACHE_LOCK_POLL_MIN;
+    apr_time_t now, next, deadline;
+    const char *lockname;
+    void *dummy;
+
+    apr_pool_userdata_get(&dummy, CACHE_LOCKNAME_KEY, r->pool);
+    lockname = (const char *)dummy;
+    if (!lockname) {
+        return APR_EINVAL;
+    }
+
+    deadline = apr_time_now() + conf->lockwait;
+    for (;;) {
+        /* read the generation before the stat, so that a lock removed
+         * in between still wakes us up below
+         */
+        if (slot) {
+            generation = apr_atomic_read32(slot);
+        }
+        status = apr_stat(&finfo, lockname, APR_FINFO_MTIME, r->pool);
+        if (APR_STATUS_IS_ENOENT(status)) {
+            return APR_SUCCESS;
+        }
+        if (status != APR_SUCCESS) {
+            return status;
+        }
+
+        now = apr_time_now();
+        if (now >= deadline) {
+            return APR_TIMEUP;
+        }
+        next = now + poll;
+        if (next > deadline) {
+            next = deadline;
+        }
+        if (poll < CACHE_LOCK_POLL_MAX) {
+            poll *= 2;
+        }
+
+        /* sleep until the next stat, or until the generation moves */
+        while (now < next) {
+            if (!slot) {
+                apr_sleep(next - now);
+                break;
+            }
+            apr_sleep(CACHE_LOCK_POLL_MIN);
+            if (apr_atomic_read32(slot) != generation) {
+                break;
+            }
+            now = apr_time_now();
+        }
+    }
+}
+
+int cache_collapse(cache_server_conf *conf, cache_request_rec *cache,
+        request_rec *r)
+{
+    apr_status_t status;
+    apr_time_t start;
+
+    if (!conf->lock || !conf->lockpath || conf->lockwait <= 0) {
+        return DECLINED;
+    }
+
+    /* a stale entry is revalidated by cache_check_freshness(), and
+     * requests the cache must not answer have nothing to wait for
+     */
+    if (cache->stale_handle || !ap_cache_check_no_cache(cache, r)) {
+        return DECLINED;
+    }
+
+    /* if we get the lock we are the one going to the backend, and the
+     * lock is kept for cache_try_lock() to find again
+     */
+    status = cache_try_lock(conf, cache, r);
+    if (status == APR_SUCCESS || !APR_STATUS_IS_EEXIST(status)) {
+        return DECLINED;
+    }
+
+    start = apr_time_now();
+    status = cache_wait_lock(conf, cache, r);
+    if (status != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, status, r, APLOGNO(03407)
+                "cache: gave up waiting for the cache lock on %s after %"
+                APR_TIME_T_FMT "us", r->uri, apr_time_now() - start);
+        return DECLINED;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, APR_SUCCESS, r, APLOGNO(03408)
+            "cache: cache lock on %s released after %" APR_TIME_T_FMT
+            "us, looking up the cache again", r->uri, apr_time_now() - start);
+
+    return cache_select(cache, r);
 }
 
 int ap_cache_check_no_cache(cache_request_rec *cache, request_rec *r)
@@ -511,12 +679,104 @@ int ap_cache_check_no_store(cache_request_rec *cache, request_rec *r)
     return 1;
 }
 
+static apr_status_t cache_refresh_release(void *dummy)
+{
+    apr_atomic_dec32(&cache_refresh_counters.active);
+    return APR_SUCCESS;
+}
+
+void cache_refresh_done(cache_request_rec *cache, request_rec *r, int ok)
+{
+    apr_atomic_inc32(ok ? &cache_refresh_counters.done
+                        : &cache_refresh_counters.failed);
+    apr_pool_cleanup_run(r->pool, cache, cache_refresh_release);
+    cache->refresh = 0;
+}
+
+/*
+ * Reserve one of the CacheRefreshMax slots of this child and take the
+ * cache lock, so that a single request refreshes the entity. The slot
+ * and the lock go with the request pool if the refresh is never run.
+ */
+static void cache_refresh_start(cache_server_conf *conf,
+        cache_request_rec *cache, request_rec *r)
+{
+    apr_status_t status;
+
+    /* absolute URIs of forward proxy requests can't be replayed as
+     * subrequests
+     */
+    if (cache->refresh || r->main || conf->refresh_max <= 0
+            || r->unparsed_uri[0] != '/') {
+        return;
+    }
+
+    if (apr_atomic_inc32(&cache_refresh_counters.active)
+            >= (apr_uint32_t)conf->refresh_max) {
+        apr_atomic_dec32(&cache_refresh_counters.active);
+        apr_atomic_inc32(&cache_refresh_counters.busy);
+        return;
+    }
+    apr_pool_cleanup_register(r->pool, cache, cache_refresh_release,
+                              apr_pool_cleanup_null);
+
+    status = cache_try_lock(conf, cache, r);
+    if (status != APR_SUCCESS) {
+        /* someone else is on it already */
+        apr_pool_cleanup_run(r->pool, cache, cache_refresh_release);
+        return;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03410)
+            "Cached URL will be refreshed once the response is sent: %s",
+            r->unparsed_uri);
+    cache->refresh = 1;
+}
+
+/* Is this the subrequest refreshing the entity of its main request? */
+static int cache_is_refresh(cache_request_rec *cache, request_rec *r)
+{
+    void *key;
+
+    if (!r->main || !cache->key) {
+        return 0;
+    }
+    apr_pool_userdata_get(&key, CACHE_REFRESH_KEY, r->main->pool);
+    return key && !strcmp((const char *)key, cache->key);
+}
+
+/* The stale-while-revalidate of the cached response, or -1 */
+static apr_int64_t cache_stale_while_revalidate(cache_handle_t *h,
+        request_rec *r)
+{
+    const char *cc = cache_table_getm(r->pool, h->resp_hdrs, "Cache-Control");
+    const char *token;
+    char *header, *last, *endp;
+    apr_off_t offt;
+
+    if (!cc) {
+        return -1;
+    }
+    header = apr_pstrdup(r->pool, cc);
+    token = cache_strqtok(header, CACHE_SEPARATOR, &last);
+    while (token) {
+        if (!ap_casecmpstrn(token, "stale-while-revalidate", 22)
+                && token[22] == '='
+                && !apr_strtoff(&offt, token + 23, &endp, 10)
+                && endp > token + 23 && !*endp) {
+            return offt;
+        }
+        token = cache_strqtok(NULL, CACHE_SEPARATOR, &last);
+    }
+    return -1;
+}
+
 int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
         request_rec *r)
 {
     apr_status_t status;
     apr_int64_t age, maxage_req, maxage_cresp, maxage, smaxage, maxstale;
-    apr_int64_t minfresh;
+    apr_int64_t minfresh, lifetime, swr;
     const char *cc_req;
     const char *pragma;
     const char *agestr = NULL;
@@ -581,6 +841,11 @@ int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
                 r->unparsed_uri);
     }
 
+    /* a background refresh revalidates the entity whatever its age */
+    if (cache_is_refresh(cache, r)) {
+        return 0;
+    }
+
     /* These come from the cached entity. */
     if (h->cache_obj->info.control.no_cache
             || h->cache_obj->info.control.invalidated) {
@@ -638,6 +903,17 @@ int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
         maxage = MIN(maxage_req, maxage_cresp);
     }
 
+    /* the freshness lifetime, if any */
+    if (maxage != -1) {
+        lifetime = maxage;
+    }
+    else if ((smaxage == -1) && (info->expire != APR_DATE_BAD)) {
+        lifetime = apr_time_sec(info->expire - info->date);
+    }
+    else {
+        lifetime = -1;
+    }
+
     /* extract max-stale */
     if (cache->control_in.max_stale) {
         if(cache->control_in.max_stale_value != -1) {
@@ -716,9 +992,47 @@ int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
                                  "113 Heuristic expiration");
             }
         }
+
+        /* refresh it ahead of time if it is about to expire */
+        if (conf->refresh_window && (lifetime != -1)
+                && (age + apr_time_sec(conf->refresh_window) >= lifetime)) {
+            cache_refresh_start(conf, cache, r);
+        }
+
         return 1;    /* Cache object is fresh (enough) */
     }
 
+    /*
+     * RFC5861 stale-while-revalidate: for as many seconds past its
+     * lifetime as the response allows, the stale entity is served at once
+     * and refreshed in the background afterwards. Not when revalidation is
+     * required by the response, or the client asked for fresher content.
+     */
+    if (conf->stale_while_revalidate && !r->main && (lifetime != -1)
+            && (smaxage == -1) && (maxage_req == -1) && !minfresh
+            && !h->cache_obj->info.control.must_revalidate
+            && !h->cache_obj->info.control.proxy_revalidate
+            && (swr = cache_stale_while_revalidate(h, r)) > 0
+            && (age < lifetime + swr)) {
+
+        cache_refresh_start(conf, cache, r);
+        apr_atomic_inc32(&cache_refresh_counters.stale);
+
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03411)
+                "Serving stale cached URL within stale-while-revalidate: %s",
+                r->unparsed_uri);
+
+        /* make sure we don't stomp on a previous warning */
+        warn_head = apr_table_get(h->resp_hdrs, "Warning");
+        if ((warn_head == NULL) ||
+            ((warn_head != NULL) && (ap_strstr_c(warn_head, "110") == NULL))) {
+            apr_table_mergen(h->resp_hdrs, "Warning",
+                             "110 Response is stale");
+        }
+
+        return 1;
+    }
+
     /*
      * At this point we are stale, but: if we are under load, we may let
      * a significant number of stale requests through before the first
@@ -92,13 +92,18 @@ extern "C" {
 #define DEFAULT_CACHE_EXPIRE    MSEC_ONE_HR
 #define DEFAULT_CACHE_LMFACTOR  (0.1)
 #define DEFAULT_CACHE_MAXAGE    5
+#define DEFAULT_CACHE_LOCKWAIT  0
 #define DEFAULT_X_CACHE         0
 #define DEFAULT_X_CACHE_DETAIL  0
 #define DEFAULT_CACHE_STALE_ON_ERROR 1
+#define DEFAULT_CACHE_STALE_WHILE_REVALIDATE 0
+#define DEFAULT_CACHE_REFRESH_WINDOW 0
+#define DEFAULT_CACHE_REFRESH_MAX 4
 #define DEFAULT_CACHE_LOCKPATH "mod_cache-lock"
 #define CACHE_LOCKNAME_KEY "mod_cache-lockname"
 #define CACHE_LOCKFILE_KEY "mod_cache-lockfile"
 #define CACHE_CTX_KEY "mod_cache-ctx"
+#define CACHE_REFRESH_KEY "mod_cache-refresh"
 #define CACHE_SEPARATOR ", \t"
 
 /**
@@ -126,6 +131,12 @@ typedef struct {
     apr_array_header_t *ignore_session_id;
     const char *lockpath;
     apr_time_t lockmaxage;
+    /* how long a cache miss waits for the lock held by another request */
+    apr_interval_time_t lockwait;
+    /* refresh entities this close to expiry in the background */
+    apr_time_t refresh_window;
+    /* background refreshes running at once in a child */
+    int refresh_max;
     apr_uri_t *base_uri;
     /** ignore client's requests for uncached responses */
     unsigned int ignorecachecontrol:1;
@@ -137,6 +148,8 @@ typedef struct {
     unsigned int lock:1;
     unsigned int x_cache:1;
     unsigned int x_cache_detail:1;
+    /* honour stale-while-revalidate in cached responses */
+    unsigned int stale_while_revalidate:1;
     /* flag if CacheIgnoreHeader has been set */
     #define CACHE_IGNORE_HEADERS_SET   1
     #define CACHE_IGNORE_HEADERS_UNSET 0
@@ -152,6 +165,10 @@ typedef struct {
     unsigned int lock_set:1;
     unsigned int lockpath_set:1;
     unsigned int lockmaxage_set:1;
+    unsigned int lockwait_set:1;
+    unsigned int stale_while_revalidate_set:1;
+    unsigned int refresh_window_set:1;
+    unsigned int refresh_max_set:1;
     unsigned int x_cache_set:1;
     unsigned int x_cache_detail_set:1;
 } cache_server_conf;
@@ -230,8 +247,21 @@ typedef struct {
     apr_off_t size;                     /* the content length from the headers, or -1 */
     apr_bucket_brigade *out;            /* brigade to reuse for upstream responses */
     cache_control_t control_in;         /* cache control incoming */
+    int refresh;                        /* refresh the entity once served */
 } cache_request_rec;
 
+/* Background refreshes of this child, shown by mod_status */
+typedef struct {
+    apr_uint32_t active;                /* running now */
+    apr_uint32_t started;
+    apr_uint32_t done;
+    apr_uint32_t failed;
+    apr_uint32_t busy;                  /* not started, CacheRefreshMax hit */
+    apr_uint32_t stale;                 /* served within stale-while-revalidate */
+} cache_refresh_counters_t;
+
+extern cache_refresh_counters_t cache_refresh_counters;
+
 /**
  * Check the whether the request allows a cached object to be served as per RFC2616
  * section 14.9.4 (Cache Revalidation and Reload Controls)
@@ -252,6 +282,11 @@ int ap_cache_check_no_store(cache_request_rec *cache, request_rec *r);
 
 /**
  * Check the freshness of the cache object per RFC2616 section 13.2 (Expiration Model)
+ *
+ * A stale object within the stale-while-revalidate window of RFC5861, or
+ * a fresh one within CacheRefreshWindow of its expiry, is reported fresh
+ * and cache->refresh is set when the caller should refresh it in the
+ * background once the response is sent.
  * @param h cache_handle_t
  * @param cache cache_request_rec
  * @param r request_rec
@@ -299,6 +334,49 @@ apr_status_t cache_try_lock(cache_server_conf *conf, cache_request_rec *cache,
 apr_status_t cache_remove_lock(cache_server_conf *conf,
         cache_request_rec *cache, request_rec *r, apr_bucket_brigade *bb);
 
+/**
+ * Create the table of lock generations shared by the children.
+ *
+ * cache_remove_lock() bumps the generation of the key's slot once the
+ * lock is gone, so that the requests waiting in cache_wait_lock() notice
+ * at once, across threads and processes. Without the table the waiters
+ * fall back to polling the lock file.
+ */
+apr_status_t cache_lock_wait_init(apr_pool_t *p);
+
+/**
+ * Wait for the cache lock held by another request to go away.
+ *
+ * Returns APR_SUCCESS once the lock file is removed, APR_TIMEUP when
+ * CacheLockWait expired first, or the error from stat otherwise.
+ */
+apr_status_t cache_wait_lock(cache_server_conf *conf,
+        cache_request_rec *cache, request_rec *r);
+
+/**
+ * Collapse a cache miss onto the request already fetching the entity.
+ *
+ * When a lock wait is configured and another request holds the lock on
+ * the key, wait for that request to commit its entity to the cache and
+ * look the cache up again. If we got the lock ourselves, or the wait
+ * fails or times out, DECLINED is returned and the request goes to the
+ * backend as before.
+ *
+ * @return OK if the cache now has a fresh entity for the request, as
+ *         from cache_select(), DECLINED otherwise.
+ */
+int cache_collapse(cache_server_conf *conf, cache_request_rec *cache,
+        request_rec *r);
+
+/**
+ * Account for the end of a background refresh started by
+ * cache_check_freshness(), and give its slot back.
+ *
+ * The refresh may not have been run at all, when the request did not
+ * end up serving the cached entity.
+ */
+void cache_refresh_done(cache_request_rec *cache, request_rec *r, int ok);
+
 cache_provider_list *cache_get_providers(request_rec *r,
         cache_server_conf *conf, apr_uri_t uri);
 
@@ -130,7 +130,36 @@ if test "x$ap_distcache_configured" = "x"; then
 fi
 ])
 
-APACHE_MODULE(socache_shmcb,  shmcb small object cache provider, , , most)
+dnl
+dnl The subcache locks of mod_socache_shmcb are apr_atomic_cas32() on the
+dnl shared segment, which only work across processes when APR's atomics
+dnl are the compiler's builtins rather than its generic ones, made of
+dnl process-local mutexes.  APR uses the builtins when the compiler has
+dnl them, except on i486 to i686 unless it was configured with
+dnl --enable-nonportable-atomics: follow the same rules.  Set
+dnl ap_cv_atomics_lockfree=no in the environment when APR was built with
+dnl generic atomics anyway.
+dnl
+APACHE_MODULE(socache_shmcb,  shmcb small object cache provider, , , most, [
+  AC_CACHE_CHECK([for lock-free atomics], [ap_cv_atomics_lockfree], [
+    case "$host_cpu" in
+      i[[456]]86)
+        ap_cv_atomics_lockfree=no
+        ;;
+      *)
+        AC_TRY_LINK([], [
+          unsigned int lock = 0;
+          __sync_bool_compare_and_swap(&lock, 0, 1);
+          __sync_lock_test_and_set(&lock, 0);
+        ], [ap_cv_atomics_lockfree=yes], [ap_cv_atomics_lockfree=no])
+        ;;
+    esac
+  ])
+  if test "$ap_cv_atomics_lockfree" = "yes"; then
+    AC_DEFINE(HAVE_LOCKFREE_ATOMICS, 1,
+              [Define if APR's atomics work across processes])
+  fi
+])
 APACHE_MODULE(socache_dbm, dbm small object cache provider, , , most)
 APACHE_MODULE(socache_memcache, memcache small object cache provider, , , most)
 APACHE_MODULE(socache_dc, distcache small object cache provider, , , no, [
@@ -19,6 +19,8 @@
 #include "cache_storage.h"
 #include "cache_util.h"
 
+#include "mod_status.h"
+
 module AP_MODULE_DECLARE_DATA cache_module;
 APR_OPTIONAL_FN_TYPE(ap_cache_generate_key) *cache_generate_key;
 
@@ -35,6 +37,7 @@ static ap_filter_rec_t *cache_out_filter_handle;
 static ap_filter_rec_t *cache_out_subreq_filter_handle;
 static ap_filter_rec_t *cache_remove_url_filter_handle;
 static ap_filter_rec_t *cache_invalidate_filter_handle;
+static ap_filter_rec_t *cache_refresh_filter_handle;
 
 /**
  * Entity headers' names
@@ -80,14 +83,143 @@ static const char *MOD_CACHE_ENTITY_HEADERS[] = {
  * caching goals where the admin understands what they are doing.
  */
 
+/*
+ * CACHE_REFRESH ends the filter stack of background refresh subrequests:
+ * the response has been saved to the cache on the way, nobody wants it.
+ */
+static apr_status_t cache_refresh_filter(ap_filter_t *f, apr_bucket_brigade *in)
+{
+    apr_brigade_cleanup(in);
+    return APR_SUCCESS;
+}
+
+/*
+ * Refresh the entity just served from the cache, when cache_check_freshness()
+ * asked for it, by running a conditional subrequest for it through the
+ * CACHE_SAVE_SUBREQ filter. This runs from cache_log_transaction(), once
+ * the whole response has been written to the client, so the backend
+ * latency is not seen by it.
+ *
+ * That is from within the core output filter, which is destroying the
+ * EOR bucket: nothing of the refresh may be written to the connection.
+ * Its response ends in CACHE_REFRESH, and so do the interim responses
+ * and anything else sent to the protocol or connection filters, which
+ * are pointed at CACHE_REFRESH for the time of the subrequest.
+ */
+static void cache_refresh(request_rec *r, cache_request_rec *cache)
+{
+    conn_rec *c = r->connection;
+    request_rec *rr;
+    ap_filter_t *f, *conn_filters;
+    apr_table_t *headers_in = r->headers_in;
+    apr_time_t start = apr_time_now();
+    void *lockfile;
+    int rv;
+
+    apr_atomic_inc32(&cache_refresh_counters.started);
+
+    /* a filter of the main request, so that the subrequest's filters
+     * all go in front of it
+     */
+    f = apr_pcalloc(r->pool, sizeof(ap_filter_t));
+    f->frec = cache_refresh_filter_handle;
+    f->r = r;
+    f->c = c;
+
+    /* the client's conditionals and cache controls are not ours */
+    r->headers_in = apr_table_copy(r->pool, headers_in);
+    apr_table_unset(r->headers_in, "If-Match");
+    apr_table_unset(r->headers_in, "If-Modified-Since");
+    apr_table_unset(r->headers_in, "If-None-Match");
+    apr_table_unset(r->headers_in, "If-Range");
+    apr_table_unset(r->headers_in, "If-Unmodified-Since");
+    apr_table_unset(r->headers_in, "Range");
+    apr_table_unset(r->headers_in, "Cache-Control");
+    apr_table_unset(r->headers_in, "Pragma");
+
+    apr_pool_userdata_setn(cache->key, CACHE_REFRESH_KEY, NULL, r->pool);
+    rr = ap_sub_req_method_uri("GET", r->unparsed_uri, r, f);
+    r->headers_in = headers_in;
+    rr->proto_output_filters = f;
+    conn_filters = c->output_filters;
+    c->output_filters = f;
+
+    /* hand our cache lock over to the subrequest, which removes it once
+     * the entity is saved
+     */
+    apr_pool_userdata_get(&lockfile, CACHE_LOCKFILE_KEY, r->pool);
+    if (lockfile) {
+        apr_pool_userdata_setn(lockfile, CACHE_LOCKFILE_KEY, NULL, rr->pool);
+        apr_pool_userdata_setn(NULL, CACHE_LOCKFILE_KEY, NULL, r->pool);
+    }
+
+    rv = rr->status;
+    if (rv == HTTP_OK) {
+        rv = ap_run_sub_req(rr);
+        if (rv == OK) {
+            rv = rr->status;
+        }
+    }
+    ap_destroy_sub_req(rr);
+    c->output_filters = conn_filters;
+    apr_pool_userdata_setn(NULL, CACHE_REFRESH_KEY, NULL, r->pool);
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03412)
+            "cache: background refresh of %s returned %d after %"
+            APR_TIME_T_FMT "us", r->unparsed_uri, rv, apr_time_now() - start);
+
+    cache_refresh_done(cache, r, rv < HTTP_BAD_REQUEST);
+}
+
+/*
+ * The transaction is logged when its EOR bucket is destroyed, that is
+ * once the core has written the whole response out: run the refreshes
+ * asked for by cache_serve() then. The worker is still the one serving
+ * the connection, so a following request on a keep-alive connection
+ * waits for the refresh, but the response it was asked for does not.
+ */
+static int cache_log_transaction(request_rec *r)
+{
+    cache_request_rec *cache;
+
+    for (; r; r = r->next) {
+        cache = ap_get_module_config(r->request_config, &cache_module);
+        if (cache && cache->refresh) {
+            cache_refresh(r, cache);
+        }
+    }
+    return DECLINED;
+}
+
+/*
+ * Send the cached response, remembering to refresh the entity once it
+ * is out if cache_check_freshness() asked for it.
+ */
+static int cache_serve(request_rec *r, cache_request_rec *cache,
+                       const char *caller)
+{
+    apr_bucket_brigade *out;
+    apr_bucket *e;
+
+    if (cache->refresh) {
+        ap_set_module_config(r->request_config, &cache_module, cache);
+    }
+
+    /* kick off the filter stack */
+    out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    e = apr_bucket_eos_create(out->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(out, e);
+
+    return ap_pass_brigade_fchk(r, out, "%s(%s): ap_pass_brigade returned",
+                                caller, cache->provider_name);
+}
+
 static int cache_quick_handler(request_rec *r, int lookup)
 {
     apr_status_t rv;
     const char *auth;
     cache_provider_list *providers;
     cache_request_rec *cache;
-    apr_bucket_brigade *out;
-    apr_bucket *e;
     ap_filter_t *next;
     ap_filter_rec_t *cache_out_handle;
     cache_server_conf *conf;
@@ -177,6 +309,10 @@ static int cache_quick_handler(request_rec *r, int lookup)
      *   return OK
      */
     rv = cache_select(cache, r);
+    if (rv == DECLINED && !lookup) {
+        /* someone else may be fetching this entity right now */
+        rv = cache_collapse(conf, cache, r);
+    }
     if (rv != OK) {
         if (rv == DECLINED) {
             if (!lookup) {
@@ -328,14 +464,7 @@ static int cache_quick_handler(request_rec *r, int lookup)
         next = next->next;
     }
 
-    /* kick off the filter stack */
-    out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    e = apr_bucket_eos_create(out->bucket_alloc);
-    APR_BRIGADE_INSERT_TAIL(out, e);
-
-    return ap_pass_brigade_fchk(r, out,
-                                "cache_quick_handler(%s): ap_pass_brigade returned",
-                                cache->provider_name);
+    return cache_serve(r, cache, "cache_quick_handler");
 }
 
 /**
@@ -395,8 +524,6 @@ static int cache_handler(request_rec *r)
     apr_status_t rv;
     cache_provider_list *providers;
     cache_request_rec *cache;
-    apr_bucket_brigade *out;
-    apr_bucket *e;
     ap_filter_t *next;
     ap_filter_rec_t *cache_out_handle;
     ap_filter_rec_t *cache_save_handle;
@@ -477,6 +604,10 @@ static int cache_handler(request_rec *r)
      *   return OK
      */
     rv = cache_select(cache, r);
+    if (rv == DECLINED) {
+        /* someone else may be fetching this entity right now */
+        rv = cache_collapse(conf, cache, r);
+    }
     if (rv != OK) {
         if (rv == DECLINED) {
 
@@ -624,12 +755,7 @@ static int cache_handler(request_rec *r)
         next = next->next;
     }
 
-    /* kick off the filter stack */
-    out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    e = apr_bucket_eos_create(out->bucket_alloc);
-    APR_BRIGADE_INSERT_TAIL(out, e);
-    return ap_pass_brigade_fchk(r, out, "cache(%s): ap_pass_brigade returned",
-                                cache->provider_name);
+    return cache_serve(r, cache, "cache");
 }
 
 /*
@@ -2027,6 +2153,10 @@ static void * create_cache_config(apr_pool_t *p, server_rec *s)
     ps->lock_set = 0;
     ps->lockpath = ap_runtime_dir_relative(p, DEFAULT_CACHE_LOCKPATH);
     ps->lockmaxage = apr_time_from_sec(DEFAULT_CACHE_MAXAGE);
+    ps->lockwait = apr_time_from_msec(DEFAULT_CACHE_LOCKWAIT);
+    ps->stale_while_revalidate = DEFAULT_CACHE_STALE_WHILE_REVALIDATE;
+    ps->refresh_window = apr_time_from_sec(DEFAULT_CACHE_REFRESH_WINDOW);
+    ps->refresh_max = DEFAULT_CACHE_REFRESH_MAX;
     ps->x_cache = DEFAULT_X_CACHE;
     ps->x_cache_detail = DEFAULT_X_CACHE_DETAIL;
     return ps;
@@ -2075,6 +2205,22 @@ static void * merge_cache_config(apr_pool_t *p, void *basev, void *overridesv)
         (overrides->lockmaxage_set == 0)
         ? base->lockmaxage
         : overrides->lockmaxage;
+    ps->lockwait =
+        (overrides->lockwait_set == 0)
+        ? base->lockwait
+        : overrides->lockwait;
+    ps->stale_while_revalidate =
+        (overrides->stale_while_revalidate_set == 0)
+        ? base->stale_while_revalidate
+        : overrides->stale_while_revalidate;
+    ps->refresh_window =
+        (overrides->refresh_window_set == 0)
+        ? base->refresh_window
+        : overrides->refresh_window;
+    ps->refresh_max =
+        (overrides->refresh_max_set == 0)
+        ? base->refresh_max
+        : overrides->refresh_max;
     ps->quick =
         (overrides->quick_set == 0)
         ? base->quick
@@ -2426,6 +2572,74 @@ static const char *set_cache_lock_maxage(cmd_parms *parms, void *dummy,
     return NULL;
 }
 
+static const char *set_cache_lock_wait(cmd_parms *parms, void *dummy,
+                                       const char *arg)
+{
+    cache_server_conf *conf;
+    apr_interval_time_t wait;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    if (ap_timeout_parameter_parse(arg, &wait, "ms") != APR_SUCCESS
+            || wait < 0) {
+        return "CacheLockWait must be a positive time, in milliseconds by "
+               "default";
+    }
+    conf->lockwait = wait;
+    conf->lockwait_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_stale_while_revalidate(cmd_parms *parms,
+                                                    void *dummy, int flag)
+{
+    cache_server_conf *conf;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    conf->stale_while_revalidate = flag;
+    conf->stale_while_revalidate_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_refresh_window(cmd_parms *parms, void *dummy,
+                                            const char *arg)
+{
+    cache_server_conf *conf;
+    apr_int64_t seconds;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    seconds = apr_atoi64(arg);
+    if (seconds < 0) {
+        return "CacheRefreshWindow value must be a positive integer";
+    }
+    conf->refresh_window = apr_time_from_sec(seconds);
+    conf->refresh_window_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_refresh_max(cmd_parms *parms, void *dummy,
+                                         const char *arg)
+{
+    cache_server_conf *conf;
+    int max;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    max = atoi(arg);
+    if (max < 0) {
+        return "CacheRefreshMax value must be a positive integer";
+    }
+    conf->refresh_max = max;
+    conf->refresh_max_set = 1;
+    return NULL;
+}
+
 static const char *set_cache_x_cache(cmd_parms *parms, void *dummy, int flag)
 {
 
@@ -2514,6 +2728,23 @@ static int cache_post_config(apr_pool_t *p, apr_pool_t *plog,
     if (!cache_generate_key) {
         cache_generate_key = cache_generate_key_default;
     }
+
+    /* requests waiting on a cache lock are woken through shared memory */
+    for (; s; s = s->next) {
+        cache_server_conf *conf =
+            (cache_server_conf *)ap_get_module_config(s->module_config,
+                                                      &cache_module);
+        if (conf->lock && conf->lockwait > 0) {
+            apr_status_t rv = cache_lock_wait_init(p);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(03409)
+                        "cache: could not create the shared memory for "
+                        "CacheLockWait, waiting requests will poll the "
+                        "lock files instead");
+            }
+            break;
+        }
+    }
     return OK;
 }
 
@@ -2581,6 +2812,22 @@ static const command_rec cache_cmds[] =
                   "DefaultRuntimeDir setting."),
     AP_INIT_TAKE1("CacheLockMaxAge", set_cache_lock_maxage, NULL, RSRC_CONF,
                   "Maximum age of any thundering herd lock."),
+    AP_INIT_TAKE1("CacheLockWait", set_cache_lock_wait, NULL, RSRC_CONF,
+                  "How long a cache miss waits for the request holding the "
+                  "thundering herd lock to cache the entity, in milliseconds "
+                  "by default. Default is 0, not to wait."),
+    AP_INIT_FLAG("CacheStaleWhileRevalidate", set_cache_stale_while_revalidate,
+                 NULL, RSRC_CONF,
+                 "Serve stale content within the stale-while-revalidate of "
+                 "the response and refresh it in the background. Default "
+                 "is on."),
+    AP_INIT_TAKE1("CacheRefreshWindow", set_cache_refresh_window, NULL,
+                  RSRC_CONF,
+                  "Refresh entities this many seconds before they expire, in "
+                  "the background. Default is 0, not to."),
+    AP_INIT_TAKE1("CacheRefreshMax", set_cache_refresh_max, NULL, RSRC_CONF,
+                  "Maximum number of background refreshes running at once "
+                  "in a child process. Default is 4."),
     AP_INIT_FLAG("CacheHeader", set_cache_x_cache, NULL, RSRC_CONF | ACCESS_CONF,
                  "Add a X-Cache header to responses. Default is off."),
     AP_INIT_FLAG("CacheDetailHeader", set_cache_x_cache_detail, NULL,
@@ -2594,6 +2841,40 @@ static const command_rec cache_cmds[] =
     {NULL}
 };
 
+static int cache_status_hook(request_rec *r, int flags)
+{
+    apr_uint32_t active, started, done, failed, busy, stale;
+
+    active = apr_atomic_read32(&cache_refresh_counters.active);
+    started = apr_atomic_read32(&cache_refresh_counters.started);
+    done = apr_atomic_read32(&cache_refresh_counters.done);
+    failed = apr_atomic_read32(&cache_refresh_counters.failed);
+    busy = apr_atomic_read32(&cache_refresh_counters.busy);
+    stale = apr_atomic_read32(&cache_refresh_counters.stale);
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr />\n<h1>mod_cache Background Refresh (this child)</h1>\n\n"
+                 "<table border=\"0\"><tr>"
+                 "<th>Active</th><th>Started</th><th>Done</th>"
+                 "<th>Failed</th><th>Busy</th><th>Stale Served</th>"
+                 "</tr>\n", r);
+        ap_rprintf(r, "<tr><td>%u</td><td>%u</td><td>%u</td><td>%u</td>"
+                   "<td>%u</td><td>%u</td></tr>\n</table>\n",
+                   active, started, done, failed, busy, stale);
+    }
+    else {
+        ap_rprintf(r, "CacheRefreshActive: %u\n"
+                   "CacheRefreshStarted: %u\n"
+                   "CacheRefreshDone: %u\n"
+                   "CacheRefreshFailed: %u\n"
+                   "CacheRefreshBusy: %u\n"
+                   "CacheRefreshStaleServed: %u\n",
+                   active, started, done, failed, busy, stale);
+    }
+
+    return OK;
+}
+
 static void register_hooks(apr_pool_t *p)
 {
     /* cache initializer */
@@ -2684,7 +2965,21 @@ static void register_hooks(apr_pool_t *p)
                                   cache_invalidate_filter,
                                   NULL,
                                   AP_FTYPE_PROTOCOL);
+    /*
+     * CACHE_REFRESH is never added to a filter chain: it is handed to the
+     * background refresh subrequests as the filter after their own.
+     */
+    cache_refresh_filter_handle =
+        ap_register_output_filter("CACHE_REFRESH",
+                                  cache_refresh_filter,
+                                  NULL,
+                                  AP_FTYPE_CONTENT_SET);
     ap_hook_post_config(cache_post_config, NULL, NULL, APR_HOOK_REALLY_FIRST);
+    /* after the access logs, so that they do not include the refreshes */
+    ap_hook_log_transaction(cache_log_transaction, NULL, NULL,
+                            APR_HOOK_REALLY_LAST);
+    APR_OPTIONAL_HOOK(ap, status_hook, cache_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
 }
 
 AP_DECLARE_MODULE(cache) =
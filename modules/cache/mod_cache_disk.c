@@ -16,12 +16,18 @@
 
 #include "apr_lib.h"
 #include "apr_file_io.h"
+#include "apr_hash.h"
 #include "apr_strings.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
 #include "mod_cache.h"
 #include "mod_cache_disk.h"
+#include "mod_status.h"
 #include "http_config.h"
 #include "http_log.h"
 #include "http_core.h"
+#include "ap_mpm.h"
 #include "ap_provider.h"
 #include "util_filter.h"
 #include "util_script.h"
@@ -44,19 +50,26 @@
  * Format #1:
  *   apr_uint32_t format;
  *   apr_time_t expire;
- *   apr_array_t vary_headers (delimited by CRLF)
+ *   vary_headers (a disk_cache_strings_t block)
  *
  * Format #2:
  *   disk_cache_info_t (first sizeof(apr_uint32_t) bytes is the format)
  *   entity name (dobj->name) [length is in disk_cache_info_t->name_len]
- *   r->headers_out (delimited by CRLF)
- *   CRLF
- *   r->headers_in (delimited by CRLF)
- *   CRLF
+ *   r->headers_out (a disk_cache_strings_t block of keys and values)
+ *   r->headers_in (a disk_cache_strings_t block of keys and values)
+ *
+ * Files written in the earlier text formats (VARY_FORMAT_VERSION_TEXT and
+ * DISK_FORMAT_VERSION_TEXT) hold the vary headers and the headers as
+ * lines delimited by CRLF, each list ending with an empty line.  They are
+ * still read, and replaced in the current format when the entity is
+ * stored again.
  */
 
 module AP_MODULE_DECLARE_DATA cache_disk_module;
 
+/* The largest block of strings read or written */
+#define MAX_STRINGS_LEN (1024 * 1024)
+
 /* Forward declarations */
 static int remove_entity(cache_handle_t *h);
 static apr_status_t store_headers(cache_handle_t *h, request_rec *r, cache_info *i);
@@ -66,6 +79,8 @@ static apr_status_t recall_headers(cache_handle_t *h, request_rec *r);
 static apr_status_t recall_body(cache_handle_t *h, apr_pool_t *p, apr_bucket_brigade *bb);
 static apr_status_t read_array(request_rec *r, apr_array_header_t* arr,
                                apr_file_t *file);
+static apr_status_t read_vary(request_rec *r, apr_array_header_t* arr,
+                              apr_file_t *file);
 
 /*
  * Local static functions
@@ -211,6 +226,18 @@ static apr_status_t file_cache_create(disk_cache_conf *conf, disk_cache_file_t *
     return APR_SUCCESS;
 }
 
+static void cache_info_recall(cache_info *info,
+                              const disk_cache_info_t *disk_info)
+{
+    info->status = disk_info->status;
+    info->date = disk_info->date;
+    info->expire = disk_info->expire;
+    info->request_time = disk_info->request_time;
+    info->response_time = disk_info->response_time;
+
+    memcpy(&info->control, &disk_info->control, sizeof(cache_control_t));
+}
+
 /* These two functions get and put state information into the data
  * file for an ap_cache_el, this state information will be read
  * and written transparent to clients of this module
@@ -228,15 +255,12 @@ static int file_cache_recall_mydata(apr_file_t *fd, cache_info *info,
     if (rv != APR_SUCCESS) {
         return rv;
     }
+    if (!DISK_FORMAT_KNOWN(dobj->disk_info.format)) {
+        return APR_EGENERAL;
+    }
 
     /* Store it away so we can get it later. */
-    info->status = dobj->disk_info.status;
-    info->date = dobj->disk_info.date;
-    info->expire = dobj->disk_info.expire;
-    info->request_time = dobj->disk_info.request_time;
-    info->response_time = dobj->disk_info.response_time;
-
-    memcpy(&info->control, &dobj->disk_info.control, sizeof(cache_control_t));
+    cache_info_recall(info, &dobj->disk_info);
 
     /* Note that we could optimize this by conditionally doing the palloc
      * depending upon the size. */
@@ -332,6 +356,646 @@ static void tokens_to_array(apr_pool_t *p, const char *data,
          sizeof(char *), array_alphasort);
 }
 
+static apr_int32_t data_file_flags(request_rec *r)
+{
+    apr_int32_t flags = APR_READ | APR_BINARY;
+#ifdef APR_SENDFILE_ENABLED
+    core_dir_config *coreconf = ap_get_core_module_config(r->per_dir_config);
+
+    /* When we are in the quick handler we don't have the per-directory
+     * configuration, so this check only takes the global setting of
+     * the EnableSendFile directive into account.
+     */
+    flags |= AP_SENDFILE_ENABLED(coreconf->enable_sendfile);
+#endif
+    return flags;
+}
+
+/*
+ * The hot tier
+ *
+ * Each child keeps the entries it serves most often in memory: their
+ * disk_cache_info_t, name and parsed response and request headers, plus
+ * either the body, when it is no larger than CacheDiskHotMaxObjectSize,
+ * or an open descriptor on the .data file.  A hit on the hot tier reads
+ * neither the .header file nor, for small bodies, the .data file.
+ *
+ * Entries are kept in LRU order, in a hash keyed by the path of their
+ * .header file.  The vary file of an entity with Vary headers gets an
+ * entry of its own, holding the list of headers.
+ *
+ * Admission is TinyLFU like: the number of times each key was recently
+ * read from disk is estimated by a small table of counters, two per key,
+ * all halved every HOT_SKETCH_SAMPLE reads.  A key is admitted the second
+ * time it is read, and when the tier is full only if it was read more
+ * often than each of the least recently used entries it would evict.
+ *
+ * Other children and htcacheclean may replace or remove the files of an
+ * entry, so the .header file is checked again with a stat() every
+ * CacheDiskHotRecheck; entries are dropped when it changed.
+ */
+
+#define HOT_SKETCH_SIZE   4096          /* counters, a power of two */
+#define HOT_SKETCH_SAMPLE (10 * HOT_SKETCH_SIZE)
+#define HOT_SKETCH_MAX    15
+#define HOT_ADMIT         2             /* reads before admission */
+
+typedef struct disk_cache_hot_entry hot_entry;
+
+struct disk_cache_hot_entry {
+    hot_entry *prev;             /* LRU list, most recently used first */
+    hot_entry *next;
+    apr_pool_t *pool;
+    const char *path;            /* of the .header or vary file */
+    apr_uint32_t hash;
+    apr_size_t size;             /* memory accounted to the entry */
+    int refs;                    /* requests using the entry */
+    int linked;                  /* still in the tier */
+    apr_time_t checked;          /* when the file was last checked */
+    apr_time_t mtime;            /* identity of the file */
+    apr_ino_t inode;
+    apr_dev_t device;
+    apr_array_header_t *varray;  /* vary file: the Vary headers */
+    const char *name;            /* .header file: the entity */
+    disk_cache_info_t disk_info;
+    apr_table_t *resp_hdrs;
+    apr_table_t *req_hdrs;
+    apr_off_t file_size;         /* of the .data file */
+    const char *body;            /* the body, or NULL if left on disk */
+    apr_file_t *fd;              /* the .data file kept open, or NULL */
+    apr_int32_t fd_flags;
+    int fd_busy;                 /* a request reads through the fd */
+};
+
+typedef struct {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_hash_t *entries;
+    hot_entry *head;
+    hot_entry *tail;
+    apr_size_t size;
+    apr_size_t max_size;
+    apr_size_t max_object;
+    int files;
+    int max_files;
+    apr_interval_time_t recheck;
+    apr_uint32_t samples;
+    unsigned char sketch[HOT_SKETCH_SIZE];
+    apr_uint64_t hits;
+    apr_uint64_t misses;
+    apr_uint64_t promotions;
+    apr_uint64_t rejections;
+    apr_uint64_t evictions;
+    apr_uint64_t invalidations;
+} hot_tier;
+
+/* The hot tier of this child, NULL when disabled */
+static hot_tier *hot = NULL;
+
+static void hot_lock(void)
+{
+#if APR_HAS_THREADS
+    if (hot->mutex) {
+        apr_thread_mutex_lock(hot->mutex);
+    }
+#endif
+}
+
+static void hot_unlock(void)
+{
+#if APR_HAS_THREADS
+    if (hot->mutex) {
+        apr_thread_mutex_unlock(hot->mutex);
+    }
+#endif
+}
+
+static apr_uint32_t hot_hash(const char *path)
+{
+    apr_ssize_t len = APR_HASH_KEY_STRING;
+
+    return apr_hashfunc_default(path, &len);
+}
+
+/* Count a read of the key, returning its estimated frequency. Locked. */
+static unsigned int hot_sketch_add(apr_uint32_t hash)
+{
+    unsigned char *a = &hot->sketch[hash & (HOT_SKETCH_SIZE - 1)];
+    unsigned char *b = &hot->sketch[(hash >> 16) & (HOT_SKETCH_SIZE - 1)];
+
+    if (*a < HOT_SKETCH_MAX) {
+        (*a)++;
+    }
+    if (*b < HOT_SKETCH_MAX) {
+        (*b)++;
+    }
+    if (++hot->samples >= HOT_SKETCH_SAMPLE) {
+        int i;
+
+        for (i = 0; i < HOT_SKETCH_SIZE; i++) {
+            hot->sketch[i] >>= 1;
+        }
+        hot->samples = 0;
+    }
+
+    return *a < *b ? *a : *b;
+}
+
+static unsigned int hot_sketch_get(apr_uint32_t hash)
+{
+    unsigned char a = hot->sketch[hash & (HOT_SKETCH_SIZE - 1)];
+    unsigned char b = hot->sketch[(hash >> 16) & (HOT_SKETCH_SIZE - 1)];
+
+    return a < b ? a : b;
+}
+
+/* Locked. */
+static void hot_link(hot_entry *e)
+{
+    e->prev = NULL;
+    e->next = hot->head;
+    if (hot->head) {
+        hot->head->prev = e;
+    }
+    else {
+        hot->tail = e;
+    }
+    hot->head = e;
+    apr_hash_set(hot->entries, e->path, APR_HASH_KEY_STRING, e);
+    hot->size += e->size;
+    e->linked = 1;
+}
+
+/* Take the entry out of the tier, freeing it unless a request still uses
+ * it. Locked.
+ */
+static void hot_unlink(hot_entry *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        hot->head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        hot->tail = e->prev;
+    }
+    apr_hash_set(hot->entries, e->path, APR_HASH_KEY_STRING, NULL);
+    hot->size -= e->size;
+    if (e->fd) {
+        hot->files--;
+    }
+    e->linked = 0;
+    if (!e->refs) {
+        apr_pool_destroy(e->pool);
+    }
+}
+
+/* Make room for size bytes by evicting least recently used entries, as
+ * long as they were read less often than freq. Returns 0 if the new entry
+ * is not worth the ones it would evict. Locked.
+ */
+static int hot_make_room(apr_size_t size, unsigned int freq)
+{
+    apr_size_t room = hot->max_size - hot->size;
+    hot_entry *victim = hot->tail;
+
+    while (room < size) {
+        if (!victim || hot_sketch_get(victim->hash) >= freq) {
+            return 0;
+        }
+        room += victim->size;
+        victim = victim->prev;
+    }
+    while (hot->size + size > hot->max_size) {
+        hot_unlink(hot->tail);
+        hot->evictions++;
+    }
+
+    return 1;
+}
+
+static void hot_remove(const char *path)
+{
+    hot_entry *e;
+
+    if (!hot || !path) {
+        return;
+    }
+
+    hot_lock();
+    e = apr_hash_get(hot->entries, path, APR_HASH_KEY_STRING);
+    if (e) {
+        hot_unlink(e);
+        hot->invalidations++;
+    }
+    hot_unlock();
+}
+
+static apr_status_t hot_release(void *data)
+{
+    hot_entry *e = data;
+
+    hot_lock();
+    if (!--e->refs && !e->linked) {
+        apr_pool_destroy(e->pool);
+    }
+    hot_unlock();
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t hot_release_fd(void *data)
+{
+    hot_entry *e = data;
+
+    hot_lock();
+    e->fd_busy = 0;
+    hot_unlock();
+
+    return APR_SUCCESS;
+}
+
+/* Find the entry of the file at path, held until the end of the request,
+ * or NULL.
+ */
+static hot_entry *hot_lookup(request_rec *r, const char *path)
+{
+    hot_entry *e;
+    apr_finfo_t finfo;
+    apr_status_t rv;
+    int check = 0;
+
+    hot_lock();
+    e = apr_hash_get(hot->entries, path, APR_HASH_KEY_STRING);
+    if (e) {
+        if (e != hot->head) {
+            e->prev->next = e->next;
+            if (e->next) {
+                e->next->prev = e->prev;
+            }
+            else {
+                hot->tail = e->prev;
+            }
+            e->prev = NULL;
+            e->next = hot->head;
+            hot->head->prev = e;
+            hot->head = e;
+        }
+        e->refs++;
+        if (r->request_time - e->checked >= hot->recheck) {
+            e->checked = r->request_time;
+            check = 1;
+        }
+    }
+    hot_unlock();
+
+    if (!e) {
+        return NULL;
+    }
+    apr_pool_cleanup_register(r->pool, e, hot_release, apr_pool_cleanup_null);
+
+    if (check) {
+        rv = apr_stat(&finfo, path, APR_FINFO_MTIME | APR_FINFO_IDENT, r->pool);
+        if ((rv != APR_SUCCESS && rv != APR_INCOMPLETE)
+                || finfo.mtime != e->mtime || finfo.inode != e->inode
+                || finfo.device != e->device) {
+            hot_lock();
+            if (e->linked) {
+                hot_unlink(e);
+                hot->invalidations++;
+            }
+            hot_unlock();
+            return NULL;
+        }
+    }
+
+    return e;
+}
+
+static apr_size_t hot_table_size(apr_table_t *t)
+{
+    const apr_array_header_t *arr = apr_table_elts(t);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)arr->elts;
+    apr_size_t size = 0;
+    int i;
+
+    for (i = 0; i < arr->nelts; ++i) {
+        size += sizeof(apr_table_entry_t) + strlen(elts[i].key)
+              + strlen(elts[i].val) + 2;
+    }
+
+    return size;
+}
+
+static int hot_table_add(void *rec, const char *key, const char *value)
+{
+    apr_table_add((apr_table_t *)rec, key, value);
+    return 1;
+}
+
+static apr_table_t *hot_table_copy(apr_pool_t *p, apr_table_t *t)
+{
+    apr_table_t *copy = apr_table_make(p, apr_table_elts(t)->nelts);
+
+    apr_table_do(hot_table_add, copy, t, NULL);
+    return copy;
+}
+
+/* Serve the entity from the hot tier if it is there. On DECLINED, dobj is
+ * left for open_entity() to go to the disk.
+ */
+static int hot_open_entity(cache_handle_t *h, request_rec *r,
+                           disk_cache_conf *conf, cache_object_t *obj,
+                           disk_cache_object_t *dobj, const char *key)
+{
+    const char *hashfile = dobj->hashfile;
+    const char *nkey = key;
+    apr_int32_t flags;
+    apr_pool_t *pool;
+    hot_entry *e;
+
+    e = hot_lookup(r, dobj->vary.file);
+    if (e && e->varray) {
+        nkey = regen_key(r->pool, r->headers_in, e->varray, key);
+
+        dobj->hashfile = NULL;
+        dobj->prefix = dobj->vary.file;
+        dobj->hdrs.file = header_file(r->pool, conf, dobj, nkey);
+
+        e = hot_lookup(r, dobj->hdrs.file);
+    }
+    else {
+        dobj->hdrs.file = dobj->vary.file;
+    }
+
+    if (!e || e->varray || strcmp(e->name, key)
+            || (e->disk_info.header_only && !r->header_only)) {
+        goto miss;
+    }
+
+    dobj->data.file = data_file(r->pool, conf, dobj, nkey);
+
+    if (e->disk_info.has_body && !e->body) {
+        int checkout = 0;
+
+        flags = data_file_flags(r);
+
+        /* The kept descriptor is handed to one request at a time, since
+         * its duplicates share the file offset.
+         */
+        hot_lock();
+        if (e->fd && !e->fd_busy && e->fd_flags == flags) {
+            e->fd_busy = 1;
+            checkout = 1;
+        }
+        hot_unlock();
+
+        if (checkout) {
+            apr_pool_cleanup_register(r->pool, e, hot_release_fd,
+                                      apr_pool_cleanup_null);
+            if (apr_file_dup(&dobj->data.fd, e->fd, r->pool) != APR_SUCCESS) {
+                dobj->data.fd = NULL;
+            }
+        }
+        if (!dobj->data.fd) {
+            apr_finfo_t finfo;
+
+            if (apr_file_open(&dobj->data.fd, dobj->data.file, flags, 0,
+                              r->pool) != APR_SUCCESS) {
+                dobj->data.fd = NULL;
+                hot_remove(e->path);
+                goto miss;
+            }
+            if (apr_file_info_get(&finfo, APR_FINFO_IDENT, dobj->data.fd)
+                    != APR_SUCCESS || finfo.inode != e->disk_info.inode
+                    || finfo.device != e->disk_info.device) {
+                apr_file_close(dobj->data.fd);
+                dobj->data.fd = NULL;
+                hot_remove(e->path);
+                goto miss;
+            }
+        }
+    }
+
+    obj->key = nkey;
+    dobj->key = nkey;
+    dobj->name = key;
+    dobj->file_size = e->file_size;
+    memcpy(&dobj->disk_info, &e->disk_info, sizeof(disk_cache_info_t));
+    cache_info_recall(&obj->info, &dobj->disk_info);
+
+    apr_pool_create(&pool, r->pool);
+    apr_pool_tag(pool, "mod_cache (open_entity)");
+
+    file_cache_create(conf, &dobj->hdrs, pool);
+    file_cache_create(conf, &dobj->vary, pool);
+    file_cache_create(conf, &dobj->data, pool);
+
+    dobj->hot = e;
+    h->cache_obj = obj;
+    obj->vobj = dobj;
+
+    hot_lock();
+    hot->hits++;
+    hot_unlock();
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03402)
+            "Recalled cached URL info header %s from the hot tier",
+            dobj->name);
+
+    return OK;
+
+miss:
+    dobj->hashfile = hashfile;
+    dobj->prefix = NULL;
+    dobj->hdrs.file = NULL;
+    dobj->data.file = NULL;
+
+    hot_lock();
+    hot->misses++;
+    hot_unlock();
+
+    return DECLINED;
+}
+
+static hot_entry *hot_entry_create(request_rec *r, const char *path,
+                                   apr_uint32_t hash, apr_finfo_t *finfo,
+                                   apr_size_t size)
+{
+    apr_pool_t *pool;
+    hot_entry *e;
+
+    apr_pool_create(&pool, hot->pool);
+    apr_pool_tag(pool, "mod_cache_disk (hot entry)");
+
+    e = apr_pcalloc(pool, sizeof(hot_entry));
+    e->pool = pool;
+    e->path = apr_pstrdup(pool, path);
+    e->hash = hash;
+    e->size = sizeof(hot_entry) + strlen(path) + size;
+    e->checked = r->request_time;
+    e->mtime = finfo->mtime;
+    e->inode = finfo->inode;
+    e->device = finfo->device;
+
+    return e;
+}
+
+/* Count a read of the entity from disk, and admit it to the hot tier if it
+ * is read often enough. Called with the headers just recalled, and the
+ * .header file it was read from still open.
+ */
+static void hot_promote(cache_handle_t *h, request_rec *r,
+                        disk_cache_object_t *dobj)
+{
+    hot_entry *e, *v = NULL;
+    apr_finfo_t finfo;
+    apr_size_t size;
+    apr_uint32_t hash;
+    unsigned int freq;
+    int keep_body, keep_file = 0, admitted = 0;
+
+    hash = hot_hash(dobj->hdrs.file);
+
+    hot_lock();
+    freq = hot_sketch_add(hash);
+    if (freq < HOT_ADMIT
+            || apr_hash_get(hot->entries, dobj->hdrs.file,
+                            APR_HASH_KEY_STRING)) {
+        freq = 0;
+    }
+    hot_unlock();
+
+    if (!freq || apr_file_info_get(&finfo, APR_FINFO_MTIME | APR_FINFO_IDENT,
+                                   dobj->hdrs.fd) != APR_SUCCESS) {
+        return;
+    }
+
+    size = strlen(dobj->name) + hot_table_size(h->resp_hdrs)
+         + hot_table_size(h->req_hdrs);
+    keep_body = dobj->disk_info.has_body && dobj->data.fd
+                && dobj->file_size <= (apr_off_t)hot->max_object;
+    if (keep_body) {
+        size += (apr_size_t)dobj->file_size;
+    }
+    if (size + sizeof(hot_entry) + strlen(dobj->hdrs.file) > hot->max_size) {
+        return;
+    }
+
+    e = hot_entry_create(r, dobj->hdrs.file, hash, &finfo, size);
+    e->name = apr_pstrdup(e->pool, dobj->name);
+    memcpy(&e->disk_info, &dobj->disk_info, sizeof(disk_cache_info_t));
+    e->resp_hdrs = hot_table_copy(e->pool, h->resp_hdrs);
+    e->req_hdrs = hot_table_copy(e->pool, h->req_hdrs);
+    e->file_size = dobj->file_size;
+
+    if (keep_body) {
+        char *buf = apr_palloc(e->pool, (apr_size_t)e->file_size + 1);
+        apr_size_t len = (apr_size_t)e->file_size;
+        apr_off_t offset = 0;
+        apr_status_t rv = APR_SUCCESS;
+
+        if (len) {
+            rv = apr_file_read_full(dobj->data.fd, buf, len, &len);
+            apr_file_seek(dobj->data.fd, APR_SET, &offset);
+        }
+        if (rv != APR_SUCCESS) {
+            apr_pool_destroy(e->pool);
+            return;
+        }
+        e->body = buf;
+    }
+    else if (dobj->disk_info.has_body && dobj->data.fd) {
+        hot_lock();
+        if (hot->files < hot->max_files) {
+            hot->files++;
+            keep_file = 1;
+        }
+        hot_unlock();
+
+        /* a descriptor of our own: a duplicate would share the offset of
+         * the one this request reads through
+         */
+        if (keep_file) {
+            apr_finfo_t dinfo;
+
+            e->fd_flags = data_file_flags(r);
+            if (apr_file_open(&e->fd, dobj->data.file, e->fd_flags, 0,
+                              e->pool) != APR_SUCCESS) {
+                e->fd = NULL;
+            }
+            else if (apr_file_info_get(&dinfo, APR_FINFO_IDENT, e->fd)
+                         != APR_SUCCESS
+                     || dinfo.inode != dobj->disk_info.inode
+                     || dinfo.device != dobj->disk_info.device) {
+                apr_file_close(e->fd);
+                e->fd = NULL;
+            }
+        }
+    }
+
+    if (dobj->prefix && dobj->varray
+            && apr_stat(&finfo, dobj->prefix, APR_FINFO_MTIME | APR_FINFO_IDENT,
+                        r->pool) == APR_SUCCESS) {
+        const char **elts = (const char **)dobj->varray->elts;
+        int i;
+
+        for (i = 0, size = 0; i < dobj->varray->nelts; i++) {
+            size += sizeof(char *) + strlen(elts[i]) + 1;
+        }
+        v = hot_entry_create(r, dobj->prefix, hot_hash(dobj->prefix), &finfo,
+                             size);
+        v->varray = apr_array_make(v->pool, dobj->varray->nelts,
+                                   sizeof(char *));
+        for (i = 0; i < dobj->varray->nelts; i++) {
+            *(const char **)apr_array_push(v->varray) =
+                apr_pstrdup(v->pool, elts[i]);
+        }
+    }
+
+    hot_lock();
+    if (keep_file && !e->fd) {
+        hot->files--;
+    }
+    if (!apr_hash_get(hot->entries, e->path, APR_HASH_KEY_STRING)) {
+        if (hot_make_room(e->size, freq)) {
+            hot_link(e);
+            hot->promotions++;
+            admitted = 1;
+        }
+        else {
+            hot->rejections++;
+        }
+    }
+    if (!admitted && e->fd) {
+        hot->files--;
+    }
+    if (v && admitted
+            && !apr_hash_get(hot->entries, v->path, APR_HASH_KEY_STRING)
+            && hot_make_room(v->size, freq)) {
+        hot_link(v);
+        v = NULL;
+    }
+    hot_unlock();
+
+    if (!admitted) {
+        apr_pool_destroy(e->pool);
+    }
+    else {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03403)
+                "Promoted URL %s to the hot tier", dobj->name);
+    }
+    if (v) {
+        apr_pool_destroy(v->pool);
+    }
+}
+
 /*
  * Hook and mod_cache callback functions
  */
@@ -410,9 +1074,6 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     static int error_logged = 0;
     disk_cache_conf *conf = ap_get_module_config(r->server->module_config,
                                                  &cache_disk_module);
-#ifdef APR_SENDFILE_ENABLED
-    core_dir_config *coreconf = ap_get_core_module_config(r->per_dir_config);
-#endif
     apr_finfo_t finfo;
     cache_object_t *obj;
     cache_info *info;
@@ -446,6 +1107,11 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     dobj->root_len = conf->cache_root_len;
 
     dobj->vary.file = header_file(r->pool, conf, dobj, key);
+
+    if (hot && hot_open_entity(h, r, conf, obj, dobj, key) == OK) {
+        return OK;
+    }
+
     flags = APR_READ|APR_BINARY|APR_BUFFERED;
     rc = apr_file_open(&dobj->vary.fd, dobj->vary.file, flags, 0, r->pool);
     if (rc != APR_SUCCESS) {
@@ -456,7 +1122,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     len = sizeof(format);
     apr_file_read_full(dobj->vary.fd, &format, len, &len);
 
-    if (format == VARY_FORMAT_VERSION) {
+    if (VARY_FORMAT_KNOWN(format)) {
         apr_array_header_t* varray;
         apr_time_t expire;
 
@@ -464,7 +1130,12 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
         apr_file_read_full(dobj->vary.fd, &expire, len, &len);
 
         varray = apr_array_make(r->pool, 5, sizeof(char*));
-        rc = read_array(r, varray, dobj->vary.fd);
+        if (format == VARY_FORMAT_VERSION) {
+            rc = read_vary(r, varray, dobj->vary.fd);
+        }
+        else {
+            rc = read_array(r, varray, dobj->vary.fd);
+        }
         if (rc != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, rc, r, APLOGNO(00704)
                     "Cannot parse vary header file: %s",
@@ -476,6 +1147,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
 
         nkey = regen_key(r->pool, r->headers_in, varray, key);
 
+        dobj->varray = varray;
         dobj->hashfile = NULL;
         dobj->prefix = dobj->vary.file;
         dobj->hdrs.file = header_file(r->pool, conf, dobj, nkey);
@@ -486,7 +1158,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
             return DECLINED;
         }
     }
-    else if (format != DISK_FORMAT_VERSION) {
+    else if (!DISK_FORMAT_KNOWN(format)) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00705)
                 "File '%s' has a version mismatch. File had version: %d.",
                 dobj->vary.file, format);
@@ -542,14 +1214,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
 
     /* Open the data file */
     if (dobj->disk_info.has_body) {
-        flags = APR_READ | APR_BINARY;
-#ifdef APR_SENDFILE_ENABLED
-        /* When we are in the quick handler we don't have the per-directory
-         * configuration, so this check only takes the global setting of
-         * the EnableSendFile directive into account.
-         */
-        flags |= AP_SENDFILE_ENABLED(coreconf->enable_sendfile);
-#endif
+        flags = data_file_flags(r);
         rc = apr_file_open(&dobj->data.fd, dobj->data.file, flags, 0, r->pool);
         if (rc != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, rc, r, APLOGNO(00708)
@@ -634,6 +1299,9 @@ static int remove_url(cache_handle_t *h, request_rec *r)
         return DECLINED;
     }
 
+    hot_remove(dobj->hdrs.file);
+    hot_remove(dobj->prefix);
+
     /* Delete headers file */
     if (dobj->hdrs.file) {
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00711)
@@ -745,32 +1413,138 @@ static apr_status_t read_array(request_rec *r, apr_array_header_t* arr,
     return APR_SUCCESS;
 }
 
-static apr_status_t store_array(apr_file_t *fd, apr_array_header_t* arr)
+/*
+ * Reads a block of strings, and points strs at them in a single buffer
+ * from the request pool.  Each length is checked against the size of the
+ * block and the NUL following the string.
+ */
+static apr_status_t read_strings(request_rec *r, apr_file_t *file,
+                                 const char ***strs, apr_uint32_t *count)
 {
-    int i;
+    disk_cache_strings_t block;
+    const apr_uint32_t *lens;
+    const char **s;
+    char *buf, *p, *end;
+    apr_size_t len;
+    apr_uint32_t i;
     apr_status_t rv;
-    struct iovec iov[2];
-    apr_size_t amt;
-    const char **elts;
 
-    elts = (const char **) arr->elts;
+    len = sizeof(block);
+    rv = apr_file_read_full(file, &block, len, &len);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (block.len > MAX_STRINGS_LEN
+            || block.count > block.len / (sizeof(apr_uint32_t) + 1)) {
+        return APR_EGENERAL;
+    }
 
-    for (i = 0; i < arr->nelts; i++) {
-        iov[0].iov_base = (char*) elts[i];
-        iov[0].iov_len = strlen(elts[i]);
-        iov[1].iov_base = CRLF;
-        iov[1].iov_len = sizeof(CRLF) - 1;
+    buf = apr_palloc(r->pool, block.len + 1);
+    len = block.len;
+    rv = apr_file_read_full(file, buf, len, &len);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
 
-        rv = apr_file_writev_full(fd, (const struct iovec *) &iov, 2, &amt);
-        if (rv != APR_SUCCESS) {
-            return rv;
+    lens = (const apr_uint32_t *) buf;
+    p = buf + block.count * sizeof(apr_uint32_t);
+    end = buf + block.len;
+    s = apr_palloc(r->pool, (block.count + 1) * sizeof(char *));
+    for (i = 0; i < block.count; i++) {
+        if (lens[i] >= (apr_size_t)(end - p) || p[lens[i]] != '\0') {
+            return APR_EGENERAL;
         }
+        s[i] = p;
+        p += lens[i] + 1;
     }
 
-    iov[0].iov_base = CRLF;
-    iov[0].iov_len = sizeof(CRLF) - 1;
+    *strs = s;
+    *count = block.count;
+    return APR_SUCCESS;
+}
+
+static apr_status_t read_vary(request_rec *r, apr_array_header_t* arr,
+                              apr_file_t *file)
+{
+    const char **strs;
+    apr_uint32_t count, i;
+    apr_status_t rv;
 
-    return apr_file_writev_full(fd, (const struct iovec *) &iov, 1, &amt);
+    rv = read_strings(r, file, &strs, &count);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(03404)
+                      "Premature end or corruption of vary array.");
+        return rv;
+    }
+
+    for (i = 0; i < count; i++) {
+        *((const char **) apr_array_push(arr)) = strs[i];
+    }
+
+    return APR_SUCCESS;
+}
+
+/*
+ * Writes a block of strings, read back by read_strings(), in one go.
+ */
+static apr_status_t store_strings(apr_pool_t *p, apr_file_t *fd,
+                                  const char **strs, apr_uint32_t count)
+{
+    disk_cache_strings_t *block;
+    apr_uint32_t *lens;
+    apr_size_t len = 0;
+    apr_uint32_t i;
+    char *buf, *s;
+
+    for (i = 0; i < count; i++) {
+        len += strlen(strs[i]) + 1;
+    }
+    len += count * sizeof(apr_uint32_t);
+    if (len > MAX_STRINGS_LEN) {
+        return APR_ENOSPC;
+    }
+
+    buf = apr_palloc(p, sizeof(disk_cache_strings_t) + len);
+    block = (disk_cache_strings_t *) buf;
+    block->count = count;
+    block->len = (apr_uint32_t) len;
+    lens = (apr_uint32_t *) (buf + sizeof(disk_cache_strings_t));
+    s = (char *) (lens + count);
+    for (i = 0; i < count; i++) {
+        lens[i] = (apr_uint32_t) strlen(strs[i]);
+        memcpy(s, strs[i], lens[i] + 1);
+        s += lens[i] + 1;
+    }
+
+    return apr_file_write_full(fd, buf, sizeof(disk_cache_strings_t) + len,
+                               NULL);
+}
+
+/* The keys and values of a table, if any, for store_strings() */
+static const char **table_strings(apr_pool_t *p, apr_table_t *table,
+                                  apr_uint32_t *count)
+{
+    const apr_array_header_t *arr;
+    apr_table_entry_t *elts;
+    const char **strs;
+    int i;
+
+    *count = 0;
+    if (!table) {
+        return NULL;
+    }
+
+    arr = apr_table_elts(table);
+    elts = (apr_table_entry_t *) arr->elts;
+    strs = apr_palloc(p, (arr->nelts * 2 + 1) * sizeof(char *));
+    for (i = 0; i < arr->nelts; ++i) {
+        if (elts[i].key != NULL) {
+            strs[(*count)++] = elts[i].key;
+            strs[(*count)++] = elts[i].val;
+        }
+    }
+
+    return strs;
 }
 
 static apr_status_t read_table(cache_handle_t *handle, request_rec *r,
@@ -855,6 +1629,47 @@ static apr_status_t read_table(cache_handle_t *handle, request_rec *r,
     return APR_SUCCESS;
 }
 
+/*
+ * Reads a block of headers into a table made to fit, the strings staying
+ * in the buffer read_strings() read them into.
+ */
+static apr_status_t read_headers(request_rec *r, apr_table_t **table,
+                                 apr_file_t *file)
+{
+    const char **strs;
+    apr_uint32_t count, i;
+    apr_status_t rv;
+
+    rv = read_strings(r, file, &strs, &count);
+    if (rv == APR_SUCCESS && (count & 1)) {
+        rv = APR_EGENERAL;
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(03405)
+                      "Premature end or corruption of cache headers.");
+        *table = apr_table_make(r->pool, 1);
+        return rv;
+    }
+
+    *table = apr_table_make(r->pool, count / 2);
+    for (i = 0; i < count; i += 2) {
+        apr_table_addn(*table, strs[i], strs[i + 1]);
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t recall_table(cache_handle_t *h, request_rec *r,
+                                 disk_cache_object_t *dobj,
+                                 apr_table_t **table)
+{
+    if (dobj->disk_info.format == DISK_FORMAT_VERSION_TEXT) {
+        *table = apr_table_make(r->pool, 20);
+        return read_table(h, r, *table, dobj->hdrs.fd);
+    }
+    return read_headers(r, table, dobj->hdrs.fd);
+}
+
 /*
  * Reads headers from a buffer and returns an array of headers.
  * Returns NULL on file error
@@ -865,7 +1680,13 @@ static apr_status_t read_table(cache_handle_t *handle, request_rec *r,
 static apr_status_t recall_headers(cache_handle_t *h, request_rec *r)
 {
     disk_cache_object_t *dobj = (disk_cache_object_t *) h->cache_obj->vobj;
-    apr_status_t rv;
+    apr_status_t rv, rv2;
+
+    if (dobj->hot) {
+        h->resp_hdrs = apr_table_copy(r->pool, dobj->hot->resp_hdrs);
+        h->req_hdrs = apr_table_copy(r->pool, dobj->hot->req_hdrs);
+        return APR_SUCCESS;
+    }
 
     /* This case should not happen... */
     if (!dobj->hdrs.fd) {
@@ -874,23 +1695,24 @@ static apr_status_t recall_headers(cache_handle_t *h, request_rec *r)
         return APR_NOTFOUND;
     }
 
-    h->req_hdrs = apr_table_make(r->pool, 20);
-    h->resp_hdrs = apr_table_make(r->pool, 20);
-
     /* Call routine to read the header lines/status line */
-    rv = read_table(h, r, h->resp_hdrs, dobj->hdrs.fd);
+    rv = recall_table(h, r, dobj, &h->resp_hdrs);
     if (rv != APR_SUCCESS) { 
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(02987) 
                       "Error reading response headers from %s for %s",
                       dobj->hdrs.file, dobj->name);
     }
-    rv = read_table(h, r, h->req_hdrs, dobj->hdrs.fd);
-    if (rv != APR_SUCCESS) { 
+    rv2 = recall_table(h, r, dobj, &h->req_hdrs);
+    if (rv2 != APR_SUCCESS) { 
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(02988) 
                       "Error reading request headers from %s for %s",
                       dobj->hdrs.file, dobj->name);
     }
 
+    if (hot && rv == APR_SUCCESS && rv2 == APR_SUCCESS) {
+        hot_promote(h, r, dobj);
+    }
+
     apr_file_close(dobj->hdrs.fd);
 
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00720)
@@ -902,45 +1724,19 @@ static apr_status_t recall_body(cache_handle_t *h, apr_pool_t *p, apr_bucket_bri
 {
     disk_cache_object_t *dobj = (disk_cache_object_t*) h->cache_obj->vobj;
 
-    if (dobj->data.fd) {
+    if (dobj->hot && dobj->hot->body) {
+        /* the entry is held until the end of the request */
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create(
+                dobj->hot->body, (apr_size_t)dobj->file_size,
+                bb->bucket_alloc));
+    }
+    else if (dobj->data.fd) {
         apr_brigade_insert_file(bb, dobj->data.fd, 0, dobj->file_size, p);
     }
 
     return APR_SUCCESS;
 }
 
-static apr_status_t store_table(apr_file_t *fd, apr_table_t *table)
-{
-    int i;
-    apr_status_t rv;
-    struct iovec iov[4];
-    apr_size_t amt;
-    apr_table_entry_t *elts;
-
-    elts = (apr_table_entry_t *) apr_table_elts(table)->elts;
-    for (i = 0; i < apr_table_elts(table)->nelts; ++i) {
-        if (elts[i].key != NULL) {
-            iov[0].iov_base = elts[i].key;
-            iov[0].iov_len = strlen(elts[i].key);
-            iov[1].iov_base = ": ";
-            iov[1].iov_len = sizeof(": ") - 1;
-            iov[2].iov_base = elts[i].val;
-            iov[2].iov_len = strlen(elts[i].val);
-            iov[3].iov_base = CRLF;
-            iov[3].iov_len = sizeof(CRLF) - 1;
-
-            rv = apr_file_writev_full(fd, (const struct iovec *) &iov, 4, &amt);
-            if (rv != APR_SUCCESS) {
-                return rv;
-            }
-        }
-    }
-    iov[0].iov_base = CRLF;
-    iov[0].iov_len = sizeof(CRLF) - 1;
-    rv = apr_file_writev_full(fd, (const struct iovec *) &iov, 1, &amt);
-    return rv;
-}
-
 static apr_status_t store_headers(cache_handle_t *h, request_rec *r, cache_info *info)
 {
     disk_cache_object_t *dobj = (disk_cache_object_t*) h->cache_obj->vobj;
@@ -972,6 +1768,8 @@ static apr_status_t write_headers(cache_handle_t *h, request_rec *r)
 
     disk_cache_info_t disk_info;
     struct iovec iov[2];
+    const char **strs;
+    apr_uint32_t count;
 
     memset(&disk_info, 0, sizeof(disk_cache_info_t));
 
@@ -1032,7 +1830,16 @@ static apr_status_t write_headers(cache_handle_t *h, request_rec *r)
             varray = apr_array_make(r->pool, 6, sizeof(char*));
             tokens_to_array(r->pool, tmp, varray);
 
-            store_array(dobj->vary.tempfd, varray);
+            rv = store_strings(r->pool, dobj->vary.tempfd,
+                               (const char **) varray->elts, varray->nelts);
+            if (rv != APR_SUCCESS) {
+                ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(03406)
+                        "could not write to vary file %s",
+                        dobj->vary.tempfile);
+                apr_file_close(dobj->vary.tempfd);
+                apr_pool_destroy(dobj->vary.pool);
+                return rv;
+            }
 
             rv = apr_file_close(dobj->vary.tempfd);
             if (rv != APR_SUCCESS) {
@@ -1095,30 +1902,28 @@ static apr_status_t write_headers(cache_handle_t *h, request_rec *r)
         return rv;
     }
 
-    if (dobj->headers_out) {
-        rv = store_table(dobj->hdrs.tempfd, dobj->headers_out);
-        if (rv != APR_SUCCESS) {
-            ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00727)
-                    "could not write out-headers to header file %s",
-                    dobj->hdrs.tempfile);
-            apr_file_close(dobj->hdrs.tempfd);
-            apr_pool_destroy(dobj->hdrs.pool);
-            return rv;
-        }
+    strs = table_strings(r->pool, dobj->headers_out, &count);
+    rv = store_strings(r->pool, dobj->hdrs.tempfd, strs, count);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00727)
+                "could not write out-headers to header file %s",
+                dobj->hdrs.tempfile);
+        apr_file_close(dobj->hdrs.tempfd);
+        apr_pool_destroy(dobj->hdrs.pool);
+        return rv;
     }
 
     /* Parse the vary header and dump those fields from the headers_in. */
     /* FIXME: Make call to the same thing cache_select calls to crack Vary. */
-    if (dobj->headers_in) {
-        rv = store_table(dobj->hdrs.tempfd, dobj->headers_in);
-        if (rv != APR_SUCCESS) {
-            ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00728)
-                    "could not write in-headers to header file %s",
-                    dobj->hdrs.tempfile);
-            apr_file_close(dobj->hdrs.tempfd);
-            apr_pool_destroy(dobj->hdrs.pool);
-            return rv;
-        }
+    strs = table_strings(r->pool, dobj->headers_in, &count);
+    rv = store_strings(r->pool, dobj->hdrs.tempfd, strs, count);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00728)
+                "could not write in-headers to header file %s",
+                dobj->hdrs.tempfile);
+        apr_file_close(dobj->hdrs.tempfd);
+        apr_pool_destroy(dobj->hdrs.pool);
+        return rv;
     }
 
     rv = apr_file_close(dobj->hdrs.tempfd); /* flush and close */
@@ -1362,6 +2167,10 @@ static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
                 dobj->name);
     }
 
+    /* the copies in the hot tier of this child are out of date now */
+    hot_remove(dobj->hdrs.file);
+    hot_remove(dobj->prefix);
+
     apr_pool_destroy(dobj->data.pool);
 
     return APR_SUCCESS;
@@ -1423,6 +2232,10 @@ static void *create_config(apr_pool_t *p, server_rec *s)
     conf->cache_root = NULL;
     conf->cache_root_len = 0;
 
+    conf->hot_max_object = DEFAULT_HOT_MAX_OBJECT_SIZE;
+    conf->hot_files = DEFAULT_HOT_FILES;
+    conf->hot_recheck = DEFAULT_HOT_RECHECK;
+
     return conf;
 }
 
@@ -1533,6 +2346,80 @@ static const char
     return NULL;
 }
 
+static const char
+*set_cache_hot_size(cmd_parms *parms, void *in_struct_ptr, const char *arg)
+{
+    disk_cache_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                 &cache_disk_module);
+    const char *err = ap_check_cmd_context(parms, GLOBAL_ONLY);
+    apr_off_t size;
+
+    if (err != NULL) {
+        return err;
+    }
+    if (apr_strtoff(&size, arg, NULL, 10) != APR_SUCCESS || size < 0) {
+        return "CacheDiskHotSize argument must be a non-negative integer representing the memory of the hot tier of each child in bytes.";
+    }
+    conf->hot_size = (apr_size_t)size;
+    return NULL;
+}
+
+static const char
+*set_cache_hot_max_object(cmd_parms *parms, void *in_struct_ptr,
+                          const char *arg)
+{
+    disk_cache_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                 &cache_disk_module);
+    const char *err = ap_check_cmd_context(parms, GLOBAL_ONLY);
+    apr_off_t size;
+
+    if (err != NULL) {
+        return err;
+    }
+    if (apr_strtoff(&size, arg, NULL, 10) != APR_SUCCESS || size < 0) {
+        return "CacheDiskHotMaxObjectSize argument must be a non-negative integer representing the max size of a body held in memory in bytes.";
+    }
+    conf->hot_max_object = (apr_size_t)size;
+    return NULL;
+}
+
+static const char
+*set_cache_hot_files(cmd_parms *parms, void *in_struct_ptr, const char *arg)
+{
+    disk_cache_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                 &cache_disk_module);
+    const char *err = ap_check_cmd_context(parms, GLOBAL_ONLY);
+    int val = atoi(arg);
+
+    if (err != NULL) {
+        return err;
+    }
+    if (val < 0) {
+        return "CacheDiskHotFiles value must be a non-negative integer";
+    }
+    conf->hot_files = val;
+    return NULL;
+}
+
+static const char
+*set_cache_hot_recheck(cmd_parms *parms, void *in_struct_ptr, const char *arg)
+{
+    disk_cache_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                 &cache_disk_module);
+    const char *err = ap_check_cmd_context(parms, GLOBAL_ONLY);
+    apr_interval_time_t recheck;
+
+    if (err != NULL) {
+        return err;
+    }
+    if (ap_timeout_parameter_parse(arg, &recheck, "s") != APR_SUCCESS
+            || recheck < 0) {
+        return "CacheDiskHotRecheck argument must be a non-negative time interval";
+    }
+    conf->hot_recheck = recheck;
+    return NULL;
+}
+
 static const command_rec disk_cache_cmds[] =
 {
     AP_INIT_TAKE1("CacheRoot", set_cache_root, NULL, RSRC_CONF,
@@ -1549,6 +2436,14 @@ static const command_rec disk_cache_cmds[] =
                   "The maximum quantity of data to attempt to read and cache in one go"),
     AP_INIT_TAKE1("CacheReadTime", set_cache_readtime, NULL, RSRC_CONF | ACCESS_CONF,
                   "The maximum time taken to attempt to read and cache in go"),
+    AP_INIT_TAKE1("CacheDiskHotSize", set_cache_hot_size, NULL, RSRC_CONF,
+                  "The memory of the in-memory hot tier of each child, 0 to disable it"),
+    AP_INIT_TAKE1("CacheDiskHotMaxObjectSize", set_cache_hot_max_object, NULL, RSRC_CONF,
+                  "The maximum size of a body held in memory by the hot tier"),
+    AP_INIT_TAKE1("CacheDiskHotFiles", set_cache_hot_files, NULL, RSRC_CONF,
+                  "The number of data files the hot tier of each child keeps open"),
+    AP_INIT_TAKE1("CacheDiskHotRecheck", set_cache_hot_recheck, NULL, RSRC_CONF,
+                  "The time between checks of the disk for entries of the hot tier"),
     {NULL}
 };
 
@@ -1566,11 +2461,123 @@ static const cache_provider cache_disk_provider =
     &invalidate_entity
 };
 
+static void disk_cache_child_init(apr_pool_t *p, server_rec *s)
+{
+    disk_cache_conf *conf = ap_get_module_config(s->module_config,
+                                                 &cache_disk_module);
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    apr_status_t rv;
+    int threaded = 0;
+#endif
+
+    if (!conf->hot_size) {
+        return;
+    }
+
+    /* entries come and go from any thread, give them an allocator of
+     * their own
+     */
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&pool, p, NULL, allocator);
+    apr_allocator_owner_set(allocator, pool);
+    apr_pool_tag(pool, "mod_cache_disk (hot tier)");
+
+    hot = apr_pcalloc(pool, sizeof(hot_tier));
+    hot->pool = pool;
+    hot->entries = apr_hash_make(pool);
+    hot->max_size = conf->hot_size;
+    hot->max_object = conf->hot_max_object;
+    hot->max_files = conf->hot_files;
+    hot->recheck = conf->hot_recheck;
+
+#if APR_HAS_THREADS
+    ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded);
+    if (threaded) {
+        rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+        if (rv == APR_SUCCESS) {
+            apr_allocator_mutex_set(allocator, mutex);
+            rv = apr_thread_mutex_create(&hot->mutex,
+                                         APR_THREAD_MUTEX_DEFAULT, pool);
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03401)
+                         "could not create the hot tier mutex, "
+                         "hot tier disabled");
+            hot = NULL;
+            apr_pool_destroy(pool);
+        }
+    }
+#endif
+}
+
+static int disk_cache_status_hook(request_rec *r, int flags)
+{
+    apr_uint64_t hits, misses, promotions, rejections, evictions;
+    apr_uint64_t invalidations;
+    apr_size_t size;
+    int entries, files;
+
+    if (!hot) {
+        return OK;
+    }
+
+    hot_lock();
+    hits = hot->hits;
+    misses = hot->misses;
+    promotions = hot->promotions;
+    rejections = hot->rejections;
+    evictions = hot->evictions;
+    invalidations = hot->invalidations;
+    size = hot->size;
+    entries = apr_hash_count(hot->entries);
+    files = hot->files;
+    hot_unlock();
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr />\n<h1>mod_cache_disk Hot Tier (this child)</h1>\n\n"
+                 "<table border=\"0\"><tr>"
+                 "<th>Entries</th><th>Bytes</th><th>Files</th>"
+                 "<th>Hits</th><th>Misses</th><th>Promotions</th>"
+                 "<th>Rejections</th><th>Evictions</th>"
+                 "<th>Invalidations</th></tr>\n", r);
+        ap_rprintf(r, "<tr><td>%d</td><td>%" APR_SIZE_T_FMT "</td>"
+                   "<td>%d</td><td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td></tr>\n</table>\n",
+                   entries, size, files, hits, misses, promotions,
+                   rejections, evictions, invalidations);
+    }
+    else {
+        ap_rprintf(r, "CacheDiskHotEntries: %d\n"
+                   "CacheDiskHotBytes: %" APR_SIZE_T_FMT "\n"
+                   "CacheDiskHotFiles: %d\n"
+                   "CacheDiskHotHits: %" APR_UINT64_T_FMT "\n"
+                   "CacheDiskHotMisses: %" APR_UINT64_T_FMT "\n"
+                   "CacheDiskHotPromotions: %" APR_UINT64_T_FMT "\n"
+                   "CacheDiskHotRejections: %" APR_UINT64_T_FMT "\n"
+                   "CacheDiskHotEvictions: %" APR_UINT64_T_FMT "\n"
+                   "CacheDiskHotInvalidations: %" APR_UINT64_T_FMT "\n",
+                   entries, size, files, hits, misses, promotions,
+                   rejections, evictions, invalidations);
+    }
+
+    return OK;
+}
+
 static void disk_cache_register_hook(apr_pool_t *p)
 {
     /* cache initializer */
     ap_register_provider(p, CACHE_PROVIDER_GROUP, "disk", "0",
                          &cache_disk_provider);
+    ap_hook_child_init(disk_cache_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+    APR_OPTIONAL_HOOK(ap, status_hook, disk_cache_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
 }
 
 AP_DECLARE_MODULE(cache_disk) = {
@@ -54,6 +54,8 @@ typedef struct disk_cache_object {
     apr_off_t offset;            /* Max size to set aside */
     apr_time_t timeout;          /* Max time to set aside */
     unsigned int done:1;         /* Is the attempt to cache complete? */
+    apr_array_header_t *varray;  /* Vary headers, if opened through a vary file */
+    struct disk_cache_hot_entry *hot; /* Hot tier entry we were recalled from */
 } disk_cache_object_t;
 
 
@@ -68,12 +70,19 @@ typedef struct disk_cache_object {
 #define DEFAULT_MAX_FILE_SIZE 1000000
 #define DEFAULT_READSIZE 0
 #define DEFAULT_READTIME 0
+#define DEFAULT_HOT_MAX_OBJECT_SIZE 65536
+#define DEFAULT_HOT_FILES 64
+#define DEFAULT_HOT_RECHECK apr_time_from_sec(5)
 
 typedef struct {
     const char* cache_root;
     apr_size_t cache_root_len;
     int dirlevels;               /* Number of levels of subdirectories */
     int dirlength;               /* Length of subdirectory names */
+    apr_size_t hot_size;         /* memory for the hot tier, 0 disables it */
+    apr_size_t hot_max_object;   /* largest body held by the hot tier */
+    int hot_files;               /* .data files the hot tier keeps open */
+    apr_interval_time_t hot_recheck; /* time between checks of the disk */
 } disk_cache_conf;
 
 typedef struct {
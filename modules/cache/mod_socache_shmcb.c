@@ -25,6 +25,8 @@
 #include "apr_strings.h"
 #include "apr_time.h"
 #include "apr_shm.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 #include "apr_general.h"
@@ -32,6 +34,15 @@
 #if APR_HAVE_LIMITS_H
 #include <limits.h>
 #endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if APR_HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
 
 #include "ap_socache.h"
 
@@ -52,19 +63,29 @@
 #define ALIGNED_SUBCACHE_SIZE APR_ALIGN_DEFAULT(sizeof(SHMCBSubcache))
 #define ALIGNED_INDEX_SIZE APR_ALIGN_DEFAULT(sizeof(SHMCBIndex))
 
+/* The subcaches have their own locks where APR's atomics work across
+ * processes (see the check in config.m4) and the holder of a lock can be
+ * found gone with kill(), so that a crashed process does not leave its
+ * lock held forever.  Elsewhere, users serialize all operations with a
+ * mutex of theirs (AP_SOCACHE_FLAG_NOTMPSAFE), as that one is released
+ * by the system when its holder dies.
+ */
+#if defined(HAVE_LOCKFREE_ATOMICS) && APR_HAVE_UNISTD_H && APR_HAVE_SIGNAL_H
+#define SHMCB_SUBCACHE_LOCKS 1
+#else
+#define SHMCB_SUBCACHE_LOCKS 0
+#endif
+
+/* Times a subcache lock is polled before yielding the CPU */
+#define SHMCB_LOCK_SPINS 100
+
+/* Times a waiter yields before checking that the holder is still there */
+#define SHMCB_LOCK_YIELDS 100
+
 /*
  * Header structure - the start of the shared-mem segment
  */
 typedef struct {
-    /* Stats for cache operations */
-    unsigned long stat_stores;
-    unsigned long stat_replaced;
-    unsigned long stat_expiries;
-    unsigned long stat_scrolled;
-    unsigned long stat_retrieves_hit;
-    unsigned long stat_retrieves_miss;
-    unsigned long stat_removes_hit;
-    unsigned long stat_removes_miss;
     /* Number of subcaches */
     unsigned int subcache_num;
     /* How many indexes each subcache's queue has */
@@ -82,10 +103,21 @@ typedef struct {
  * indexes then data
  */
 typedef struct {
+    /* The pid of the process holding it, or 0 */
+    apr_uint32_t lock;
     /* The start position and length of the cyclic buffer of indexes */
     unsigned int idx_pos, idx_used;
     /* Same for the data area */
     unsigned int data_pos, data_used;
+    /* Stats for cache operations */
+    unsigned long stat_stores;
+    unsigned long stat_replaced;
+    unsigned long stat_expiries;
+    unsigned long stat_scrolled;
+    unsigned long stat_retrieves_hit;
+    unsigned long stat_retrieves_miss;
+    unsigned long stat_removes_hit;
+    unsigned long stat_removes_miss;
 } SHMCBSubcache;
 
 /*
@@ -104,6 +136,17 @@ typedef struct {
     unsigned char removed;
 } SHMCBIndex;
 
+/*
+ * A copy of an entry, taken under the subcache lock and handed to the
+ * iterator once the lock is released
+ */
+typedef struct {
+    unsigned char *id;
+    unsigned int id_len;
+    unsigned char *data;
+    unsigned int data_len;
+} SHMCBEntry;
+
 struct ap_socache_instance_t {
     const char *data_file;
     apr_size_t shm_size;
@@ -151,6 +194,16 @@ struct ap_socache_instance_t {
  * idx1 = { data_pos = 0, data_used = 3, id_len = 1, ...}
  * idx2 = { data_pos = 3, data_used = 3, id_len = 1, ...}
  * ...
+ *
+ * Each subcache is guarded by its own spin lock, subcache->lock, taken
+ * with an atomic compare-and-swap in the shared segment, so operations
+ * on different subcaches run in parallel across threads and processes
+ * and the provider needs no external mutex. Locks are held only while
+ * the subcache's indexes and data are read or changed, never while
+ * calling out of the module. A lock holds the pid of its holder: if a
+ * process dies holding it, a waiter takes it over and empties the
+ * subcache, which may have been left half changed. A pid reused by
+ * another process only delays this until that process exits.
  */
 
 /* This macro takes a pointer to the header and a zero-based index and returns
@@ -251,6 +304,66 @@ static int shmcb_cyclic_memcmp(unsigned int buf_size, unsigned char *data,
     }
 }
 
+#if SHMCB_SUBCACHE_LOCKS
+/* The pid of this child, set by shmcb_child_init() so as not to ask for
+ * it on every lock, and 0 in processes which are not children
+ */
+static pid_t shmcb_pid;
+
+static void shmcb_child_init(apr_pool_t *p, server_rec *s)
+{
+    shmcb_pid = getpid();
+}
+#endif
+
+static void shmcb_subcache_lock(server_rec *s, SHMCBSubcache *subcache)
+{
+#if SHMCB_SUBCACHE_LOCKS
+    apr_uint32_t self = (apr_uint32_t)(shmcb_pid ? shmcb_pid : getpid());
+    apr_uint32_t owner;
+    int spins = 0, yields = 0;
+
+    while (apr_atomic_cas32(&subcache->lock, self, 0) != 0) {
+        /* wait for it to look free before trying again */
+        while ((owner = apr_atomic_read32(&subcache->lock)) != 0) {
+            if (++spins < SHMCB_LOCK_SPINS) {
+                continue;
+            }
+            spins = 0;
+            if (++yields == SHMCB_LOCK_YIELDS) {
+                yields = 0;
+                if (owner != self && kill((pid_t)owner, 0) != 0
+                    && errno == ESRCH
+                    && apr_atomic_cas32(&subcache->lock, self, owner)
+                       == owner) {
+                    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s,
+                                 APLOGNO(03413) "subcache lock held by "
+                                 "exited process %" APR_PID_T_FMT ", "
+                                 "subcache emptied", (pid_t)owner);
+                    subcache->idx_pos = subcache->idx_used = 0;
+                    subcache->data_pos = subcache->data_used = 0;
+                    return;
+                }
+            }
+            /* the holder may not be running, let it */
+#if APR_HAS_THREADS
+            apr_thread_yield();
+#else
+            apr_sleep(1);
+#endif
+        }
+    }
+#endif
+}
+
+static void shmcb_subcache_unlock(SHMCBSubcache *subcache)
+{
+#if SHMCB_SUBCACHE_LOCKS
+    /* a full barrier, unlike a plain store */
+    apr_atomic_xchg32(&subcache->lock, 0);
+#endif
+}
+
 
 /* Prototypes for low-level subcache operations */
 static void shmcb_subcache_expire(server_rec *, SHMCBHeader *, SHMCBSubcache *,
@@ -269,16 +382,12 @@ static int shmcb_subcache_retrieve(server_rec *, SHMCBHeader *, SHMCBSubcache *,
 static int shmcb_subcache_remove(server_rec *, SHMCBHeader *, SHMCBSubcache *,
                                  const unsigned char *, unsigned int);
 
-/* Returns result of the (iterator)() call, zero is success (continue) */
-static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
-                                           server_rec *s,
-                                           void *userctx,
+/* Copies the unexpired entries to buf, returns how many there are */
+static unsigned int shmcb_subcache_iterate(server_rec *s,
                                            SHMCBHeader *header,
                                            SHMCBSubcache *subcache,
-                                           ap_socache_iterator_t *iterator,
-                                           unsigned char **buf,
-                                           apr_size_t *buf_len,
-                                           apr_pool_t *pool,
+                                           SHMCBEntry *entries,
+                                           unsigned char *buf,
                                            apr_time_t now);
 
 /*
@@ -423,14 +532,6 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
     }
     /* OK, we're sorted */
     ctx->header = header = shm_segment;
-    header->stat_stores = 0;
-    header->stat_replaced = 0;
-    header->stat_expiries = 0;
-    header->stat_scrolled = 0;
-    header->stat_retrieves_hit = 0;
-    header->stat_retrieves_miss = 0;
-    header->stat_removes_hit = 0;
-    header->stat_removes_miss = 0;
     header->subcache_num = num_subcache;
     /* Convert the subcache size (in bytes) to a value that is suitable for
      * structure alignment on the host platform, by rounding down if necessary. */
@@ -461,8 +562,7 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
     /* The header is done, make the caches empty */
     for (loop = 0; loop < header->subcache_num; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
-        subcache->idx_pos = subcache->idx_used = 0;
-        subcache->data_pos = subcache->data_used = 0;
+        memset(subcache, 0, sizeof(*subcache));
     }
     ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(00830)
                  "Shared memory socache initialised");
@@ -499,19 +599,22 @@ static apr_status_t socache_shmcb_store(ap_socache_instance_t *ctx,
                 "(%u bytes)", idlen);
         return APR_EINVAL;
     }
+    shmcb_subcache_lock(s, subcache);
     tryreplace = shmcb_subcache_remove(s, header, subcache, id, idlen);
     if (shmcb_subcache_store(s, header, subcache, encoded,
                              len_encoded, id, idlen, expiry)) {
+        shmcb_subcache_unlock(subcache);
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(00833)
                      "can't store an socache entry!");
         return APR_ENOSPC;
     }
     if (tryreplace == 0) {
-        header->stat_replaced++;
+        subcache->stat_replaced++;
     }
     else {
-        header->stat_stores++;
+        subcache->stat_stores++;
     }
+    shmcb_subcache_unlock(subcache);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00834)
                  "leaving socache_shmcb_store successfully");
     return APR_SUCCESS;
@@ -532,12 +635,14 @@ static apr_status_t socache_shmcb_retrieve(ap_socache_instance_t *ctx,
                  SHMCB_MASK_DBG(header, id));
 
     /* Get the entry corresponding to the id, if it exists. */
+    shmcb_subcache_lock(s, subcache);
     rv = shmcb_subcache_retrieve(s, header, subcache, id, idlen,
                                  dest, destlen);
     if (rv == 0)
-        header->stat_retrieves_hit++;
+        subcache->stat_retrieves_hit++;
     else
-        header->stat_retrieves_miss++;
+        subcache->stat_retrieves_miss++;
+    shmcb_subcache_unlock(subcache);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00836)
                  "leaving socache_shmcb_retrieve successfully");
 
@@ -560,13 +665,15 @@ static apr_status_t socache_shmcb_remove(ap_socache_instance_t *ctx,
                 "(%u bytes)", idlen);
         return APR_EINVAL;
     }
+    shmcb_subcache_lock(s, subcache);
     if (shmcb_subcache_remove(s, header, subcache, id, idlen) == 0) {
-        header->stat_removes_hit++;
+        subcache->stat_removes_hit++;
         rv = APR_SUCCESS;
     } else {
-        header->stat_removes_miss++;
+        subcache->stat_removes_miss++;
         rv = APR_NOTFOUND;
     }
+    shmcb_subcache_unlock(subcache);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00839)
                  "leaving socache_shmcb_remove successfully");
 
@@ -583,16 +690,28 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
     apr_time_t now = apr_time_now();
     double expiry_total = 0;
     int index_pct, cache_pct;
+    unsigned long stores = 0, replaced = 0, expiries = 0, scrolled = 0;
+    unsigned long retrieves_hit = 0, retrieves_miss = 0;
+    unsigned long removes_hit = 0, removes_miss = 0;
 
     AP_DEBUG_ASSERT(header->subcache_num > 0);
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00840) "inside shmcb_status");
-    /* Perform the iteration inside the mutex to avoid corruption or invalid
-     * pointer arithmetic. The rest of our logic uses read-only header data so
-     * doesn't need the lock. */
+    /* Perform the iteration of each subcache inside its lock to avoid
+     * corruption or invalid pointer arithmetic. The rest of our logic uses
+     * read-only header data so doesn't need the lock. */
     /* Iterate over the subcaches */
     for (loop = 0; loop < header->subcache_num; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
+        shmcb_subcache_lock(s, subcache);
         shmcb_subcache_expire(s, header, subcache, now);
+        stores += subcache->stat_stores;
+        replaced += subcache->stat_replaced;
+        expiries += subcache->stat_expiries;
+        scrolled += subcache->stat_scrolled;
+        retrieves_hit += subcache->stat_retrieves_hit;
+        retrieves_miss += subcache->stat_retrieves_miss;
+        removes_hit += subcache->stat_removes_hit;
+        removes_miss += subcache->stat_removes_miss;
         total += subcache->idx_used;
         cache_total += subcache->data_used;
         if (subcache->idx_used) {
@@ -606,6 +725,7 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
             else
                 min_expiry = ((idx_expiry < min_expiry) ? idx_expiry : min_expiry);
         }
+        shmcb_subcache_unlock(subcache);
     }
     index_pct = (100 * total) / (header->index_num *
                                  header->subcache_num);
@@ -633,19 +753,17 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
         ap_rprintf(r, "index usage: <b>%d%%</b>, cache usage: <b>%d%%</b><br>",
                    index_pct, cache_pct);
         ap_rprintf(r, "total entries stored since starting: <b>%lu</b><br>",
-                   header->stat_stores);
+                   stores);
         ap_rprintf(r, "total entries replaced since starting: <b>%lu</b><br>",
-                   header->stat_replaced);
+                   replaced);
         ap_rprintf(r, "total entries expired since starting: <b>%lu</b><br>",
-                   header->stat_expiries);
+                   expiries);
         ap_rprintf(r, "total (pre-expiry) entries scrolled out of the cache: "
-                   "<b>%lu</b><br>", header->stat_scrolled);
+                   "<b>%lu</b><br>", scrolled);
         ap_rprintf(r, "total retrieves since starting: <b>%lu</b> hit, "
-                   "<b>%lu</b> miss<br>", header->stat_retrieves_hit,
-                   header->stat_retrieves_miss);
+                   "<b>%lu</b> miss<br>", retrieves_hit, retrieves_miss);
         ap_rprintf(r, "total removes since starting: <b>%lu</b> hit, "
-                   "<b>%lu</b> miss<br>", header->stat_removes_hit,
-                   header->stat_removes_miss);
+                   "<b>%lu</b> miss<br>", removes_hit, removes_miss);
     }
     else {
         ap_rputs("CacheType: SHMCB\n", r);
@@ -665,14 +783,14 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
 
         ap_rprintf(r, "CacheIndexUsage: %d%%\n", index_pct);
         ap_rprintf(r, "CacheUsage: %d%%\n", cache_pct);
-        ap_rprintf(r, "CacheStoreCount: %lu\n", header->stat_stores);
-        ap_rprintf(r, "CacheReplaceCount: %lu\n", header->stat_replaced);
-        ap_rprintf(r, "CacheExpireCount: %lu\n", header->stat_expiries);
-        ap_rprintf(r, "CacheDiscardCount: %lu\n", header->stat_scrolled);
-        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", header->stat_retrieves_hit);
-        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", header->stat_retrieves_miss);
-        ap_rprintf(r, "CacheRemoveHitCount: %lu\n", header->stat_removes_hit);
-        ap_rprintf(r, "CacheRemoveMissCount: %lu\n", header->stat_removes_miss);
+        ap_rprintf(r, "CacheStoreCount: %lu\n", stores);
+        ap_rprintf(r, "CacheReplaceCount: %lu\n", replaced);
+        ap_rprintf(r, "CacheExpireCount: %lu\n", expiries);
+        ap_rprintf(r, "CacheDiscardCount: %lu\n", scrolled);
+        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", retrieves_hit);
+        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", retrieves_miss);
+        ap_rprintf(r, "CacheRemoveHitCount: %lu\n", removes_hit);
+        ap_rprintf(r, "CacheRemoveMissCount: %lu\n", removes_miss);
     }
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00841) "leaving shmcb_status");
 }
@@ -683,20 +801,36 @@ static apr_status_t socache_shmcb_iterate(ap_socache_instance_t *instance,
                                           apr_pool_t *pool)
 {
     SHMCBHeader *header = instance->header;
-    unsigned int loop;
+    unsigned int loop, n, i;
     apr_time_t now = apr_time_now();
     apr_status_t rv = APR_SUCCESS;
-    apr_size_t buflen = 0;
-    unsigned char *buf = NULL;
-
-    /* Perform the iteration inside the mutex to avoid corruption or invalid
-     * pointer arithmetic. The rest of our logic uses read-only header data so
-     * doesn't need the lock. */
+    SHMCBEntry *entries;
+    unsigned char *buf;
+
+    /* Room for the copies of a whole subcache: the data, plus the NULs
+     * and alignment of each id and data */
+    entries = apr_palloc(pool, header->index_num * sizeof(SHMCBEntry));
+    buf = apr_palloc(pool, header->subcache_data_size
+                           + header->index_num * 2 * APR_ALIGN_DEFAULT(1));
+
+    /* Copy each subcache's entries inside its lock to avoid corruption or
+     * invalid pointer arithmetic, then call the iterator on them without
+     * the lock, so that it may use the cache. */
     /* Iterate over the subcaches */
     for (loop = 0; loop < header->subcache_num && rv == APR_SUCCESS; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
-        rv = shmcb_subcache_iterate(instance, s, userctx, header, subcache,
-                                    iterator, &buf, &buflen, pool, now);
+
+        shmcb_subcache_lock(s, subcache);
+        n = shmcb_subcache_iterate(s, header, subcache, entries, buf, now);
+        shmcb_subcache_unlock(subcache);
+
+        for (i = 0; i < n && rv == APR_SUCCESS; i++) {
+            rv = iterator(instance, s, userctx, entries[i].id,
+                          entries[i].id_len, entries[i].data,
+                          entries[i].data_len, pool);
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(00855)
+                         "shmcb entry iterated");
+        }
     }
     return rv;
 }
@@ -746,7 +880,7 @@ static void shmcb_subcache_expire(server_rec *s, SHMCBHeader *header,
         subcache->data_used -= diff;
         subcache->data_pos = idx->data_pos;
     }
-    header->stat_expiries += expired;
+    subcache->stat_expiries += expired;
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00843)
                  "we now have %u socache entries", subcache->idx_used);
 }
@@ -802,7 +936,7 @@ static int shmcb_subcache_store(server_rec *s, SHMCBHeader *header,
                                                       header->subcache_data_size);
             subcache->data_pos = idx2->data_pos;
             /* Stats */
-            header->stat_scrolled++;
+            subcache->stat_scrolled++;
             /* Loop admin */
             idx = idx2;
             loop++;
@@ -902,7 +1036,7 @@ static int shmcb_subcache_retrieve(server_rec *s, SHMCBHeader *header,
             else {
                 /* Already stale, quietly remove and treat as not-found */
                 idx->removed = 1;
-                header->stat_expiries++;
+                subcache->stat_expiries++;
                 ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00850)
                              "shmcb_subcache_retrieve discarding expired entry");
                 return -1;
@@ -954,20 +1088,17 @@ static int shmcb_subcache_remove(server_rec *s, SHMCBHeader *header,
 }
 
 
-static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
-                                           server_rec *s,
-                                           void *userctx,
+static unsigned int shmcb_subcache_iterate(server_rec *s,
                                            SHMCBHeader *header,
                                            SHMCBSubcache *subcache,
-                                           ap_socache_iterator_t *iterator,
-                                           unsigned char **buf,
-                                           apr_size_t *buf_len,
-                                           apr_pool_t *pool,
+                                           SHMCBEntry *entries,
+                                           unsigned char *buf,
                                            apr_time_t now)
 {
     unsigned int pos;
     unsigned int loop = 0;
-    apr_status_t rv;
+    unsigned int n = 0;
+    apr_size_t buf_pos = 0;
 
     pos = subcache->idx_pos;
     while (loop < subcache->idx_used) {
@@ -979,54 +1110,37 @@ static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00854)
                          "iterating idx=%d, data=%d", pos, idx->data_pos);
             if (idx->expires > now) {
-                unsigned char *id = *buf;
-                unsigned char *dest;
-                unsigned int data_offset, dest_len;
-                apr_size_t buf_req;
+                SHMCBEntry *entry = &entries[n++];
+                unsigned int data_offset;
 
                 /* Find the offset of the data segment, after the id */
                 data_offset = SHMCB_CYCLIC_INCREMENT(idx->data_pos,
                                                      idx->id_len,
                                                      header->subcache_data_size);
 
-                dest_len = idx->data_used - idx->id_len;
-
-                buf_req = APR_ALIGN_DEFAULT(idx->id_len + 1)
-                        + APR_ALIGN_DEFAULT(dest_len + 1);
-
-                if (buf_req > *buf_len) {
-                     /* Grow to ~150% of this buffer requirement on resize
-                      * always using APR_ALIGN_DEFAULT sized pages
-                      */
-                     *buf_len = buf_req + APR_ALIGN_DEFAULT(buf_req / 2);
-                     *buf = apr_palloc(pool, *buf_len);
-                     id = *buf;
-                }
-
-                dest = *buf + APR_ALIGN_DEFAULT(idx->id_len + 1);
+                entry->id = buf + buf_pos;
+                entry->id_len = idx->id_len;
+                buf_pos += APR_ALIGN_DEFAULT(entry->id_len + 1);
+                entry->data = buf + buf_pos;
+                entry->data_len = idx->data_used - idx->id_len;
+                buf_pos += APR_ALIGN_DEFAULT(entry->data_len + 1);
 
                 /* Copy out the data, because it's potentially cyclic */
-                shmcb_cyclic_cton_memcpy(header->subcache_data_size, id,
+                shmcb_cyclic_cton_memcpy(header->subcache_data_size, entry->id,
                                          SHMCB_DATA(header, subcache),
-                                         idx->data_pos, idx->id_len);
-                id[idx->id_len] = '\0';
+                                         idx->data_pos, entry->id_len);
+                entry->id[entry->id_len] = '\0';
 
-                shmcb_cyclic_cton_memcpy(header->subcache_data_size, dest,
+                shmcb_cyclic_cton_memcpy(header->subcache_data_size,
+                                         entry->data,
                                          SHMCB_DATA(header, subcache),
-                                         data_offset, dest_len);
-                dest[dest_len] = '\0';
-
-                rv = iterator(instance, s, userctx, id, idx->id_len,
-                              dest, dest_len, pool);
-                ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(00855)
-                             "shmcb entry iterated");
-                if (rv != APR_SUCCESS)
-                    return rv;
+                                         data_offset, entry->data_len);
+                entry->data[entry->data_len] = '\0';
             }
             else {
                 /* Already stale, quietly remove and treat as not-found */
                 idx->removed = 1;
-                header->stat_expiries++;
+                subcache->stat_expiries++;
                 ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00856)
                              "shmcb_subcache_iterate discarding expired entry");
             }
@@ -1036,12 +1150,16 @@ static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
         pos = SHMCB_CYCLIC_INCREMENT(pos, 1, header->index_num);
     }
 
-    return APR_SUCCESS;
+    return n;
 }
 
 static const ap_socache_provider_t socache_shmcb = {
     "shmcb",
+#if SHMCB_SUBCACHE_LOCKS
+    0,
+#else
     AP_SOCACHE_FLAG_NOTMPSAFE,
+#endif
     socache_shmcb_create,
     socache_shmcb_init,
     socache_shmcb_destroy,
@@ -1063,6 +1181,10 @@ static void register_hooks(apr_pool_t *p)
                          AP_SOCACHE_DEFAULT_PROVIDER,
                          AP_SOCACHE_PROVIDER_VERSION,
                          &socache_shmcb);
+
+#if SHMCB_SUBCACHE_LOCKS
+    ap_hook_child_init(shmcb_child_init, NULL, NULL, APR_HOOK_REALLY_FIRST);
+#endif
 }
 
 AP_DECLARE_MODULE(socache_shmcb) = {
@@ -59,6 +59,7 @@
 #include "http_core.h"
 #include "http_protocol.h"
 #include "http_main.h"
+#include "http_request.h"
 #include "ap_mpm.h"
 #include "util_script.h"
 #include <time.h>
@@ -71,6 +72,7 @@
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 #include "apr_strings.h"
+#include "apr_thread_mutex.h"
 
 #define STATUS_MAXLINE 64
 
@@ -530,6 +532,9 @@ static int status_handler(request_rec *r)
     if (is_async) {
         int write_completion = 0, lingering_close = 0, keep_alive = 0,
             connections = 0;
+        apr_uint32_t timers_pending = 0, timers_fired = 0,
+                     timers_late_max = 0;
+        apr_uint64_t timers_late_total = 0;
         /*
          * These differ from 'busy' and 'ready' in how gracefully finishing
          * threads are counted. XXX: How to make this clear in the html?
@@ -541,10 +546,14 @@ static int status_handler(request_rec *r)
 		         "<th rowspan=\"2\">PID</th>"
                          "<th colspan=\"2\">Connections</th>\n"
                          "<th colspan=\"2\">Threads</th>"
-                         "<th colspan=\"4\">Async connections</th></tr>\n"
+                         "<th colspan=\"4\">Async connections</th>"
+                         "<th colspan=\"4\">Timers</th></tr>\n"
                      "<tr><th>total</th><th>accepting</th>"
                          "<th>busy</th><th>idle</th><th>writing</th>"
-                         "<th>keep-alive</th><th>closing</th></tr>\n", r);
+                         "<th>keep-alive</th><th>closing</th>"
+                         "<th>pending</th><th>fired</th>"
+                         "<th>late avg (&micro;s)</th>"
+                         "<th>late max (&micro;s)</th></tr>\n", r);
         for (i = 0; i < server_limit; ++i) {
             ps_record = ap_get_scoreboard_process(i);
             if (ps_record->pid) {
@@ -554,35 +563,58 @@ static int status_handler(request_rec *r)
                 lingering_close  += ps_record->lingering_close;
                 busy_workers     += thread_busy_buffer[i];
                 idle_workers     += thread_idle_buffer[i];
+                timers_pending   += ps_record->timers_pending;
+                timers_fired     += ps_record->timers_fired;
+                timers_late_total += (apr_uint64_t)ps_record->timers_late_avg
+                                     * ps_record->timers_fired;
+                if (timers_late_max < ps_record->timers_late_max)
+                    timers_late_max = ps_record->timers_late_max;
                 if (!short_report)
                     ap_rprintf(r, "<tr><td>%u</td><td>%" APR_PID_T_FMT "</td>"
                                       "<td>%u</td><td>%s</td><td>%u</td>"
                                       "<td>%u</td><td>%u</td><td>%u</td>"
-                                      "<td>%u</td>"
+                                      "<td>%u</td><td>%u</td><td>%u</td>"
+                                      "<td>%u</td><td>%u</td>"
                                       "</tr>\n",
                                i, ps_record->pid, ps_record->connections,
                                ps_record->not_accepting ? "no" : "yes",
                                thread_busy_buffer[i], thread_idle_buffer[i],
                                ps_record->write_completion,
                                ps_record->keep_alive,
-                               ps_record->lingering_close);
+                               ps_record->lingering_close,
+                               ps_record->timers_pending,
+                               ps_record->timers_fired,
+                               ps_record->timers_late_avg,
+                               ps_record->timers_late_max);
             }
         }
         if (!short_report) {
             ap_rprintf(r, "<tr><td>Sum</td><td>%d</td><td>&nbsp;</td><td>%d</td>"
                           "<td>%d</td><td>%d</td><td>%d</td><td>%d</td>"
+                          "<td>%u</td><td>%u</td><td>%u</td><td>%u</td>"
                           "</tr>\n</table>\n",
                           connections, busy_workers, idle_workers,
-                          write_completion, keep_alive, lingering_close);
+                          write_completion, keep_alive, lingering_close,
+                          timers_pending, timers_fired,
+                          timers_fired ? (apr_uint32_t)(timers_late_total
+                                                        / timers_fired) : 0,
+                          timers_late_max);
 
         }
         else {
             ap_rprintf(r, "ConnsTotal: %d\n"
                           "ConnsAsyncWriting: %d\n"
                           "ConnsAsyncKeepAlive: %d\n"
-                          "ConnsAsyncClosing: %d\n",
+                          "ConnsAsyncClosing: %d\n"
+                          "TimersPending: %u\n"
+                          "TimersFired: %u\n"
+                          "TimersLateAvgUsec: %u\n"
+                          "TimersLateMaxUsec: %u\n",
                        connections, write_completion, keep_alive,
-                       lingering_close);
+                       lingering_close, timers_pending, timers_fired,
+                       timers_fired ? (apr_uint32_t)(timers_late_total
+                                                     / timers_fired) : 0,
+                       timers_late_max);
         }
     }
 
@@ -927,6 +959,501 @@ static int status_handler(request_rec *r)
     return 0;
 }
 
+/*
+ * OpenMetrics export (the "server-metrics" handler)
+ *
+ * With StatusMetrics On each request is accounted at log time in a slot
+ * of shared memory which belongs to the scoreboard thread that served it,
+ * so that accounting takes a few plain increments and no lock or atomic
+ * operation.  A scrape sums the slots which were used.  Requests that are
+ * not served by a scoreboard thread of their own (HTTP/2 streams run on
+ * the connection's slot) go to one extra slot per child, under a mutex.
+ * Counters are 64 bits wide and may be read torn on 32-bit platforms;
+ * a scraper sees that as a glitch in one sample at worst.
+ */
+
+#define METRICS_HANDLER "server-metrics"
+#define METRICS_CONTENT_TYPE \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define METRICS_CACHE_LINE 64
+#define METRICS_BUCKETS 12
+
+static const apr_interval_time_t metrics_bounds[METRICS_BUCKETS] = {
+    1000, 5000, 10000, 25000, 50000, 100000,
+    250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static const char *const metrics_le[METRICS_BUCKETS] = {
+    "0.001", "0.005", "0.01", "0.025", "0.05", "0.1",
+    "0.25", "0.5", "1.0", "2.5", "5.0", "10.0"
+};
+
+typedef struct {
+    apr_uint64_t count;
+    apr_uint64_t sum;                       /* microseconds */
+    apr_uint64_t bucket[METRICS_BUCKETS];   /* not cumulative */
+} metrics_histogram;
+
+typedef struct {
+    apr_uint64_t requests;
+    apr_uint64_t bytes;
+} metrics_vhost;
+
+typedef struct {
+    metrics_histogram duration;
+    metrics_histogram ttfb;
+    apr_uint64_t codes[RESPONSE_CODES];     /* by ap_index_of_response() */
+    /* followed by one metrics_vhost per server_rec */
+} metrics_slot;
+
+typedef struct {
+    int vhost;                              /* index in the vhost counters */
+} status_server_conf;
+
+static int metrics_enabled;
+static char *metrics_base;
+static apr_size_t metrics_slot_size;
+static int metrics_vhosts;
+static int metrics_codes[RESPONSE_CODES];
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *metrics_mutex;
+#endif
+
+static const char metrics_ttfb_filter_name[] = "STATUS_METRICS_TTFB";
+
+#define METRICS_SLOT(child_num, thread_num) \
+    ((metrics_slot *)(metrics_base + \
+                      ((apr_size_t)(child_num) * (thread_limit + 1) \
+                       + (thread_num)) * metrics_slot_size))
+
+#define METRICS_SLOT_VHOSTS(slot) ((metrics_vhost *)((slot) + 1))
+
+static void metrics_observe(metrics_histogram *h, apr_interval_time_t t)
+{
+    int i;
+
+    if (t < 0) {
+        t = 0;
+    }
+    h->count++;
+    h->sum += t;
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        if (t <= metrics_bounds[i]) {
+            h->bucket[i]++;
+            break;
+        }
+    }
+}
+
+/* Time to first byte, measured the way mod_logio's %^FB is */
+static apr_status_t metrics_ttfb_filter(ap_filter_t *f,
+                                        apr_bucket_brigade *bb)
+{
+    request_rec *r = f->r;
+    apr_interval_time_t *ttfb;
+
+    ttfb = apr_palloc(r->pool, sizeof(*ttfb));
+    *ttfb = apr_time_now() - r->request_time;
+    ap_set_module_config(r->request_config, &status_module, ttfb);
+
+    ap_remove_output_filter(f);
+    return ap_pass_brigade(f->next, bb);
+}
+
+static void metrics_insert_filter(request_rec *r)
+{
+    if (metrics_base) {
+        ap_add_output_filter(metrics_ttfb_filter_name, NULL, r,
+                             r->connection);
+    }
+}
+
+static int metrics_log_transaction(request_rec *r)
+{
+    status_server_conf *conf;
+    apr_interval_time_t duration, *ttfb;
+    metrics_slot *slot;
+    metrics_vhost *vhost;
+    int child_num, thread_num, shared;
+
+    if (!metrics_base || !r->connection->sbh) {
+        return DECLINED;
+    }
+
+    duration = apr_time_now() - r->request_time;
+    while (r->next) {
+        r = r->next;
+    }
+    ttfb = ap_get_module_config(r->request_config, &status_module);
+    conf = ap_get_module_config(r->server->module_config, &status_module);
+
+    ap_sb_get_child_thread(r->connection->sbh, &child_num, &thread_num);
+    if (child_num < 0 || child_num >= server_limit
+        || thread_num < 0 || thread_num >= thread_limit) {
+        return DECLINED;
+    }
+    shared = (r->connection->master != NULL);
+    if (shared) {
+        thread_num = thread_limit;
+    }
+    slot = METRICS_SLOT(child_num, thread_num);
+    vhost = METRICS_SLOT_VHOSTS(slot) + conf->vhost;
+
+#if APR_HAS_THREADS
+    if (shared && metrics_mutex) {
+        apr_thread_mutex_lock(metrics_mutex);
+    }
+#endif
+    /* unknown status codes count as 500, as they are sent */
+    slot->codes[ap_index_of_response(r->status)]++;
+    metrics_observe(&slot->duration, duration);
+    if (ttfb) {
+        metrics_observe(&slot->ttfb, *ttfb);
+    }
+    vhost->requests++;
+    vhost->bytes += r->bytes_sent;
+#if APR_HAS_THREADS
+    if (shared && metrics_mutex) {
+        apr_thread_mutex_unlock(metrics_mutex);
+    }
+#endif
+
+    return OK;
+}
+
+static const char *metrics_escape(apr_pool_t *p, const char *s)
+{
+    const char *c;
+    char *out, *d;
+
+    for (c = s; *c; c++) {
+        if (*c == '\\' || *c == '"' || *c == '\n') {
+            break;
+        }
+    }
+    if (!*c) {
+        return s;
+    }
+
+    d = out = apr_palloc(p, 2 * strlen(s) + 1);
+    for (c = s; *c; c++) {
+        if (*c == '\n') {
+            *d++ = '\\';
+            *d++ = 'n';
+            continue;
+        }
+        if (*c == '\\' || *c == '"') {
+            *d++ = '\\';
+        }
+        *d++ = *c;
+    }
+    *d = '\0';
+
+    return out;
+}
+
+static void metrics_histogram_out(request_rec *r, const char *name,
+                                  const char *help, metrics_histogram *h)
+{
+    apr_uint64_t cumulative = 0;
+    int i;
+
+    ap_rprintf(r, "# TYPE %s histogram\n# UNIT %s seconds\n# HELP %s %s\n",
+               name, name, name, help);
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        cumulative += h->bucket[i];
+        ap_rprintf(r, "%s_bucket{le=\"%s\"} %" APR_UINT64_T_FMT "\n",
+                   name, metrics_le[i], cumulative);
+    }
+    ap_rprintf(r, "%s_bucket{le=\"+Inf\"} %" APR_UINT64_T_FMT "\n"
+                  "%s_count %" APR_UINT64_T_FMT "\n"
+                  "%s_sum %" APR_UINT64_T_FMT ".%06" APR_UINT64_T_FMT "\n",
+               name, h->count, name, h->count,
+               name, h->sum / APR_USEC_PER_SEC, h->sum % APR_USEC_PER_SEC);
+}
+
+static void metrics_requests_out(request_rec *r)
+{
+    metrics_slot *total;
+    metrics_vhost *total_vhosts;
+    server_rec *s;
+    int i, j, k;
+
+    total = apr_pcalloc(r->pool, metrics_slot_size);
+    total_vhosts = METRICS_SLOT_VHOSTS(total);
+
+    for (i = 0; i < server_limit; i++) {
+        for (j = 0; j <= thread_limit; j++) {
+            metrics_slot *slot = METRICS_SLOT(i, j);
+            metrics_vhost *vhosts = METRICS_SLOT_VHOSTS(slot);
+
+            /* skip the slots of threads which never served a request */
+            if (!slot->duration.count) {
+                continue;
+            }
+            total->duration.count += slot->duration.count;
+            total->duration.sum += slot->duration.sum;
+            total->ttfb.count += slot->ttfb.count;
+            total->ttfb.sum += slot->ttfb.sum;
+            for (k = 0; k < METRICS_BUCKETS; k++) {
+                total->duration.bucket[k] += slot->duration.bucket[k];
+                total->ttfb.bucket[k] += slot->ttfb.bucket[k];
+            }
+            for (k = 0; k < RESPONSE_CODES; k++) {
+                total->codes[k] += slot->codes[k];
+            }
+            for (k = 0; k < metrics_vhosts; k++) {
+                total_vhosts[k].requests += vhosts[k].requests;
+                total_vhosts[k].bytes += vhosts[k].bytes;
+            }
+        }
+    }
+
+    ap_rputs("# TYPE httpd_requests counter\n"
+             "# HELP httpd_requests Requests served, by status code.\n", r);
+    for (k = 0; k < RESPONSE_CODES; k++) {
+        if (total->codes[k] && metrics_codes[k]) {
+            ap_rprintf(r, "httpd_requests_total{code=\"%d\"} %"
+                          APR_UINT64_T_FMT "\n",
+                       metrics_codes[k], total->codes[k]);
+        }
+    }
+
+    metrics_histogram_out(r, "httpd_request_duration_seconds",
+                          "Time from reading the request line to logging.",
+                          &total->duration);
+    metrics_histogram_out(r, "httpd_time_to_first_byte_seconds",
+                          "Time from reading the request line to the first "
+                          "response body bytes.",
+                          &total->ttfb);
+
+    ap_rputs("# TYPE httpd_vhost_requests counter\n"
+             "# HELP httpd_vhost_requests Requests served, by virtual "
+             "host.\n", r);
+    for (s = ap_server_conf, k = 0; s && k < metrics_vhosts; s = s->next, k++) {
+        ap_rprintf(r, "httpd_vhost_requests_total{vhost=\"%s:%u\"} %"
+                      APR_UINT64_T_FMT "\n",
+                   metrics_escape(r->pool, s->server_hostname
+                                           ? s->server_hostname : ""),
+                   (unsigned)s->port, total_vhosts[k].requests);
+    }
+    ap_rputs("# TYPE httpd_vhost_sent_bytes counter\n"
+             "# UNIT httpd_vhost_sent_bytes bytes\n"
+             "# HELP httpd_vhost_sent_bytes Response body bytes sent, by "
+             "virtual host.\n", r);
+    for (s = ap_server_conf, k = 0; s && k < metrics_vhosts; s = s->next, k++) {
+        ap_rprintf(r, "httpd_vhost_sent_bytes_total{vhost=\"%s:%u\"} %"
+                      APR_UINT64_T_FMT "\n",
+                   metrics_escape(r->pool, s->server_hostname
+                                           ? s->server_hostname : ""),
+                   (unsigned)s->port, total_vhosts[k].bytes);
+    }
+}
+
+/* Gauges from the scoreboard, which is read in place rather than copied */
+static void metrics_scoreboard_out(request_rec *r)
+{
+    apr_uint32_t connections = 0, write_completion = 0, keep_alive = 0,
+                 lingering_close = 0, suspended = 0;
+    int i, j, busy = 0, idle = 0, processes = 0;
+    ap_generation_t mpm_generation;
+
+    ap_mpm_query(AP_MPMQ_GENERATION, &mpm_generation);
+
+    for (i = 0; i < server_limit; i++) {
+        process_score *ps_record = ap_get_scoreboard_process(i);
+
+        if (!ps_record->pid) {
+            continue;
+        }
+        processes++;
+        connections      += ps_record->connections;
+        write_completion += ps_record->write_completion;
+        keep_alive       += ps_record->keep_alive;
+        lingering_close  += ps_record->lingering_close;
+        suspended        += ps_record->suspended;
+        if (ps_record->quiescing) {
+            continue;
+        }
+        for (j = 0; j < thread_limit; j++) {
+            int res = ap_get_scoreboard_worker_from_indexes(i, j)->status;
+
+            if (res == SERVER_READY) {
+                if (ps_record->generation == mpm_generation)
+                    idle++;
+            }
+            else if (res != SERVER_DEAD &&
+                     res != SERVER_STARTING &&
+                     res != SERVER_IDLE_KILL) {
+                busy++;
+            }
+        }
+    }
+
+    ap_rprintf(r, "# TYPE httpd_uptime_seconds gauge\n"
+                  "# UNIT httpd_uptime_seconds seconds\n"
+                  "# HELP httpd_uptime_seconds Time since the last restart.\n"
+                  "httpd_uptime_seconds %" APR_TIME_T_FMT "\n",
+               apr_time_sec(apr_time_now()
+                            - ap_scoreboard_image->global->restart_time));
+    ap_rprintf(r, "# TYPE httpd_processes gauge\n"
+                  "# HELP httpd_processes Running child processes.\n"
+                  "httpd_processes %d\n", processes);
+    ap_rprintf(r, "# TYPE httpd_workers gauge\n"
+                  "# HELP httpd_workers Worker threads, by state.\n"
+                  "httpd_workers{state=\"busy\"} %d\n"
+                  "httpd_workers{state=\"idle\"} %d\n", busy, idle);
+    ap_rprintf(r, "# TYPE httpd_worker_utilization_ratio gauge\n"
+                  "# HELP httpd_worker_utilization_ratio Busy workers out of "
+                  "MaxRequestWorkers.\n"
+                  "httpd_worker_utilization_ratio %.4f\n",
+               max_servers > 0 ? (double)busy / ((double)max_servers
+                                                 * threads_per_child) : 0.0);
+
+    if (is_async) {
+        ap_rprintf(r, "# TYPE httpd_connections gauge\n"
+                      "# HELP httpd_connections Connections, by state.\n"
+                      "httpd_connections{state=\"total\"} %u\n"
+                      "httpd_connections{state=\"write_completion\"} %u\n"
+                      "httpd_connections{state=\"keep_alive\"} %u\n"
+                      "httpd_connections{state=\"lingering_close\"} %u\n"
+                      "httpd_connections{state=\"suspended\"} %u\n",
+                   connections, write_completion, keep_alive,
+                   lingering_close, suspended);
+    }
+}
+
+static int metrics_handler(request_rec *r)
+{
+    if (strcmp(r->handler, METRICS_HANDLER)) {
+        return DECLINED;
+    }
+
+    r->allowed = (AP_METHOD_BIT << M_GET);
+    if (r->method_number != M_GET) {
+        return DECLINED;
+    }
+
+    if (!ap_exists_scoreboard_image()) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(03397)
+                      "Server metrics unavailable in inetd mode");
+        return HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    ap_set_content_type(r, METRICS_CONTENT_TYPE);
+    apr_table_setn(r->headers_out, "Cache-Control", "no-cache");
+    if (r->header_only) {
+        return OK;
+    }
+
+    metrics_scoreboard_out(r);
+    if (metrics_base) {
+        metrics_requests_out(r);
+    }
+    ap_rputs("# EOF\n", r);
+
+    return OK;
+}
+
+static int metrics_init(apr_pool_t *p, server_rec *s)
+{
+    apr_shm_t *shm;
+    apr_size_t size;
+    apr_status_t rv;
+    server_rec *vs;
+    int i;
+
+    metrics_base = NULL;
+    if (!metrics_enabled
+        || ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    metrics_vhosts = 0;
+    for (vs = s; vs; vs = vs->next) {
+        status_server_conf *conf = ap_get_module_config(vs->module_config,
+                                                        &status_module);
+        conf->vhost = metrics_vhosts++;
+    }
+
+    for (i = 0; i < RESPONSE_CODES; i++) {
+        metrics_codes[i] = 0;
+    }
+    for (i = 100; i < 600; i++) {
+        int index = ap_index_of_response(i);
+
+        /* the codes without a status line of their own map to 500 */
+        if (!metrics_codes[index] && atoi(ap_get_status_line(i)) == i) {
+            metrics_codes[index] = i;
+        }
+    }
+
+    /* A slot per scoreboard thread plus a shared one per child, each
+     * starting on its own cache line
+     */
+    metrics_slot_size = APR_ALIGN(sizeof(metrics_slot)
+                                  + metrics_vhosts * sizeof(metrics_vhost),
+                                  METRICS_CACHE_LINE);
+    size = (apr_size_t)server_limit * (thread_limit + 1) * metrics_slot_size;
+
+#if APR_HAS_SHARED_MEMORY
+    rv = apr_shm_create(&shm, size + METRICS_CACHE_LINE, NULL, p);
+#else
+    rv = APR_ENOTIMPL;
+#endif
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(03398)
+                     "Failed to create %" APR_SIZE_T_FMT " bytes of shared "
+                     "memory; server-metrics will only report the "
+                     "scoreboard", size);
+        return OK;
+    }
+#if APR_HAS_SHARED_MEMORY
+    metrics_base = (char *)APR_ALIGN((apr_uintptr_t)apr_shm_baseaddr_get(shm),
+                                     METRICS_CACHE_LINE);
+    memset(metrics_base, 0, size);
+#endif
+
+    return OK;
+}
+
+static void metrics_child_init(apr_pool_t *p, server_rec *s)
+{
+#if APR_HAS_THREADS
+    int threaded_mpm;
+
+    metrics_mutex = NULL;
+    if (metrics_base
+        && ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm) == APR_SUCCESS
+        && threaded_mpm) {
+        apr_thread_mutex_create(&metrics_mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    }
+#endif
+}
+
+static const char *set_status_metrics(cmd_parms *cmd, void *dummy, int flag)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    metrics_enabled = flag;
+    return NULL;
+}
+
+static void *create_status_server_config(apr_pool_t *p, server_rec *s)
+{
+    return apr_pcalloc(p, sizeof(status_server_conf));
+}
+
+static const command_rec status_cmds[] =
+{
+    AP_INIT_FLAG("StatusMetrics", set_status_metrics, NULL, RSRC_CONF,
+                 "\"On\" to account requests for the server-metrics handler"),
+    {NULL}
+};
+
 static int status_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
 {
     /* When mod_status is loaded, default our ExtendedStatus to 'on'
@@ -935,6 +1462,7 @@ static int status_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
      * scoreboard entries.
      */
     ap_extended_status = 1;
+    metrics_enabled = 0;
     return OK;
 }
 
@@ -961,7 +1489,7 @@ static int status_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp,
         threads_per_child = 1;
     ap_mpm_query(AP_MPMQ_MAX_DAEMONS, &max_servers);
     ap_mpm_query(AP_MPMQ_IS_ASYNC, &is_async);
-    return OK;
+    return metrics_init(p, s);
 }
 
 #ifdef HAVE_TIMES
@@ -974,11 +1502,18 @@ static void status_child_init(apr_pool_t *p, server_rec *s)
 static void register_hooks(apr_pool_t *p)
 {
     ap_hook_handler(status_handler, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_handler(metrics_handler, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_pre_config(status_pre_config, NULL, NULL, APR_HOOK_LAST);
     ap_hook_post_config(status_init, NULL, NULL, APR_HOOK_MIDDLE);
 #ifdef HAVE_TIMES
     ap_hook_child_init(status_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 #endif
+    ap_hook_child_init(metrics_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_insert_filter(metrics_insert_filter, NULL, NULL, APR_HOOK_LAST);
+    ap_hook_log_transaction(metrics_log_transaction, NULL, NULL,
+                            APR_HOOK_MIDDLE);
+    ap_register_output_filter(metrics_ttfb_filter_name, metrics_ttfb_filter,
+                              NULL, AP_FTYPE_RESOURCE);
 }
 
 AP_DECLARE_MODULE(status) =
@@ -986,8 +1521,8 @@ AP_DECLARE_MODULE(status) =
     STANDARD20_MODULE_STUFF,
     NULL,                       /* dir config creater */
     NULL,                       /* dir merger --- default is to override */
-    NULL,                       /* server config */
+    create_status_server_config, /* server config */
     NULL,                       /* merge server config */
-    NULL,                       /* command table */
+    status_cmds,                /* command table */
     register_hooks              /* register_hooks */
 };
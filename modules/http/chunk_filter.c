@@ -85,6 +85,11 @@ apr_status_t ap_http_chunk_filter(ap_filter_t *f, apr_bucket_brigade *b)
             if (APR_BUCKET_IS_FLUSH(e)) {
                 flush = e;
                 if (e != APR_BRIGADE_LAST(b)) {
+                    if (!tmp) {
+                        tmp = ap_reuse_brigade_from_pool("ap_http_chunk_filter",
+                                                         f->r->pool,
+                                                         c->bucket_alloc);
+                    }
                     more = apr_brigade_split_ex(b, APR_BUCKET_NEXT(e), tmp);
                 }
                 break;
@@ -105,6 +110,11 @@ apr_status_t ap_http_chunk_filter(ap_filter_t *f, apr_bucket_brigade *b)
                      * block so we pass down what we have so far.
                      */
                     bytes += len;
+                    if (!tmp) {
+                        tmp = ap_reuse_brigade_from_pool("ap_http_chunk_filter",
+                                                         f->r->pool,
+                                                         c->bucket_alloc);
+                    }
                     more = apr_brigade_split_ex(b, APR_BUCKET_NEXT(e), tmp);
                     break;
                 }
@@ -284,6 +284,8 @@ conn_rec *h2_slave_create(conn_rec *master, apr_pool_t *parent,
     c->clogging_input_filters = 1;
     c->log                    = NULL;
     c->log_id                 = NULL;
+    /* The master's are on its pool, and used by its thread */
+    c->spare_brigades         = NULL;
     /* Simulate that we had already a request on this connection. */
     c->keepalives             = 1;
     /* We cannot install the master connection socket on the slaves, as
@@ -0,0 +1,237 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file log_binary_common.h
+ * @brief Binary access log records, shared by mod_log_config, rotatelogs
+ * and logdecode
+ *
+ * A binary log is a sequence of records, each one framed as
+ *
+ *   0xb1 length checksum body
+ *
+ * where length is a varint giving the length of the body, and checksum
+ * is the Adler-32 of the body, four bytes least significant first.
+ * Varints are unsigned LEB128: seven bits per byte, least significant
+ * first, the high bit set on all bytes but the last.
+ *
+ * Several processes write to the same log, and a piped log only keeps
+ * their writes of up to PIPE_BUF bytes whole, so a longer record can be
+ * interleaved with others.  Readers skip what is not a record with a
+ * good checksum, from the sync byte on, and go on with the next one.
+ *
+ * A schema record body describes a log format:
+ *
+ *   0x00 "HTBL" version id count field...
+ *
+ * where version is a byte, id (1 to LOG_BINARY_ID_MAX) and count are
+ * varints, and each field is a type byte followed by a varint length and
+ * that many bytes: the text of a constant, or the format item otherwise
+ * ("%h", "%{Referer}i", ...).
+ *
+ * An entry record body starts with the varint id of its schema, followed by
+ * one value per non constant field of the schema:
+ *
+ *   STRING  varint length + 1 and the bytes, or 0 for "-"
+ *   NUMBER  varint value + 1, or 0 for "-"
+ *   TIME    varint seconds since the epoch, then the offset from UTC in
+ *           minutes as a zigzag varint; a single 0 for "-"
+ *
+ * Writers send their schemas again from time to time, so that a reader
+ * starting anywhere in a stream, or a rotated file, gets to know them.
+ *
+ * @defgroup MOD_LOG_CONFIG_BINARY Binary access logs
+ * @ingroup  MOD_LOG_CONFIG
+ * @{
+ */
+
+#ifndef LOG_BINARY_COMMON_H
+#define LOG_BINARY_COMMON_H
+
+#include "apr.h"
+
+#define LOG_BINARY_MAGIC        "HTBL"
+#define LOG_BINARY_MAGIC_LEN    4
+#define LOG_BINARY_VERSION      1
+
+/* ids fit in two varint bytes */
+#define LOG_BINARY_ID_MAX       16383
+
+/* a varint is at most ten bytes long */
+#define LOG_BINARY_VARINT_MAX   10
+
+#define LOG_BINARY_SYNC         0xb1
+#define LOG_BINARY_CHECKSUM_LEN 4
+
+/* the bytes of a record before its body, at most */
+#define LOG_BINARY_FRAME_MAX    (1 + LOG_BINARY_VARINT_MAX \
+                                 + LOG_BINARY_CHECKSUM_LEN)
+
+#define LOG_BINARY_CONST        0
+#define LOG_BINARY_STRING       1
+#define LOG_BINARY_NUMBER       2
+#define LOG_BINARY_TIME         3
+
+/* seconds between two copies of a schema from the same process */
+#define LOG_BINARY_SCHEMA_INTERVAL 60
+
+static APR_INLINE unsigned char *log_binary_put_varint(unsigned char *d,
+                                                       apr_uint64_t v)
+{
+    while (v >= 0x80) {
+        *d++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *d++ = (unsigned char)v;
+    return d;
+}
+
+static APR_INLINE apr_size_t log_binary_varint_len(apr_uint64_t v)
+{
+    apr_size_t n = 1;
+
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+/* Read a varint from *s, before end.  Returns 0 if it is incomplete or
+ * too long, leaving *s unchanged.
+ */
+static APR_INLINE int log_binary_get_varint(const unsigned char **s,
+                                            const unsigned char *end,
+                                            apr_uint64_t *v)
+{
+    const unsigned char *p = *s;
+    apr_uint64_t n = 0;
+    int shift = 0;
+
+    while (p < end && shift < 7 * LOG_BINARY_VARINT_MAX) {
+        n |= (apr_uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            *v = n;
+            *s = p;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+/* The Adler-32 of len bytes at s */
+static APR_INLINE apr_uint32_t log_binary_checksum(const unsigned char *s,
+                                                   apr_size_t len)
+{
+    apr_uint32_t a = 1, b = 0;
+    apr_size_t n;
+
+    while (len) {
+        /* the most bytes before b can overflow */
+        n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += *s++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* Frame the body_len bytes of a record body, which must have
+ * LOG_BINARY_FRAME_MAX bytes of room before them.  Returns the start of
+ * the record, and its whole length in *len.
+ */
+static APR_INLINE unsigned char *log_binary_frame(unsigned char *body,
+                                                  apr_size_t body_len,
+                                                  apr_size_t *len)
+{
+    apr_uint32_t sum = log_binary_checksum(body, body_len);
+    unsigned char *rec = body - LOG_BINARY_CHECKSUM_LEN;
+
+    rec[0] = (unsigned char)sum;
+    rec[1] = (unsigned char)(sum >> 8);
+    rec[2] = (unsigned char)(sum >> 16);
+    rec[3] = (unsigned char)(sum >> 24);
+    rec -= log_binary_varint_len(body_len);
+    log_binary_put_varint(rec, body_len);
+    *--rec = LOG_BINARY_SYNC;
+
+    *len = body + body_len - rec;
+    return rec;
+}
+
+/* Find the next record from *s, before end, skipping anything which is
+ * not a record with a body of at most max bytes and a good checksum.
+ * Returns 1 with the record in *rec, its body in *body and *body_len,
+ * and *s past it.  Otherwise returns 0 with *s at the first byte which
+ * could start a record once more data is read, or at end if there is
+ * none, or if eof is set and no more data will come.
+ */
+static APR_INLINE int log_binary_next_record(const unsigned char **s,
+                                             const unsigned char *end,
+                                             apr_size_t max, int eof,
+                                             const unsigned char **rec,
+                                             const unsigned char **body,
+                                             apr_size_t *body_len)
+{
+    const unsigned char *p, *q;
+    apr_uint64_t len;
+    apr_uint32_t sum;
+
+    for (p = *s; p < end; ++p) {
+        if (*p != LOG_BINARY_SYNC) {
+            continue;
+        }
+        q = p + 1;
+        if (!log_binary_get_varint(&q, end, &len)) {
+            if (!eof && end - q < LOG_BINARY_VARINT_MAX) {
+                *s = p;
+                return 0;
+            }
+            continue;
+        }
+        if (len > max) {
+            continue;
+        }
+        if ((apr_uint64_t)(end - q) < LOG_BINARY_CHECKSUM_LEN + len) {
+            if (!eof) {
+                *s = p;
+                return 0;
+            }
+            continue;
+        }
+        sum = (apr_uint32_t)q[0] | (apr_uint32_t)q[1] << 8
+              | (apr_uint32_t)q[2] << 16 | (apr_uint32_t)q[3] << 24;
+        q += LOG_BINARY_CHECKSUM_LEN;
+        if (sum != log_binary_checksum(q, (apr_size_t)len)) {
+            continue;
+        }
+        *rec = p;
+        *body = q;
+        *body_len = (apr_size_t)len;
+        *s = q + len;
+        return 1;
+    }
+    *s = end;
+    return 0;
+}
+
+#endif /* LOG_BINARY_COMMON_H */
+/** @} */
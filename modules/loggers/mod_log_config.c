@@ -151,8 +151,14 @@
 #include "apr_hash.h"
 #include "apr_optional.h"
 #include "apr_anylock.h"
+#include "apr_atomic.h"
+#if APR_HAS_THREADS
+#include "apr_thread_proc.h"
+#include "apr_thread_cond.h"
+#endif
 
 #define APR_WANT_STRFUNC
+#define APR_WANT_IOVEC
 #include "apr_want.h"
 
 #include "ap_config.h"
@@ -165,6 +171,8 @@
 #include "util_time.h"
 #include "ap_mpm.h"
 #include "ap_provider.h"
+#include "mod_status.h"
+#include "log_binary_common.h"
 
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>
@@ -197,13 +205,28 @@ static void *ap_default_log_writer_init(apr_pool_t *p, server_rec *s,
                                         const char* name);
 static void *ap_buffered_log_writer_init(apr_pool_t *p, server_rec *s,
                                         const char* name);
+#if APR_HAS_THREADS
+static apr_status_t ap_async_log_writer(request_rec *r,
+                           void *handle,
+                           const char **strs,
+                           int *strl,
+                           int nelts,
+                           apr_size_t len);
+static void *ap_async_log_writer_init(apr_pool_t *p, server_rec *s,
+                                        const char* name);
+static void async_log_child_init(apr_pool_t *p, server_rec *s);
+#endif
 
 static ap_log_writer_init *ap_log_set_writer_init(ap_log_writer_init *handle);
 static ap_log_writer *ap_log_set_writer(ap_log_writer *handle);
 static ap_log_writer *log_writer = ap_default_log_writer;
 static ap_log_writer_init *log_writer_init = ap_default_log_writer_init;
-static int buffered_logs = 0; /* default unbuffered */
+#define BUFFERED_LOGS_OFF   0
+#define BUFFERED_LOGS_ON    1
+#define BUFFERED_LOGS_ASYNC 2
+static int buffered_logs = BUFFERED_LOGS_OFF; /* default unbuffered */
 static apr_array_header_t *all_buffered_logs = NULL;
+static apr_array_header_t *all_async_logs = NULL;
 
 /* POSIX.1 defines PIPE_BUF as the maximum number of bytes that is
  * guaranteed to be atomic when writing a pipe.  And PIPE_BUF >= 512
@@ -260,6 +283,24 @@ typedef struct {
     apr_anylock_t mutex;
 } buffered_log;
 
+/*
+ * The schema record of a format of binary logs, and its id.  The ids are
+ * allocated at config time, from a hash of the fields of the formats so
+ * that all the processes writing a log agree on them, even across
+ * restarts, taking the next free one when the hash of another format's
+ * fields gave the same.  The tables are read-only once the logs are
+ * open.
+ */
+typedef struct {
+    const char *schema;
+    apr_size_t schema_len;
+    unsigned int id;
+} binary_schema;
+
+static apr_hash_t *binary_schemas;      /* binary_schema by format */
+static apr_hash_t *binary_schema_ids;   /* id by fields */
+static apr_hash_t *binary_schema_used;  /* fields by id */
+
 typedef struct {
     const char *fname;
     const char *format_string;
@@ -270,6 +311,13 @@ typedef struct {
     ap_expr_info_t *condition_expr;
     /** place of definition or NULL if already checked */
     const ap_directive_t *directive;
+    /** encoding=binary, see log_binary_common.h */
+    int binary;
+    const binary_schema *schema;
+    apr_array_header_t *schema_format;
+    /** when this process is to send the schema again, in seconds since
+     *  the epoch (atomic) */
+    apr_uint32_t schema_next;
 } config_log_state;
 
 /*
@@ -291,8 +339,27 @@ typedef struct {
     int condition_sense;
     int want_orig;
     apr_array_header_t *conditions;
+    int step;               /* how render_log_items() outputs the item */
+    apr_size_t len;         /* length of a constant, bound of a fixed step */
+    const char *spec;       /* the text the item was parsed from */
 } log_format_item;
 
+/*
+ * Steps of render_log_items().  Constants are copied, and the items of
+ * bounded length which need no escaping are formatted straight into the
+ * output; the others call their handler.
+ */
+#define LOG_STEP_CALL           0
+#define LOG_STEP_CONST          1
+#define LOG_STEP_STATUS         2
+#define LOG_STEP_BYTES_CLF      3
+#define LOG_STEP_BYTES          4
+#define LOG_STEP_TIME_CLF       5
+#define LOG_STEP_DURATION_USEC  6
+
+/* "-9223372036854775808" */
+#define LOG_INT_SIZE 20
+
 /*
  * errorlog_provider_data holds pointer to provider and its handle
  * generated by provider initialization. It is used when logging using
@@ -322,6 +389,66 @@ typedef struct {
     void *log_writer;
 } default_log_writer;
 
+#if APR_HAS_THREADS
+/*
+ * With BufferedLogs Async, each log has a ring buffer per child which
+ * the request threads append formatted records to without taking a lock,
+ * and which a writer thread (one per child) drains with large writev()s.
+ *
+ * A request thread reserves the space of its record by advancing head
+ * with a CAS, copies the record after a 4 byte header, then sets the
+ * header to publish it.  A record never wraps: when it does not fit
+ * before the end of the ring, a padding record fills the rest.  The
+ * writer thread consumes the published records from tail, and once they
+ * are written zeroes all the bytes they used before advancing tail, so
+ * that wherever the header of a later record falls it starts as zero.
+ * Positions are free running 32 bit counters, the ring size being a
+ * power of two.
+ */
+#define ASYNC_LOG_COMMIT       0x40000000
+#define ASYNC_LOG_PAD          0x80000000
+#define ASYNC_LOG_LEN_MASK     0x3fffffff
+#define ASYNC_LOG_RECORD(len)  ((4 + (apr_uint32_t)(len) + 3) & ~3)
+#define ASYNC_LOG_MIN_SIZE     (64 * 1024)
+#define ASYNC_LOG_MAX_SIZE     (256 * 1024 * 1024)
+#define ASYNC_LOG_IOVECS       64
+#define ASYNC_LOG_INTERVAL     apr_time_from_msec(100)
+#define ASYNC_LOG_WAIT         apr_time_from_msec(10)
+
+#define ASYNC_LOG_OVERFLOW_BLOCK 0
+#define ASYNC_LOG_OVERFLOW_DROP  1
+
+typedef struct {
+    default_log_writer *writer;
+    const char *name;
+    server_rec *s;
+    int piped;
+    char *ring;                     /* allocated by each child */
+    apr_uint32_t size;
+    volatile apr_uint32_t head;     /* reserved by the request threads */
+    volatile apr_uint32_t tail;     /* consumed by the writer thread */
+    volatile apr_uint32_t dropped;
+    volatile apr_uint32_t blocked;
+    /* maintained by the writer thread */
+    apr_uint64_t records;
+    apr_uint64_t bytes;
+    apr_uint64_t writes;
+    apr_time_t last_sync;
+    int failing;
+} async_log;
+
+static apr_size_t async_log_size = 1024 * 1024;
+static int async_log_overflow = ASYNC_LOG_OVERFLOW_BLOCK;
+static apr_interval_time_t async_log_sync_interval = 0;
+
+static apr_thread_t *async_log_thread;
+static apr_thread_mutex_t *async_log_mutex;
+static apr_thread_cond_t *async_log_wakeup;   /* for the writer thread */
+static apr_thread_cond_t *async_log_space;    /* for blocked requests */
+static int async_log_waiters;
+static volatile apr_uint32_t async_log_stopping;
+#endif
+
 static char *pfmt(apr_pool_t *p, int i)
 {
     if (i <= 0) {
@@ -670,6 +797,55 @@ static apr_time_t get_request_end_time(request_rec *r)
 }
 
 
+/* Write the CLF time into buf, of DEFAULT_REQUEST_TIME_SIZE bytes, and
+ * return its length
+ */
+static apr_size_t clf_request_time(char *buf, apr_time_t request_time)
+{
+    /* This code uses the same technique as ap_explode_recent_localtime():
+     * optimistic caching with logic to detect and correct race conditions.
+     * See the comments in server/util_time.c for more information.
+     */
+    cached_request_time cached_time;
+    unsigned t_seconds = (unsigned)apr_time_sec(request_time);
+    unsigned i = t_seconds & TIME_CACHE_MASK;
+    apr_size_t len;
+
+    cached_time = request_time_cache[i];
+    if ((t_seconds != cached_time.t) ||
+        (t_seconds != cached_time.t_validate)) {
+
+        /* Invalid or old snapshot, so compute the proper time string
+         * and store it in the cache
+         */
+        apr_time_exp_t xt;
+        char sign;
+        int timz;
+
+        ap_explode_recent_localtime(&xt, request_time);
+        timz = xt.tm_gmtoff;
+        if (timz < 0) {
+            timz = -timz;
+            sign = '-';
+        }
+        else {
+            sign = '+';
+        }
+        cached_time.t = t_seconds;
+        apr_snprintf(cached_time.timestr, DEFAULT_REQUEST_TIME_SIZE,
+                     "[%02d/%s/%d:%02d:%02d:%02d %c%.2d%.2d]",
+                     xt.tm_mday, apr_month_snames[xt.tm_mon],
+                     xt.tm_year+1900, xt.tm_hour, xt.tm_min, xt.tm_sec,
+                     sign, timz / (60*60), (timz % (60*60)) / 60);
+        cached_time.t_validate = t_seconds;
+        request_time_cache[i] = cached_time;
+    }
+
+    len = strlen(cached_time.timestr);
+    memcpy(buf, cached_time.timestr, len + 1);
+    return len;
+}
+
 static const char *log_request_time(request_rec *r, char *a)
 {
     apr_time_exp_t xt;
@@ -765,43 +941,10 @@ static const char *log_request_time(request_rec *r, char *a)
         return log_request_time_custom(r, a, &xt);
     }
     else {                                   /* CLF format */
-        /* This code uses the same technique as ap_explode_recent_localtime():
-         * optimistic caching with logic to detect and correct race conditions.
-         * See the comments in server/util_time.c for more information.
-         */
-        cached_request_time* cached_time = apr_palloc(r->pool,
-                                                      sizeof(*cached_time));
-        unsigned t_seconds = (unsigned)apr_time_sec(request_time);
-        unsigned i = t_seconds & TIME_CACHE_MASK;
-        *cached_time = request_time_cache[i];
-        if ((t_seconds != cached_time->t) ||
-            (t_seconds != cached_time->t_validate)) {
-
-            /* Invalid or old snapshot, so compute the proper time string
-             * and store it in the cache
-             */
-            char sign;
-            int timz;
-
-            ap_explode_recent_localtime(&xt, request_time);
-            timz = xt.tm_gmtoff;
-            if (timz < 0) {
-                timz = -timz;
-                sign = '-';
-            }
-            else {
-                sign = '+';
-            }
-            cached_time->t = t_seconds;
-            apr_snprintf(cached_time->timestr, DEFAULT_REQUEST_TIME_SIZE,
-                         "[%02d/%s/%d:%02d:%02d:%02d %c%.2d%.2d]",
-                         xt.tm_mday, apr_month_snames[xt.tm_mon],
-                         xt.tm_year+1900, xt.tm_hour, xt.tm_min, xt.tm_sec,
-                         sign, timz / (60*60), (timz % (60*60)) / 60);
-            cached_time->t_validate = t_seconds;
-            request_time_cache[i] = *cached_time;
-        }
-        return cached_time->timestr;
+        char *buf = apr_palloc(r->pool, DEFAULT_REQUEST_TIME_SIZE);
+
+        clf_request_time(buf, request_time);
+        return buf;
     }
 }
 
@@ -1079,20 +1222,64 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
     return "Ran off end of LogFormat parsing args to some directive";
 }
 
+/* Choose how render_log_items() outputs each item */
+static void compile_log_items(apr_array_header_t *format)
+{
+    log_format_item *items = (log_format_item *) format->elts;
+    int i;
+
+    for (i = 0; i < format->nelts; ++i) {
+        log_format_item *it = &items[i];
+
+        it->step = LOG_STEP_CALL;
+        it->len = LOG_INT_SIZE;
+        if (it->func == constant_item) {
+            it->step = LOG_STEP_CONST;
+            it->len = strlen(it->arg);
+        }
+        else if (it->func == log_status) {
+            it->step = LOG_STEP_STATUS;
+        }
+        else if (it->func == clf_log_bytes_sent) {
+            it->step = LOG_STEP_BYTES_CLF;
+        }
+        else if (it->func == log_bytes_sent) {
+            it->step = LOG_STEP_BYTES;
+        }
+        else if (it->func == log_request_duration_microseconds) {
+            it->step = LOG_STEP_DURATION_USEC;
+        }
+        else if (it->func == log_request_time
+                 && (!*it->arg || !strcmp(it->arg, "begin"))) {
+            it->step = LOG_STEP_TIME_CLF;
+            it->len = DEFAULT_REQUEST_TIME_SIZE;
+        }
+    }
+}
+
 static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const char **err)
 {
     apr_array_header_t *a = apr_array_make(p, 30, sizeof(log_format_item));
+    log_format_item *it;
+    const char *start;
     char *res;
 
     while (*s) {
-        if ((res = parse_log_item(p, (log_format_item *) apr_array_push(a), &s))) {
+        it = (log_format_item *) apr_array_push(a);
+        start = s;
+        if ((res = parse_log_item(p, it, &s))) {
             *err = res;
             return NULL;
         }
+        it->spec = apr_pstrmemdup(p, start, s - start);
     }
 
     s = APR_EOL_STR;
-    parse_log_item(p, (log_format_item *) apr_array_push(a), &s);
+    it = (log_format_item *) apr_array_push(a);
+    parse_log_item(p, it, &s);
+    it->spec = APR_EOL_STR;
+
+    compile_log_items(a);
     return a;
 }
 
@@ -1101,13 +1288,8 @@ static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const
  * Actually logging.
  */
 
-static const char *process_item(request_rec *r, request_rec *orig,
-                          log_format_item *item)
+static int item_wanted(request_rec *r, log_format_item *item)
 {
-    const char *cp;
-
-    /* First, see if we need to process this thing at all... */
-
     if (item->conditions && item->conditions->nelts != 0) {
         int i;
         int *conds = (int *) item->conditions->elts;
@@ -1122,16 +1304,327 @@ static const char *process_item(request_rec *r, request_rec *orig,
 
         if ((item->condition_sense && in_list)
             || (!item->condition_sense && !in_list)) {
-            return "-";
+            return 0;
         }
     }
 
+    return 1;
+}
+
+static const char *process_item(request_rec *r, request_rec *orig,
+                          log_format_item *item)
+{
+    const char *cp;
+
+    /* First, see if we need to process this thing at all... */
+
+    if (!item_wanted(r, item)) {
+        return "-";
+    }
+
     /* We do.  Do it... */
 
     cp = (*item->func) (item->want_orig ? orig : r, item->arg);
     return cp ? cp : "-";
 }
 
+static char *render_int(char *d, apr_int64_t n)
+{
+    char buf[LOG_INT_SIZE];
+    char *s = buf + sizeof(buf);
+    apr_uint64_t u = (n < 0) ? 0 - (apr_uint64_t)n : (apr_uint64_t)n;
+
+    do {
+        *--s = '0' + (char)(u % 10);
+        u /= 10;
+    } while (u);
+    if (n < 0) {
+        *--s = '-';
+    }
+
+    memcpy(d, s, buf + sizeof(buf) - s);
+    return d + (buf + sizeof(buf) - s);
+}
+
+/*
+ * Render the log line in one buffer: the items which call their handler
+ * are processed first, so that the length of the line is bounded before
+ * it is written.
+ */
+static char *render_log_items(request_rec *r, request_rec *orig,
+                              apr_array_header_t *format, apr_size_t *len)
+{
+    log_format_item *items = (log_format_item *) format->elts;
+    const char **strs;
+    apr_size_t *strl, bound = 0;
+    char *buf, *d;
+    int i;
+
+    strs = apr_palloc(r->pool, sizeof(char *) * format->nelts);
+    strl = apr_palloc(r->pool, sizeof(apr_size_t) * format->nelts);
+
+    for (i = 0; i < format->nelts; ++i) {
+        log_format_item *item = &items[i];
+
+        if (item->step == LOG_STEP_CONST) {
+            strs[i] = item->arg;
+            strl[i] = item->len;
+        }
+        else if (item->step == LOG_STEP_CALL || !item_wanted(r, item)) {
+            strs[i] = process_item(r, orig, item);
+            strl[i] = strlen(strs[i]);
+        }
+        else {
+            strs[i] = NULL;
+            strl[i] = item->len;
+        }
+        bound += strl[i];
+    }
+
+    d = buf = apr_palloc(r->pool, bound + 1);
+    for (i = 0; i < format->nelts; ++i) {
+        log_format_item *item = &items[i];
+        request_rec *rr = item->want_orig ? orig : r;
+
+        if (strs[i]) {
+            memcpy(d, strs[i], strl[i]);
+            d += strl[i];
+            continue;
+        }
+
+        switch (item->step) {
+        case LOG_STEP_STATUS:
+            if (rr->status <= 0) {
+                *d++ = '-';
+            }
+            else {
+                d = render_int(d, rr->status);
+            }
+            break;
+        case LOG_STEP_BYTES_CLF:
+        case LOG_STEP_BYTES:
+            if (!rr->sent_bodyct || !rr->bytes_sent) {
+                *d++ = (item->step == LOG_STEP_BYTES) ? '0' : '-';
+            }
+            else {
+                d = render_int(d, rr->bytes_sent);
+            }
+            break;
+        case LOG_STEP_TIME_CLF:
+            d += clf_request_time(d, rr->request_time);
+            break;
+        case LOG_STEP_DURATION_USEC:
+            d = render_int(d, get_request_end_time(rr) - rr->request_time);
+            break;
+        }
+    }
+    *d = '\0';
+
+    *len = d - buf;
+    return buf;
+}
+
+/*
+ * Binary logs: the record formats are described in log_binary_common.h
+ */
+static int binary_field_type(const log_format_item *item)
+{
+    switch (item->step) {
+    case LOG_STEP_CONST:
+        return LOG_BINARY_CONST;
+    case LOG_STEP_STATUS:
+    case LOG_STEP_BYTES_CLF:
+    case LOG_STEP_BYTES:
+    case LOG_STEP_DURATION_USEC:
+        return LOG_BINARY_NUMBER;
+    case LOG_STEP_TIME_CLF:
+        return LOG_BINARY_TIME;
+    }
+    return LOG_BINARY_STRING;
+}
+
+/* Build the schema record of a format, framed, and allocate its id, at
+ * config time; NULL if there is no id left
+ */
+static const binary_schema *binary_log_schema(apr_pool_t *p,
+                                              apr_array_header_t *format)
+{
+    log_format_item *items = (log_format_item *) format->elts;
+    binary_schema *bs;
+    unsigned char *fields, *buf, *body, *d;
+    apr_size_t size = 0, body_len;
+    apr_ssize_t fields_len;
+    unsigned int id, *idp;
+    int i;
+
+    bs = apr_hash_get(binary_schemas, &format, sizeof(format));
+    if (bs) {
+        return bs;
+    }
+
+    for (i = 0; i < format->nelts; ++i) {
+        size += 1 + LOG_BINARY_VARINT_MAX + strlen(items[i].spec);
+    }
+    d = fields = apr_palloc(p, size);
+    for (i = 0; i < format->nelts; ++i) {
+        apr_size_t l = strlen(items[i].spec);
+
+        *d++ = (unsigned char)binary_field_type(&items[i]);
+        d = log_binary_put_varint(d, l);
+        memcpy(d, items[i].spec, l);
+        d += l;
+    }
+    fields_len = d - fields;
+
+    idp = apr_hash_get(binary_schema_ids, fields, fields_len);
+    if (!idp) {
+        unsigned int n = 0;
+
+        id = apr_hashfunc_default((const char *)fields, &fields_len)
+             % LOG_BINARY_ID_MAX + 1;
+        while (apr_hash_get(binary_schema_used, &id, sizeof(id))) {
+            if (++n == LOG_BINARY_ID_MAX) {
+                ap_log_perror(APLOG_MARK, APLOG_ERR, 0, p, APLOGNO(03414)
+                              "too many formats of binary logs");
+                return NULL;
+            }
+            id = id % LOG_BINARY_ID_MAX + 1;
+        }
+        idp = apr_palloc(p, sizeof(*idp));
+        *idp = id;
+        apr_hash_set(binary_schema_ids, fields, fields_len, idp);
+        apr_hash_set(binary_schema_used, idp, sizeof(*idp), fields);
+    }
+    id = *idp;
+
+    buf = apr_palloc(p, LOG_BINARY_FRAME_MAX + 1 + LOG_BINARY_MAGIC_LEN + 1
+                        + 2 * LOG_BINARY_VARINT_MAX + fields_len);
+    d = body = buf + LOG_BINARY_FRAME_MAX;
+    *d++ = 0;
+    memcpy(d, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LEN);
+    d += LOG_BINARY_MAGIC_LEN;
+    *d++ = LOG_BINARY_VERSION;
+    d = log_binary_put_varint(d, id);
+    d = log_binary_put_varint(d, format->nelts);
+    memcpy(d, fields, fields_len);
+    d += fields_len;
+
+    body_len = d - body;
+    bs = apr_palloc(p, sizeof(*bs));
+    bs->id = id;
+    bs->schema = (const char *)log_binary_frame(body, body_len,
+                                                &bs->schema_len);
+    apr_hash_set(binary_schemas, apr_pmemdup(p, &format, sizeof(format)),
+                 sizeof(format), bs);
+    return bs;
+}
+
+/*
+ * Render the entry record of a request: like render_log_items(), the
+ * handlers run first to bound its length.  Constants are left to the
+ * schema, and the numbers and the CLF time are not formatted at all.
+ */
+static char *render_log_binary(request_rec *r, request_rec *orig,
+                               apr_array_header_t *format, unsigned int id,
+                               apr_size_t *len)
+{
+    log_format_item *items = (log_format_item *) format->elts;
+    const char **strs;
+    apr_size_t *strl, bound = LOG_BINARY_VARINT_MAX, body_len;
+    unsigned char *buf, *body, *d;
+    int i;
+
+    strs = apr_palloc(r->pool, sizeof(char *) * format->nelts);
+    strl = apr_palloc(r->pool, sizeof(apr_size_t) * format->nelts);
+
+    for (i = 0; i < format->nelts; ++i) {
+        log_format_item *item = &items[i];
+        const char *cp;
+
+        /* strs[i] is the string of a handler, or "-" for a fixed step
+         * which is not wanted
+         */
+        strs[i] = NULL;
+        strl[i] = 0;
+        if (item->step == LOG_STEP_CONST) {
+            continue;
+        }
+        if (!item_wanted(r, item)) {
+            if (item->step != LOG_STEP_CALL) {
+                strs[i] = "-";
+            }
+        }
+        else if (item->step == LOG_STEP_CALL) {
+            cp = (*item->func) (item->want_orig ? orig : r, item->arg);
+            if (cp && strcmp(cp, "-")) {
+                strs[i] = cp;
+                strl[i] = strlen(cp);
+            }
+        }
+        bound += 2 * LOG_BINARY_VARINT_MAX + strl[i];
+    }
+
+    buf = apr_palloc(r->pool, LOG_BINARY_FRAME_MAX + bound);
+    d = body = buf + LOG_BINARY_FRAME_MAX;
+    d = log_binary_put_varint(d, id);
+    for (i = 0; i < format->nelts; ++i) {
+        log_format_item *item = &items[i];
+        request_rec *rr = item->want_orig ? orig : r;
+
+        if (item->step == LOG_STEP_CONST) {
+            continue;
+        }
+        if (item->step == LOG_STEP_CALL) {
+            if (strs[i]) {
+                d = log_binary_put_varint(d, strl[i] + 1);
+                memcpy(d, strs[i], strl[i]);
+                d += strl[i];
+            }
+            else {
+                *d++ = 0;
+            }
+            continue;
+        }
+        if (strs[i]) {
+            *d++ = 0;
+            continue;
+        }
+
+        switch (item->step) {
+        case LOG_STEP_STATUS:
+            d = log_binary_put_varint(d, rr->status > 0 ? rr->status + 1 : 0);
+            break;
+        case LOG_STEP_BYTES_CLF:
+        case LOG_STEP_BYTES:
+            if (!rr->sent_bodyct || !rr->bytes_sent) {
+                *d++ = (item->step == LOG_STEP_BYTES) ? 1 : 0;
+            }
+            else {
+                d = log_binary_put_varint(d, (apr_uint64_t)rr->bytes_sent + 1);
+            }
+            break;
+        case LOG_STEP_TIME_CLF: {
+            apr_time_exp_t xt;
+            int minutes;
+
+            ap_explode_recent_localtime(&xt, rr->request_time);
+            minutes = xt.tm_gmtoff / 60;
+            d = log_binary_put_varint(d, apr_time_sec(rr->request_time) + 1);
+            d = log_binary_put_varint(d, minutes < 0 ? -2 * minutes - 1
+                                                     : 2 * minutes);
+            break;
+        }
+        case LOG_STEP_DURATION_USEC:
+            d = log_binary_put_varint(d, get_request_end_time(rr)
+                                         - rr->request_time + 1);
+            break;
+        }
+    }
+
+    body_len = d - body;
+    return (char *)log_binary_frame(body, body_len, len);
+}
+
 static void flush_log(buffered_log *buf)
 {
     if (buf->outcnt && buf->handle != NULL) {
@@ -1145,12 +1638,11 @@ static void flush_log(buffered_log *buf)
 static int config_log_transaction(request_rec *r, config_log_state *cls,
                                   apr_array_header_t *default_format)
 {
-    log_format_item *items;
-    const char **strs;
-    int *strl;
+    const char *strs[2];
+    int strl[2];
+    int nelts = 0;
     request_rec *orig;
-    int i;
-    apr_size_t len = 0;
+    apr_size_t len;
     apr_array_header_t *format;
     char *envar;
     apr_status_t rv;
@@ -1188,10 +1680,6 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
 
     format = cls->format ? cls->format : default_format;
 
-    strs = apr_palloc(r->pool, sizeof(char *) * (format->nelts));
-    strl = apr_palloc(r->pool, sizeof(int) * (format->nelts));
-    items = (log_format_item *) format->elts;
-
     orig = r;
     while (orig->prev) {
         orig = orig->prev;
@@ -1200,19 +1688,53 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
         r = r->next;
     }
 
-    for (i = 0; i < format->nelts; ++i) {
-        strs[i] = process_item(r, orig, &items[i]);
-    }
+    if (cls->binary) {
+        const binary_schema *bs = cls->schema;
+        int send_schema = 0;
 
-    for (i = 0; i < format->nelts; ++i) {
-        len += strl[i] = strlen(strs[i]);
+        if (format != cls->schema_format) {
+            /* a log shared with a virtual host with another default
+             * format, which the schema of the log is not for
+             */
+            bs = apr_hash_get(binary_schemas, &format, sizeof(format));
+            if (!bs) {
+                return DECLINED;
+            }
+            send_schema = 1;
+        }
+        else {
+            apr_uint32_t now = (apr_uint32_t)apr_time_sec(r->request_time);
+            apr_uint32_t next = apr_atomic_read32(&cls->schema_next);
+
+            /* one thread sends it */
+            if (now >= next
+                && apr_atomic_cas32(&cls->schema_next,
+                                    now + LOG_BINARY_SCHEMA_INTERVAL,
+                                    next) == next) {
+                send_schema = 1;
+            }
+        }
+        if (send_schema) {
+            strs[nelts] = bs->schema;
+            strl[nelts++] = (int)bs->schema_len;
+        }
+        strs[nelts] = render_log_binary(r, orig, format, bs->id, &len);
+        strl[nelts++] = (int)len;
+        if (send_schema) {
+            len += bs->schema_len;
+        }
     }
+    else {
+        strs[nelts] = render_log_items(r, orig, format, &len);
+        strl[nelts++] = (int)len;
+    }
+
     if (!log_writer) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00645)
                 "log writer isn't correctly setup");
         return HTTP_INTERNAL_SERVER_ERROR;
     }
-    rv = log_writer(r, cls->log_writer, strs, strl, format->nelts, len);
+    rv = log_writer(r, cls->log_writer, strs, strl, nelts, len);
     if (rv != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00646)
                       "Error writing to %s", cls->fname);
@@ -1340,6 +1862,7 @@ static const char *add_custom_log(cmd_parms *cmd, void *dummy, const char *fn,
     cls = (config_log_state *) apr_array_push(mls->config_logs);
     cls->condition_var = NULL;
     cls->condition_expr = NULL;
+    cls->binary = 0;
     if (envclause != NULL) {
         if (strncasecmp(envclause, "env=", 4) == 0) {
             if ((envclause[4] == '\0')
@@ -1404,38 +1927,162 @@ static const char *add_global_log(cmd_parms *cmd, void *dummy, const char *fn,
     return ret;
 }
 
+/* CustomLog and GlobalLog: a file name, a format, and in any order an
+ * optional "env=" or "expr=" clause and an "encoding=" clause
+ */
+static const char *add_log_argv(cmd_parms *cmd, void *dummy, int argc,
+                                char *const argv[])
+{
+    multi_log_state *mls = ap_get_module_config(cmd->server->module_config,
+                                                &log_config_module);
+    const char *envclause = NULL;
+    const char *err;
+    int binary = 0;
+    int i;
+
+    if (argc < 2 || argc > 4) {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name, " takes a file name, "
+                           "a format and optional \"env=\", \"expr=\" and "
+                           "\"encoding=\" clauses", NULL);
+    }
+    for (i = 2; i < argc; ++i) {
+        if (strncasecmp(argv[i], "encoding=", 9) == 0) {
+            if (strcasecmp(argv[i] + 9, "binary") == 0) {
+                binary = 1;
+            }
+            else if (strcasecmp(argv[i] + 9, "text") != 0) {
+                return "encoding must be text or binary";
+            }
+        }
+        else if (envclause == NULL) {
+            envclause = argv[i];
+        }
+        else {
+            return "error in condition clause";
+        }
+    }
+
+    if (cmd->info) {
+        err = add_global_log(cmd, dummy, argv[0], argv[1], envclause);
+    }
+    else {
+        err = add_custom_log(cmd, dummy, argv[0], argv[1], envclause);
+    }
+    if (err == NULL) {
+        config_log_state *clsarray = (config_log_state *) mls->config_logs->elts;
+
+        clsarray[mls->config_logs->nelts - 1].binary = binary;
+    }
+
+    return err;
+}
+
 static const char *set_transfer_log(cmd_parms *cmd, void *dummy,
                                     const char *fn)
 {
     return add_custom_log(cmd, dummy, fn, NULL, NULL);
 }
 
-static const char *set_buffered_logs_on(cmd_parms *parms, void *dummy, int flag)
+static const char *set_buffered_logs(cmd_parms *parms, void *dummy,
+                                     const char *arg)
 {
-    buffered_logs = flag;
-    if (buffered_logs) {
+    if (!strcasecmp(arg, "On")) {
+        buffered_logs = BUFFERED_LOGS_ON;
         ap_log_set_writer_init(ap_buffered_log_writer_init);
         ap_log_set_writer(ap_buffered_log_writer);
     }
-    else {
+    else if (!strcasecmp(arg, "Off")) {
+        buffered_logs = BUFFERED_LOGS_OFF;
         ap_log_set_writer_init(ap_default_log_writer_init);
         ap_log_set_writer(ap_default_log_writer);
     }
+    else if (!strcasecmp(arg, "Async")) {
+#if APR_HAS_THREADS
+        buffered_logs = BUFFERED_LOGS_ASYNC;
+        ap_log_set_writer_init(ap_async_log_writer_init);
+        ap_log_set_writer(ap_async_log_writer);
+#else
+        return "BufferedLogs Async is not supported without threads";
+#endif
+    }
+    else {
+        return "BufferedLogs must be On, Off or Async";
+    }
+    return NULL;
+}
+
+#if APR_HAS_THREADS
+static const char *set_buffered_logs_size(cmd_parms *parms, void *dummy,
+                                          const char *arg)
+{
+    apr_off_t size;
+    apr_size_t ring;
+
+    if (apr_strtoff(&size, arg, NULL, 10) != APR_SUCCESS
+        || size < ASYNC_LOG_MIN_SIZE || size > ASYNC_LOG_MAX_SIZE) {
+        return apr_psprintf(parms->pool, "BufferedLogsSize must be between "
+                            "%d and %d bytes", ASYNC_LOG_MIN_SIZE,
+                            ASYNC_LOG_MAX_SIZE);
+    }
+
+    /* the ring's size is a power of two */
+    for (ring = ASYNC_LOG_MIN_SIZE; ring < (apr_size_t)size; ring <<= 1)
+        ;
+    async_log_size = ring;
     return NULL;
 }
+
+static const char *set_buffered_logs_overflow(cmd_parms *parms, void *dummy,
+                                              const char *arg)
+{
+    if (!strcasecmp(arg, "Block")) {
+        async_log_overflow = ASYNC_LOG_OVERFLOW_BLOCK;
+    }
+    else if (!strcasecmp(arg, "Drop")) {
+        async_log_overflow = ASYNC_LOG_OVERFLOW_DROP;
+    }
+    else {
+        return "BufferedLogsOverflow must be Block or Drop";
+    }
+    return NULL;
+}
+
+static const char *set_buffered_logs_sync(cmd_parms *parms, void *dummy,
+                                          const char *arg)
+{
+    int secs = atoi(arg);
+
+    if (secs < 0) {
+        return "BufferedLogsSyncInterval must be a number of seconds";
+    }
+    async_log_sync_interval = apr_time_from_sec(secs);
+    return NULL;
+}
+#endif
 static const command_rec config_log_cmds[] =
 {
-AP_INIT_TAKE23("CustomLog", add_custom_log, NULL, RSRC_CONF,
+AP_INIT_TAKE_ARGV("CustomLog", add_log_argv, NULL, RSRC_CONF,
      "a file name, a custom log format string or format name, "
-     "and an optional \"env=\" or \"expr=\" clause (see docs)"),
-AP_INIT_TAKE23("GlobalLog", add_global_log, NULL, RSRC_CONF,
+     "an optional \"env=\" or \"expr=\" clause and an optional "
+     "\"encoding=text|binary\" clause (see docs)"),
+AP_INIT_TAKE_ARGV("GlobalLog", add_log_argv, (void *)1, RSRC_CONF,
      "Same as CustomLog, but forces virtualhosts to inherit the log"),
 AP_INIT_TAKE1("TransferLog", set_transfer_log, NULL, RSRC_CONF,
      "the filename of the access log"),
 AP_INIT_TAKE12("LogFormat", log_format, NULL, RSRC_CONF,
      "a log format string (see docs) and an optional format name"),
-AP_INIT_FLAG("BufferedLogs", set_buffered_logs_on, NULL, RSRC_CONF,
-                 "Enable Buffered Logging (experimental)"),
+AP_INIT_TAKE1("BufferedLogs", set_buffered_logs, NULL, RSRC_CONF,
+     "On, Off or Async, to enable Buffered Logging (experimental)"),
+#if APR_HAS_THREADS
+AP_INIT_TAKE1("BufferedLogsSize", set_buffered_logs_size, NULL, RSRC_CONF,
+     "the size in bytes of each log's buffer, with BufferedLogs Async"),
+AP_INIT_TAKE1("BufferedLogsOverflow", set_buffered_logs_overflow, NULL,
+     RSRC_CONF, "Block or Drop, what to do with a log record when its "
+     "buffer is full, with BufferedLogs Async"),
+AP_INIT_TAKE1("BufferedLogsSyncInterval", set_buffered_logs_sync, NULL,
+     RSRC_CONF, "the interval in seconds at which logs are synced to disk, "
+     "with BufferedLogs Async, or 0 for never"),
+#endif
     {NULL}
 };
 
@@ -1455,6 +2102,15 @@ static config_log_state *open_config_log(server_rec *s, apr_pool_t *p,
     if (cls->log_writer == NULL)
         return NULL;
 
+    if (cls->binary) {
+        cls->schema_format = cls->format ? cls->format : default_format;
+        cls->schema = binary_log_schema(p, cls->schema_format);
+        if (!cls->schema) {
+            return NULL;
+        }
+        cls->schema_next = 0;
+    }
+
     return cls;
 }
 
@@ -1515,6 +2171,21 @@ static int open_multi_logs(server_rec *s, apr_pool_t *p)
         }
     }
 
+    if (mls->server_config_logs) {
+        /* The binary logs of the main server written with this server's
+         * default format need its schema too
+         */
+        clsarray = (config_log_state *) mls->server_config_logs->elts;
+        for (i = 0; i < mls->server_config_logs->nelts; ++i) {
+            config_log_state *cls = &clsarray[i];
+
+            if (cls->binary && cls->log_writer && !cls->format
+                && !binary_log_schema(p, mls->default_format)) {
+                return DONE;
+            }
+        }
+    }
+
     return OK;
 }
 
@@ -1528,7 +2199,7 @@ static apr_status_t flush_all_logs(void *data)
     buffered_log *buf;
     int i;
 
-    if (!buffered_logs)
+    if (buffered_logs != BUFFERED_LOGS_ON)
         return APR_SUCCESS;
 
     for (; s; s = s->next) {
@@ -1557,9 +2228,14 @@ static int init_config_log(apr_pool_t *pc, apr_pool_t *p, apr_pool_t *pt, server
     int res;
 
     /* First init the buffered logs array, which is needed when opening the logs. */
-    if (buffered_logs) {
+    if (buffered_logs == BUFFERED_LOGS_ON) {
         all_buffered_logs = apr_array_make(p, 5, sizeof(buffered_log *));
     }
+#if APR_HAS_THREADS
+    else if (buffered_logs == BUFFERED_LOGS_ASYNC) {
+        all_async_logs = apr_array_make(p, 5, sizeof(async_log *));
+    }
+#endif
 
     /* Next, do "physical" server, which gets default log fd and format
      * for the virtual servers, if they don't override...
@@ -1581,8 +2257,14 @@ static void init_child(apr_pool_t *p, server_rec *s)
 
     ap_mpm_query(AP_MPMQ_MAX_THREADS, &mpm_threads);
 
+#if APR_HAS_THREADS
+    if (buffered_logs == BUFFERED_LOGS_ASYNC) {
+        async_log_child_init(p, s);
+    }
+#endif
+
     /* Now register the last buffer flush with the cleanup engine */
-    if (buffered_logs) {
+    if (buffered_logs == BUFFERED_LOGS_ON) {
         int i;
         buffered_log **array = (buffered_log **)all_buffered_logs->elts;
 
@@ -1656,13 +2338,18 @@ static apr_status_t ap_default_log_writer( request_rec *r,
 
     /*
      * We do this memcpy dance because write() is atomic for len < PIPE_BUF,
-     * while writev() need not be.
+     * while writev() need not be.  Rendered lines come in one piece.
      */
-    str = apr_palloc(r->pool, len + 1);
+    if (nelts == 1) {
+        str = (char *)strs[0];
+    }
+    else {
+        str = apr_palloc(r->pool, len + 1);
 
-    for (i = 0, s = str; i < nelts; ++i) {
-        memcpy(s, strs[i], strl[i]);
-        s += strl[i];
+        for (i = 0, s = str; i < nelts; ++i) {
+            memcpy(s, strs[i], strl[i]);
+            s += strl[i];
+        }
     }
 
     if (log_writer->type == LOG_WRITER_FD) {
@@ -1826,6 +2513,335 @@ static apr_status_t ap_buffered_log_writer(request_rec *r,
     return rv;
 }
 
+#if APR_HAS_THREADS
+static void *ap_async_log_writer_init(apr_pool_t *p, server_rec *s,
+                                      const char* name)
+{
+    async_log *log;
+    default_log_writer *writer;
+
+    writer = ap_default_log_writer_init(p, s, name);
+    if (!writer) {
+        return NULL;
+    }
+
+    log = apr_pcalloc(p, sizeof(async_log));
+    log->writer = writer;
+    log->name = name;
+    log->s = s;
+    log->piped = (*name == '|');
+
+    /* Providers are written to by the request threads, as they need the
+     * request to log
+     */
+    if (writer->type == LOG_WRITER_FD) {
+        *(async_log **)apr_array_push(all_async_logs) = log;
+    }
+    return log;
+}
+
+static void async_log_wait(async_log *log)
+{
+    apr_atomic_inc32(&log->blocked);
+
+    apr_thread_mutex_lock(async_log_mutex);
+    async_log_waiters++;
+    apr_thread_cond_signal(async_log_wakeup);
+    apr_thread_cond_timedwait(async_log_space, async_log_mutex,
+                              ASYNC_LOG_WAIT);
+    async_log_waiters--;
+    apr_thread_mutex_unlock(async_log_mutex);
+}
+
+static apr_status_t ap_async_log_writer(request_rec *r,
+                                        void *handle,
+                                        const char **strs,
+                                        int *strl,
+                                        int nelts,
+                                        apr_size_t len)
+{
+    async_log *log = handle;
+    apr_uint32_t head, tail, off, pad, need, used;
+    apr_uint32_t *hdr;
+    char *s;
+    int i;
+
+    /* Before the child's writer thread runs, for providers and for
+     * records which would hog the ring, write synchronously.
+     */
+    if (!log->ring || len > log->size / 4) {
+        return ap_default_log_writer(r, log->writer, strs, strl, nelts, len);
+    }
+
+    need = ASYNC_LOG_RECORD(len);
+    for (;;) {
+        head = apr_atomic_read32(&log->head);
+        tail = apr_atomic_read32(&log->tail);
+        off = head & (log->size - 1);
+        pad = (off + need > log->size) ? log->size - off : 0;
+        used = head - tail;
+        if (used + pad + need <= log->size) {
+            if (apr_atomic_cas32(&log->head, head + pad + need,
+                                 head) == head) {
+                break;
+            }
+            continue;
+        }
+        if (async_log_overflow == ASYNC_LOG_OVERFLOW_DROP) {
+            apr_atomic_inc32(&log->dropped);
+            return APR_SUCCESS;
+        }
+        async_log_wait(log);
+    }
+
+    if (pad) {
+        hdr = (apr_uint32_t *)(log->ring + off);
+        apr_atomic_cas32(hdr, ASYNC_LOG_COMMIT | ASYNC_LOG_PAD | (pad - 4), 0);
+        off = 0;
+    }
+    hdr = (apr_uint32_t *)(log->ring + off);
+    for (i = 0, s = (char *)(hdr + 1); i < nelts; ++i) {
+        memcpy(s, strs[i], strl[i]);
+        s += strl[i];
+    }
+    /* publish, the CAS orders the copy before the header */
+    apr_atomic_cas32(hdr, ASYNC_LOG_COMMIT | (apr_uint32_t)len, 0);
+
+    /* wake the writer thread early when the ring gets half full */
+    used += pad + need;
+    if (used >= log->size / 2 && used - pad - need < log->size / 2) {
+        apr_thread_cond_signal(async_log_wakeup);
+    }
+
+    return APR_SUCCESS;
+}
+
+static void async_log_write(async_log *log, struct iovec *vec, int nvec,
+                            apr_size_t len)
+{
+    apr_status_t rv;
+
+    rv = apr_file_writev_full(log->writer->log_writer, vec, nvec, NULL);
+    log->writes++;
+    if (rv != APR_SUCCESS) {
+        /* once per run of failures */
+        if (!log->failing) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, log->s, APLOGNO(03399)
+                         "Error writing to %s", log->name);
+        }
+        log->failing = 1;
+        return;
+    }
+    log->failing = 0;
+    log->bytes += len;
+}
+
+/* Zero the bytes of the ring from start to end, which may wrap */
+static void async_log_clear(async_log *log, apr_uint32_t start,
+                            apr_uint32_t end)
+{
+    apr_uint32_t off = start & (log->size - 1);
+    apr_uint32_t len = end - start;
+
+    if (off + len > log->size) {
+        memset(log->ring + off, 0, log->size - off);
+        len -= log->size - off;
+        off = 0;
+    }
+    memset(log->ring + off, 0, len);
+}
+
+static apr_size_t async_log_drain(async_log *log)
+{
+    struct iovec vec[ASYNC_LOG_IOVECS];
+    apr_uint32_t start, tail;
+    apr_size_t len = 0, total = 0;
+    int n = 0;
+
+    start = tail = apr_atomic_read32(&log->tail);
+    while (tail - start < log->size) {
+        apr_uint32_t off = tail & (log->size - 1);
+        apr_uint32_t *hdr = (apr_uint32_t *)(log->ring + off);
+        /* the CAS orders the read of the header before the record's */
+        apr_uint32_t v = apr_atomic_cas32(hdr, 0, 0);
+        apr_uint32_t rlen = v & ASYNC_LOG_LEN_MASK;
+
+        /* not published yet; anything but a whole record in the ring
+         * can't come from a request thread
+         */
+        if (!(v & ASYNC_LOG_COMMIT)
+            || ASYNC_LOG_RECORD(rlen) > log->size - off) {
+            break;
+        }
+        if (!(v & ASYNC_LOG_PAD)) {
+            /* Keep each write to a pipe atomic, the other children
+             * write to it too.
+             */
+            if (n == ASYNC_LOG_IOVECS
+                || (log->piped && n && len + rlen > LOG_BUFSIZE)) {
+                async_log_write(log, vec, n, len);
+                total += len;
+                len = 0;
+                n = 0;
+            }
+            vec[n].iov_base = (char *)(hdr + 1);
+            vec[n].iov_len = rlen;
+            len += rlen;
+            n++;
+            log->records++;
+        }
+        tail += ASYNC_LOG_RECORD(rlen);
+    }
+    if (n) {
+        async_log_write(log, vec, n, len);
+        total += len;
+    }
+    if (tail != start) {
+        /* release the space, once it is all zero again */
+        async_log_clear(log, start, tail);
+        apr_atomic_cas32(&log->tail, tail, start);
+    }
+
+    if (total && async_log_sync_interval && !log->piped) {
+        apr_time_t now = apr_time_now();
+
+        if (now - log->last_sync >= async_log_sync_interval) {
+            apr_file_sync(log->writer->log_writer);
+            log->last_sync = now;
+        }
+    }
+
+    return total;
+}
+
+static void * APR_THREAD_FUNC async_log_main(apr_thread_t *thd, void *data)
+{
+    async_log **logs = (async_log **)all_async_logs->elts;
+    int i, stopping;
+
+    do {
+        apr_size_t total = 0;
+
+        stopping = apr_atomic_read32(&async_log_stopping);
+        for (i = 0; i < all_async_logs->nelts; i++) {
+            total += async_log_drain(logs[i]);
+        }
+
+        apr_thread_mutex_lock(async_log_mutex);
+        if (total && async_log_waiters) {
+            apr_thread_cond_broadcast(async_log_space);
+        }
+        else if (!stopping && !apr_atomic_read32(&async_log_stopping)) {
+            apr_thread_cond_timedwait(async_log_wakeup, async_log_mutex,
+                                      async_log_waiters ? ASYNC_LOG_WAIT
+                                                        : ASYNC_LOG_INTERVAL);
+        }
+        apr_thread_mutex_unlock(async_log_mutex);
+    } while (!stopping);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t async_log_stop(void *data)
+{
+    apr_status_t rv;
+
+    /* the writer thread drains the rings once more before exiting */
+    apr_atomic_set32(&async_log_stopping, 1);
+    apr_thread_mutex_lock(async_log_mutex);
+    apr_thread_cond_signal(async_log_wakeup);
+    apr_thread_mutex_unlock(async_log_mutex);
+    apr_thread_join(&rv, async_log_thread);
+    async_log_thread = NULL;
+
+    return APR_SUCCESS;
+}
+
+static void async_log_child_init(apr_pool_t *p, server_rec *s)
+{
+    async_log **logs = (async_log **)all_async_logs->elts;
+    apr_status_t rv;
+    int i;
+
+    if (!all_async_logs->nelts) {
+        return;
+    }
+
+    for (i = 0; i < all_async_logs->nelts; i++) {
+        logs[i]->size = (apr_uint32_t)async_log_size;
+        logs[i]->ring = apr_pcalloc(p, async_log_size);
+    }
+
+    async_log_stopping = 0;
+    async_log_waiters = 0;
+    if ((rv = apr_thread_mutex_create(&async_log_mutex,
+                                      APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS
+        || (rv = apr_thread_cond_create(&async_log_wakeup, p)) != APR_SUCCESS
+        || (rv = apr_thread_cond_create(&async_log_space, p)) != APR_SUCCESS
+        || (rv = apr_thread_create(&async_log_thread, NULL, async_log_main,
+                                   NULL, p)) != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(03400)
+                     "could not start the log writer thread, "
+                     "logging synchronously");
+        for (i = 0; i < all_async_logs->nelts; i++) {
+            logs[i]->ring = NULL;
+        }
+        return;
+    }
+    apr_pool_cleanup_register(p, NULL, async_log_stop,
+                              apr_pool_cleanup_null);
+}
+
+static int log_status_hook(request_rec *r, int flags)
+{
+    async_log **logs;
+    int i;
+
+    if (!all_async_logs || !all_async_logs->nelts || !async_log_thread) {
+        return OK;
+    }
+
+    logs = (async_log **)all_async_logs->elts;
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr />\n<h1>Asynchronous Logs (this child)</h1>\n\n"
+                 "<table border=\"0\"><tr>"
+                 "<th>Log</th><th>Records</th><th>Bytes</th><th>Writes</th>"
+                 "<th>Pending</th><th>Dropped</th><th>Blocked</th></tr>\n",
+                 r);
+    }
+    for (i = 0; i < all_async_logs->nelts; ++i) {
+        async_log *log = logs[i];
+        apr_uint32_t pending = apr_atomic_read32(&log->head)
+                               - apr_atomic_read32(&log->tail);
+
+        if (!(flags & AP_STATUS_SHORT)) {
+            ap_rprintf(r, "<tr><td>%s</td><td>%" APR_UINT64_T_FMT "</td>"
+                       "<td>%" APR_UINT64_T_FMT "</td>"
+                       "<td>%" APR_UINT64_T_FMT "</td>"
+                       "<td>%u</td><td>%u</td><td>%u</td></tr>\n",
+                       ap_escape_html(r->pool, log->name), log->records,
+                       log->bytes, log->writes, pending,
+                       apr_atomic_read32(&log->dropped),
+                       apr_atomic_read32(&log->blocked));
+        }
+        else {
+            ap_rprintf(r, "AsyncLog[%d]: %s %" APR_UINT64_T_FMT " %"
+                       APR_UINT64_T_FMT " %" APR_UINT64_T_FMT " %u %u %u\n",
+                       i, log->name, log->records, log->bytes, log->writes,
+                       pending, apr_atomic_read32(&log->dropped),
+                       apr_atomic_read32(&log->blocked));
+        }
+    }
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("</table>\n", r);
+    }
+
+    return OK;
+}
+#endif /* APR_HAS_THREADS */
+
 static int log_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
 {
     static APR_OPTIONAL_FN_TYPE(ap_register_log_handler) *log_pfn_register;
@@ -1868,10 +2884,20 @@ static int log_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
         log_pfn_register(p, "^to", log_trailer_out, 0);
     }
 
+    binary_schemas = apr_hash_make(p);
+    binary_schema_ids = apr_hash_make(p);
+    binary_schema_used = apr_hash_make(p);
+
     /* reset to default conditions */
     ap_log_set_writer_init(ap_default_log_writer_init);
     ap_log_set_writer(ap_default_log_writer);
-    buffered_logs = 0;
+    buffered_logs = BUFFERED_LOGS_OFF;
+    all_async_logs = NULL;
+#if APR_HAS_THREADS
+    async_log_size = 1024 * 1024;
+    async_log_overflow = ASYNC_LOG_OVERFLOW_BLOCK;
+    async_log_sync_interval = 0;
+#endif
 
     return OK;
 }
@@ -1932,6 +2958,10 @@ static void register_hooks(apr_pool_t *p)
     ap_hook_child_init(init_child,NULL,NULL,APR_HOOK_MIDDLE);
     ap_hook_open_logs(init_config_log,NULL,NULL,APR_HOOK_MIDDLE);
     ap_hook_log_transaction(multi_log_transaction,NULL,NULL,APR_HOOK_MIDDLE);
+#if APR_HAS_THREADS
+    APR_OPTIONAL_HOOK(ap, status_hook, log_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
+#endif
 
     /* Init log_hash before we register the optional function. It is
      * possible for the optional function, ap_register_log_handler,
@@ -53,6 +53,8 @@
 #include "apr_lib.h"
 #include "apr_signal.h"
 #include "apr_global_mutex.h"
+#include "apr_atomic.h"
+#include "apr_version.h"
 #include "apr_dbm.h"
 #include "apr_dbd.h"
 #include "mod_dbd.h"
@@ -95,10 +97,13 @@
 #include "http_protocol.h"
 #include "http_vhost.h"
 #include "util_mutex.h"
+#include "ap_socache.h"
 
 #include "mod_ssl.h"
+#include "mod_status.h"
 
 #include "mod_rewrite.h"
+#include "rewrite_prefix.h"
 #include "ap_expr.h"
 
 #if APR_CHARSET_EBCDIC
@@ -311,10 +316,23 @@ typedef struct data_item {
     char *data;
 } data_item;
 
+/* the (per-child) counters of a RewriteRule, shared by all its copies */
+typedef struct {
+    const char   *pattern;
+    const char   *filename;
+    int           line_num;
+    apr_uint32_t  evaluated;
+    apr_uint32_t  matched;
+    apr_uint64_t  usecs;
+} rewriterule_stats;
+
 typedef struct {
     apr_array_header_t *rewriteconds;/* the corresponding RewriteCond entries */
     char      *pattern;              /* the RegExp pattern string             */
     ap_regex_t *regexp;              /* the RegExp pattern compilation        */
+    char      *prefix;               /* literal prefix of anchored patterns   */
+    apr_size_t prefixlen;            /* or 0 if none                          */
+    rewriterule_stats *stats;        /* NULL for .htaccess rules              */
     char      *output;               /* the Substitution string               */
     int        flags;                /* Flags which control the substitution  */
     char      *forced_mimetype;      /* forced MIME type of substitution      */
@@ -327,12 +345,32 @@ typedef struct {
     char       *escapes;             /* specific backref escapes              */
 } rewriterule_entry;
 
+/* a trie of the literal prefixes of the rules, see rewrite_index */
+typedef struct prefix_node {
+    struct prefix_node *child;        /* first child                        */
+    struct prefix_node *sibling;      /* next child of the parent           */
+    apr_array_header_t *rules;        /* the rules whose prefix ends here   */
+    char                c;
+} prefix_node;
+
+/* the dispatch index of a rule set: the candidate rules for a subject are
+ * those without a literal prefix plus those whose prefix is found along
+ * the subject's path in the tries.
+ */
+typedef struct {
+    prefix_node   *exact;             /* prefixes of case sensitive rules   */
+    prefix_node   *nocase;            /* lowercased prefixes of [NC] rules  */
+    unsigned char *always;            /* rules without a prefix             */
+    int            nrules;
+} rewrite_index;
+
 typedef struct {
     int           state;              /* the RewriteEngine state            */
     int           options;            /* the RewriteOption state            */
     apr_hash_t         *rewritemaps;  /* the RewriteMap entries             */
     apr_array_header_t *rewriteconds; /* the RewriteCond entries (temp.)    */
     apr_array_header_t *rewriterules; /* the RewriteRule entries            */
+    rewrite_index *index;             /* the dispatch index of the rules    */
     server_rec   *server;             /* the corresponding server indicator */
     unsigned int state_set:1;
     unsigned int options_set:1;
@@ -351,22 +389,44 @@ typedef struct {
 } rewrite_perdir_conf;
 
 /* the (per-child) cache structures.
+ *
+ * All the cached maps are created at child init, so cachep->maps is
+ * read-only afterwards. Each map is split in CACHE_SHARDS shards by the
+ * hash of the keys, with their own lock, mtime and LRU list, so that
+ * concurrent lookups of different keys rarely contend.
  */
+#define CACHE_SHARDS 16
+
 typedef struct cache {
     apr_pool_t         *pool;
     apr_hash_t         *maps;
+    int                 shard_max;     /* max entries per shard, or 0 */
+} cache;
+
+/* cached entries are malloc()ed so that they can be freed on eviction,
+ * the key and value being stored right after the structure.
+ */
+typedef struct cacheentry {
+    struct cacheentry *prev;           /* LRU list, most recent first */
+    struct cacheentry *next;
+    apr_ssize_t        klen;
+    char              *val;
+    char               key[1];
+} cacheentry;
+
+typedef struct {
 #if APR_HAS_THREADS
     apr_thread_mutex_t *lock;
 #endif
-} cache;
+    apr_time_t          mtime;         /* of the map the entries come from */
+    apr_hash_t         *entries;
+    cacheentry         *first;
+    cacheentry         *last;
+    int                 nentries;
+} cacheshard;
 
-/* cached maps contain an mtime for the whole map and live in a subpool
- * of the cachep->pool. That makes it easy to forget them if necessary.
- */
 typedef struct {
-    apr_time_t mtime;
-    apr_pool_t *pool;
-    apr_hash_t *entries;
+    cacheshard shards[CACHE_SHARDS];
 } cachedmap;
 
 /* the regex structure for the
@@ -415,6 +475,24 @@ static apr_hash_t *mapfunc_hash;
 /* the cache */
 static cache *cachep;
 
+/* RewriteMapCacheSize */
+static int cache_max_entries;
+
+/* the counters of all the RewriteRules from the configuration */
+static apr_array_header_t *rule_stats;
+
+#if !APR_VERSION_AT_LEAST(1,7,0) && APR_HAS_THREADS
+/* guards the 64 bit times of the rules when APR can't add them atomically */
+static apr_thread_mutex_t *rule_stats_lock;
+#endif
+
+/* RewriteMapSharedCache */
+static ap_socache_provider_t *map_socache_provider = NULL;
+static ap_socache_instance_t *map_socache_instance = NULL;
+static apr_interval_time_t map_socache_timeout;
+static apr_global_mutex_t *map_socache_mutex = NULL;
+static const char *map_socache_id = "rewrite-map-cache";
+
 /* whether proxy module is available or not */
 static int proxy_available;
 
@@ -996,97 +1074,257 @@ static char *subst_prefix_path(request_rec *r, char *input, const char *match,
  * +-------------------------------------------------------+
  */
 
-static void set_cache_value(const char *name, apr_time_t t, char *key,
-                            char *val)
+static void cache_unlink(cacheshard *shard, cacheentry *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        shard->first = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        shard->last = e->prev;
+    }
+}
+
+static void cache_link_first(cacheshard *shard, cacheentry *e)
+{
+    e->prev = NULL;
+    e->next = shard->first;
+    if (shard->first) {
+        shard->first->prev = e;
+    }
+    else {
+        shard->last = e;
+    }
+    shard->first = e;
+}
+
+static void cache_remove(cacheshard *shard, cacheentry *e)
+{
+    apr_hash_set(shard->entries, e->key, e->klen, NULL);
+    cache_unlink(shard, e);
+    shard->nentries--;
+    free(e);
+}
+
+/* forget the entries of an outdated map */
+static void cache_flush(cacheshard *shard, apr_time_t t)
+{
+    while (shard->first) {
+        cache_remove(shard, shard->first);
+    }
+    shard->mtime = t;
+}
+
+static cacheshard *cache_shard(const char *name, const char *key,
+                               apr_ssize_t *klen)
 {
     cachedmap *map;
 
-    if (cachep) {
+    if (!cachep) {
+        return NULL;
+    }
+    map = apr_hash_get(cachep->maps, name, APR_HASH_KEY_STRING);
+    if (!map) {
+        return NULL;
+    }
+
+    *klen = strlen(key);
+    return &map->shards[apr_hashfunc_default(key, klen) % CACHE_SHARDS];
+}
+
+static void cache_store(cacheshard *shard, apr_time_t t, const char *key,
+                        apr_ssize_t klen, const char *val)
+{
+    apr_size_t vlen = strlen(val);
+    cacheentry *e, *old;
+
+    /* We need to copy the key and the value into OUR memory,
+     * so that we don't leave it during the r->pool cleanup.
+     */
+    e = ap_malloc(APR_OFFSETOF(cacheentry, key) + klen + 1 + vlen + 1);
+    e->klen = klen;
+    memcpy(e->key, key, klen + 1);
+    e->val = e->key + klen + 1;
+    memcpy(e->val, val, vlen + 1);
+
 #if APR_HAS_THREADS
-        apr_thread_mutex_lock(cachep->lock);
+    apr_thread_mutex_lock(shard->lock);
 #endif
-        map = apr_hash_get(cachep->maps, name, APR_HASH_KEY_STRING);
 
-        if (!map) {
-            apr_pool_t *p;
+    if (shard->mtime != t) {
+        cache_flush(shard, t);
+    }
+    else if ((old = apr_hash_get(shard->entries, key, klen)) != NULL) {
+        cache_remove(shard, old);
+    }
+    else if (cachep->shard_max && shard->nentries >= cachep->shard_max) {
+        cache_remove(shard, shard->last);
+    }
+
+    apr_hash_set(shard->entries, e->key, klen, e);
+    cache_link_first(shard, e);
+    shard->nentries++;
 
-            if (apr_pool_create(&p, cachep->pool) != APR_SUCCESS) {
 #if APR_HAS_THREADS
-                apr_thread_mutex_unlock(cachep->lock);
+    apr_thread_mutex_unlock(shard->lock);
 #endif
-                return;
-            }
+}
 
-            map = apr_palloc(cachep->pool, sizeof(cachedmap));
-            map->pool = p;
-            map->entries = apr_hash_make(map->pool);
-            map->mtime = t;
+/* the shared cache is keyed by map, mtime and key, so that the entries
+ * of an outdated map are simply never found again.
+ */
+static const char *shared_cache_id(apr_pool_t *p, const char *name,
+                                   apr_time_t t, const char *key)
+{
+    return apr_psprintf(p, "%s:%" APR_TIME_T_FMT ":%s", name, t, key);
+}
 
-            apr_hash_set(cachep->maps, name, APR_HASH_KEY_STRING, map);
-        }
-        else if (map->mtime != t) {
-            apr_pool_clear(map->pool);
-            map->entries = apr_hash_make(map->pool);
-            map->mtime = t;
+static int shared_cache_lock(request_rec *r)
+{
+    apr_status_t rv;
+
+    if (!map_socache_mutex) {
+        return 1;
+    }
+    rv = apr_global_mutex_lock(map_socache_mutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(03391)
+                      "mod_rewrite: can't lock the shared map cache");
+        return 0;
+    }
+    return 1;
+}
+
+static void shared_cache_unlock(void)
+{
+    if (map_socache_mutex) {
+        apr_global_mutex_unlock(map_socache_mutex);
+    }
+}
+
+static char *get_shared_cache_value(request_rec *r, const char *name,
+                                    apr_time_t t, const char *key)
+{
+    const char *id = shared_cache_id(r->pool, name, t, key);
+    unsigned char val[HUGE_STRING_LEN];
+    unsigned int vlen = sizeof(val);
+    apr_status_t rv;
+
+    if (!shared_cache_lock(r)) {
+        return NULL;
+    }
+    rv = map_socache_provider->retrieve(map_socache_instance, r->server,
+                                        (const unsigned char *)id,
+                                        strlen(id), val, &vlen, r->pool);
+    shared_cache_unlock();
+
+    if (rv != APR_SUCCESS) {
+        if (!APR_STATUS_IS_NOTFOUND(rv)) {
+            rewritelog((r, 3, NULL, "shared cache lookup of %s failed (%d)",
+                        id, rv));
         }
+        return NULL;
+    }
 
-        /* Now we should have a valid map->entries hash, where we
-         * can store our value.
-         *
-         * We need to copy the key and the value into OUR pool,
-         * so that we don't leave it during the r->pool cleanup.
-         */
-        apr_hash_set(map->entries,
-                     apr_pstrdup(map->pool, key), APR_HASH_KEY_STRING,
-                     apr_pstrdup(map->pool, val));
+    /* copied to the pool only on a hit, misses allocate nothing */
+    return apr_pstrmemdup(r->pool, (const char *)val, vlen);
+}
 
-#if APR_HAS_THREADS
-        apr_thread_mutex_unlock(cachep->lock);
-#endif
+static void set_shared_cache_value(request_rec *r, const char *name,
+                                   apr_time_t t, const char *key,
+                                   const char *val)
+{
+    const char *id = shared_cache_id(r->pool, name, t, key);
+    apr_size_t vlen = strlen(val);
+    apr_status_t rv;
+
+    /* get_shared_cache_value() could not retrieve it */
+    if (vlen >= HUGE_STRING_LEN) {
+        return;
+    }
+
+    if (!shared_cache_lock(r)) {
+        return;
+    }
+    rv = map_socache_provider->store(map_socache_instance, r->server,
+                                     (const unsigned char *)id, strlen(id),
+                                     apr_time_now() + map_socache_timeout,
+                                     (unsigned char *)val, vlen, r->pool);
+    shared_cache_unlock();
+
+    if (rv != APR_SUCCESS) {
+        rewritelog((r, 3, NULL, "shared cache store of %s failed (%d)",
+                    id, rv));
+    }
+}
+
+static void set_cache_value(request_rec *r, const char *name, apr_time_t t,
+                            char *key, char *val)
+{
+    cacheshard *shard;
+    apr_ssize_t klen;
+
+    shard = cache_shard(name, key, &klen);
+    if (shard) {
+        cache_store(shard, t, key, klen, val);
+    }
+    if (map_socache_instance) {
+        set_shared_cache_value(r, name, t, key, val);
     }
 
     return;
 }
 
-static char *get_cache_value(const char *name, apr_time_t t, char *key,
-                             apr_pool_t *p)
+static char *get_cache_value(request_rec *r, const char *name, apr_time_t t,
+                             char *key)
 {
-    cachedmap *map;
+    cacheshard *shard;
+    cacheentry *e;
+    apr_ssize_t klen = 0;
     char *val = NULL;
 
-    if (cachep) {
+    shard = cache_shard(name, key, &klen);
+    if (shard) {
 #if APR_HAS_THREADS
-        apr_thread_mutex_lock(cachep->lock);
+        apr_thread_mutex_lock(shard->lock);
 #endif
-        map = apr_hash_get(cachep->maps, name, APR_HASH_KEY_STRING);
-
-        if (map) {
-            /* if this map is outdated, forget it. */
-            if (map->mtime != t) {
-                apr_pool_clear(map->pool);
-                map->entries = apr_hash_make(map->pool);
-                map->mtime = t;
-            }
-            else {
-                val = apr_hash_get(map->entries, key, APR_HASH_KEY_STRING);
-                if (val) {
-                    /* copy the cached value into the supplied pool,
-                     * where it belongs (r->pool usually)
-                     */
-                    val = apr_pstrdup(p, val);
-                }
+
+        /* if this map is outdated, forget it. */
+        if (shard->mtime != t) {
+            cache_flush(shard, t);
+        }
+        else if ((e = apr_hash_get(shard->entries, key, klen)) != NULL) {
+            if (e != shard->first) {
+                cache_unlink(shard, e);
+                cache_link_first(shard, e);
             }
+            /* copy the cached value into the request pool,
+             * where it belongs
+             */
+            val = apr_pstrdup(r->pool, e->val);
         }
 
 #if APR_HAS_THREADS
-        apr_thread_mutex_unlock(cachep->lock);
+        apr_thread_mutex_unlock(shard->lock);
 #endif
     }
 
+    if (!val && map_socache_instance) {
+        val = get_shared_cache_value(r, name, t, key);
+        if (val && shard) {
+            cache_store(shard, t, key, klen, val);
+        }
+    }
+
     return val;
 }
 
-static int init_cache(apr_pool_t *p)
+static int init_cache(apr_pool_t *p, server_rec *s)
 {
     cachep = apr_palloc(p, sizeof(cache));
     if (apr_pool_create(&cachep->pool, p) != APR_SUCCESS) {
@@ -1095,9 +1333,58 @@ static int init_cache(apr_pool_t *p)
     }
 
     cachep->maps = apr_hash_make(cachep->pool);
+    cachep->shard_max = (cache_max_entries + CACHE_SHARDS - 1) / CACHE_SHARDS;
+
+    /* create all the cached maps now, to not need any lock for
+     * cachep->maps at runtime.
+     */
+    for (; s; s = s->next) {
+        rewrite_server_conf *conf;
+        apr_hash_index_t *hi;
+
+        conf = ap_get_module_config(s->module_config, &rewrite_module);
+        for (hi = apr_hash_first(p, conf->rewritemaps); hi;
+             hi = apr_hash_next(hi)) {
+            rewritemap_entry *entry;
+            cachedmap *map;
+            void *val;
+            int i;
+
+            apr_hash_this(hi, NULL, NULL, &val);
+            entry = val;
+
+            if (!entry->cachename
+                || apr_hash_get(cachep->maps, entry->cachename,
+                                APR_HASH_KEY_STRING)) {
+                continue;
+            }
+
+            map = apr_pcalloc(cachep->pool, sizeof(cachedmap));
+            for (i = 0; i < CACHE_SHARDS; ++i) {
+                cacheshard *shard = &map->shards[i];
+                apr_pool_t *sp;
+
+                /* apr_hash_set() may allocate, so each shard's hash
+                 * needs its own pool.
+                 */
+                if (apr_pool_create(&sp, cachep->pool) != APR_SUCCESS) {
+                    cachep = NULL;
+                    return 0;
+                }
+                shard->entries = apr_hash_make(sp);
 #if APR_HAS_THREADS
-    (void)apr_thread_mutex_create(&(cachep->lock), APR_THREAD_MUTEX_DEFAULT, p);
+                if (apr_thread_mutex_create(&shard->lock,
+                                            APR_THREAD_MUTEX_DEFAULT,
+                                            sp) != APR_SUCCESS) {
+                    cachep = NULL;
+                    return 0;
+                }
 #endif
+            }
+            apr_hash_set(cachep->maps, entry->cachename, APR_HASH_KEY_STRING,
+                         map);
+        }
+    }
 
     return 1;
 }
@@ -1625,7 +1912,7 @@ static char *lookup_map(request_rec *r, char *name, char *key)
             return NULL;
         }
 
-        value = get_cache_value(s->cachename, st.mtime, key, r->pool);
+        value = get_cache_value(r, s->cachename, st.mtime, key);
         if (!value) {
             rewritelog((r, 6, NULL,
                         "cache lookup FAILED, forcing new map lookup"));
@@ -1634,13 +1921,13 @@ static char *lookup_map(request_rec *r, char *name, char *key)
             if (!value) {
                 rewritelog((r, 5, NULL, "map lookup FAILED: map=%s[txt] key=%s",
                             name, key));
-                set_cache_value(s->cachename, st.mtime, key, "");
+                set_cache_value(r, s->cachename, st.mtime, key, "");
                 return NULL;
             }
 
             rewritelog((r, 5, NULL,"map lookup OK: map=%s[txt] key=%s -> val=%s",
                         name, key, value));
-            set_cache_value(s->cachename, st.mtime, key, value);
+            set_cache_value(r, s->cachename, st.mtime, key, value);
         }
         else {
             rewritelog((r,5,NULL,"cache lookup OK: map=%s[txt] key=%s -> val=%s",
@@ -1681,7 +1968,7 @@ static char *lookup_map(request_rec *r, char *name, char *key)
             return NULL;
         }
 
-        value = get_cache_value(s->cachename, st.mtime, key, r->pool);
+        value = get_cache_value(r, s->cachename, st.mtime, key);
         if (!value) {
             rewritelog((r, 6, NULL,
                         "cache lookup FAILED, forcing new map lookup"));
@@ -1690,14 +1977,14 @@ static char *lookup_map(request_rec *r, char *name, char *key)
             if (!value) {
                 rewritelog((r, 5, NULL, "map lookup FAILED: map=%s[dbm] key=%s",
                             name, key));
-                set_cache_value(s->cachename, st.mtime, key, "");
+                set_cache_value(r, s->cachename, st.mtime, key, "");
                 return NULL;
             }
 
             rewritelog((r, 5, NULL, "map lookup OK: map=%s[dbm] key=%s -> "
                         "val=%s", name, key, value));
 
-            set_cache_value(s->cachename, st.mtime, key, value);
+            set_cache_value(r, s->cachename, st.mtime, key, value);
             return value;
         }
 
@@ -1725,7 +2012,7 @@ static char *lookup_map(request_rec *r, char *name, char *key)
      * SQL map with cache
      */
     case MAPTYPE_DBD_CACHE:
-        value = get_cache_value(s->cachename, 0, key, r->pool);
+        value = get_cache_value(r, s->cachename, 0, key);
         if (!value) {
             rewritelog((r, 6, NULL,
                         "cache lookup FAILED, forcing new map lookup"));
@@ -1734,14 +2021,14 @@ static char *lookup_map(request_rec *r, char *name, char *key)
             if (!value) {
                 rewritelog((r, 5, NULL, "SQL map lookup FAILED: map %s key=%s",
                             name, key));
-                set_cache_value(s->cachename, 0, key, "");
+                set_cache_value(r, s->cachename, 0, key, "");
                 return NULL;
             }
 
             rewritelog((r, 5, NULL, "SQL map lookup OK: map %s key=%s, val=%s",
                         name, key, value));
 
-            set_cache_value(s->cachename, 0, key, value);
+            set_cache_value(r, s->cachename, 0, key, value);
             return value;
         }
 
@@ -2693,6 +2980,25 @@ static apr_status_t rewritelock_remove(void *data)
     return APR_SUCCESS;
 }
 
+static apr_status_t map_socache_remove_lock(void *data)
+{
+    if (map_socache_mutex) {
+        apr_global_mutex_destroy(map_socache_mutex);
+        map_socache_mutex = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t map_socache_destroy(void *data)
+{
+    if (map_socache_instance) {
+        map_socache_provider->destroy(map_socache_instance,
+                                      (server_rec *)data);
+        map_socache_instance = NULL;
+    }
+    return APR_SUCCESS;
+}
+
 
 /*
  * +-------------------------------------------------------+
@@ -3195,6 +3501,81 @@ static const char *cmd_rewritemap(cmd_parms *cmd, void *dconf, const char *a1,
     return NULL;
 }
 
+static const char *cmd_rewritemapcachesize(cmd_parms *cmd, void *dconf,
+                                           const char *a1)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *end;
+    long n;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    n = strtol(a1, &end, 10);
+    if (*end || n < 0 || n > APR_INT32_MAX) {
+        return "RewriteMapCacheSize: argument must be a number of entries, "
+               "or 0 for no limit";
+    }
+    cache_max_entries = (int)n;
+
+    return NULL;
+}
+
+static const char *cmd_rewritemapsharedcache(cmd_parms *cmd, void *dconf,
+                                             const char *a1, const char *a2)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    const char *sep, *name;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    if (!strcasecmp(a1, "none")) {
+        map_socache_provider = NULL;
+        map_socache_instance = NULL;
+        return NULL;
+    }
+
+    if (a2) {
+        apr_int64_t secs = apr_atoi64(a2);
+        if (secs <= 0) {
+            return "RewriteMapSharedCache: timeout must be a positive "
+                   "number of seconds";
+        }
+        map_socache_timeout = apr_time_from_sec(secs);
+    }
+
+    /* Argument is of form 'name:args' or just 'name'. */
+    sep = ap_strchr_c(a1, ':');
+    if (sep) {
+        name = apr_pstrmemdup(cmd->pool, a1, sep - a1);
+        sep++;
+    }
+    else {
+        name = a1;
+    }
+
+    map_socache_provider = ap_lookup_provider(AP_SOCACHE_PROVIDER_GROUP, name,
+                                              AP_SOCACHE_PROVIDER_VERSION);
+    if (map_socache_provider == NULL) {
+        return apr_psprintf(cmd->pool, "RewriteMapSharedCache: unknown "
+                            "socache provider '%s'. Maybe you need to load "
+                            "the appropriate socache module (mod_socache_%s?)",
+                            name, name);
+    }
+
+    err = map_socache_provider->create(&map_socache_instance, sep,
+                                       cmd->temp_pool, cmd->pool);
+    if (err) {
+        map_socache_instance = NULL;
+        return apr_psprintf(cmd->pool, "RewriteMapSharedCache: %s", err);
+    }
+
+    return NULL;
+}
+
 static const char *cmd_rewritebase(cmd_parms *cmd, void *in_dconf,
                                    const char *a1)
 {
@@ -3791,6 +4172,25 @@ static const char *cmd_rewriterule(cmd_parms *cmd, void *in_dconf,
     newrule->pattern = a1;
     newrule->regexp  = regexp;
 
+    newrule->prefix = NULL;
+    newrule->prefixlen = 0;
+    if (!(newrule->flags & RULEFLAG_NOTMATCH)) {
+        newrule->prefix = pattern_literal_prefix(cmd->pool, a1,
+                                                 newrule->flags
+                                                 & RULEFLAG_NOCASE,
+                                                 &newrule->prefixlen);
+    }
+
+    /* .htaccess rules are parsed for each request, don't count them */
+    newrule->stats = NULL;
+    if (cmd->pool == cmd->server->process->pconf) {
+        newrule->stats = apr_pcalloc(cmd->pool, sizeof(rewriterule_stats));
+        newrule->stats->pattern = newrule->pattern;
+        newrule->stats->filename = cmd->directive->filename;
+        newrule->stats->line_num = cmd->directive->line_num;
+        APR_ARRAY_PUSH(rule_stats, rewriterule_stats *) = newrule->stats;
+    }
+
     /* arg2: the output string */
     newrule->output = a2;
     if (*a2 == '-' && !a2[1]) {
@@ -4051,15 +4451,152 @@ static APR_INLINE void force_type_handler(rewriterule_entry *p,
 }
 
 /*
- * Apply a single RewriteRule
+ * Dispatch index of a rule set
  */
-static int apply_rewrite_rule(rewriterule_entry *p, rewrite_ctx *ctx)
+static void prefix_insert(apr_pool_t *p, prefix_node *node, const char *prefix,
+                          int nocase, int rule)
+{
+    for (; *prefix; ++prefix) {
+        char c = nocase ? apr_tolower(*prefix) : *prefix;
+        prefix_node *child;
+
+        for (child = node->child; child && child->c != c;
+             child = child->sibling)
+            ;
+        if (!child) {
+            child = apr_pcalloc(p, sizeof(prefix_node));
+            child->c = c;
+            child->sibling = node->child;
+            node->child = child;
+        }
+        node = child;
+    }
+
+    if (!node->rules) {
+        node->rules = apr_array_make(p, 1, sizeof(int));
+    }
+    APR_ARRAY_PUSH(node->rules, int) = rule;
+}
+
+/* mark the rules whose prefix the subject starts with */
+static void prefix_mark(const prefix_node *node, const char *s, int nocase,
+                        unsigned char *candidates)
+{
+    for (;;) {
+        if (node->rules) {
+            int i;
+            for (i = 0; i < node->rules->nelts; ++i) {
+                candidates[APR_ARRAY_IDX(node->rules, i, int)] = 1;
+            }
+        }
+        if (!*s) {
+            break;
+        }
+        {
+            char c = nocase ? apr_tolower(*s) : *s;
+            for (node = node->child; node && node->c != c;
+                 node = node->sibling)
+                ;
+        }
+        if (!node) {
+            break;
+        }
+        ++s;
+    }
+}
+
+static rewrite_index *build_rewrite_index(apr_pool_t *p,
+                                          apr_array_header_t *rewriterules)
+{
+    rewriterule_entry *entries = (rewriterule_entry *)rewriterules->elts;
+    rewrite_index *index;
+    int i, nprefixes = 0;
+
+    index = apr_palloc(p, sizeof(rewrite_index));
+    index->nrules = rewriterules->nelts;
+    index->always = apr_pcalloc(p, index->nrules ? index->nrules : 1);
+    index->exact = apr_pcalloc(p, sizeof(prefix_node));
+    index->nocase = apr_pcalloc(p, sizeof(prefix_node));
+
+    for (i = 0; i < rewriterules->nelts; ++i) {
+        rewriterule_entry *rule = &entries[i];
+
+        if (!rule->prefixlen) {
+            index->always[i] = 1;
+        }
+        else if (rule->flags & RULEFLAG_NOCASE) {
+            prefix_insert(p, index->nocase, rule->prefix, 1, i);
+            nprefixes++;
+        }
+        else {
+            prefix_insert(p, index->exact, rule->prefix, 0, i);
+            nprefixes++;
+        }
+    }
+
+    /* nothing to dispatch on */
+    if (!nprefixes) {
+        return NULL;
+    }
+    return index;
+}
+
+static APR_INLINE int rule_prefix_matches(const rewriterule_entry *p,
+                                          const char *uri)
+{
+    if (!p->prefixlen) {
+        return 1;
+    }
+    if (p->flags & RULEFLAG_NOCASE) {
+        return !ap_casecmpstrn(uri, p->prefix, p->prefixlen);
+    }
+    return !strncmp(uri, p->prefix, p->prefixlen);
+}
+
+/* The time spent in a rule is added by all the threads of the child */
+static void rule_stats_add_usecs(rewriterule_stats *st, apr_uint64_t usecs)
+{
+#if APR_VERSION_AT_LEAST(1,7,0)
+    apr_atomic_add64(&st->usecs, usecs);
+#else
+#if APR_HAS_THREADS
+    if (rule_stats_lock) {
+        apr_thread_mutex_lock(rule_stats_lock);
+        st->usecs += usecs;
+        apr_thread_mutex_unlock(rule_stats_lock);
+        return;
+    }
+#endif
+    st->usecs += usecs;
+#endif
+}
+
+static apr_uint64_t rule_stats_read_usecs(rewriterule_stats *st)
+{
+#if APR_VERSION_AT_LEAST(1,7,0)
+    return apr_atomic_read64(&st->usecs);
+#else
+    apr_uint64_t usecs;
+#if APR_HAS_THREADS
+    if (rule_stats_lock) {
+        apr_thread_mutex_lock(rule_stats_lock);
+        usecs = st->usecs;
+        apr_thread_mutex_unlock(rule_stats_lock);
+        return usecs;
+    }
+#endif
+    usecs = st->usecs;
+    return usecs;
+#endif
+}
+
+/*
+ * Compute the subject of the RewriteRule patterns, and the candidate
+ * rules for it if the rule set is indexed
+ */
+static void prepare_rule_subject(rewrite_ctx *ctx, unsigned char *candidates,
+                                 const rewrite_index *index)
 {
-    ap_regmatch_t regmatch[AP_MAX_REG_MATCH];
-    apr_array_header_t *rewriteconds;
-    rewritecond_entry *conds;
-    int i, rc;
-    char *newuri = NULL;
     request_rec *r = ctx->r;
     int is_proxyreq = 0;
 
@@ -4095,6 +4632,28 @@ static int apply_rewrite_rule(rewriterule_entry *p, rewrite_ctx *ctx)
         }
     }
 
+    if (candidates) {
+        memcpy(candidates, index->always, index->nrules);
+        prefix_mark(index->exact, ctx->uri, 0, candidates);
+        prefix_mark(index->nocase, ctx->uri, 1, candidates);
+    }
+}
+
+/*
+ * Apply a single RewriteRule to ctx->uri, as computed by
+ * prepare_rule_subject()
+ */
+static int apply_rewrite_rule(rewriterule_entry *p, rewrite_ctx *ctx)
+{
+    ap_regmatch_t regmatch[AP_MAX_REG_MATCH];
+    apr_array_header_t *rewriteconds;
+    rewritecond_entry *conds;
+    int i, rc;
+    char *newuri = NULL;
+    request_rec *r = ctx->r;
+    int is_proxyreq = (   ctx->perdir && r->proxyreq && r->filename
+                       && !strncmp(r->filename, "proxy:", 6));
+
     /* Try to match the URI against the RewriteRule pattern
      * and exit immediately if it didn't apply.
      */
@@ -4300,7 +4859,7 @@ static int apply_rewrite_rule(rewriterule_entry *p, rewrite_ctx *ctx)
  * i.e. a list of rewrite rules
  */
 static int apply_rewrite_list(request_rec *r, apr_array_header_t *rewriterules,
-                              char *perdir)
+                              rewrite_index *index, char *perdir)
 {
     rewriterule_entry *entries;
     rewriterule_entry *p;
@@ -4310,17 +4869,23 @@ static int apply_rewrite_list(request_rec *r, apr_array_header_t *rewriterules,
     int s;
     rewrite_ctx *ctx;
     int round = 1;
+    unsigned char *candidates = NULL;
 
     ctx = apr_palloc(r->pool, sizeof(*ctx));
     ctx->perdir = perdir;
     ctx->r = r;
 
+    if (index) {
+        candidates = apr_palloc(r->pool, index->nrules);
+    }
+
     /*
      *  Iterate over all existing rules
      */
     entries = (rewriterule_entry *)rewriterules->elts;
     changed = 0;
     loop:
+    prepare_rule_subject(ctx, candidates, index);
     for (i = 0; i < rewriterules->nelts; i++) {
         p = &entries[i];
 
@@ -4336,10 +4901,27 @@ static int apply_rewrite_list(request_rec *r, apr_array_header_t *rewriterules,
         }
 
         /*
-         *  Apply the current rule.
+         *  Apply the current rule, unless the subject does not have
+         *  its literal prefix, whence the pattern can't match.
          */
         ctx->vary = NULL;
-        rc = apply_rewrite_rule(p, ctx);
+        if (candidates ? !candidates[i] : !rule_prefix_matches(p, ctx->uri)) {
+            rc = 0;
+        }
+        else if (p->stats) {
+            apr_time_t start = apr_time_now();
+
+            rc = apply_rewrite_rule(p, ctx);
+
+            rule_stats_add_usecs(p->stats, apr_time_now() - start);
+            apr_atomic_inc32(&p->stats->evaluated);
+            if (rc) {
+                apr_atomic_inc32(&p->stats->matched);
+            }
+        }
+        else {
+            rc = apply_rewrite_rule(p, ctx);
+        }
 
         if (rc) {
             /* Regardless of what we do next, we've found a match. Check to see
@@ -4410,6 +4992,9 @@ static int apply_rewrite_list(request_rec *r, apr_array_header_t *rewriterules,
                 goto loop;
             }
 
+            /* the rule may have changed the subject of the next ones */
+            prepare_rule_subject(ctx, candidates, index);
+
             /*
              *  If we are forced to skip N next rules, do it now.
              */
@@ -4453,6 +5038,13 @@ static int pre_config(apr_pool_t *pconf,
     APR_OPTIONAL_FN_TYPE(ap_register_rewrite_mapfunc) *map_pfn_register;
 
     ap_mutex_register(pconf, rewritemap_mutex_type, NULL, APR_LOCK_DEFAULT, 0);
+    ap_mutex_register(pconf, map_socache_id, NULL, APR_LOCK_DEFAULT, 0);
+
+    cache_max_entries = 0;
+    rule_stats = apr_array_make(pconf, 8, sizeof(rewriterule_stats *));
+    map_socache_provider = NULL;
+    map_socache_instance = NULL;
+    map_socache_timeout = apr_time_from_sec(300);
 
     /* register int: rewritemap handlers */
     map_pfn_register = APR_RETRIEVE_OPTIONAL_FN(ap_register_rewrite_mapfunc);
@@ -4485,6 +5077,48 @@ static int post_config(apr_pool_t *p,
     apr_pool_cleanup_register(p, (void *)s, rewritelock_remove,
                               apr_pool_cleanup_null);
 
+    if (map_socache_instance) {
+        static struct ap_socache_hints map_socache_hints = {64, 64, 60000000};
+
+        if (map_socache_provider->flags & AP_SOCACHE_FLAG_NOTMPSAFE) {
+            rv = ap_global_mutex_create(&map_socache_mutex, NULL,
+                                        map_socache_id, NULL, s, p, 0);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(03392)
+                             "mod_rewrite: could not create the shared map "
+                             "cache mutex");
+                return HTTP_INTERNAL_SERVER_ERROR;
+            }
+            apr_pool_cleanup_register(p, NULL, map_socache_remove_lock,
+                                      apr_pool_cleanup_null);
+        }
+
+        rv = map_socache_provider->init(map_socache_instance, map_socache_id,
+                                        &map_socache_hints, s, p);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(03393)
+                         "mod_rewrite: could not initialise the shared map "
+                         "cache");
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
+        apr_pool_cleanup_register(p, (void *)s, map_socache_destroy,
+                                  apr_pool_cleanup_null);
+    }
+
+    /* index the server rule sets, which are final once merged; per-dir
+     * ones are merged at runtime and only use the rules' own prefixes.
+     */
+    {
+        server_rec *vs;
+
+        for (vs = s; vs; vs = vs->next) {
+            rewrite_server_conf *conf;
+
+            conf = ap_get_module_config(vs->module_config, &rewrite_module);
+            conf->index = build_rewrite_index(p, conf->rewriterules);
+        }
+    }
+
     /* if we are not doing the initial config, step through the servers and
      * open the RewriteMap prg:xxx programs,
      */
@@ -4516,8 +5150,24 @@ static void init_child(apr_pool_t *p, server_rec *s)
         }
     }
 
+    if (map_socache_mutex) {
+        rv = apr_global_mutex_child_init(&map_socache_mutex,
+                 apr_global_mutex_lockfile(map_socache_mutex), p);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(03394)
+                         "mod_rewrite: could not init the shared map cache "
+                         "mutex in child");
+        }
+    }
+
+#if !APR_VERSION_AT_LEAST(1,7,0) && APR_HAS_THREADS
+    if (rule_stats->nelts) {
+        apr_thread_mutex_create(&rule_stats_lock, APR_THREAD_MUTEX_DEFAULT, p);
+    }
+#endif
+
     /* create the lookup cache */
-    if (!init_cache(p)) {
+    if (!init_cache(p, s)) {
         ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(00667)
                      "mod_rewrite: could not init map cache in child");
     }
@@ -4660,7 +5310,8 @@ static int hook_uri2file(request_rec *r)
         /*
          *  now apply the rules ...
          */
-        rulestatus = apply_rewrite_list(r, conf->rewriterules, NULL);
+        rulestatus = apply_rewrite_list(r, conf->rewriterules, conf->index,
+                                        NULL);
         apr_table_setn(r->notes, "mod_rewrite_rewritten",
                        apr_psprintf(r->pool,"%d",rulestatus));
     }
@@ -4949,7 +5600,8 @@ static int hook_fixup(request_rec *r)
     /*
      *  now apply the rules ...
      */
-    rulestatus = apply_rewrite_list(r, dconf->rewriterules, dconf->directory);
+    rulestatus = apply_rewrite_list(r, dconf->rewriterules, NULL,
+                                    dconf->directory);
     if (rulestatus) {
         unsigned skip;
 
@@ -5260,9 +5912,58 @@ static const command_rec command_table[] = {
                      "an URL-applied regexp-pattern and a substitution URL"),
     AP_INIT_TAKE23(   "RewriteMap",      cmd_rewritemap,      NULL, RSRC_CONF,
                      "a mapname and a filename and options"),
+    AP_INIT_TAKE1(   "RewriteMapCacheSize", cmd_rewritemapcachesize, NULL,
+                     RSRC_CONF,
+                     "the maximum number of cached entries per map and "
+                     "child, or 0 for no limit"),
+    AP_INIT_TAKE12(  "RewriteMapSharedCache", cmd_rewritemapsharedcache, NULL,
+                     RSRC_CONF,
+                     "an socache provider[:args] for map entries shared by "
+                     "all children, and the entries' timeout in seconds"),
     { NULL }
 };
 
+static int rewrite_status_hook(request_rec *r, int flags)
+{
+    rewriterule_stats **stats = (rewriterule_stats **)rule_stats->elts;
+    int i;
+
+    if (!rule_stats->nelts) {
+        return OK;
+    }
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr />\n<h1>RewriteRule Statistics (this child)</h1>\n\n"
+                 "<table border=\"0\"><tr>"
+                 "<th>Rule</th><th>Pattern</th><th>Evaluated</th>"
+                 "<th>Matched</th><th>Time (&mu;s)</th></tr>\n", r);
+    }
+    for (i = 0; i < rule_stats->nelts; ++i) {
+        rewriterule_stats *st = stats[i];
+        apr_uint32_t evaluated = apr_atomic_read32(&st->evaluated);
+        apr_uint32_t matched = apr_atomic_read32(&st->matched);
+        apr_uint64_t usecs = rule_stats_read_usecs(st);
+
+        if (!(flags & AP_STATUS_SHORT)) {
+            ap_rprintf(r, "<tr><td>%s:%d</td><td>%s</td><td>%u</td>"
+                       "<td>%u</td><td>%" APR_UINT64_T_FMT "</td></tr>\n",
+                       ap_escape_html(r->pool, st->filename), st->line_num,
+                       ap_escape_html(r->pool, st->pattern),
+                       evaluated, matched, usecs);
+        }
+        else {
+            ap_rprintf(r, "RewriteRule[%d]: %s:%d %u %u %" APR_UINT64_T_FMT
+                       "\n", i, st->filename, st->line_num,
+                       evaluated, matched, usecs);
+        }
+    }
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("</table>\n", r);
+    }
+
+    return OK;
+}
+
 static void ap_register_rewrite_mapfunc(char *name, rewrite_mapfunc_t *func)
 {
     apr_hash_set(mapfunc_hash, name, strlen(name), (const void *)func);
@@ -5285,6 +5986,8 @@ static void register_hooks(apr_pool_t *p)
     ap_hook_pre_config(pre_config, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_post_config(post_config, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_child_init(init_child, NULL, NULL, APR_HOOK_MIDDLE);
+    APR_OPTIONAL_HOOK(ap, status_hook, rewrite_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
 
     ap_hook_fixups(hook_fixup, aszPre, NULL, APR_HOOK_FIRST);
     ap_hook_fixups(hook_mimetype, NULL, NULL, APR_HOOK_LAST);
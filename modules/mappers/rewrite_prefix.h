@@ -0,0 +1,137 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file rewrite_prefix.h
+ * @brief Literal prefixes of RewriteRule patterns, for mod_rewrite's rule
+ * dispatch and test/test-rewrite-prefix
+ *
+ * @defgroup MOD_REWRITE_PREFIX Literal prefixes of patterns
+ * @ingroup  MOD_REWRITE
+ * @{
+ */
+
+#ifndef REWRITE_PREFIX_H
+#define REWRITE_PREFIX_H
+
+#include "apr.h"
+#include "apr_lib.h"
+#include "apr_pools.h"
+
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+/*
+ * Extract the literal prefix which a subject must start with to match an
+ * anchored pattern, e.g. "/images/" for "^/images/(.*)$". Returns NULL if
+ * there is none or the pattern is too clever for us.
+ */
+static APR_INLINE char *pattern_literal_prefix(apr_pool_t *p,
+                                               const char *pattern,
+                                               int nocase, apr_size_t *len)
+{
+    const char *s;
+    char *prefix, *d;
+    int depth = 0, inclass = 0;
+
+    if (*pattern != '^') {
+        return NULL;
+    }
+
+    /* A top level alternative is not anchored. Bail out on quoting and
+     * inline options, which could hide or fake the grouping.
+     */
+    for (s = pattern; *s; ++s) {
+        if (*s == '\\') {
+            if (!*++s || *s == 'Q') {
+                return NULL;
+            }
+        }
+        else if (inclass) {
+            if (*s == ']') {
+                inclass = 0;
+            }
+        }
+        else if (*s == '[') {
+            inclass = 1;
+            if (s[1] == '^') {
+                ++s;
+            }
+            if (s[1] == ']') {
+                ++s;
+            }
+        }
+        else if (*s == '(') {
+            if (s[1] == '?' && (apr_isalpha(s[2]) || s[2] == '-')) {
+                return NULL;
+            }
+            ++depth;
+        }
+        else if (*s == ')') {
+            if (--depth < 0) {
+                return NULL;
+            }
+        }
+        else if (*s == '|' && !depth) {
+            return NULL;
+        }
+    }
+
+    prefix = d = apr_palloc(p, strlen(pattern));
+    for (s = pattern + 1; *s; ) {
+        const char *next;
+        char c;
+
+        if (*s == '\\') {
+            if (apr_isalnum(s[1])) {
+                break;      /* \d, \w, backreferences, ... */
+            }
+            c = s[1];
+            next = s + 2;
+        }
+        else if (strchr(".[]()|*+?{}^$", *s)) {
+            break;
+        }
+        else {
+            c = *s;
+            next = s + 1;
+        }
+
+        /* caseless matching of non ASCII bytes depends on the locale */
+        if (nocase && !apr_isascii(c)) {
+            break;
+        }
+        /* a quantified literal may be absent */
+        if (*next == '*' || *next == '?' || *next == '{') {
+            break;
+        }
+        *d++ = c;
+        if (*next == '+') {
+            break;
+        }
+        s = next;
+    }
+
+    if (d == prefix) {
+        return NULL;
+    }
+    *d = '\0';
+    *len = d - prefix;
+    return prefix;
+}
+
+#endif /* REWRITE_PREFIX_H */
+/** @} */
@@ -34,6 +34,10 @@
 #include "apr_portable.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
 
 #define APR_WANT_STDIO
 #define APR_WANT_STRFUNC
@@ -51,6 +55,7 @@
 #include "util_cfgtree.h"
 #include "util_varbuf.h"
 #include "mpm_common.h"
+#include "ap_mpm.h"
 
 #define APLOG_UNSET   (APLOG_NO_MODULE - 1)
 /* we know core's module_index is 0 */
@@ -1358,9 +1363,10 @@ AP_DECLARE(const char *) ap_walk_config(ap_directive_t *current,
     return NULL;
 }
 
-AP_DECLARE(const char *) ap_build_config(cmd_parms *parms,
-                                         apr_pool_t *p, apr_pool_t *temp_pool,
-                                         ap_directive_t **conftree)
+static const char *build_config(cmd_parms *parms,
+                                apr_pool_t *p, apr_pool_t *temp_pool,
+                                ap_directive_t **conftree,
+                                apr_size_t max_len)
 {
     ap_directive_t *current = *conftree;
     ap_directive_t *curr_parent = NULL;
@@ -1368,9 +1374,6 @@ AP_DECLARE(const char *) ap_build_config(cmd_parms *parms,
     ap_directive_t **last_ptr = NULL;
     apr_status_t rc;
     struct ap_varbuf vb;
-    apr_size_t max_len = VARBUF_MAX_LEN;
-    if (p == temp_pool)
-        max_len = HUGE_STRING_LEN; /* lower limit for .htaccess */
 
     ap_varbuf_init(temp_pool, &vb, VARBUF_INIT_LEN);
 
@@ -1436,6 +1439,17 @@ AP_DECLARE(const char *) ap_build_config(cmd_parms *parms,
     return NULL;
 }
 
+AP_DECLARE(const char *) ap_build_config(cmd_parms *parms,
+                                         apr_pool_t *p, apr_pool_t *temp_pool,
+                                         ap_directive_t **conftree)
+{
+    apr_size_t max_len = VARBUF_MAX_LEN;
+    if (p == temp_pool)
+        max_len = HUGE_STRING_LEN; /* lower limit for .htaccess */
+
+    return build_config(parms, p, temp_pool, conftree, max_len);
+}
+
 /*
  * Generic command functions...
  */
@@ -2080,13 +2094,364 @@ AP_DECLARE(int) ap_process_config_tree(server_rec *s,
     return OK;
 }
 
+/*
+ * Per-child cache of parsed .htaccess files.
+ *
+ * Parsing the same .htaccess files for every request is costly with
+ * AllowOverride All, so the per-dir config built from a file is kept and
+ * reused by later requests as long as the file keeps the same identity
+ * (device, inode, mtime and size) and is read with the same overrides by
+ * the same server.  Each entry lives in its own unmanaged pool; the
+ * requests using it hold a reference, so an evicted entry is only
+ * destroyed when the last of them is done.  The cache is bounded to
+ * HtaccessCacheMaxMem bytes and HtaccessCacheSize entries, the least
+ * recently used going first.  APR can't tell the size of a pool (but in
+ * debug builds), so an entry accounts for twice the size of its file,
+ * the tree of directives holding a copy of the text and the handlers
+ * usually keeping another of their arguments, plus its key, rounded up
+ * to the blocks its pool is allocated by.
+ *
+ * This only applies when the core opens the files (no other module hooks
+ * open_htaccess), and its stat() goes through the stat cache.
+ */
+
+#define HTACCESS_CACHE_BLOCK 8192
+
+typedef struct htaccess_entry_t htaccess_entry_t;
+
+typedef struct {
+    server_rec *server;
+    apr_table_t *override_list;
+    int override;
+    int override_opts;
+    apr_ino_t inode;
+    apr_dev_t device;
+    apr_time_t mtime;
+    apr_off_t size;
+} htaccess_key_t;
+
+struct htaccess_entry_t {
+    htaccess_entry_t *prev;     /* LRU list, most recently used first */
+    htaccess_entry_t *next;
+    apr_pool_t *pool;           /* holds this entry and the parsed config */
+    ap_conf_vector_t *conf;
+    unsigned int refs;          /* requests using conf */
+    int evicted;
+    apr_size_t size;            /* accounted memory */
+    apr_size_t keylen;
+    char *key;                  /* htaccess_key_t followed by the path */
+};
+
+typedef struct {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_hash_t *entries;
+    htaccess_entry_t *first;
+    htaccess_entry_t *last;
+    unsigned int count;
+    unsigned int max;
+    apr_size_t bytes;
+    apr_size_t max_bytes;
+} htaccess_cache_t;
+
+static htaccess_cache_t *htaccess_cache = NULL;
+
+static APR_INLINE void htaccess_cache_lock(void)
+{
+#if APR_HAS_THREADS
+    if (htaccess_cache && htaccess_cache->mutex) {
+        apr_thread_mutex_lock(htaccess_cache->mutex);
+    }
+#endif
+}
+
+static APR_INLINE void htaccess_cache_unlock(void)
+{
+#if APR_HAS_THREADS
+    if (htaccess_cache && htaccess_cache->mutex) {
+        apr_thread_mutex_unlock(htaccess_cache->mutex);
+    }
+#endif
+}
+
+/* Unlink an entry, under the lock */
+static void htaccess_cache_evict(htaccess_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        htaccess_cache->first = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        htaccess_cache->last = e->prev;
+    }
+    apr_hash_set(htaccess_cache->entries, e->key, e->keylen, NULL);
+    htaccess_cache->count--;
+    htaccess_cache->bytes -= e->size;
+
+    e->evicted = 1;
+    if (!e->refs) {
+        apr_pool_destroy(e->pool);
+    }
+}
+
+static apr_status_t htaccess_cache_release(void *data)
+{
+    htaccess_entry_t *e = data;
+
+    htaccess_cache_lock();
+    if (!--e->refs && e->evicted) {
+        apr_pool_destroy(e->pool);
+    }
+    htaccess_cache_unlock();
+
+    return APR_SUCCESS;
+}
+
+/* Take a reference for the (main) request, under the lock */
+static void htaccess_cache_acquire(request_rec *r, htaccess_entry_t *e)
+{
+    request_rec *top = r;
+
+    /* Subrequests' configs may end up in their main request */
+    while (top->main) {
+        top = top->main;
+    }
+    e->refs++;
+    apr_pool_cleanup_register(top->pool, e, htaccess_cache_release,
+                              apr_pool_cleanup_null);
+}
+
+static apr_status_t htaccess_cache_cleanup(void *dummy)
+{
+    if (htaccess_cache) {
+        while (htaccess_cache->first) {
+            htaccess_cache_evict(htaccess_cache->first);
+        }
+        htaccess_cache = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+void ap_htaccess_cache_child_init(apr_pool_t *pchild, unsigned int max,
+                                  apr_size_t max_bytes)
+{
+#if APR_HAS_THREADS
+    int threaded_mpm;
+#endif
+
+    htaccess_cache = NULL;
+    if (!max || !max_bytes) {
+        return;
+    }
+
+    htaccess_cache = apr_pcalloc(pchild, sizeof(*htaccess_cache));
+    htaccess_cache->max = max;
+    htaccess_cache->max_bytes = max_bytes;
+    htaccess_cache->entries = apr_hash_make(pchild);
+#if APR_HAS_THREADS
+    if (ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm) == APR_SUCCESS
+        && threaded_mpm
+        && apr_thread_mutex_create(&htaccess_cache->mutex,
+                                   APR_THREAD_MUTEX_DEFAULT,
+                                   pchild) != APR_SUCCESS) {
+        htaccess_cache = NULL;
+        return;
+    }
+#endif
+    apr_pool_cleanup_register(pchild, NULL, htaccess_cache_cleanup,
+                              apr_pool_cleanup_null);
+}
+
+/* Find or parse the .htaccess file FILENAME through the cache.
+ * Returns OK with *result set to the config (NULL if there is no such
+ * file), DECLINED if the file can't be cached, or an HTTP error.
+ */
+static int parse_htaccess_cached(ap_conf_vector_t **result, request_rec *r,
+                                 const cmd_parms *parms, const char *d,
+                                 const char *filename)
+{
+    htaccess_key_t hkey;
+    htaccess_entry_t *e, *other;
+    apr_size_t flen, keylen;
+    apr_finfo_t finfo;
+    apr_pool_t *pool, *ptemp;
+    ap_configfile_t *f;
+    ap_directive_t *temptree = NULL;
+    cmd_parms cparms;
+    const char *errmsg;
+    char *key;
+    apr_status_t rv;
+
+    rv = ap_statcache_stat(&finfo, filename, APR_FINFO_MIN | APR_FINFO_IDENT,
+                           r->pool);
+    if (APR_STATUS_IS_ENOENT(rv) || APR_STATUS_IS_ENOTDIR(rv)) {
+        *result = NULL;
+        return OK;
+    }
+    if ((rv != APR_SUCCESS && rv != APR_INCOMPLETE)
+        || finfo.filetype != APR_REG
+        || (finfo.valid & (APR_FINFO_MIN | APR_FINFO_IDENT))
+           != (APR_FINFO_MIN | APR_FINFO_IDENT)) {
+        return DECLINED;
+    }
+    if (finfo.size > (apr_off_t)htaccess_cache->max_bytes) {
+        return DECLINED;
+    }
+
+    memset(&hkey, 0, sizeof(hkey));
+    hkey.server = r->server;
+    hkey.override_list = parms->override_list;
+    hkey.override = parms->override;
+    hkey.override_opts = parms->override_opts;
+    hkey.inode = finfo.inode;
+    hkey.device = finfo.device;
+    hkey.mtime = finfo.mtime;
+    hkey.size = finfo.size;
+
+    flen = strlen(filename);
+    keylen = sizeof(hkey) + flen;
+    key = apr_palloc(r->pool, keylen);
+    memcpy(key, &hkey, sizeof(hkey));
+    memcpy(key + sizeof(hkey), filename, flen);
+
+    htaccess_cache_lock();
+    e = apr_hash_get(htaccess_cache->entries, key, keylen);
+    if (e) {
+        if (e->prev) {
+            /* Move to front */
+            e->prev->next = e->next;
+            if (e->next) {
+                e->next->prev = e->prev;
+            }
+            else {
+                htaccess_cache->last = e->prev;
+            }
+            e->prev = NULL;
+            e->next = htaccess_cache->first;
+            htaccess_cache->first->prev = e;
+            htaccess_cache->first = e;
+        }
+        htaccess_cache_acquire(r, e);
+        *result = e->conf;
+    }
+    htaccess_cache_unlock();
+    if (e) {
+        return OK;
+    }
+
+    rv = ap_pcfg_openfile(&f, r->pool, filename);
+    if (APR_STATUS_IS_ENOENT(rv) || APR_STATUS_IS_ENOTDIR(rv)) {
+        *result = NULL;
+        return OK;
+    }
+    if (rv != APR_SUCCESS) {
+        /* Let the uncached path report it */
+        return DECLINED;
+    }
+
+    if (apr_pool_create_unmanaged_ex(&pool, NULL, NULL) != APR_SUCCESS) {
+        ap_cfg_closefile(f);
+        return DECLINED;
+    }
+    apr_pool_tag(pool, "htaccess_cache");
+
+    e = apr_pcalloc(pool, sizeof(*e));
+    e->pool = pool;
+    e->size = APR_ALIGN(2 * (apr_size_t)finfo.size + keylen,
+                        HTACCESS_CACHE_BLOCK);
+    e->keylen = keylen;
+    e->key = apr_pmemdup(pool, key, keylen);
+    e->conf = ap_create_per_dir_config(pool);
+
+    /* What the directives keep must not come from the request, which is
+     * gone by the time the next one gets the cached config; so parse with
+     * a temporary pool of the entry's own, with the .htaccess line limit.
+     */
+    apr_pool_create(&ptemp, pool);
+    apr_pool_tag(ptemp, "htaccess_cache_temp");
+
+    cparms = *parms;
+    cparms.pool = pool;
+    cparms.temp_pool = ptemp;
+    cparms.path = apr_pstrdup(pool, d);
+    cparms.config_file = f;
+    errmsg = build_config(&cparms, pool, ptemp, &temptree, HUGE_STRING_LEN);
+    if (errmsg == NULL)
+        errmsg = ap_walk_config(temptree, &cparms, e->conf);
+
+    ap_cfg_closefile(f);
+
+    if (errmsg) {
+        ap_log_rerror(APLOG_MARK, APLOG_ALERT, 0, r,
+                      "%s: %s", filename, errmsg);
+        apr_pool_destroy(pool);
+        return HTTP_INTERNAL_SERVER_ERROR;
+    }
+    apr_pool_destroy(ptemp);
+
+    htaccess_cache_lock();
+    other = apr_hash_get(htaccess_cache->entries, e->key, keylen);
+    if (other) {
+        /* Another thread was quicker, use its entry */
+        htaccess_cache_acquire(r, other);
+        *result = other->conf;
+        htaccess_cache_unlock();
+        apr_pool_destroy(pool);
+        return OK;
+    }
+    if (e->size > htaccess_cache->max_bytes) {
+        /* Too big to be cached, but good for this request */
+        e->evicted = 1;
+        htaccess_cache_acquire(r, e);
+        *result = e->conf;
+        htaccess_cache_unlock();
+        return OK;
+    }
+    while ((htaccess_cache->count >= htaccess_cache->max
+            || htaccess_cache->bytes + e->size > htaccess_cache->max_bytes)
+           && htaccess_cache->last) {
+        htaccess_cache_evict(htaccess_cache->last);
+    }
+    e->next = htaccess_cache->first;
+    if (htaccess_cache->first) {
+        htaccess_cache->first->prev = e;
+    }
+    else {
+        htaccess_cache->last = e;
+    }
+    htaccess_cache->first = e;
+    htaccess_cache->count++;
+    htaccess_cache->bytes += e->size;
+    apr_hash_set(htaccess_cache->entries, e->key, keylen, e);
+    htaccess_cache_acquire(r, e);
+    *result = e->conf;
+    htaccess_cache_unlock();
+
+    return OK;
+}
+
 apr_status_t ap_open_htaccess(request_rec *r, const char *dir_name,
                               const char *access_name,
                               ap_configfile_t **conffile,
                               const char **full_name)
 {
+    apr_status_t rv;
+
     *full_name = ap_make_full_path(r->pool, dir_name, access_name);
-    return ap_pcfg_openfile(conffile, r->pool, *full_name);
+    if (ap_statcache_absent(*full_name, &rv)) {
+        return rv;
+    }
+    rv = ap_pcfg_openfile(conffile, r->pool, *full_name);
+    if (APR_STATUS_IS_ENOENT(rv) || APR_STATUS_IS_ENOTDIR(rv)) {
+        ap_statcache_set_absent(*full_name, rv);
+    }
+    return rv;
 }
 
 AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
@@ -2123,6 +2488,23 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
     while (access_names[0]) {
         const char *access_name = ap_getword_conf(r->pool, &access_names);
 
+        if (htaccess_cache && _hooks.link_open_htaccess->nelts == 1) {
+            int res;
+
+            filename = ap_make_full_path(r->pool, d, access_name);
+            res = parse_htaccess_cached(&dc, r, &parms, d, filename);
+            if (res == OK) {
+                if (dc) {
+                    *result = dc;
+                    break;
+                }
+                continue;
+            }
+            if (res != DECLINED) {
+                return res;
+            }
+        }
+
         filename = NULL;
         status = ap_run_open_htaccess(r, d, access_name, &f, &filename);
         if (status == APR_SUCCESS) {
@@ -47,6 +47,7 @@
 #include "scoreboard.h"
 #include "mod_core.h"
 #include "mod_proxy.h"
+#include "mod_status.h"
 #include "ap_listen.h"
 #include "ap_provider.h"
 
@@ -571,6 +572,15 @@ static void *merge_core_server_configs(apr_pool_t *p, void *basev, void *virtv)
                            ? virt->merge_trailers
                            : base->merge_trailers;
 
+    conf->io_uring = (virt->io_uring != AP_IO_URING_UNSET)
+                     ? virt->io_uring
+                     : base->io_uring;
+
+    conf->output_coalescing =
+        (virt->output_coalescing != AP_OUTPUT_COALESCING_UNSET)
+        ? virt->output_coalescing
+        : base->output_coalescing;
+
     conf->protocols = ((virt->protocols->nelts > 0) ?
                        virt->protocols : base->protocols);
     conf->protocols_honor_order = ((virt->protocols_honor_order < 0) ?
@@ -3099,6 +3109,146 @@ static const char *set_runtime_dir(cmd_parms *cmd, void *dummy, const char *arg)
     return NULL;
 }
 
+#ifndef AP_MERGE_CACHE_DEFAULT
+#define AP_MERGE_CACHE_DEFAULT 1024
+#endif
+static unsigned int merge_cache_size = AP_MERGE_CACHE_DEFAULT;
+
+static const char *set_merge_cache_size(cmd_parms *cmd, void *dummy,
+                                        const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *end;
+    long val;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    val = strtol(arg, &end, 10);
+    if (*end || val < 0) {
+        return "MergedConfigCacheSize must be a non-negative number of "
+               "entries";
+    }
+    merge_cache_size = (unsigned int)val;
+
+    return NULL;
+}
+
+#ifndef AP_STAT_CACHE_SIZE_DEFAULT
+#define AP_STAT_CACHE_SIZE_DEFAULT 8192
+#endif
+#ifndef AP_HTACCESS_CACHE_DEFAULT
+#define AP_HTACCESS_CACHE_DEFAULT 256
+#endif
+#ifndef AP_HTACCESS_CACHE_MEM_DEFAULT
+#define AP_HTACCESS_CACHE_MEM_DEFAULT 4096      /* KBytes */
+#endif
+static unsigned int htaccess_cache_size = AP_HTACCESS_CACHE_DEFAULT;
+static apr_size_t htaccess_cache_mem = AP_HTACCESS_CACHE_MEM_DEFAULT * 1024;
+
+static const char *set_htaccess_cache_size(cmd_parms *cmd, void *dummy,
+                                           const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *end;
+    long val;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    val = strtol(arg, &end, 10);
+    if (*end || val < 0) {
+        return "HtaccessCacheSize must be a non-negative number of entries";
+    }
+    htaccess_cache_size = (unsigned int)val;
+
+    return NULL;
+}
+
+static const char *set_htaccess_cache_mem(cmd_parms *cmd, void *dummy,
+                                          const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *end;
+    long val;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    val = strtol(arg, &end, 10);
+    if (*end || val < 0 || (apr_size_t)val > APR_SIZE_MAX / 1024) {
+        return "HtaccessCacheMaxMem must be a non-negative number of KBytes";
+    }
+    htaccess_cache_mem = (apr_size_t)val * 1024;
+
+    return NULL;
+}
+
+static apr_interval_time_t stat_cache_ttl = 0;
+static unsigned int stat_cache_size = AP_STAT_CACHE_SIZE_DEFAULT;
+static int stat_cache_inotify = 0;
+
+static const char *set_stat_cache_ttl(cmd_parms *cmd, void *dummy,
+                                      const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+
+    if (ap_timeout_parameter_parse(arg, &stat_cache_ttl, "s") != APR_SUCCESS
+        || stat_cache_ttl < 0) {
+        return "StatCacheTTL must be a non-negative duration";
+    }
+
+    return NULL;
+}
+
+static const char *set_stat_cache_size(cmd_parms *cmd, void *dummy,
+                                       const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *end;
+    long val;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    val = strtol(arg, &end, 10);
+    if (*end || val <= 0) {
+        return "StatCacheSize must be a positive number of entries";
+    }
+    stat_cache_size = (unsigned int)val;
+
+    return NULL;
+}
+
+static const char *set_stat_cache_inotify(cmd_parms *cmd, void *dummy,
+                                          int arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+
+#ifndef HAVE_SYS_INOTIFY_H
+    if (arg) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, cmd->server, APLOGNO(03396)
+                     "StatCacheInotify: inotify is not available on this "
+                     "platform, ignored");
+    }
+#endif
+    stat_cache_inotify = arg;
+
+    return NULL;
+}
+
 static const char *set_timeout(cmd_parms *cmd, void *dummy, const char *arg)
 {
     const char *err = ap_check_cmd_context(cmd, NOT_IN_DIR_LOC_FILE);
@@ -4394,6 +4544,44 @@ static const char *set_merge_trailers(cmd_parms *cmd, void *dummy, int arg)
     return NULL;
 }
 
+static const char *set_enable_io_uring(cmd_parms *cmd, void *dummy, int arg)
+{
+    core_server_config *conf = ap_get_module_config(cmd->server->module_config,
+                                                    &core_module);
+#if !HAVE_IO_URING || !APR_HAS_THREADS
+    if (arg) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, cmd->server, APLOGNO(03386)
+                     "EnableIOUring: io_uring is not available in this "
+                     "build, ignored");
+    }
+#endif
+    conf->io_uring = (arg ? AP_IO_URING_ENABLE : AP_IO_URING_DISABLE);
+
+    return NULL;
+}
+
+static const char *set_output_coalescing(cmd_parms *cmd, void *dummy,
+                                         const char *arg)
+{
+    core_server_config *conf = ap_get_module_config(cmd->server->module_config,
+                                                    &core_module);
+
+    if (!strcasecmp(arg, "Off")) {
+        conf->output_coalescing = AP_OUTPUT_COALESCING_OFF;
+    }
+    else if (!strcasecmp(arg, "Latency")) {
+        conf->output_coalescing = AP_OUTPUT_COALESCING_LATENCY;
+    }
+    else if (!strcasecmp(arg, "Packets")) {
+        conf->output_coalescing = AP_OUTPUT_COALESCING_PACKETS;
+    }
+    else {
+        return "OutputCoalescing must be Off, Latency or Packets";
+    }
+
+    return NULL;
+}
+
 /* Note --- ErrorDocument will now work from .htaccess files.
  * The AllowOverride of Fileinfo allows webmasters to turn it off
  */
@@ -4538,6 +4726,22 @@ AP_INIT_TAKE_ARGV("LogLevelOverride", set_loglevel_override, NULL, RSRC_CONF,
   "Override LogLevel for clients with certain IPs"),
 AP_INIT_TAKE1("NameVirtualHost", ap_set_name_virtual_host, NULL, RSRC_CONF,
   "A numeric IP address:port, or the name of a host"),
+AP_INIT_TAKE1("MergedConfigCacheSize", set_merge_cache_size, NULL, RSRC_CONF,
+  "Maximum number of merged per-directory configurations cached by each "
+  "child process (0 disables the cache)"),
+AP_INIT_TAKE1("HtaccessCacheSize", set_htaccess_cache_size, NULL, RSRC_CONF,
+  "Maximum number of parsed .htaccess files cached by each child process "
+  "(0 disables the cache)"),
+AP_INIT_TAKE1("HtaccessCacheMaxMem", set_htaccess_cache_mem, NULL, RSRC_CONF,
+  "Maximum memory in KBytes of the parsed .htaccess files cached by each "
+  "child process (0 disables the cache)"),
+AP_INIT_TAKE1("StatCacheTTL", set_stat_cache_ttl, NULL, RSRC_CONF,
+  "How long each child caches the stat() results of the directory walk "
+  "(0 disables the cache)"),
+AP_INIT_TAKE1("StatCacheSize", set_stat_cache_size, NULL, RSRC_CONF,
+  "Maximum number of stat() results cached by each child process"),
+AP_INIT_FLAG("StatCacheInotify", set_stat_cache_inotify, NULL, RSRC_CONF,
+  "Invalidate cached stat() results on inotify events (Linux)"),
 AP_INIT_TAKE1("ServerTokens", set_serv_tokens, NULL, RSRC_CONF,
   "Determine tokens displayed in the Server: header - Min(imal), "
   "Major, Minor, Prod(uctOnly), OS, or Full"),
@@ -4655,6 +4859,11 @@ AP_INIT_TAKE1("TraceEnable", set_trace_enable, NULL, RSRC_CONF,
               "'on' (default), 'off' or 'extended' to trace request body content"),
 AP_INIT_FLAG("MergeTrailers", set_merge_trailers, NULL, RSRC_CONF,
               "merge request trailers into request headers or not"),
+AP_INIT_FLAG("EnableIOUring", set_enable_io_uring, NULL, RSRC_CONF,
+              "Controls whether io_uring may be used to transmit files"),
+AP_INIT_TAKE1("OutputCoalescing", set_output_coalescing, NULL, RSRC_CONF,
+              "Off, Latency or Packets: how small writes are gathered "
+              "before being sent to the client"),
 AP_INIT_ITERATE("HttpProtocol", set_http_protocol, NULL, RSRC_CONF,
               "'min=0.9' (default) or 'min=1.0' to allow/deny HTTP/0.9; "
               "'liberal', 'strict', 'strict,log-only'"),
@@ -5035,6 +5244,13 @@ static int core_pre_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *ptem
 
     mpm_common_pre_config(pconf);
 
+    merge_cache_size = AP_MERGE_CACHE_DEFAULT;
+    stat_cache_ttl = 0;
+    stat_cache_size = AP_STAT_CACHE_SIZE_DEFAULT;
+    stat_cache_inotify = 0;
+    htaccess_cache_size = AP_HTACCESS_CACHE_DEFAULT;
+    htaccess_cache_mem = AP_HTACCESS_CACHE_MEM_DEFAULT * 1024;
+
     return OK;
 }
 
@@ -5290,6 +5506,7 @@ AP_CORE_DECLARE(conn_rec *) ap_create_slave_connection(conn_rec *c)
     sc->master = c;
     sc->input_filters = NULL;
     sc->output_filters = NULL;
+    sc->spare_brigades = NULL;
     sc->pool = pool;
     new = apr_array_push(c->slaves);
     new->c = sc;
@@ -5331,6 +5548,13 @@ static void core_child_init(apr_pool_t *pchild, server_rec *s)
      */
     proc.pid = getpid();
     apr_random_after_fork(&proc);
+
+    ap_core_output_filter_child_init(pchild, s);
+    ap_merge_cache_child_init(pchild, s, merge_cache_size);
+    ap_statcache_child_init(pchild, s, stat_cache_ttl, stat_cache_size,
+                            stat_cache_inotify);
+    ap_htaccess_cache_child_init(pchild, htaccess_cache_size,
+                                 htaccess_cache_mem);
 }
 
 static void core_optional_fn_retrieve(void)
@@ -5436,7 +5660,7 @@ static apr_status_t core_insert_network_bucket(conn_rec *c,
 static apr_status_t core_dirwalk_stat(apr_finfo_t *finfo, request_rec *r,
                                       apr_int32_t wanted) 
 {
-    return apr_stat(finfo, r->filename, wanted, r->pool);
+    return ap_statcache_stat(finfo, r->filename, wanted, r->pool);
 }
 
 static void core_dump_config(apr_pool_t *p, server_rec *s)
@@ -5592,6 +5816,10 @@ static void register_hooks(apr_pool_t *p)
     ap_hook_insert_network_bucket(core_insert_network_bucket, NULL, NULL,
                                   APR_HOOK_REALLY_LAST);
     ap_hook_dirwalk_stat(core_dirwalk_stat, NULL, NULL, APR_HOOK_REALLY_LAST);
+    APR_OPTIONAL_HOOK(ap, status_hook, ap_statcache_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
+    APR_OPTIONAL_HOOK(ap, status_hook, ap_core_output_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
     ap_hook_open_htaccess(ap_open_htaccess, NULL, NULL, APR_HOOK_REALLY_LAST);
     ap_hook_optional_fn_retrieve(core_optional_fn_retrieve, NULL, NULL,
                                  APR_HOOK_MIDDLE);
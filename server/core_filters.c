@@ -25,6 +25,7 @@
 #include "apr_fnmatch.h"
 #include "apr_hash.h"
 #include "apr_thread_proc.h"    /* for RLIMIT stuff */
+#include "apr_thread_mutex.h"
 
 #define APR_WANT_IOVEC
 #define APR_WANT_STRFUNC
@@ -51,9 +52,41 @@
 #include "ap_listen.h"
 
 #include "mod_so.h" /* for ap_find_loaded_module_symbol */
+#include "mod_status.h"
+
+#if HAVE_IO_URING && APR_HAS_THREADS
+#define AP_HAS_IO_URING 1
+#include "apr_portable.h"
+#include <liburing.h>
+#include <sys/socket.h>
+#else
+#define AP_HAS_IO_URING 0
+#endif
+
+#if HAVE_STRUCT_TCP_INFO_TCPI_SEGS_OUT
+#include "apr_portable.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+#if HAVE_STRUCT_TCP_INFO_TCPI_SEGS_OUT && defined(TCP_INFO)
+#define AP_HAS_TCP_INFO 1
+#else
+#define AP_HAS_TCP_INFO 0
+#endif
 
 #define AP_MIN_SENDFILE_BYTES           (256)
 
+/* Unless OutputCoalescing is Off, runs of in-memory buckets smaller than
+ * AP_COALESCE_SMALL_BYTES (about one Ethernet MSS) are copied into heap
+ * buckets of AP_COALESCE_BLOCK_BYTES (the largest TLS record) when there
+ * are more of them than a single writev() takes.  With Packets, a response
+ * is also held back until AP_COALESCE_BLOCK_BYTES are pending, and the
+ * socket stays corked until the end of the response.
+ */
+#define AP_COALESCE_SMALL_BYTES         (1448)
+#define AP_COALESCE_BLOCK_BYTES         (16384)
+
 /**
  * Remove all zero length buckets from the brigade.
  */
@@ -81,8 +114,31 @@ struct core_output_filter_ctx {
     apr_bucket_brigade *tmp_flush_bb;
     apr_bucket_brigade *empty_bb;
     apr_size_t bytes_written;
+    int corked;
+    /* not yet added to output_stats */
+    apr_uint32_t responses;
+    apr_uint32_t syscalls;
+    apr_uint32_t coalesced;
+    apr_uint32_t held;
+    /* tcpi_segs_out when output_stats was last updated */
+    apr_uint32_t segs_out;
 };
 
+/* Per child totals of the core output filter, for mod_status */
+static struct {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    int enabled;
+    apr_uint64_t responses;
+    apr_uint64_t syscalls;
+    apr_uint64_t coalesced;
+    apr_uint64_t held;
+    /* TCP segments sent, for packet_responses responses */
+    apr_uint64_t packets;
+    apr_uint64_t packet_responses;
+} output_stats;
+
 struct core_filter_ctx {
     apr_bucket_brigade *tmpbb;
 };
@@ -328,29 +384,48 @@ apr_status_t ap_core_input_filter(ap_filter_t *f, apr_bucket_brigade *b,
 
 static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
                                              apr_bucket_brigade *bb,
-                                             apr_size_t *bytes_written,
+                                             core_output_filter_ctx_t *ctx,
                                              conn_rec *c);
 
 static void remove_empty_buckets(apr_bucket_brigade *bb);
 
+static void set_cork(core_output_filter_ctx_t *ctx, apr_socket_t *s, int on);
+
+static int coalesce_output(core_output_filter_ctx_t *ctx,
+                           apr_bucket_brigade *bb, int policy, int *end);
+
+static void update_output_stats(core_output_filter_ctx_t *ctx,
+                                apr_socket_t *s);
+
 static apr_status_t send_brigade_blocking(apr_socket_t *s,
                                           apr_bucket_brigade *bb,
-                                          apr_size_t *bytes_written,
+                                          core_output_filter_ctx_t *ctx,
                                           conn_rec *c);
 
 static apr_status_t writev_nonblocking(apr_socket_t *s,
                                        struct iovec *vec, apr_size_t nvec,
                                        apr_bucket_brigade *bb,
-                                       apr_size_t *cumulative_bytes_written,
+                                       core_output_filter_ctx_t *ctx,
                                        conn_rec *c);
 
 #if APR_HAS_SENDFILE
 static apr_status_t sendfile_nonblocking(apr_socket_t *s,
                                          apr_bucket *bucket,
-                                         apr_size_t *cumulative_bytes_written,
+                                         core_output_filter_ctx_t *ctx,
                                          conn_rec *c);
 #endif
 
+#if AP_HAS_IO_URING
+typedef struct core_uring_t core_uring_t;
+static core_uring_t *uring_get(conn_rec *c);
+static apr_status_t uring_send_nonblocking(core_uring_t *u, apr_socket_t *s,
+                                           struct iovec *vec, apr_size_t nvec,
+                                           apr_bucket *bucket,
+                                           apr_bucket_brigade *bb,
+                                           core_output_filter_ctx_t *ctx,
+                                           conn_rec *c);
+#endif
+
 /* Optional function coming from mod_logio, used for logging of output
  * traffic
  */
@@ -361,9 +436,11 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
     conn_rec *c = f->c;
     core_net_rec *net = f->ctx;
     core_output_filter_ctx_t *ctx = net->out_ctx;
+    core_server_config *conf;
     apr_bucket *flush_upto = NULL;
     apr_status_t rv;
     int loglevel = ap_get_conn_module_loglevel(c, APLOG_MODULE_INDEX);
+    int policy, end = 0, write_completion, responses = 0;
 
     /* Fail quickly if the connection has already been aborted. */
     if (c->aborted) {
@@ -389,6 +466,18 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
         }
         bb = ctx->empty_bb;
     }
+    else {
+        apr_bucket *e;
+
+        for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+             e = APR_BUCKET_NEXT(e)) {
+            if (AP_BUCKET_IS_EOR(e)) {
+                responses++;
+            }
+        }
+        ctx->responses += responses;
+    }
+    write_completion = APR_BRIGADE_EMPTY(bb);
 
     /* Scan through the brigade and decide whether to attempt a write,
      * and how much to write, based on the following rules:
@@ -436,9 +525,36 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
     ap_filter_reinstate_brigade(f, bb, &flush_upto);
 
     if (APR_BRIGADE_EMPTY(bb)) {
+        if (ctx->corked) {
+            set_cork(ctx, net->client_socket, 0);
+        }
         return APR_SUCCESS;
     }
 
+    /* Unless OutputCoalescing is Off, gather small buckets so that a
+     * writev() carries more data.  With Packets, wait for more data while
+     * the response is small and incomplete, and keep the socket corked
+     * until its end, so that the headers and the start of the body share
+     * packets.
+     */
+    conf = ap_get_core_module_config(c->base_server->module_config);
+    policy = conf->output_coalescing;
+    if (policy == AP_OUTPUT_COALESCING_UNSET) {
+        policy = AP_OUTPUT_COALESCING_LATENCY;
+    }
+    if (policy != AP_OUTPUT_COALESCING_OFF) {
+        if (coalesce_output(ctx, bb, policy, &end)
+            && flush_upto == NULL && !write_completion) {
+            ctx->held++;
+            ap_filter_setaside_brigade(f, bb);
+            return APR_SUCCESS;
+        }
+        if (policy == AP_OUTPUT_COALESCING_PACKETS && !ctx->corked
+            && !end && !write_completion) {
+            set_cork(ctx, net->client_socket, 1);
+        }
+    }
+
     if (flush_upto != NULL) {
         ctx->tmp_flush_bb = apr_brigade_split_ex(bb, flush_upto,
                                                  ctx->tmp_flush_bb);
@@ -446,8 +562,7 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
                 ap_log_cerror(APLOG_MARK, APLOG_TRACE8, 0, c,
                               "flushing now");
         }
-        rv = send_brigade_blocking(net->client_socket, bb,
-                                   &(ctx->bytes_written), c);
+        rv = send_brigade_blocking(net->client_socket, bb, ctx, c);
         if (rv != APR_SUCCESS) {
             /* The client has aborted the connection */
             ap_log_cerror(APLOG_MARK, APLOG_TRACE1, rv, c,
@@ -464,8 +579,7 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
         APR_BRIGADE_CONCAT(bb, ctx->tmp_flush_bb);
     }
 
-    rv = send_brigade_nonblocking(net->client_socket, bb, &(ctx->bytes_written),
-            c);
+    rv = send_brigade_nonblocking(net->client_socket, bb, ctx, c);
     if ((rv != APR_SUCCESS) && (!APR_STATUS_IS_EAGAIN(rv))) {
         /* The client has aborted the connection */
         ap_log_cerror(
@@ -485,6 +599,13 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
     remove_empty_buckets(bb);
     ap_filter_setaside_brigade(f, bb);
 
+    if (ctx->corked && (end || write_completion)) {
+        set_cork(ctx, net->client_socket, 0);
+    }
+    if (responses) {
+        update_output_stats(ctx, net->client_socket);
+    }
+
     return APR_SUCCESS;
 }
 
@@ -500,7 +621,7 @@ apr_status_t ap_core_output_filter(ap_filter_t *f, apr_bucket_brigade *bb)
 
 static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
                                              apr_bucket_brigade *bb,
-                                             apr_size_t *bytes_written,
+                                             core_output_filter_ctx_t *ctx,
                                              conn_rec *c)
 {
     apr_bucket *bucket, *next;
@@ -526,19 +647,27 @@ static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
 
             if ((apr_file_flags_get(fd) & APR_SENDFILE_ENABLED) &&
                 (bucket->length >= AP_MIN_SENDFILE_BYTES)) {
-                if (nvec > 0) {
+                /* Already corked for the whole response with
+                 * OutputCoalescing Packets
+                 */
+                int cork = (nvec > 0 && !ctx->corked);
+                if (cork) {
                     (void)apr_socket_opt_set(s, APR_TCP_NOPUSH, 1);
-                    rv = writev_nonblocking(s, vec, nvec, bb, bytes_written, c);
+                }
+                if (nvec > 0) {
+                    rv = writev_nonblocking(s, vec, nvec, bb, ctx, c);
                     if (rv != APR_SUCCESS) {
-                        (void)apr_socket_opt_set(s, APR_TCP_NOPUSH, 0);
+                        if (cork) {
+                            (void)apr_socket_opt_set(s, APR_TCP_NOPUSH, 0);
+                        }
                         return rv;
                     }
                 }
-                rv = sendfile_nonblocking(s, bucket, bytes_written, c);
-                if (nvec > 0) {
+                rv = sendfile_nonblocking(s, bucket, ctx, c);
+                if (cork) {
                     (void)apr_socket_opt_set(s, APR_TCP_NOPUSH, 0);
-                    nvec = 0;
                 }
+                nvec = 0;
                 if (rv != APR_SUCCESS) {
                     return rv;
                 }
@@ -546,6 +675,27 @@ static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
             }
         }
 #endif /* APR_HAS_SENDFILE */
+#if AP_HAS_IO_URING
+        /* Files which can't be sendfile'd are read into registered buffers
+         * and written from there, along with the preceding data, in a
+         * single io_uring submission (if enabled).
+         */
+        if (APR_BUCKET_IS_FILE(bucket)
+                && (bucket->length >= AP_MIN_SENDFILE_BYTES)) {
+            core_uring_t *u = uring_get(c);
+            if (u) {
+                rv = uring_send_nonblocking(u, s, vec, nvec, bucket, bb,
+                                            ctx, c);
+                if (rv != APR_ENOTIMPL) {
+                    nvec = 0;
+                    if (rv != APR_SUCCESS) {
+                        return rv;
+                    }
+                    break;
+                }
+            }
+        }
+#endif /* AP_HAS_IO_URING */
         /* didn't sendfile */
         if (!APR_BUCKET_IS_METADATA(bucket)) {
             const char *data;
@@ -557,7 +707,7 @@ static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
             if (APR_STATUS_IS_EAGAIN(rv)) {
                 /* Read would block; flush any pending data and retry. */
                 if (nvec) {
-                    rv = writev_nonblocking(s, vec, nvec, bb, bytes_written, c);
+                    rv = writev_nonblocking(s, vec, nvec, bb, ctx, c);
                     if (rv) {
                         return rv;
                     }
@@ -576,7 +726,7 @@ static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
             vec[nvec].iov_len = length;
             nvec++;
             if (nvec == MAX_IOVEC_TO_WRITE) {
-                rv = writev_nonblocking(s, vec, nvec, bb, bytes_written, c);
+                rv = writev_nonblocking(s, vec, nvec, bb, ctx, c);
                 nvec = 0;
                 if (rv != APR_SUCCESS) {
                     return rv;
@@ -587,7 +737,7 @@ static apr_status_t send_brigade_nonblocking(apr_socket_t *s,
     }
 
     if (nvec > 0) {
-        rv = writev_nonblocking(s, vec, nvec, bb, bytes_written, c);
+        rv = writev_nonblocking(s, vec, nvec, bb, ctx, c);
         if (rv != APR_SUCCESS) {
             return rv;
         }
@@ -607,16 +757,161 @@ static void remove_empty_buckets(apr_bucket_brigade *bb)
     }
 }
 
+static void set_cork(core_output_filter_ctx_t *ctx, apr_socket_t *s, int on)
+{
+    /* TCP_CORK on Linux, TCP_NOPUSH on BSDs; uncorking sends what the
+     * kernel held back.
+     */
+    (void)apr_socket_opt_set(s, APR_TCP_NOPUSH, on);
+    ctx->syscalls++;
+    ctx->corked = on;
+}
+
+static APR_INLINE int is_small_bucket(apr_bucket *e)
+{
+    return (APR_BUCKET_IS_TRANSIENT(e) || APR_BUCKET_IS_HEAP(e)
+            || APR_BUCKET_IS_POOL(e) || APR_BUCKET_IS_IMMORTAL(e))
+           && e->length < AP_COALESCE_SMALL_BYTES;
+}
+
+/* Copy the runs of small in-memory buckets of bb into heap buckets of
+ * AP_COALESCE_BLOCK_BYTES, when bb has more buckets than a single writev()
+ * takes.  Returns whether the write should rather be held back (policy
+ * Packets), and sets *end if bb contains a flush or the end of a response.
+ */
+static int coalesce_output(core_output_filter_ctx_t *ctx,
+                           apr_bucket_brigade *bb, int policy, int *end)
+{
+    apr_bucket *e, *next, *block = NULL;
+    apr_size_t nvec = 0, nsmall = 0, bytes = 0;
+    int hold = (policy == AP_OUTPUT_COALESCING_PACKETS);
+
+    *end = 0;
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        if (APR_BUCKET_IS_METADATA(e)) {
+            if (APR_BUCKET_IS_FLUSH(e) || AP_BUCKET_IS_EOR(e)) {
+                *end = 1;
+            }
+            continue;
+        }
+        if (e->length == (apr_size_t)-1 || APR_BUCKET_IS_FILE(e)) {
+            hold = 0;
+        }
+        else {
+            bytes += e->length;
+        }
+        if (is_small_bucket(e)) {
+            nsmall++;
+        }
+        nvec++;
+    }
+    if (*end || bytes >= AP_COALESCE_BLOCK_BYTES) {
+        hold = 0;
+    }
+    if (hold || nvec <= MAX_IOVEC_TO_WRITE || nsmall < 2) {
+        return hold;
+    }
+
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb); e = next) {
+        apr_bucket_heap *h;
+        const char *data;
+        apr_size_t len;
+
+        next = APR_BUCKET_NEXT(e);
+
+        if (!is_small_bucket(e)) {
+            block = NULL;
+            continue;
+        }
+        if (block && AP_COALESCE_BLOCK_BYTES - block->length < e->length) {
+            block = NULL;
+        }
+        if (!block) {
+            char *buf;
+
+            /* Nothing to gain from copying a lone small bucket */
+            if (next == APR_BRIGADE_SENTINEL(bb) || !is_small_bucket(next)) {
+                continue;
+            }
+            buf = apr_bucket_alloc(AP_COALESCE_BLOCK_BYTES, bb->bucket_alloc);
+            block = apr_bucket_heap_create(buf, AP_COALESCE_BLOCK_BYTES,
+                                           apr_bucket_free, bb->bucket_alloc);
+            block->length = 0;
+            APR_BUCKET_INSERT_BEFORE(e, block);
+        }
+
+        /* in-memory buckets */
+        if (apr_bucket_read(e, &data, &len, APR_BLOCK_READ) != APR_SUCCESS) {
+            block = NULL;
+            continue;
+        }
+        h = block->data;
+        memcpy(h->base + block->start + block->length, data, len);
+        block->length += len;
+        apr_bucket_delete(e);
+        ctx->coalesced++;
+    }
+
+    return 0;
+}
+
+static void update_output_stats(core_output_filter_ctx_t *ctx,
+                                apr_socket_t *s)
+{
+    apr_uint32_t packets = 0;
+    int packets_known = 0;
+
+#if AP_HAS_TCP_INFO
+    /* One getsockopt() per response, only with ExtendedStatus */
+    if (ap_extended_status) {
+        struct tcp_info ti;
+        socklen_t len = sizeof(ti);
+        apr_os_sock_t sd;
+
+        if (apr_os_sock_get(&sd, s) == APR_SUCCESS
+            && getsockopt(sd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) {
+            packets = ti.tcpi_segs_out - ctx->segs_out;
+            ctx->segs_out = ti.tcpi_segs_out;
+            packets_known = 1;
+        }
+    }
+#endif
+
+    if (!output_stats.enabled) {
+        return;
+    }
+#if APR_HAS_THREADS
+    if (output_stats.mutex) {
+        apr_thread_mutex_lock(output_stats.mutex);
+    }
+#endif
+    output_stats.responses += ctx->responses;
+    output_stats.syscalls += ctx->syscalls;
+    output_stats.coalesced += ctx->coalesced;
+    output_stats.held += ctx->held;
+    if (packets_known) {
+        output_stats.packets += packets;
+        output_stats.packet_responses += ctx->responses;
+    }
+#if APR_HAS_THREADS
+    if (output_stats.mutex) {
+        apr_thread_mutex_unlock(output_stats.mutex);
+    }
+#endif
+    ctx->responses = ctx->syscalls = ctx->coalesced = ctx->held = 0;
+}
+
 static apr_status_t send_brigade_blocking(apr_socket_t *s,
                                           apr_bucket_brigade *bb,
-                                          apr_size_t *bytes_written,
+                                          core_output_filter_ctx_t *ctx,
                                           conn_rec *c)
 {
     apr_status_t rv;
 
     rv = APR_SUCCESS;
     while (!APR_BRIGADE_EMPTY(bb)) {
-        rv = send_brigade_nonblocking(s, bb, bytes_written, c);
+        rv = send_brigade_nonblocking(s, bb, ctx, c);
         if (rv != APR_SUCCESS) {
             if (APR_STATUS_IS_EAGAIN(rv)) {
                 /* Wait until we can send more data */
@@ -644,10 +939,39 @@ static apr_status_t send_brigade_blocking(apr_socket_t *s,
     return rv;
 }
 
+/* Remove from bb the buckets (or parts) of vec[*offset..nvec-1] which have
+ * been written (n bytes), updating vec and *offset accordingly.
+ */
+static void remove_written_buckets(apr_bucket_brigade *bb,
+                                   struct iovec *vec, apr_size_t nvec,
+                                   apr_size_t *offset, apr_size_t n)
+{
+    apr_size_t i;
+
+    for (i = *offset; i < nvec; ) {
+        apr_bucket *bucket = APR_BRIGADE_FIRST(bb);
+        if (APR_BUCKET_IS_METADATA(bucket)) {
+            apr_bucket_delete(bucket);
+        }
+        else if (n >= vec[i].iov_len) {
+            apr_bucket_delete(bucket);
+            (*offset)++;
+            n -= vec[i++].iov_len;
+        }
+        else {
+            apr_bucket_split(bucket, n);
+            apr_bucket_delete(bucket);
+            vec[i].iov_len -= n;
+            vec[i].iov_base = (char *) vec[i].iov_base + n;
+            break;
+        }
+    }
+}
+
 static apr_status_t writev_nonblocking(apr_socket_t *s,
                                        struct iovec *vec, apr_size_t nvec,
                                        apr_bucket_brigade *bb,
-                                       apr_size_t *cumulative_bytes_written,
+                                       core_output_filter_ctx_t *ctx,
                                        conn_rec *c)
 {
     apr_status_t rv = APR_SUCCESS, arv;
@@ -671,26 +995,10 @@ static apr_status_t writev_nonblocking(apr_socket_t *s,
     while (bytes_written < bytes_to_write) {
         apr_size_t n = 0;
         rv = apr_socket_sendv(s, vec + offset, nvec - offset, &n);
+        ctx->syscalls++;
         if (n > 0) {
             bytes_written += n;
-            for (i = offset; i < nvec; ) {
-                apr_bucket *bucket = APR_BRIGADE_FIRST(bb);
-                if (APR_BUCKET_IS_METADATA(bucket)) {
-                    apr_bucket_delete(bucket);
-                }
-                else if (n >= vec[i].iov_len) {
-                    apr_bucket_delete(bucket);
-                    offset++;
-                    n -= vec[i++].iov_len;
-                }
-                else {
-                    apr_bucket_split(bucket, n);
-                    apr_bucket_delete(bucket);
-                    vec[i].iov_len -= n;
-                    vec[i].iov_base = (char *) vec[i].iov_base + n;
-                    break;
-                }
-            }
+            remove_written_buckets(bb, vec, nvec, &offset, n);
         }
         if (rv != APR_SUCCESS) {
             break;
@@ -699,7 +1007,7 @@ static apr_status_t writev_nonblocking(apr_socket_t *s,
     if ((ap__logio_add_bytes_out != NULL) && (bytes_written > 0)) {
         ap__logio_add_bytes_out(c, bytes_written);
     }
-    *cumulative_bytes_written += bytes_written;
+    ctx->bytes_written += bytes_written;
 
     arv = apr_socket_timeout_set(s, old_timeout);
     if ((arv != APR_SUCCESS) && (rv == APR_SUCCESS)) {
@@ -714,7 +1022,7 @@ static apr_status_t writev_nonblocking(apr_socket_t *s,
 
 static apr_status_t sendfile_nonblocking(apr_socket_t *s,
                                          apr_bucket *bucket,
-                                         apr_size_t *cumulative_bytes_written,
+                                         core_output_filter_ctx_t *ctx,
                                          conn_rec *c)
 {
     apr_status_t rv = APR_SUCCESS;
@@ -749,6 +1057,7 @@ static apr_status_t sendfile_nonblocking(apr_socket_t *s,
             return arv;
         }
         rv = apr_socket_sendfile(s, fd, NULL, &file_offset, &n, 0);
+        ctx->syscalls++;
         if (rv == APR_SUCCESS) {
             bytes_written += n;
             file_offset += n;
@@ -761,7 +1070,7 @@ static apr_status_t sendfile_nonblocking(apr_socket_t *s,
     if ((ap__logio_add_bytes_out != NULL) && (bytes_written > 0)) {
         ap__logio_add_bytes_out(c, bytes_written);
     }
-    *cumulative_bytes_written += bytes_written;
+    ctx->bytes_written += bytes_written;
     if ((bytes_written < file_length) && (bytes_written > 0)) {
         apr_bucket_split(bucket, bytes_written);
         apr_bucket_delete(bucket);
@@ -773,3 +1082,373 @@ static apr_status_t sendfile_nonblocking(apr_socket_t *s,
 }
 
 #endif
+
+#if AP_HAS_IO_URING
+
+/* Each thread has its own ring, with AP_URING_CHUNKS registered buffers
+ * where the files are read before being written to the socket.  The read
+ * and write of each chunk are linked, so that a short read or write stops
+ * the chain, and the whole chain goes with a single io_uring_enter().
+ */
+#define AP_URING_CHUNKS         4
+#define AP_URING_CHUNK_SIZE     (64 * 1024)
+#define AP_URING_ENTRIES        (2 * AP_URING_CHUNKS)
+
+/* Up to this amount of (headers) data is copied in front of the file's
+ * first chunk, otherwise it's written with writev_nonblocking() first.
+ */
+#define AP_URING_MAX_PREPEND    (AP_URING_CHUNK_SIZE / 4)
+
+struct core_uring_t {
+    struct io_uring ring;
+    char *bufs;
+};
+
+static apr_threadkey_t *uring_key = NULL;
+static int uring_unavailable = 0;
+static core_uring_t uring_none; /* threads which failed to setup a ring */
+
+static void uring_destroy(void *data)
+{
+    core_uring_t *u = data;
+
+    if (u && u != &uring_none) {
+        io_uring_queue_exit(&u->ring);
+        free(u->bufs);
+        free(u);
+    }
+}
+
+static core_uring_t *uring_get(conn_rec *c)
+{
+    core_server_config *conf;
+    core_uring_t *u = NULL;
+    void *bufs = NULL;
+    int ret;
+
+    if (!uring_key || uring_unavailable) {
+        return NULL;
+    }
+    conf = ap_get_core_module_config(c->base_server->module_config);
+    if (conf->io_uring != AP_IO_URING_ENABLE) {
+        return NULL;
+    }
+
+    apr_threadkey_private_get((void **)&u, uring_key);
+    if (u) {
+        return (u != &uring_none) ? u : NULL;
+    }
+
+    u = calloc(1, sizeof *u);
+    if (!u) {
+        return NULL;
+    }
+    ret = io_uring_queue_init(AP_URING_ENTRIES, &u->ring, 0);
+    if (ret == 0) {
+        ret = posix_memalign(&bufs, 4096,
+                             AP_URING_CHUNKS * AP_URING_CHUNK_SIZE);
+        if (ret == 0) {
+            struct iovec iov[AP_URING_CHUNKS];
+            int i;
+
+            u->bufs = bufs;
+            for (i = 0; i < AP_URING_CHUNKS; ++i) {
+                iov[i].iov_base = u->bufs + i * AP_URING_CHUNK_SIZE;
+                iov[i].iov_len = AP_URING_CHUNK_SIZE;
+            }
+            ret = io_uring_register_buffers(&u->ring, iov, AP_URING_CHUNKS);
+        }
+        else {
+            ret = -ret;
+        }
+        if (ret < 0) {
+            io_uring_queue_exit(&u->ring);
+            free(u->bufs);
+        }
+    }
+    if (ret < 0) {
+        /* Not supported or not allowed by the system, don't try again */
+        if (ret == -ENOSYS || ret == -EPERM) {
+            uring_unavailable = 1;
+        }
+        ap_log_cerror(APLOG_MARK, APLOG_WARNING, APR_FROM_OS_ERROR(-ret), c,
+                      APLOGNO(03387) "io_uring setup failed, falling back "
+                      "to regular I/O");
+        free(u);
+        u = &uring_none;
+    }
+    apr_threadkey_private_set(u, uring_key);
+
+    return (u != &uring_none) ? u : NULL;
+}
+
+static apr_status_t uring_send_nonblocking(core_uring_t *u, apr_socket_t *s,
+                                           struct iovec *vec, apr_size_t nvec,
+                                           apr_bucket *bucket,
+                                           apr_bucket_brigade *bb,
+                                           core_output_filter_ctx_t *ctx,
+                                           conn_rec *c)
+{
+    apr_bucket_file *file_bucket = (apr_bucket_file *)(bucket->data);
+    apr_os_sock_t sd;
+    apr_os_file_t fd;
+    apr_size_t len[AP_URING_CHUNKS];
+    int res[AP_URING_ENTRIES];
+    apr_size_t prepend = 0, offset = 0, remaining, file_written = 0;
+    apr_size_t bytes_written = 0, i;
+    apr_off_t file_offset = bucket->start;
+    apr_interval_time_t old_timeout;
+    apr_status_t rv = APR_SUCCESS, arv;
+    unsigned int nsqe = 0, n;
+    int ret;
+
+    /* XTHREAD files may need to be reopened by the bucket itself */
+    if ((apr_file_flags_get(file_bucket->fd) & APR_FOPEN_XTHREAD)
+            || apr_os_file_get(&fd, file_bucket->fd) != APR_SUCCESS
+            || apr_os_sock_get(&sd, s) != APR_SUCCESS) {
+        return APR_ENOTIMPL;
+    }
+
+    if (nvec > 0) {
+        for (i = 0; i < nvec; i++) {
+            prepend += vec[i].iov_len;
+        }
+        if (prepend > AP_URING_MAX_PREPEND) {
+            rv = writev_nonblocking(s, vec, nvec, bb,
+                                    ctx, c);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            prepend = 0;
+            nvec = 0;
+        }
+        else {
+            char *pos = u->bufs;
+            for (i = 0; i < nvec; i++) {
+                memcpy(pos, vec[i].iov_base, vec[i].iov_len);
+                pos += vec[i].iov_len;
+            }
+        }
+    }
+
+    /* The ring must not block on the socket */
+    arv = apr_socket_timeout_get(s, &old_timeout);
+    if (arv != APR_SUCCESS) {
+        return arv;
+    }
+    arv = apr_socket_timeout_set(s, 0);
+    if (arv != APR_SUCCESS) {
+        return arv;
+    }
+
+    remaining = bucket->length;
+    for (n = 0; n < AP_URING_CHUNKS && remaining > 0; ++n) {
+        char *buf = u->bufs + n * AP_URING_CHUNK_SIZE;
+        apr_size_t head = (n == 0) ? prepend : 0;
+        struct io_uring_sqe *sqe;
+
+        len[n] = AP_URING_CHUNK_SIZE - head;
+        if (len[n] > remaining) {
+            len[n] = remaining;
+        }
+
+        sqe = io_uring_get_sqe(&u->ring);
+        AP_DEBUG_ASSERT(sqe != NULL);
+        io_uring_prep_read_fixed(sqe, fd, buf + head, len[n], file_offset, n);
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe->user_data = nsqe++;
+
+        sqe = io_uring_get_sqe(&u->ring);
+        AP_DEBUG_ASSERT(sqe != NULL);
+        io_uring_prep_write_fixed(sqe, sd, buf, head + len[n], 0, n);
+        remaining -= len[n];
+        file_offset += len[n];
+        if (n + 1 < AP_URING_CHUNKS && remaining > 0) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+        sqe->user_data = nsqe++;
+    }
+
+    do {
+        ret = io_uring_submit_and_wait(&u->ring, nsqe);
+        ctx->syscalls++;
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        rv = APR_FROM_OS_ERROR(-ret);
+        goto ring_failed;
+    }
+    for (i = 0; i < nsqe; ) {
+        struct io_uring_cqe *cqe;
+        ret = io_uring_wait_cqe(&u->ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            rv = APR_FROM_OS_ERROR(-ret);
+            goto ring_failed;
+        }
+        res[cqe->user_data] = cqe->res;
+        io_uring_cqe_seen(&u->ring, cqe);
+        i++;
+    }
+
+    for (i = 0; i < n; i++) {
+        int r = res[2 * i], w = res[2 * i + 1];
+        apr_size_t head = (i == 0) ? prepend : 0;
+
+        if (r < 0 || (apr_size_t)r != len[i]) {
+            /* short read means the file was truncated under us */
+            rv = (r < 0) ? APR_FROM_OS_ERROR(-r) : APR_EOF;
+            break;
+        }
+        if (w < 0) {
+            rv = APR_FROM_OS_ERROR(-w);
+            break;
+        }
+        bytes_written += w;
+        if (head) {
+            apr_size_t done = ((apr_size_t)w < head) ? (apr_size_t)w : head;
+            remove_written_buckets(bb, vec, nvec, &offset, done);
+            w -= done;
+        }
+        file_written += w;
+        if ((apr_size_t)w < len[i]) {
+            rv = APR_EAGAIN;
+            break;
+        }
+    }
+    /* Anything written after the failure would have corrupted the stream,
+     * the links should have prevented it.
+     */
+    for (++i; i < n; i++) {
+        if (res[2 * i + 1] > 0) {
+            ap_log_cerror(APLOG_MARK, APLOG_ERR, 0, c, APLOGNO(03388)
+                          "io_uring wrote out of order, aborting");
+            rv = APR_EGENERAL;
+            break;
+        }
+    }
+
+    if (file_written == bucket->length) {
+        apr_bucket_delete(bucket);
+    }
+    else if (file_written > 0) {
+        apr_bucket_split(bucket, file_written);
+        apr_bucket_delete(bucket);
+    }
+    goto out;
+
+ring_failed:
+    /* The ring's state is unknown, stop using it for this thread (leaking
+     * it, since the kernel may still be using the buffers).
+     */
+    ap_log_cerror(APLOG_MARK, APLOG_ERR, rv, c, APLOGNO(03389)
+                  "io_uring submission failed, falling back to regular I/O");
+    apr_threadkey_private_set(&uring_none, uring_key);
+
+out:
+    if ((ap__logio_add_bytes_out != NULL) && (bytes_written > 0)) {
+        ap__logio_add_bytes_out(c, bytes_written);
+    }
+    ctx->bytes_written += bytes_written;
+
+    arv = apr_socket_timeout_set(s, old_timeout);
+    if ((arv != APR_SUCCESS) && (rv == APR_SUCCESS)) {
+        rv = arv;
+    }
+    return rv;
+}
+
+#endif /* AP_HAS_IO_URING */
+
+void ap_core_output_filter_child_init(apr_pool_t *pchild, server_rec *s)
+{
+#if APR_HAS_THREADS
+    int threaded_mpm;
+
+    if (ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm) == APR_SUCCESS
+        && threaded_mpm
+        && apr_thread_mutex_create(&output_stats.mutex,
+                                   APR_THREAD_MUTEX_DEFAULT,
+                                   pchild) != APR_SUCCESS) {
+        output_stats.mutex = NULL;
+    }
+    else
+#endif
+    output_stats.enabled = 1;
+
+#if AP_HAS_IO_URING
+    for (; s; s = s->next) {
+        core_server_config *conf;
+        conf = ap_get_core_module_config(s->module_config);
+        if (conf->io_uring == AP_IO_URING_ENABLE) {
+            if (apr_threadkey_private_create(&uring_key, uring_destroy,
+                                             pchild) != APR_SUCCESS) {
+                uring_key = NULL;
+            }
+            break;
+        }
+    }
+#endif
+}
+
+int ap_core_output_status_hook(request_rec *r, int flags)
+{
+    apr_uint64_t responses, syscalls, coalesced, held, packets, presponses;
+
+    if (!output_stats.enabled) {
+        return OK;
+    }
+
+#if APR_HAS_THREADS
+    if (output_stats.mutex) {
+        apr_thread_mutex_lock(output_stats.mutex);
+    }
+#endif
+    responses = output_stats.responses;
+    syscalls = output_stats.syscalls;
+    coalesced = output_stats.coalesced;
+    held = output_stats.held;
+    packets = output_stats.packets;
+    presponses = output_stats.packet_responses;
+#if APR_HAS_THREADS
+    if (output_stats.mutex) {
+        apr_thread_mutex_unlock(output_stats.mutex);
+    }
+#endif
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rprintf(r, "<hr />\n<h1>Network Output (this child)</h1>\n\n"
+                   "<table border=\"0\"><tr><th>Responses</th>"
+                   "<th>Syscalls/Response</th><th>Packets/Response</th>"
+                   "<th>Coalesced Buckets</th><th>Held Writes</th></tr>\n"
+                   "<tr><td>%" APR_UINT64_T_FMT "</td><td>%.2f</td>",
+                   responses,
+                   responses ? (double)syscalls / responses : 0.0);
+        if (presponses) {
+            ap_rprintf(r, "<td>%.2f</td>", (double)packets / presponses);
+        }
+        else {
+            ap_rputs("<td>-</td>", r);
+        }
+        ap_rprintf(r, "<td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td></tr>\n</table>\n",
+                   coalesced, held);
+    }
+    else {
+        ap_rprintf(r, "OutputResponses: %" APR_UINT64_T_FMT "\n"
+                   "OutputSyscalls: %" APR_UINT64_T_FMT "\n"
+                   "OutputSyscallsPerResponse: %.2f\n",
+                   responses, syscalls,
+                   responses ? (double)syscalls / responses : 0.0);
+        if (presponses) {
+            ap_rprintf(r, "OutputPacketsPerResponse: %.2f\n",
+                       (double)packets / presponses);
+        }
+        ap_rprintf(r, "OutputCoalescedBuckets: %" APR_UINT64_T_FMT "\n"
+                   "OutputHeldWrites: %" APR_UINT64_T_FMT "\n",
+                   coalesced, held);
+    }
+
+    return OK;
+}
@@ -95,7 +95,6 @@
 #include "mpm_default.h"
 #include "http_vhost.h"
 #include "unixd.h"
-#include "apr_skiplist.h"
 #include "util_time.h"
 
 #include <signal.h>
@@ -170,6 +169,8 @@ static unsigned int worker_factor = DEFAULT_WORKER_FACTOR * WORKER_FACTOR_SCALE;
     /* AsyncRequestWorkerFactor * 16 */
 
 static int threads_per_child = 0;           /* ThreadsPerChild */
+static int num_listener_threads = 1;        /* ListenerThreadsPerChild */
+static int per_thread_allocator = 0;        /* PerThreadAllocator */
 static int ap_daemons_to_start = 0;         /* StartServers */
 static int min_spare_threads = 0;           /* MinSpareThreads */
 static int max_spare_threads = 0;           /* MaxSpareThreads */
@@ -196,13 +197,12 @@ static fd_queue_t *worker_queue;
 static fd_queue_info_t *worker_queue_info;
 static int mpm_state = AP_MPMQ_STARTING;
 
-static apr_thread_mutex_t *timeout_mutex;
-
 module AP_MODULE_DECLARE_DATA mpm_event_module;
 
 /* forward declare */
 struct event_srv_cfg_s;
 typedef struct event_srv_cfg_s event_srv_cfg;
+typedef struct event_shard_t event_shard_t;
 
 struct event_conn_state_t {
     /** APR_RING of expiration timeouts */
@@ -215,6 +215,8 @@ struct event_conn_state_t {
     request_rec *r;
     /** server config this struct refers to */
     event_srv_cfg *sc;
+    /** listener shard (pollset and timeout queues) owning this conn */
+    event_shard_t *shard;
     /** is the current conn_rec suspended?  (disassociated with
      * a particular MPM thread; for suspend_/resume_connection
      * hooks)
@@ -237,24 +239,63 @@ struct timeout_queue {
     apr_interval_time_t timeout;
     struct timeout_queue *next;
 };
+
 /*
+ * Each listener thread owns a shard of the connections, with its own
+ * pollset, timeout queues and timer wheel.  Shard 0 also polls the
+ * listening sockets and the poll callbacks; accepted connections and timed
+ * callbacks are then spread round-robin over all the shards
+ * (ListenerThreadsPerChild).
+ *
  * Several timeout queues that use different timeouts, so that we always can
  * simply append to the end.
  *   write_completion_q uses vhost's TimeOut
  *   keepalive_q        uses vhost's KeepAliveTimeOut
  *   linger_q           uses MAX_SECS_TO_LINGER
  *   short_linger_q     uses SECONDS_TO_LINGER
+ *
+ * The pollset is for sockets that are in any of the timeout queues.
+ * Currently we use the timeout_mutex to make sure that connections are
+ * added/removed atomically to/from both the pollset and a timeout queue.
+ * Otherwise some confusion can happen under high load if timeout queues
+ * and pollset get out of sync.
+ * XXX: It should be possible to make the lock unnecessary in many or even all
+ * XXX: cases.
  */
-static struct timeout_queue *write_completion_q,
-                            *keepalive_q,
-                            *linger_q,
-                            *short_linger_q;
+struct event_shard_t {
+    int id;
+    apr_pollset_t *pollset;
+    apr_thread_mutex_t *timeout_mutex;
+    struct timeout_queue *write_completion_q,
+                         *keepalive_q,
+                         *linger_q,
+                         *short_linger_q;
+    ap_timer_wheel_t *timers;
+    apr_thread_t *thread;
+    apr_os_thread_t *os_thread;
+};
+static event_shard_t *shards;
+
+/* With PerThreadAllocator, the requests' pools get their memory from the
+ * allocator of the worker thread which created them (indexed by thread
+ * slot) rather than from the connection's, so that the memory retained
+ * (up to MaxMemFree) is bounded by the number of threads instead of the
+ * number of (keep-alive) connections.  They are never destroyed because
+ * requests may outlive their thread.
+ */
+static apr_allocator_t **thread_allocators = NULL;
+static apr_uint32_t next_shard = 0;         /* round-robin for new conns */
+static apr_uint32_t next_timer_shard = 0;   /* round-robin for timers */
+static apr_uint32_t listeners_running = 0;  /* listener threads not exited */
+
+#define MAX_LISTENER_THREADS 64
 
 static apr_pollfd_t *listener_pollfd;
 
 /*
  * Macros for accessing struct timeout_queue.
- * For TO_QUEUE_APPEND and TO_QUEUE_REMOVE, timeout_mutex must be held.
+ * For TO_QUEUE_APPEND and TO_QUEUE_REMOVE, the shard's timeout_mutex must
+ * be held.
  */
 #define TO_QUEUE_APPEND(q, el)                                                \
     do {                                                                      \
@@ -284,16 +325,9 @@ static apr_pollfd_t *listener_pollfd;
 
 #define TO_QUEUE_ELEM_INIT(el) APR_RING_ELEM_INIT(el, timeout_list)
 
-/*
- * The pollset for sockets that are in any of the timeout queues. Currently
- * we use the timeout_mutex to make sure that connections are added/removed
- * atomically to/from both event_pollset and a timeout queue. Otherwise
- * some confusion can happen under high load if timeout queues and pollset
- * get out of sync.
- * XXX: It should be possible to make the lock unnecessary in many or even all
- * XXX: cases.
- */
-static apr_pollset_t *event_pollset;
+/* The vhost's write completion and keepalive queues of the conn's shard */
+#define CS_WC_Q(cs) ((cs)->sc->wc_q[(cs)->shard->id])
+#define CS_KA_Q(cs) ((cs)->sc->ka_q[(cs)->shard->id])
 
 #if HAVE_SERF
 typedef struct {
@@ -308,7 +342,7 @@ static serf_context_t *g_serf;
 typedef struct
 {
     int pslot;  /* process slot */
-    int tslot;  /* worker slot of the thread */
+    int tslot;  /* worker slot of the thread, or shard of the listener */
 } proc_info;
 
 /* Structure used to pass information to the thread responsible for
@@ -317,7 +351,7 @@ typedef struct
 typedef struct
 {
     apr_thread_t **threads;
-    apr_thread_t *listener;
+    int listeners_started;
     int child_num_arg;
     apr_threadattr_t *threadattr;
 } thread_starter;
@@ -394,8 +428,9 @@ static event_child_bucket *all_buckets, /* All listeners buckets */
                           *my_bucket;   /* Current child bucket */
 
 struct event_srv_cfg_s {
-    struct timeout_queue *wc_q,
-                         *ka_q;
+    /* per shard queues (indexed by shard id) */
+    struct timeout_queue **wc_q,
+                         **ka_q;
 };
 
 #define ID_FROM_CHILD_THREAD(c, t)    ((c * thread_limit) + t)
@@ -425,7 +460,6 @@ static apr_pool_t *pchild;      /* Pool for httpd child stuff */
 static pid_t ap_my_pid;         /* Linux getpid() doesn't work except in main
                                    thread. Use this instead */
 static pid_t parent_pid;
-static apr_os_thread_t *listener_os_thread;
 
 /* The LISTENER_SIGNAL signal will be sent from the main thread to the
  * listener thread to wake it up for graceful termination (what a child
@@ -444,7 +478,7 @@ static void disable_listensocks(int process_slot)
 {
     int i;
     for (i = 0; i < num_listensocks; i++) {
-        apr_pollset_remove(event_pollset, &listener_pollfd[i]);
+        apr_pollset_remove(shards[0].pollset, &listener_pollfd[i]);
     }
     ap_scoreboard_image->parent[process_slot].not_accepting = 1;
 }
@@ -462,7 +496,7 @@ static void enable_listensocks(int process_slot)
                  apr_atomic_read32(&suspended_count),
                  ap_queue_info_get_idlers(worker_queue_info));
     for (i = 0; i < num_listensocks; i++)
-        apr_pollset_add(event_pollset, &listener_pollfd[i]);
+        apr_pollset_add(shards[0].pollset, &listener_pollfd[i]);
     /*
      * XXX: This is not yet optimal. If many workers suddenly become available,
      * XXX: the parent may kill some processes off too soon.
@@ -484,25 +518,32 @@ static void close_worker_sockets(void)
 static void wakeup_listener(void)
 {
     listener_may_exit = 1;
-    if (!listener_os_thread) {
+    if (!shards || !shards[0].os_thread) {
         /* XXX there is an obscure path that this doesn't handle perfectly:
          *     right after listener thread is created but before
-         *     listener_os_thread is set, the first worker thread hits an
+         *     its os_thread is set, the first worker thread hits an
          *     error and starts graceful termination
          */
         return;
     }
 
-    /* unblock the listener if it's waiting for a worker */
+    /* unblock the listeners if they are waiting for a worker */
     ap_queue_info_term(worker_queue_info);
 
     /*
      * we should just be able to "kill(ap_my_pid, LISTENER_SIGNAL)" on all
-     * platforms and wake up the listener thread since it is the only thread
-     * with SIGHUP unblocked, but that doesn't work on Linux
+     * platforms and wake up the listener threads since they are the only
+     * threads with SIGHUP unblocked, but that doesn't work on Linux
      */
 #ifdef HAVE_PTHREAD_KILL
-    pthread_kill(*listener_os_thread, LISTENER_SIGNAL);
+    {
+        int i;
+        for (i = 0; i < num_listener_threads; i++) {
+            if (shards[i].os_thread) {
+                pthread_kill(*shards[i].os_thread, LISTENER_SIGNAL);
+            }
+        }
+    }
 #else
     kill(ap_my_pid, LISTENER_SIGNAL);
 #endif
@@ -861,6 +902,7 @@ static int start_lingering_close_common(event_conn_state_t *cs, int in_worker)
 {
     apr_status_t rv;
     struct timeout_queue *q;
+    event_shard_t *shard = cs->shard;
     apr_socket_t *csd = cs->pfd.desc.s;
 #ifdef AP_DEBUG
     {
@@ -877,11 +919,11 @@ static int start_lingering_close_common(event_conn_state_t *cs, int in_worker)
      * DoS attacks.
      */
     if (apr_table_get(cs->c->notes, "short-lingering-close")) {
-        q = short_linger_q;
+        q = shard->short_linger_q;
         cs->pub.state = CONN_STATE_LINGER_SHORT;
     }
     else {
-        q = linger_q;
+        q = shard->linger_q;
         cs->pub.state = CONN_STATE_LINGER_NORMAL;
     }
     apr_atomic_inc32(&lingering_count);
@@ -891,20 +933,20 @@ static int start_lingering_close_common(event_conn_state_t *cs, int in_worker)
     else {
         cs->c->sbh = NULL;
     }
-    apr_thread_mutex_lock(timeout_mutex);
+    apr_thread_mutex_lock(shard->timeout_mutex);
     TO_QUEUE_APPEND(q, cs);
     cs->pfd.reqevents = (
             cs->pub.sense == CONN_SENSE_WANT_WRITE ? APR_POLLOUT :
                     APR_POLLIN) | APR_POLLHUP | APR_POLLERR;
     cs->pub.sense = CONN_SENSE_DEFAULT;
-    rv = apr_pollset_add(event_pollset, &cs->pfd);
-    apr_thread_mutex_unlock(timeout_mutex);
+    rv = apr_pollset_add(shard->pollset, &cs->pfd);
+    apr_thread_mutex_unlock(shard->timeout_mutex);
     if (rv != APR_SUCCESS && !APR_STATUS_IS_EEXIST(rv)) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, ap_server_conf, APLOGNO(03092)
                      "start_lingering_close: apr_pollset_add failure");
-        apr_thread_mutex_lock(timeout_mutex);
+        apr_thread_mutex_lock(shard->timeout_mutex);
         TO_QUEUE_REMOVE(q, cs);
-        apr_thread_mutex_unlock(timeout_mutex);
+        apr_thread_mutex_unlock(shard->timeout_mutex);
         apr_socket_close(cs->pfd.desc.s);
         ap_push_pool(worker_queue_info, cs->p);
         return 0;
@@ -1082,6 +1124,8 @@ static void process_socket(apr_thread_t *thd, apr_pool_t * p, apr_socket_t * soc
         cs->p = p;
         cs->sc = ap_get_module_config(ap_server_conf->module_config,
                                       &mpm_event_module);
+        cs->shard = &shards[apr_atomic_inc32(&next_shard)
+                            % num_listener_threads];
         cs->pfd.desc_type = APR_POLL_SOCKET;
         cs->pfd.reqevents = APR_POLLIN;
         cs->pfd.desc.s = sock;
@@ -1172,14 +1216,14 @@ read_request:
              */
             cs->queue_timestamp = apr_time_now();
             notify_suspend(cs);
-            apr_thread_mutex_lock(timeout_mutex);
-            TO_QUEUE_APPEND(cs->sc->wc_q, cs);
+            apr_thread_mutex_lock(cs->shard->timeout_mutex);
+            TO_QUEUE_APPEND(CS_WC_Q(cs), cs);
             cs->pfd.reqevents = (
                     cs->pub.sense == CONN_SENSE_WANT_READ ? APR_POLLIN :
                             APR_POLLOUT) | APR_POLLHUP | APR_POLLERR;
             cs->pub.sense = CONN_SENSE_DEFAULT;
-            rc = apr_pollset_add(event_pollset, &cs->pfd);
-            apr_thread_mutex_unlock(timeout_mutex);
+            rc = apr_pollset_add(cs->shard->pollset, &cs->pfd);
+            apr_thread_mutex_unlock(cs->shard->timeout_mutex);
             return;
         }
         else if (c->keepalive != AP_CONN_KEEPALIVE || c->aborted ||
@@ -1209,13 +1253,13 @@ read_request:
          */
         cs->queue_timestamp = apr_time_now();
         notify_suspend(cs);
-        apr_thread_mutex_lock(timeout_mutex);
-        TO_QUEUE_APPEND(cs->sc->ka_q, cs);
+        apr_thread_mutex_lock(cs->shard->timeout_mutex);
+        TO_QUEUE_APPEND(CS_KA_Q(cs), cs);
 
         /* Add work to pollset. */
         cs->pfd.reqevents = APR_POLLIN;
-        rc = apr_pollset_add(event_pollset, &cs->pfd);
-        apr_thread_mutex_unlock(timeout_mutex);
+        rc = apr_pollset_add(cs->shard->pollset, &cs->pfd);
+        apr_thread_mutex_unlock(cs->shard->timeout_mutex);
 
         if (rc != APR_SUCCESS) {
             ap_log_error(APLOG_MARK, APLOG_ERR, rc, ap_server_conf, APLOGNO(03093)
@@ -1245,14 +1289,14 @@ static apr_status_t event_resume_suspended (conn_rec *c) {
     apr_atomic_dec32(&suspended_count);
     c->suspended_baton = NULL;
 
-    apr_thread_mutex_lock(timeout_mutex);
-    TO_QUEUE_APPEND(cs->sc->wc_q, cs);
+    apr_thread_mutex_lock(cs->shard->timeout_mutex);
+    TO_QUEUE_APPEND(CS_WC_Q(cs), cs);
     cs->pfd.reqevents = (
             cs->pub.sense == CONN_SENSE_WANT_READ ? APR_POLLIN :
                     APR_POLLOUT) | APR_POLLHUP | APR_POLLERR;
     cs->pub.sense = CONN_SENSE_DEFAULT;
-    apr_pollset_add(event_pollset, &cs->pfd);
-    apr_thread_mutex_unlock(timeout_mutex);
+    apr_pollset_add(cs->shard->pollset, &cs->pfd);
+    apr_thread_mutex_unlock(cs->shard->timeout_mutex);
 
     return OK;
 }
@@ -1371,14 +1415,14 @@ static apr_status_t init_pollset(apr_pool_t *p)
         pfd->client_data = pt;
 
         apr_socket_opt_set(pfd->desc.s, APR_SO_NONBLOCK, 1);
-        apr_pollset_add(event_pollset, pfd);
+        apr_pollset_add(shards[0].pollset, pfd);
 
         lr->accept_func = ap_unixd_accept;
     }
 
 #if HAVE_SERF
     baton = apr_pcalloc(p, sizeof(*baton));
-    baton->pollset = event_pollset;
+    baton->pollset = shards[0].pollset;
     /* TODO: subpools, threads, reuse, etc.  -- currently use malloc() inside :( */
     baton->pool = p;
 
@@ -1464,34 +1508,6 @@ static void get_worker(int *have_idle_worker_p, int blocking, int *all_busy)
     }
 }
 
-/* Structures to reuse */
-static APR_RING_HEAD(timer_free_ring_t, timer_event_t) timer_free_ring;
-
-static apr_skiplist *timer_skiplist;
-
-/* The following compare function is used by apr_skiplist_insert() to keep the
- * elements (timers) sorted and provide O(log n) complexity (this is also true
- * for apr_skiplist_{find,remove}(), but those are not used in MPM event where
- * inserted timers are not searched nor removed, but with apr_skiplist_pop()
- * which does use any compare function).  It is meant to return 0 when a == b,
- * <0 when a < b, and >0 when a > b.  However apr_skiplist_insert() will not
- * add duplicates (i.e. a == b), and apr_skiplist_add() is only available in
- * APR 1.6, yet multiple timers could possibly be created in the same micro-
- * second (duplicates with regard to apr_time_t); therefore we implement the
- * compare function to return +1 instead of 0 when compared timers are equal,
- * thus duplicates are still added after each other (in order of insertion).
- */
-static int timer_comp(void *a, void *b)
-{
-    apr_time_t t1 = (apr_time_t) ((timer_event_t *)a)->when;
-    apr_time_t t2 = (apr_time_t) ((timer_event_t *)b)->when;
-    AP_DEBUG_ASSERT(t1);
-    AP_DEBUG_ASSERT(t2);
-    return ((t1 < t2) ? -1 : 1);
-}
-
-static apr_thread_mutex_t *g_timer_skiplist_mtx;
-
 static timer_event_t * event_get_timer_event(apr_time_t t,
                                              ap_mpm_callback_fn_t *cbfn,
                                              void *baton,
@@ -1499,18 +1515,19 @@ static timer_event_t * event_get_timer_event(apr_time_t t,
                                              apr_array_header_t *remove)
 {
     timer_event_t *te;
-    /* oh yeah, and make locking smarter/fine grained. */
-
-    apr_thread_mutex_lock(g_timer_skiplist_mtx);
+    event_shard_t *shard;
 
-    if (!APR_RING_EMPTY(&timer_free_ring, timer_event_t, link)) {
-        te = APR_RING_FIRST(&timer_free_ring);
-        APR_RING_REMOVE(te, link);
+    /* Poll callbacks' timeouts need to remove their pfds from the main
+     * pollset, so they belong to the main listener; others can go to any.
+     */
+    if (!insert || remove) {
+        shard = &shards[0];
     }
     else {
-        te = apr_skiplist_alloc(timer_skiplist, sizeof(timer_event_t));
-        APR_RING_ELEM_INIT(te, link);
+        shard = &shards[apr_atomic_inc32(&next_timer_shard)
+                        % num_listener_threads];
     }
+    te = ap_timer_wheel_get_event(shard->timers);
 
     te->cbfunc = cbfn;
     te->baton = baton;
@@ -1519,10 +1536,8 @@ static timer_event_t * event_get_timer_event(apr_time_t t,
     te->remove = remove;
 
     if (insert) { 
-        /* Okay, add sorted by when.. */
-        apr_skiplist_insert(timer_skiplist, te);
+        ap_timer_wheel_insert(shard->timers, te);
     }
-    apr_thread_mutex_unlock(g_timer_skiplist_mtx);
 
     return te;
 }
@@ -1554,7 +1569,7 @@ static apr_status_t event_cleanup_poll_callback(void *data)
         apr_pollfd_t *pfd = (apr_pollfd_t *)pfds->elts + i;
         if (pfd->client_data) {
             apr_status_t rc;
-            rc = apr_pollset_remove(event_pollset, pfd);
+            rc = apr_pollset_remove(shards[0].pollset, pfd);
             if (rc != APR_SUCCESS && !APR_STATUS_IS_NOTFOUND(rc)) {
                 final_rc = rc;
             }
@@ -1596,7 +1611,7 @@ static apr_status_t event_register_poll_callback_ex(apr_array_header_t *pfds,
     }
     for (i = 0; i < pfds->nelts; i++) {
         apr_pollfd_t *pfd = (apr_pollfd_t *)pfds->elts + i;
-        rc = apr_pollset_add(event_pollset, pfd);
+        rc = apr_pollset_add(shards[0].pollset, pfd);
         if (rc != APR_SUCCESS) {
             final_rc = rc;
         }
@@ -1632,7 +1647,9 @@ static void process_lingering_close(event_conn_state_t *cs, const apr_pollfd_t *
     apr_size_t nbytes;
     apr_status_t rv;
     struct timeout_queue *q;
-    q = (cs->pub.state == CONN_STATE_LINGER_SHORT) ? short_linger_q : linger_q;
+    event_shard_t *shard = cs->shard;
+    q = (cs->pub.state == CONN_STATE_LINGER_SHORT) ? shard->short_linger_q
+                                                    : shard->linger_q;
 
     /* socket is already in non-blocking state */
     do {
@@ -1644,15 +1661,15 @@ static void process_lingering_close(event_conn_state_t *cs, const apr_pollfd_t *
         return;
     }
 
-    apr_thread_mutex_lock(timeout_mutex);
-    rv = apr_pollset_remove(event_pollset, pfd);
+    apr_thread_mutex_lock(shard->timeout_mutex);
+    rv = apr_pollset_remove(shard->pollset, pfd);
     AP_DEBUG_ASSERT(rv == APR_SUCCESS);
 
     rv = apr_socket_close(csd);
     AP_DEBUG_ASSERT(rv == APR_SUCCESS);
 
     TO_QUEUE_REMOVE(q, cs);
-    apr_thread_mutex_unlock(timeout_mutex);
+    apr_thread_mutex_unlock(shard->timeout_mutex);
     TO_QUEUE_ELEM_INIT(cs);
 
     ap_push_pool(worker_queue_info, cs->p);
@@ -1661,10 +1678,11 @@ static void process_lingering_close(event_conn_state_t *cs, const apr_pollfd_t *
 }
 
 /* call 'func' for all elements of 'q' with timeout less than 'timeout_time'.
- * Pre-condition: timeout_mutex must already be locked
- * Post-condition: timeout_mutex will be locked again
+ * Pre-condition: the shard's timeout_mutex must already be locked
+ * Post-condition: the shard's timeout_mutex will be locked again
  */
-static void process_timeout_queue(struct timeout_queue *q,
+static void process_timeout_queue(event_shard_t *shard,
+                                  struct timeout_queue *q,
                                   apr_time_t timeout_time,
                                   int (*func)(event_conn_state_t *))
 {
@@ -1698,7 +1716,7 @@ static void process_timeout_queue(struct timeout_queue *q,
                    || cs->queue_timestamp + qp->timeout < timeout_time
                    || cs->queue_timestamp > timeout_time + qp->timeout)) {
             last = cs;
-            rv = apr_pollset_remove(event_pollset, &cs->pfd);
+            rv = apr_pollset_remove(shard->pollset, &cs->pfd);
             if (rv != APR_SUCCESS && !APR_STATUS_IS_NOTFOUND(rv)) {
                 ap_log_cerror(APLOG_MARK, APLOG_ERR, rv, cs->c, APLOGNO(00473)
                               "apr_pollset_remove failed");
@@ -1720,7 +1738,7 @@ static void process_timeout_queue(struct timeout_queue *q,
 
     AP_DEBUG_ASSERT(*q->total >= total);
     *q->total -= total;
-    apr_thread_mutex_unlock(timeout_mutex);
+    apr_thread_mutex_unlock(shard->timeout_mutex);
     first = APR_RING_FIRST(&trash);
     do {
         cs = APR_RING_NEXT(first, timeout_list);
@@ -1728,7 +1746,48 @@ static void process_timeout_queue(struct timeout_queue *q,
         func(first);
         first = cs;
     } while (--total);
-    apr_thread_mutex_lock(timeout_mutex);
+    apr_thread_mutex_lock(shard->timeout_mutex);
+}
+
+/*
+ * Publish the connections' states of all the shards to the scoreboard.
+ * Only called by the main listener.
+ */
+static void update_process_score(int process_slot)
+{
+    struct process_score *ps = ap_get_scoreboard_process(process_slot);
+    int write_completion = 0, keep_alive = 0;
+    apr_uint32_t pending = 0, fired = 0;
+    apr_uint64_t late_total = 0;
+    apr_interval_time_t late_max = 0;
+    int i;
+
+    for (i = 0; i < num_listener_threads; i++) {
+        event_shard_t *shard = &shards[i];
+        apr_thread_mutex_lock(shard->timeout_mutex);
+        write_completion += *shard->write_completion_q->total;
+        keep_alive += *shard->keepalive_q->total;
+        apr_thread_mutex_unlock(shard->timeout_mutex);
+        if (shard->timers) {
+            ap_timer_wheel_stats_t stats;
+            ap_timer_wheel_get_stats(shard->timers, &stats);
+            pending += stats.pending;
+            fired += stats.fired;
+            late_total += stats.late_total;
+            if (late_max < stats.late_max) {
+                late_max = stats.late_max;
+            }
+        }
+    }
+    ps->write_completion = write_completion;
+    ps->keep_alive = keep_alive;
+    ps->connections = apr_atomic_read32(&connection_count);
+    ps->suspended = apr_atomic_read32(&suspended_count);
+    ps->lingering_close = apr_atomic_read32(&lingering_count);
+    ps->timers_pending = pending;
+    ps->timers_fired = fired;
+    ps->timers_late_avg = fired ? (apr_uint32_t)(late_total / fired) : 0;
+    ps->timers_late_max = (apr_uint32_t)late_max;
 }
 
 static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
@@ -1736,6 +1795,8 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
     apr_status_t rc;
     proc_info *ti = dummy;
     int process_slot = ti->pslot;
+    event_shard_t *shard = &shards[ti->tslot];
+    int is_main = (shard->id == 0);
     apr_pool_t *tpool = apr_thread_pool_get(thd);
     apr_time_t timeout_time = 0, last_log;
     int closed = 0, listeners_disabled = 0;
@@ -1752,7 +1813,10 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
 #define TIMEOUT_FUDGE_FACTOR 100000
 #define EVENT_FUDGE_FACTOR 10000
 
-    rc = init_pollset(tpool);
+    /* Only the main listener polls the listening sockets, the others
+     * only take care of their shard of the connections.
+     */
+    rc = is_main ? init_pollset(tpool) : APR_SUCCESS;
     if (rc != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rc, ap_server_conf,
                      APLOGNO(03266)
@@ -1769,7 +1833,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
     apr_signal(LISTENER_SIGNAL, dummy_signal_handler);
 
     for (;;) {
-        timer_event_t *te;
+        struct timers_t expired;
         const apr_pollfd_t *out_pfd;
         apr_int32_t num = 0;
         apr_uint32_t c_count, l_count, i_count;
@@ -1777,13 +1841,14 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
         apr_time_t now;
         int workers_were_busy = 0;
         if (listener_may_exit) {
-            close_listeners(process_slot, &closed);
+            if (is_main)
+                close_listeners(process_slot, &closed);
             if (terminate_mode == ST_UNGRACEFUL
                 || apr_atomic_read32(&connection_count) == 0)
                 break;
         }
 
-        if (conns_this_child <= 0)
+        if (is_main && conns_this_child <= 0)
             check_infinite_requests();
 
         if (APLOGtrace6(ap_server_conf)) {
@@ -1791,73 +1856,64 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
             /* trace log status every second */
             if (now - last_log > apr_time_from_msec(1000)) {
                 last_log = now;
-                apr_thread_mutex_lock(timeout_mutex);
+                apr_thread_mutex_lock(shard->timeout_mutex);
                 ap_log_error(APLOG_MARK, APLOG_TRACE6, 0, ap_server_conf,
                              "connections: %u (clogged: %u write-completion: %d "
-                             "keep-alive: %d lingering: %d suspended: %u)",
+                             "keep-alive: %d lingering: %d suspended: %u) "
+                             "in listener %d",
                              apr_atomic_read32(&connection_count),
                              apr_atomic_read32(&clogged_count),
-                             *write_completion_q->total,
-                             *keepalive_q->total,
+                             *shard->write_completion_q->total,
+                             *shard->keepalive_q->total,
                              apr_atomic_read32(&lingering_count),
-                             apr_atomic_read32(&suspended_count));
-                if (dying) {
+                             apr_atomic_read32(&suspended_count),
+                             shard->id);
+                if (is_main && dying) {
                     ap_log_error(APLOG_MARK, APLOG_TRACE6, 0, ap_server_conf,
                                  "%u/%u workers shutdown",
                                  apr_atomic_read32(&threads_shutdown),
                                  threads_per_child);
                 }
-                apr_thread_mutex_unlock(timeout_mutex);
+                apr_thread_mutex_unlock(shard->timeout_mutex);
             }
         }
 
 #if HAVE_SERF
-        rc = serf_context_prerun(g_serf);
-        if (rc != APR_SUCCESS) {
-            /* TOOD: what should do here? ugh. */
+        if (is_main) {
+            rc = serf_context_prerun(g_serf);
+            if (rc != APR_SUCCESS) {
+                /* TOOD: what should do here? ugh. */
+            }
         }
 #endif
 
+        /* Fire this shard's expired timers, then sleep until the next one */
         now = apr_time_now();
-        apr_thread_mutex_lock(g_timer_skiplist_mtx);
-        te = apr_skiplist_peek(timer_skiplist);
-        if (te) {
-            if (te->when > now) {
-                timeout_interval = te->when - now;
-            }
-            else {
-                timeout_interval = 1;
-            }
-        }
-        else {
-            timeout_interval = apr_time_from_msec(100);
-        }
-        while (te) {
-            if (te->when < now + EVENT_FUDGE_FACTOR) {
-                apr_skiplist_pop(timer_skiplist, NULL);
+        APR_RING_INIT(&expired, timer_event_t, link);
+        if (ap_timer_wheel_expire(shard->timers, now + EVENT_FUDGE_FACTOR,
+                                  &expired)) {
+            while (!APR_RING_EMPTY(&expired, timer_event_t, link)) {
+                timer_event_t *te = APR_RING_FIRST(&expired);
+                APR_RING_REMOVE(te, link);
                 if (!te->canceled) { 
                     if (te->remove) {
                         int i;
                         for (i = 0; i < te->remove->nelts; i++) {
                             apr_pollfd_t *pfd = (apr_pollfd_t *)te->remove->elts + i;
-                            apr_pollset_remove(event_pollset, pfd);
+                            apr_pollset_remove(shards[0].pollset, pfd);
                         }
                     }
                     push_timer2worker(te);
                 }
                 else {
-                    APR_RING_INSERT_TAIL(&timer_free_ring, te, timer_event_t,
-                                         link);
+                    ap_timer_wheel_recycle(te);
                 }
             }
-            else {
-                break;
-            }
-            te = apr_skiplist_peek(timer_skiplist);
         }
-        apr_thread_mutex_unlock(g_timer_skiplist_mtx);
+        timeout_interval = ap_timer_wheel_timeout(shard->timers, now,
+                                                  apr_time_from_msec(100));
 
-        rc = apr_pollset_poll(event_pollset, timeout_interval, &num, &out_pfd);
+        rc = apr_pollset_poll(shard->pollset, timeout_interval, &num, &out_pfd);
         if (rc != APR_SUCCESS) {
             if (APR_STATUS_IS_EINTR(rc)) {
                 continue;
@@ -1872,7 +1928,8 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
         }
 
         if (listener_may_exit) {
-            close_listeners(process_slot, &closed);
+            if (is_main)
+                close_listeners(process_slot, &closed);
             if (terminate_mode == ST_UNGRACEFUL
                 || apr_atomic_read32(&connection_count) == 0)
                 break;
@@ -1883,23 +1940,24 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
             if (pt->type == PT_CSD) {
                 /* one of the sockets is readable */
                 event_conn_state_t *cs = (event_conn_state_t *) pt->baton;
-                struct timeout_queue *remove_from_q = cs->sc->wc_q;
+                struct timeout_queue *remove_from_q = CS_WC_Q(cs);
                 int blocking = 1;
 
+                AP_DEBUG_ASSERT(cs->shard == shard);
                 switch (cs->pub.state) {
                 case CONN_STATE_CHECK_REQUEST_LINE_READABLE:
                     cs->pub.state = CONN_STATE_READ_REQUEST_LINE;
-                    remove_from_q = cs->sc->ka_q;
+                    remove_from_q = CS_KA_Q(cs);
                     /* don't wait for a worker for a keepalive request */
                     blocking = 0;
                     /* FALL THROUGH */
                 case CONN_STATE_WRITE_COMPLETION:
                     get_worker(&have_idle_worker, blocking,
                                &workers_were_busy);
-                    apr_thread_mutex_lock(timeout_mutex);
+                    apr_thread_mutex_lock(shard->timeout_mutex);
                     TO_QUEUE_REMOVE(remove_from_q, cs);
-                    rc = apr_pollset_remove(event_pollset, &cs->pfd);
-                    apr_thread_mutex_unlock(timeout_mutex);
+                    rc = apr_pollset_remove(shard->pollset, &cs->pfd);
+                    apr_thread_mutex_unlock(shard->timeout_mutex);
 
                     /*
                      * Some of the pollset backends, like KQueue or Epoll
@@ -1923,7 +1981,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                         start_lingering_close_nonblocking(cs);
                         break;
                     }
-                    rc = push2worker(out_pfd, event_pollset);
+                    rc = push2worker(out_pfd, shard->pollset);
                     if (rc != APR_SUCCESS) {
                         ap_log_error(APLOG_MARK, APLOG_CRIT, rc,
                                      ap_server_conf, APLOGNO(03095)
@@ -2050,6 +2108,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
 #endif
             else if (pt->type == PT_USER) {
                 /* masquerade as a timer event that is firing */
+                timer_event_t *te;
                 int i = 0;
                 socket_callback_baton_t *baton = (socket_callback_baton_t *) pt->baton;
                 if (baton->cancel_event) {
@@ -2067,7 +2126,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                     /* remove all sockets in my set */
                     for (i = 0; i < baton->pfds->nelts; i++) {
                         apr_pollfd_t *pfd = (apr_pollfd_t *)baton->pfds->elts + i;
-                        apr_pollset_remove(event_pollset, pfd);
+                        apr_pollset_remove(shard->pollset, pfd);
                         pfd->client_data = NULL;
                     }
 
@@ -2087,45 +2146,46 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
          * will exceed now + TIMEOUT_FUDGE_FACTOR, can't happen otherwise).
          */
         if (now > timeout_time || now + TIMEOUT_FUDGE_FACTOR < timeout_time ) {
-            struct process_score *ps;
             timeout_time = now + TIMEOUT_FUDGE_FACTOR;
 
             /* handle timed out sockets */
-            apr_thread_mutex_lock(timeout_mutex);
+            apr_thread_mutex_lock(shard->timeout_mutex);
 
             /* Step 1: keepalive timeouts */
             /* If all workers are busy, we kill older keep-alive connections so that they
              * may connect to another process.
              */
-            if ((workers_were_busy || dying) && *keepalive_q->total) {
+            if ((workers_were_busy || dying) && *shard->keepalive_q->total) {
                 if (!dying)
                     ap_log_error(APLOG_MARK, APLOG_TRACE1, 0, ap_server_conf,
                                  "All workers are busy, will close %d keep-alive "
                                  "connections",
-                                 *keepalive_q->total);
-                process_timeout_queue(keepalive_q, 0,
+                                 *shard->keepalive_q->total);
+                process_timeout_queue(shard, shard->keepalive_q, 0,
                                       start_lingering_close_nonblocking);
             }
             else {
-                process_timeout_queue(keepalive_q, timeout_time,
+                process_timeout_queue(shard, shard->keepalive_q, timeout_time,
                                       start_lingering_close_nonblocking);
             }
             /* Step 2: write completion timeouts */
-            process_timeout_queue(write_completion_q, timeout_time,
+            process_timeout_queue(shard, shard->write_completion_q,
+                                  timeout_time,
                                   start_lingering_close_nonblocking);
             /* Step 3: (normal) lingering close completion timeouts */
-            process_timeout_queue(linger_q, timeout_time, stop_lingering_close);
+            process_timeout_queue(shard, shard->linger_q, timeout_time,
+                                  stop_lingering_close);
             /* Step 4: (short) lingering close completion timeouts */
-            process_timeout_queue(short_linger_q, timeout_time, stop_lingering_close);
-
-            ps = ap_get_scoreboard_process(process_slot);
-            ps->write_completion = *write_completion_q->total;
-            ps->keep_alive = *keepalive_q->total;
-            apr_thread_mutex_unlock(timeout_mutex);
+            process_timeout_queue(shard, shard->short_linger_q, timeout_time,
+                                  stop_lingering_close);
+            apr_thread_mutex_unlock(shard->timeout_mutex);
 
-            ps->connections = apr_atomic_read32(&connection_count);
-            ps->suspended = apr_atomic_read32(&suspended_count);
-            ps->lingering_close = apr_atomic_read32(&lingering_count);
+            if (is_main) {
+                update_process_score(process_slot);
+            }
+        }
+        if (!is_main) {
+            continue;
         }
         if (listeners_disabled && !workers_were_busy
             && ((c_count = apr_atomic_read32(&connection_count))
@@ -2144,8 +2204,13 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
          */
     }     /* listener main loop */
 
-    close_listeners(process_slot, &closed);
-    ap_queue_term(worker_queue);
+    if (is_main) {
+        close_listeners(process_slot, &closed);
+    }
+    /* The last listener out terminates the workers' queue */
+    if (!apr_atomic_dec32(&listeners_running)) {
+        ap_queue_term(worker_queue);
+    }
 
     apr_thread_exit(thd, APR_SUCCESS);
     return NULL;
@@ -2202,6 +2267,11 @@ static void *APR_THREAD_FUNC worker_thread(apr_thread_t * thd, void *dummy)
     ap_update_child_status_from_indexes(process_slot, thread_slot,
                                         SERVER_STARTING, NULL);
 
+    if (thread_allocators) {
+        apr_thread_data_set(thread_allocators[thread_slot],
+                            AP_MPM_THREAD_ALLOCATOR_KEY, NULL, thd);
+    }
+
     while (!workers_may_exit) {
         apr_socket_t *csd = NULL;
         event_conn_state_t *cs;
@@ -2263,11 +2333,7 @@ static void *APR_THREAD_FUNC worker_thread(apr_thread_t * thd, void *dummy)
         }
         if (te != NULL) {
             te->cbfunc(te->baton);
-            {
-                apr_thread_mutex_lock(g_timer_skiplist_mtx);
-                APR_RING_INSERT_TAIL(&timer_free_ring, te, timer_event_t, link);
-                apr_thread_mutex_unlock(g_timer_skiplist_mtx);
-            }
+            ap_timer_wheel_recycle(te);
         }
         else {
             is_idle = 0;
@@ -2298,25 +2364,33 @@ static int check_signal(int signum)
 
 
 
-static void create_listener_thread(thread_starter * ts)
+static void create_listener_threads(thread_starter * ts)
 {
     int my_child_num = ts->child_num_arg;
     apr_threadattr_t *thread_attr = ts->threadattr;
     proc_info *my_info;
     apr_status_t rv;
+    int i;
 
-    my_info = (proc_info *) ap_malloc(sizeof(proc_info));
-    my_info->pslot = my_child_num;
-    my_info->tslot = -1;      /* listener thread doesn't have a thread slot */
-    rv = apr_thread_create(&ts->listener, thread_attr, listener_thread,
-                           my_info, pchild);
-    if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ALERT, rv, ap_server_conf, APLOGNO(00474)
-                     "apr_thread_create: unable to create listener thread");
-        /* let the parent decide how bad this really is */
-        clean_child_exit(APEXIT_CHILDSICK);
+    apr_atomic_set32(&listeners_running, num_listener_threads);
+    for (i = 0; i < num_listener_threads; i++) {
+        event_shard_t *shard = &shards[i];
+
+        my_info = (proc_info *) ap_malloc(sizeof(proc_info));
+        my_info->pslot = my_child_num;
+        my_info->tslot = i;   /* listener threads have no thread slot,
+                               * give them their shard instead */
+        rv = apr_thread_create(&shard->thread, thread_attr, listener_thread,
+                               my_info, pchild);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ALERT, rv, ap_server_conf, APLOGNO(00474)
+                         "apr_thread_create: unable to create listener thread");
+            /* let the parent decide how bad this really is */
+            clean_child_exit(APEXIT_CHILDSICK);
+        }
+        apr_os_thread_get(&shard->os_thread, shard->thread);
     }
-    apr_os_thread_get(&listener_os_thread, ts->listener);
+    ts->listeners_started = 1;
 }
 
 /* XXX under some circumstances not understood, children can get stuck
@@ -2334,7 +2408,7 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
     apr_status_t rv;
     int i;
     int threads_created = 0;
-    int listener_started = 0;
+    int j;
     int loops;
     int prev_threads_created;
     int max_recycled_pools = -1;
@@ -2365,46 +2439,52 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
         clean_child_exit(APEXIT_CHILDFATAL);
     }
 
-    /* Create the timeout mutex and main pollset before the listener
-     * thread starts.
+    /* Create the timeout mutexes and pollsets before the listener
+     * threads start.
      */
-    rv = apr_thread_mutex_create(&timeout_mutex, APR_THREAD_MUTEX_DEFAULT,
-                                 pchild);
-    if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, ap_server_conf, APLOGNO(03102)
-                     "creation of the timeout mutex failed.");
-        clean_child_exit(APEXIT_CHILDFATAL);
-    }
+    for (j = 0; j < num_listener_threads; j++) {
+        event_shard_t *shard = &shards[j];
 
-    /* Create the main pollset */
-    for (i = 0; i < sizeof(good_methods) / sizeof(good_methods[0]); i++) {
-        rv = apr_pollset_create_ex(&event_pollset,
-                            threads_per_child*2, /* XXX don't we need more, to handle
-                                                * connections in K-A or lingering
-                                                * close?
-                                                */
-                            pchild, APR_POLLSET_THREADSAFE | APR_POLLSET_NOCOPY | APR_POLLSET_NODEFAULT,
-                            good_methods[i]);
-        if (rv == APR_SUCCESS) {
-            break;
+        rv = apr_thread_mutex_create(&shard->timeout_mutex,
+                                     APR_THREAD_MUTEX_DEFAULT, pchild);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, ap_server_conf, APLOGNO(03102)
+                         "creation of the timeout mutex failed.");
+            clean_child_exit(APEXIT_CHILDFATAL);
+        }
+
+        /* Create the shard's pollset */
+        for (i = 0; i < sizeof(good_methods) / sizeof(good_methods[0]); i++) {
+            rv = apr_pollset_create_ex(&shard->pollset,
+                                threads_per_child*2, /* XXX don't we need more, to handle
+                                                    * connections in K-A or lingering
+                                                    * close?
+                                                    */
+                                pchild, APR_POLLSET_THREADSAFE | APR_POLLSET_NOCOPY | APR_POLLSET_NODEFAULT,
+                                good_methods[i]);
+            if (rv == APR_SUCCESS) {
+                break;
+            }
+        }
+        if (rv != APR_SUCCESS) {
+            rv = apr_pollset_create(&shard->pollset,
+                                   threads_per_child*2, /* XXX don't we need more, to handle
+                                                         * connections in K-A or lingering
+                                                         * close?
+                                                         */
+                                   pchild, APR_POLLSET_THREADSAFE | APR_POLLSET_NOCOPY);
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, ap_server_conf, APLOGNO(03103)
+                         "apr_pollset_create with Thread Safety failed.");
+            clean_child_exit(APEXIT_CHILDFATAL);
         }
-    }
-    if (rv != APR_SUCCESS) {
-        rv = apr_pollset_create(&event_pollset,
-                               threads_per_child*2, /* XXX don't we need more, to handle
-                                                     * connections in K-A or lingering
-                                                     * close?
-                                                     */
-                               pchild, APR_POLLSET_THREADSAFE | APR_POLLSET_NOCOPY);
-    }
-    if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, ap_server_conf, APLOGNO(03103)
-                     "apr_pollset_create with Thread Safety failed.");
-        clean_child_exit(APEXIT_CHILDFATAL);
     }
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ap_server_conf, APLOGNO(02471)
-                 "start_threads: Using %s", apr_pollset_method_name(event_pollset));
+                 "start_threads: Using %s (%d listener thread%s)",
+                 apr_pollset_method_name(shards[0].pollset),
+                 num_listener_threads, num_listener_threads > 1 ? "s" : "");
     worker_sockets = apr_pcalloc(pchild, threads_per_child
                                  * sizeof(apr_socket_t *));
 
@@ -2442,9 +2522,8 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
         }
 
         /* Start the listener only when there are workers available */
-        if (!listener_started && threads_created) {
-            create_listener_thread(ts);
-            listener_started = 1;
+        if (!ts->listeners_started && threads_created) {
+            create_listener_threads(ts);
         }
 
 
@@ -2481,12 +2560,12 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
     return NULL;
 }
 
-static void join_workers(apr_thread_t * listener, apr_thread_t ** threads)
+static void join_workers(int with_listeners, apr_thread_t ** threads)
 {
     int i;
     apr_status_t rv, thread_rv;
 
-    if (listener) {
+    if (with_listeners) {
         int iter;
 
         /* deal with a rare timing window which affects waking up the
@@ -2509,10 +2588,12 @@ static void join_workers(apr_thread_t * listener, apr_thread_t ** threads)
                          "the listener thread didn't stop accepting");
         }
         else {
-            rv = apr_thread_join(&thread_rv, listener);
-            if (rv != APR_SUCCESS) {
-                ap_log_error(APLOG_MARK, APLOG_CRIT, rv, ap_server_conf, APLOGNO(00476)
-                             "apr_thread_join: unable to join listener thread");
+            for (i = 0; i < num_listener_threads; i++) {
+                rv = apr_thread_join(&thread_rv, shards[i].thread);
+                if (rv != APR_SUCCESS) {
+                    ap_log_error(APLOG_MARK, APLOG_CRIT, rv, ap_server_conf, APLOGNO(00476)
+                                 "apr_thread_join: unable to join listener thread");
+                }
             }
         }
     }
@@ -2551,7 +2632,6 @@ static void child_main(int child_num_arg, int child_bucket)
     thread_starter *ts;
     apr_threadattr_t *thread_attr;
     apr_thread_t *start_thread_id;
-    apr_pool_t *pskip;
     int i;
 
     mpm_state = AP_MPMQ_STARTING;       /* for benefit of any hooks that run as this
@@ -2576,11 +2656,36 @@ static void child_main(int child_num_arg, int child_bucket)
         clean_child_exit(APEXIT_CHILDFATAL);
     }
 
-    apr_thread_mutex_create(&g_timer_skiplist_mtx, APR_THREAD_MUTEX_DEFAULT, pchild);
-    APR_RING_INIT(&timer_free_ring, timer_event_t, link);
-    apr_pool_create(&pskip, pchild);
-    apr_skiplist_init(&timer_skiplist, pskip);
-    apr_skiplist_set_compare(timer_skiplist, timer_comp, timer_comp);
+    for (i = 0; i < num_listener_threads; i++) {
+        rv = ap_timer_wheel_create(&shards[i].timers, pchild);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, rv, ap_server_conf,
+                         APLOGNO(03385) "Couldn't create timer wheel");
+            clean_child_exit(APEXIT_CHILDFATAL);
+        }
+    }
+    if (per_thread_allocator) {
+        thread_allocators = apr_pcalloc(pchild, threads_per_child
+                                                * sizeof(apr_allocator_t *));
+        for (i = 0; i < threads_per_child; i++) {
+            apr_allocator_t *allocator;
+            apr_thread_mutex_t *mutex;
+
+            rv = apr_allocator_create(&allocator);
+            if (rv == APR_SUCCESS) {
+                rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                             pchild);
+            }
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_EMERG, rv, ap_server_conf,
+                             APLOGNO(03390) "Couldn't create thread allocator");
+                clean_child_exit(APEXIT_CHILDFATAL);
+            }
+            apr_allocator_max_free_set(allocator, ap_max_mem_free);
+            apr_allocator_mutex_set(allocator, mutex);
+            thread_allocators[i] = allocator;
+        }
+    }
     ap_run_child_init(pchild, ap_server_conf);
 
     /* done with init critical section */
@@ -2627,7 +2732,7 @@ static void child_main(int child_num_arg, int child_bucket)
     }
 
     ts->threads = threads;
-    ts->listener = NULL;
+    ts->listeners_started = 0;
     ts->child_num_arg = child_num_arg;
     ts->threadattr = thread_attr;
 
@@ -2668,7 +2773,7 @@ static void child_main(int child_num_arg, int child_bucket)
          *   If the worker hasn't exited, then this blocks until
          *   they have (then cleans up).
          */
-        join_workers(ts->listener, threads);
+        join_workers(ts->listeners_started, threads);
     }
     else {                      /* !one_process */
         /* remove SIGTERM from the set of blocked signals...  if one of
@@ -2709,7 +2814,7 @@ static void child_main(int child_num_arg, int child_bucket)
          *   If the worker hasn't exited, then this blocks until
          *   they have (then cleans up).
          */
-        join_workers(ts->listener, threads);
+        join_workers(ts->listeners_started, threads);
     }
 
     free(threads);
@@ -3325,6 +3430,7 @@ static void setup_slave_conn(conn_rec *c, void *csd)
     cs->c = c;
     cs->r = NULL;
     cs->sc = mcs->sc;
+    cs->shard = mcs->shard;
     cs->suspended = 0;
     cs->p = c->pool;
     cs->bucket_alloc = c->bucket_alloc;
@@ -3447,8 +3553,6 @@ static int event_open_logs(apr_pool_t * p, apr_pool_t * plog,
     }
     retained->num_buckets = num_buckets;
 
-    /* for skiplist */
-    srand((unsigned int)apr_time_now());
     return OK;
 }
 
@@ -3457,6 +3561,7 @@ static int event_pre_config(apr_pool_t * pconf, apr_pool_t * plog,
 {
     int no_detach, debug, foreground;
     apr_status_t rv;
+    apr_pollset_t *event_pollset;
     const char *userdata_key = "mpm_event_module";
 
     mpm_state = AP_MPMQ_STARTING;
@@ -3526,6 +3631,8 @@ static int event_pre_config(apr_pool_t * pconf, apr_pool_t * plog,
     thread_limit = DEFAULT_THREAD_LIMIT;
     ap_daemons_limit = server_limit;
     threads_per_child = DEFAULT_THREADS_PER_CHILD;
+    num_listener_threads = 1;
+    per_thread_allocator = 0;
     max_workers = ap_daemons_limit * threads_per_child;
     had_healthy_child = 0;
     ap_extended_status = 0;
@@ -3533,42 +3640,40 @@ static int event_pre_config(apr_pool_t * pconf, apr_pool_t * plog,
     return OK;
 }
 
-static int event_post_config(apr_pool_t *pconf, apr_pool_t *plog,
-                             apr_pool_t *ptemp, server_rec *s)
+/*
+ * Setup the timeout queues of a listener shard, for all the servers.
+ */
+static void init_shard_queues(event_shard_t *shard, server_rec *s,
+                              apr_pool_t *pconf, apr_pool_t *ptemp)
 {
     struct {
         struct timeout_queue *tail, *q;
         apr_hash_t *hash;
     } wc, ka;
 
-    /* Not needed in pre_config stage */
-    if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
-        return OK;
-    }
-
     wc.tail = ka.tail = NULL;
     wc.hash = apr_hash_make(ptemp);
     ka.hash = apr_hash_make(ptemp);
 
-    TO_QUEUE_INIT(linger_q, pconf,
+    TO_QUEUE_INIT(shard->linger_q, pconf,
                   apr_time_from_sec(MAX_SECS_TO_LINGER), NULL);
-    TO_QUEUE_INIT(short_linger_q, pconf,
+    TO_QUEUE_INIT(shard->short_linger_q, pconf,
                   apr_time_from_sec(SECONDS_TO_LINGER), NULL);
 
     for (; s; s = s->next) {
-        event_srv_cfg *sc = apr_pcalloc(pconf, sizeof *sc);
+        event_srv_cfg *sc = ap_get_module_config(s->module_config,
+                                                 &mpm_event_module);
 
-        ap_set_module_config(s->module_config, &mpm_event_module, sc);
         if (!wc.tail) {
-            /* The main server uses the global queues */
+            /* The main server uses the shard's global queues */
             TO_QUEUE_INIT(wc.q, pconf, s->timeout, NULL);
             apr_hash_set(wc.hash, &s->timeout, sizeof s->timeout, wc.q);
-            wc.tail = write_completion_q = wc.q;
+            wc.tail = shard->write_completion_q = wc.q;
 
             TO_QUEUE_INIT(ka.q, pconf, s->keep_alive_timeout, NULL);
             apr_hash_set(ka.hash, &s->keep_alive_timeout,
                          sizeof s->keep_alive_timeout, ka.q);
-            ka.tail = keepalive_q = ka.q;
+            ka.tail = shard->keepalive_q = ka.q;
         }
         else {
             /* The vhosts use any existing queue with the same timeout,
@@ -3589,8 +3694,35 @@ static int event_post_config(apr_pool_t *pconf, apr_pool_t *plog,
                 ka.tail = ka.tail->next = ka.q;
             }
         }
-        sc->wc_q = wc.q;
-        sc->ka_q = ka.q;
+        sc->wc_q[shard->id] = wc.q;
+        sc->ka_q[shard->id] = ka.q;
+    }
+}
+
+static int event_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                             apr_pool_t *ptemp, server_rec *s)
+{
+    server_rec *sp;
+    int i;
+
+    /* Not needed in pre_config stage */
+    if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    for (sp = s; sp; sp = sp->next) {
+        event_srv_cfg *sc = apr_pcalloc(pconf, sizeof *sc);
+
+        sc->wc_q = apr_pcalloc(pconf, num_listener_threads * sizeof *sc->wc_q);
+        sc->ka_q = apr_pcalloc(pconf, num_listener_threads * sizeof *sc->ka_q);
+        ap_set_module_config(sp->module_config, &mpm_event_module, sc);
+    }
+
+    shards = apr_pcalloc(pconf, num_listener_threads * sizeof *shards);
+    next_shard = 0;
+    for (i = 0; i < num_listener_threads; i++) {
+        shards[i].id = i;
+        init_shard_queues(&shards[i], s, pconf, ptemp);
     }
 
     return OK;
@@ -3804,6 +3936,21 @@ static int event_check_config(apr_pool_t *p, apr_pool_t *plog,
         min_spare_threads = 1;
     }
 
+    if (num_listener_threads > threads_per_child) {
+        if (startup) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING | APLOG_STARTUP, 0, NULL, APLOGNO(03383)
+                         "WARNING: ListenerThreadsPerChild of %d exceeds "
+                         "ThreadsPerChild of %d, decreasing to match.",
+                         num_listener_threads, threads_per_child);
+        } else {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(03384)
+                         "ListenerThreadsPerChild of %d exceeds "
+                         "ThreadsPerChild of %d, decreasing to match",
+                         num_listener_threads, threads_per_child);
+        }
+        num_listener_threads = threads_per_child;
+    }
+
     /* max_spare_threads < min_spare_threads + threads_per_child
      * checked in ap_mpm_run()
      */
@@ -3933,6 +4080,35 @@ static const char *set_thread_limit(cmd_parms * cmd, void *dummy,
     return NULL;
 }
 
+static const char *set_listener_threads(cmd_parms * cmd, void *dummy,
+                                        const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    num_listener_threads = atoi(arg);
+    if (num_listener_threads < 1
+            || num_listener_threads > MAX_LISTENER_THREADS) {
+        return apr_psprintf(cmd->pool, "ListenerThreadsPerChild must be "
+                            "between 1 and %d", MAX_LISTENER_THREADS);
+    }
+    return NULL;
+}
+
+static const char *set_per_thread_allocator(cmd_parms * cmd, void *dummy,
+                                            int arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    per_thread_allocator = arg;
+    return NULL;
+}
+
 static const char *set_worker_factor(cmd_parms * cmd, void *dummy,
                                      const char *arg)
 {
@@ -3979,6 +4155,12 @@ static const command_rec event_cmds[] = {
     AP_INIT_TAKE1("AsyncRequestWorkerFactor", set_worker_factor, NULL, RSRC_CONF,
                   "How many additional connects will be accepted per idle "
                   "worker thread"),
+    AP_INIT_TAKE1("ListenerThreadsPerChild", set_listener_threads, NULL, RSRC_CONF,
+                  "Number of listener threads (each with its own pollset) "
+                  "sharing the connections of a child"),
+    AP_INIT_FLAG("PerThreadAllocator", set_per_thread_allocator, NULL, RSRC_CONF,
+                 "Whether requests' memory comes from per worker thread "
+                 "allocators rather than per connection ones"),
     AP_GRACEFUL_SHUTDOWN_TIMEOUT_COMMAND,
     {NULL}
 };
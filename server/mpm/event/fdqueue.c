@@ -303,16 +303,99 @@ apr_status_t ap_queue_info_term(fd_queue_info_t * queue_info)
 }
 
 /**
- * Detects when the fd_queue_t is full. This utility function is expected
- * to be called from within critical sections, and is not threadsafe.
+ * Try to push an element onto the lock-free ring (Vyukov's bounded MPMC
+ * algorithm).  Each cell's seq is equal to its position when the cell is
+ * free for producers of that lap, and to position + 1 once an element has
+ * been published there.  Returns 0 if the ring is full.
  */
-#define ap_queue_full(queue) ((queue)->nelts == (queue)->bounds)
+static int ring_push(fd_queue_t *queue, const fd_queue_elem_t *elem)
+{
+    fd_queue_cell_t *cell;
+    apr_uint32_t pos = apr_atomic_read32(&queue->in);
+
+    for (;;) {
+        apr_int32_t dif;
+
+        cell = &queue->cells[pos & queue->mask];
+        dif = (apr_int32_t)(apr_atomic_read32(&cell->seq) - pos);
+        if (dif == 0) {
+            apr_uint32_t cur = apr_atomic_cas32(&queue->in, pos + 1, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if (dif < 0) {
+            return 0;
+        }
+        else {
+            pos = apr_atomic_read32(&queue->in);
+        }
+    }
+
+    cell->elem = *elem;
+    /* Publish (full barrier), consumers may now take it */
+    apr_atomic_xchg32(&cell->seq, pos + 1);
+    return 1;
+}
 
 /**
- * Detects when the fd_queue_t is empty. This utility function is expected
- * to be called from within critical sections, and is not threadsafe.
+ * Try to pop an element from the lock-free ring.
+ * Returns 0 if the ring is empty.
  */
-#define ap_queue_empty(queue) ((queue)->nelts == 0 && APR_RING_EMPTY(&queue->timers ,timer_event_t, link))
+static int ring_pop(fd_queue_t *queue, fd_queue_elem_t *elem)
+{
+    fd_queue_cell_t *cell;
+    apr_uint32_t pos = apr_atomic_read32(&queue->out);
+
+    for (;;) {
+        apr_int32_t dif;
+
+        cell = &queue->cells[pos & queue->mask];
+        dif = (apr_int32_t)(apr_atomic_read32(&cell->seq) - (pos + 1));
+        if (dif == 0) {
+            apr_uint32_t cur = apr_atomic_cas32(&queue->out, pos + 1, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if (dif < 0) {
+            return 0;
+        }
+        else {
+            pos = apr_atomic_read32(&queue->out);
+        }
+    }
+
+    *elem = cell->elem;
+#ifdef AP_DEBUG
+    cell->elem.sd = NULL;
+    cell->elem.p = NULL;
+#endif /* AP_DEBUG */
+    /* Release the cell for the producers of the next lap */
+    apr_atomic_xchg32(&cell->seq, pos + queue->mask + 1);
+    return 1;
+}
+
+/**
+ * Detects when the fd_queue_t is empty. This utility function is
+ * lock-free, hence the result is only a hint unless confirmed while
+ * holding one_big_mutex with the waiters count raised (see
+ * ap_queue_pop_something()).
+ */
+static APR_INLINE int ap_queue_empty(fd_queue_t *queue)
+{
+    fd_queue_cell_t *cell;
+    apr_uint32_t pos;
+
+    if (apr_atomic_read32(&queue->timers_count)) {
+        return 0;
+    }
+    pos = apr_atomic_read32(&queue->out);
+    cell = &queue->cells[pos & queue->mask];
+    return (apr_int32_t)(apr_atomic_read32(&cell->seq) - (pos + 1)) < 0;
+}
 
 /**
  * Callback routine that is called to destroy this
@@ -337,7 +420,7 @@ static apr_status_t ap_queue_destroy(void *data)
 apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
                            apr_pool_t * a)
 {
-    int i;
+    apr_uint32_t i, size;
     apr_status_t rv;
 
     if ((rv = apr_thread_mutex_create(&queue->one_big_mutex,
@@ -351,15 +434,24 @@ apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
 
     APR_RING_INIT(&queue->timers, timer_event_t, link);
 
-    queue->data = apr_palloc(a, queue_capacity * sizeof(fd_queue_elem_t));
-    queue->bounds = queue_capacity;
-    queue->nelts = 0;
+    /* The ring size must be a power of two */
+    for (size = 2; size < (apr_uint32_t)queue_capacity; size <<= 1)
+        ;
+
+    queue->cells = apr_palloc(a, size * sizeof(fd_queue_cell_t));
+    queue->mask = size - 1;
     queue->in = 0;
     queue->out = 0;
+    queue->timers_count = 0;
+    queue->waiters = 0;
 
     /* Set all the sockets in the queue to NULL */
-    for (i = 0; i < queue_capacity; ++i)
-        queue->data[i].sd = NULL;
+    for (i = 0; i < size; ++i) {
+        queue->cells[i].seq = i;
+        queue->cells[i].elem.sd = NULL;
+        queue->cells[i].elem.p = NULL;
+        queue->cells[i].elem.ecs = NULL;
+    }
 
     apr_pool_cleanup_register(a, queue, ap_queue_destroy,
                               apr_pool_cleanup_null);
@@ -367,6 +459,26 @@ apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
     return APR_SUCCESS;
 }
 
+/**
+ * Wake up a worker blocked in ap_queue_pop_something(), if any.
+ * The waiters count is read after the element has been published, and
+ * raised by the popper under one_big_mutex before its final emptiness
+ * check, so the wakeup can't be lost.
+ */
+static apr_status_t queue_wakeup_one(fd_queue_t *queue)
+{
+    apr_status_t rv;
+
+    if (!apr_atomic_read32(&queue->waiters)) {
+        return APR_SUCCESS;
+    }
+    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
+        return rv;
+    }
+    apr_thread_cond_signal(queue->not_empty);
+    return apr_thread_mutex_unlock(queue->one_big_mutex);
+}
+
 /**
  * Push a new socket onto the queue.
  *
@@ -376,32 +488,20 @@ apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
 apr_status_t ap_queue_push(fd_queue_t * queue, apr_socket_t * sd,
                            event_conn_state_t * ecs, apr_pool_t * p)
 {
-    fd_queue_elem_t *elem;
-    apr_status_t rv;
-
-    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
-        return rv;
-    }
+    fd_queue_elem_t elem;
 
     AP_DEBUG_ASSERT(!queue->terminated);
-    AP_DEBUG_ASSERT(!ap_queue_full(queue));
-
-    elem = &queue->data[queue->in];
-    queue->in++;
-    if (queue->in >= queue->bounds)
-        queue->in -= queue->bounds;
-    elem->sd = sd;
-    elem->ecs = ecs;
-    elem->p = p;
-    queue->nelts++;
-
-    apr_thread_cond_signal(queue->not_empty);
 
-    if ((rv = apr_thread_mutex_unlock(queue->one_big_mutex)) != APR_SUCCESS) {
-        return rv;
+    elem.sd = sd;
+    elem.ecs = ecs;
+    elem.p = p;
+    if (!ring_push(queue, &elem)) {
+        /* Can't happen as long as the idlers are reserved first */
+        AP_DEBUG_ASSERT(0);
+        return APR_EAGAIN;
     }
 
-    return APR_SUCCESS;
+    return queue_wakeup_one(queue);
 }
 
 apr_status_t ap_queue_push_timer(fd_queue_t * queue, timer_event_t *te)
@@ -415,6 +515,7 @@ apr_status_t ap_queue_push_timer(fd_queue_t * queue, timer_event_t *te)
     AP_DEBUG_ASSERT(!queue->terminated);
 
     APR_RING_INSERT_TAIL(&queue->timers, te, timer_event_t, link);
+    apr_atomic_inc32(&queue->timers_count);
 
     apr_thread_cond_signal(queue->not_empty);
 
@@ -425,6 +526,21 @@ apr_status_t ap_queue_push_timer(fd_queue_t * queue, timer_event_t *te)
     return APR_SUCCESS;
 }
 
+/**
+ * Pop the first timer event if any, with one_big_mutex held.
+ */
+static timer_event_t *queue_pop_timer(fd_queue_t *queue)
+{
+    timer_event_t *te = NULL;
+
+    if (!APR_RING_EMPTY(&queue->timers, timer_event_t, link)) {
+        te = APR_RING_FIRST(&queue->timers);
+        APR_RING_REMOVE(te, link);
+        apr_atomic_dec32(&queue->timers_count);
+    }
+    return te;
+}
+
 /**
  * Retrieves the next available socket from the queue. If there are no
  * sockets available, it will block until one becomes available.
@@ -435,56 +551,66 @@ apr_status_t ap_queue_pop_something(fd_queue_t * queue, apr_socket_t ** sd,
                                     event_conn_state_t ** ecs, apr_pool_t ** p,
                                     timer_event_t ** te_out)
 {
-    fd_queue_elem_t *elem;
+    fd_queue_elem_t elem;
     apr_status_t rv;
+    int waited = 0;
 
-    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
-        return rv;
-    }
+    *te_out = NULL;
 
-    /* Keep waiting until we wake up and find that the queue is not empty. */
-    if (ap_queue_empty(queue)) {
-        if (!queue->terminated) {
-            apr_thread_cond_wait(queue->not_empty, queue->one_big_mutex);
-        }
-        /* If we wake up and it's still empty, then we were interrupted */
-        if (ap_queue_empty(queue)) {
-            rv = apr_thread_mutex_unlock(queue->one_big_mutex);
-            if (rv != APR_SUCCESS) {
+    for (;;) {
+        /* Timers first (they are rare, only take the lock if needed) */
+        if (apr_atomic_read32(&queue->timers_count)) {
+            if ((rv = apr_thread_mutex_lock(queue->one_big_mutex))
+                    != APR_SUCCESS) {
                 return rv;
             }
-            if (queue->terminated) {
-                return APR_EOF; /* no more elements ever again */
+            *te_out = queue_pop_timer(queue);
+            if ((rv = apr_thread_mutex_unlock(queue->one_big_mutex))
+                    != APR_SUCCESS) {
+                return rv;
             }
-            else {
-                return APR_EINTR;
+            if (*te_out) {
+                return APR_SUCCESS;
             }
         }
-    }
 
-    *te_out = NULL;
+        /* Lock-free fast path */
+        if (ring_pop(queue, &elem)) {
+            *sd = elem.sd;
+            *ecs = elem.ecs;
+            *p = elem.p;
+            return APR_SUCCESS;
+        }
 
-    if (!APR_RING_EMPTY(&queue->timers, timer_event_t, link)) {
-        *te_out = APR_RING_FIRST(&queue->timers);
-        APR_RING_REMOVE(*te_out, link);
-    }
-    else {
-        elem = &queue->data[queue->out];
-        queue->out++;
-        if (queue->out >= queue->bounds)
-            queue->out -= queue->bounds;
-        queue->nelts--;
-        *sd = elem->sd;
-        *ecs = elem->ecs;
-        *p = elem->p;
-#ifdef AP_DEBUG
-        elem->sd = NULL;
-        elem->p = NULL;
-#endif /* AP_DEBUG */
-    }
+        /* If we woke up and it's still empty, then we were interrupted */
+        if (waited) {
+            return queue->terminated ? APR_EOF : APR_EINTR;
+        }
 
-    rv = apr_thread_mutex_unlock(queue->one_big_mutex);
-    return rv;
+        /* Slow path: announce ourselves as a waiter before checking
+         * emptiness for the last time, then sleep until a push or an
+         * interrupt signals us.
+         */
+        if ((rv = apr_thread_mutex_lock(queue->one_big_mutex))
+                != APR_SUCCESS) {
+            return rv;
+        }
+        apr_atomic_inc32(&queue->waiters);
+        if (ap_queue_empty(queue)) {
+            if (queue->terminated) {
+                apr_atomic_dec32(&queue->waiters);
+                apr_thread_mutex_unlock(queue->one_big_mutex);
+                return APR_EOF; /* no more elements ever again */
+            }
+            apr_thread_cond_wait(queue->not_empty, queue->one_big_mutex);
+            waited = 1;
+        }
+        apr_atomic_dec32(&queue->waiters);
+        if ((rv = apr_thread_mutex_unlock(queue->one_big_mutex))
+                != APR_SUCCESS) {
+            return rv;
+        }
+    }
 }
 
 static apr_status_t queue_interrupt(fd_queue_t *queue, int all, int term)
@@ -522,3 +648,310 @@ apr_status_t ap_queue_term(fd_queue_t * queue)
 {
     return queue_interrupt(queue, 1, 1);
 }
+
+/*
+ * Hierarchical timing wheel.
+ *
+ * Level 0 has one slot per tick (1ms) for the next TW_SIZE0 ticks, each
+ * upper level has TW_SIZE slots covering TW_SIZE times the span of a slot
+ * of the level below.  Timers are appended to the slot of their expiry
+ * tick, and the slots of the upper levels are cascaded (re-added) into the
+ * lower levels whenever the level below wraps, so both insertion and
+ * expiry are O(1) (amortized).  Timers further than the wheel's span are
+ * parked in its last slots and re-evaluated when cascaded.
+ */
+#define TW_TICK         1000    /* usecs per tick */
+#define TW_BITS0        8
+#define TW_BITS         6
+#define TW_LEVELS       4
+#define TW_SIZE0        (1 << TW_BITS0)
+#define TW_SIZE         (1 << TW_BITS)
+#define TW_MASK0        (TW_SIZE0 - 1)
+#define TW_MASK         (TW_SIZE - 1)
+#define TW_MAX_DELTA    ((((apr_uint64_t)1) << (TW_BITS0 + \
+                                                (TW_LEVELS - 1) * TW_BITS)) - 1)
+
+struct ap_timer_wheel_t
+{
+    apr_thread_mutex_t *mutex;
+    apr_pool_t *pool;
+    apr_uint64_t tick;          /* next tick to expire */
+    struct timers_t level0[TW_SIZE0];
+    struct timers_t levels[TW_LEVELS - 1][TW_SIZE];
+    struct timers_t free_ring;
+    ap_timer_wheel_stats_t stats;
+};
+
+#define TW_TIME_TO_TICK(t) ((t) > 0 ? (apr_uint64_t)(t) / TW_TICK : 0)
+
+/* Must be called with the wheel's mutex held */
+static void timer_wheel_add(ap_timer_wheel_t *wheel, timer_event_t *te)
+{
+    apr_uint64_t expires = TW_TIME_TO_TICK(te->when), delta;
+    struct timers_t *slot;
+
+    if (expires < wheel->tick) {
+        expires = wheel->tick;
+    }
+    delta = expires - wheel->tick;
+    if (delta > TW_MAX_DELTA) {
+        delta = TW_MAX_DELTA;
+        expires = wheel->tick + delta;
+    }
+
+    if (delta < TW_SIZE0) {
+        slot = &wheel->level0[expires & TW_MASK0];
+    }
+    else {
+        unsigned int shift = TW_BITS0;
+        int level;
+        for (level = 0; level < TW_LEVELS - 2; ++level) {
+            if (delta < (((apr_uint64_t)1) << (shift + TW_BITS))) {
+                break;
+            }
+            shift += TW_BITS;
+        }
+        slot = &wheel->levels[level][(expires >> shift) & TW_MASK];
+    }
+    APR_RING_INSERT_TAIL(slot, te, timer_event_t, link);
+}
+
+/* Re-add all the timers of the given slot (detached first) */
+static void timer_wheel_readd(ap_timer_wheel_t *wheel, struct timers_t *slot)
+{
+    struct timers_t tmp;
+
+    if (APR_RING_EMPTY(slot, timer_event_t, link)) {
+        return;
+    }
+    APR_RING_INIT(&tmp, timer_event_t, link);
+    APR_RING_CONCAT(&tmp, slot, timer_event_t, link);
+    while (!APR_RING_EMPTY(&tmp, timer_event_t, link)) {
+        timer_event_t *te = APR_RING_FIRST(&tmp);
+        APR_RING_REMOVE(te, link);
+        timer_wheel_add(wheel, te);
+    }
+}
+
+/* Level 0 wrapped, bring the next span of the upper levels down */
+static void timer_wheel_cascade(ap_timer_wheel_t *wheel)
+{
+    unsigned int shift = TW_BITS0;
+    int level;
+
+    for (level = 0; level < TW_LEVELS - 1; ++level) {
+        unsigned int idx = (unsigned int)(wheel->tick >> shift) & TW_MASK;
+        timer_wheel_readd(wheel, &wheel->levels[level][idx]);
+        if (idx) {
+            break;
+        }
+        shift += TW_BITS;
+    }
+}
+
+/* The clock jumped (backward or too far forward), re-add everything
+ * relatively to the new tick.
+ */
+static void timer_wheel_rebase(ap_timer_wheel_t *wheel, apr_uint64_t tick)
+{
+    struct timers_t all;
+    int i, level;
+
+    APR_RING_INIT(&all, timer_event_t, link);
+    for (i = 0; i < TW_SIZE0; ++i) {
+        APR_RING_CONCAT(&all, &wheel->level0[i], timer_event_t, link);
+    }
+    for (level = 0; level < TW_LEVELS - 1; ++level) {
+        for (i = 0; i < TW_SIZE; ++i) {
+            APR_RING_CONCAT(&all, &wheel->levels[level][i], timer_event_t,
+                            link);
+        }
+    }
+    wheel->tick = tick;
+    while (!APR_RING_EMPTY(&all, timer_event_t, link)) {
+        timer_event_t *te = APR_RING_FIRST(&all);
+        APR_RING_REMOVE(te, link);
+        timer_wheel_add(wheel, te);
+    }
+}
+
+apr_status_t ap_timer_wheel_create(ap_timer_wheel_t **pwheel, apr_pool_t *p)
+{
+    ap_timer_wheel_t *wheel;
+    apr_status_t rv;
+    int i, level;
+
+    wheel = apr_pcalloc(p, sizeof *wheel);
+    rv = apr_thread_mutex_create(&wheel->mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    /* Events are allocated under the wheel's mutex, so use our own pool */
+    rv = apr_pool_create(&wheel->pool, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    apr_pool_tag(wheel->pool, "timer_wheel");
+    wheel->tick = TW_TIME_TO_TICK(apr_time_now());
+    for (i = 0; i < TW_SIZE0; ++i) {
+        APR_RING_INIT(&wheel->level0[i], timer_event_t, link);
+    }
+    for (level = 0; level < TW_LEVELS - 1; ++level) {
+        for (i = 0; i < TW_SIZE; ++i) {
+            APR_RING_INIT(&wheel->levels[level][i], timer_event_t, link);
+        }
+    }
+    APR_RING_INIT(&wheel->free_ring, timer_event_t, link);
+
+    *pwheel = wheel;
+    return APR_SUCCESS;
+}
+
+/**
+ * Get a (recycled) timer event from the wheel, to be filled by the caller
+ * and then either inserted or recycled.
+ */
+timer_event_t *ap_timer_wheel_get_event(ap_timer_wheel_t *wheel)
+{
+    timer_event_t *te;
+
+    apr_thread_mutex_lock(wheel->mutex);
+    if (!APR_RING_EMPTY(&wheel->free_ring, timer_event_t, link)) {
+        te = APR_RING_FIRST(&wheel->free_ring);
+        APR_RING_REMOVE(te, link);
+    }
+    else {
+        te = apr_palloc(wheel->pool, sizeof *te);
+        APR_RING_ELEM_INIT(te, link);
+    }
+    apr_thread_mutex_unlock(wheel->mutex);
+
+    te->wheel = wheel;
+    return te;
+}
+
+/**
+ * Give a timer event (not in any ring) back to its wheel.
+ */
+void ap_timer_wheel_recycle(timer_event_t *te)
+{
+    ap_timer_wheel_t *wheel = te->wheel;
+
+    apr_thread_mutex_lock(wheel->mutex);
+    APR_RING_INSERT_TAIL(&wheel->free_ring, te, timer_event_t, link);
+    apr_thread_mutex_unlock(wheel->mutex);
+}
+
+void ap_timer_wheel_insert(ap_timer_wheel_t *wheel, timer_event_t *te)
+{
+    apr_thread_mutex_lock(wheel->mutex);
+    timer_wheel_add(wheel, te);
+    wheel->stats.pending++;
+    apr_thread_mutex_unlock(wheel->mutex);
+}
+
+/**
+ * Move all the timers expiring up to 'until' to the 'expired' ring,
+ * returning their number (including the canceled ones).
+ */
+apr_uint32_t ap_timer_wheel_expire(ap_timer_wheel_t *wheel, apr_time_t until,
+                                   struct timers_t *expired)
+{
+    apr_uint64_t target = TW_TIME_TO_TICK(until);
+    apr_time_t now = apr_time_now();
+    apr_uint32_t count = 0;
+    timer_event_t *te;
+
+    apr_thread_mutex_lock(wheel->mutex);
+
+    if (!wheel->stats.pending) {
+        /* Nothing to cascade nor expire, just catch up */
+        if (target >= wheel->tick) {
+            wheel->tick = target + 1;
+        }
+        apr_thread_mutex_unlock(wheel->mutex);
+        return 0;
+    }
+    if (target + TW_SIZE0 < wheel->tick
+            || (target > wheel->tick && target - wheel->tick > TW_MAX_DELTA)) {
+        timer_wheel_rebase(wheel, target);
+    }
+
+    while (wheel->tick <= target) {
+        struct timers_t *slot;
+
+        if (!(wheel->tick & TW_MASK0)) {
+            timer_wheel_cascade(wheel);
+        }
+        slot = &wheel->level0[wheel->tick & TW_MASK0];
+        if (!APR_RING_EMPTY(slot, timer_event_t, link)) {
+            for (te = APR_RING_FIRST(slot);
+                 te != APR_RING_SENTINEL(slot, timer_event_t, link);
+                 te = APR_RING_NEXT(te, link)) {
+                ++count;
+                if (!te->canceled) {
+                    apr_interval_time_t late = now - te->when;
+                    if (late > 0) {
+                        wheel->stats.late_total += late;
+                        if (late > wheel->stats.late_max) {
+                            wheel->stats.late_max = late;
+                        }
+                    }
+                    wheel->stats.fired++;
+                }
+            }
+            APR_RING_CONCAT(expired, slot, timer_event_t, link);
+        }
+        wheel->tick++;
+    }
+    AP_DEBUG_ASSERT(wheel->stats.pending >= count);
+    wheel->stats.pending -= count;
+
+    apr_thread_mutex_unlock(wheel->mutex);
+    return count;
+}
+
+/**
+ * Time until the next timer expires (or the wheel needs cascading),
+ * bounded by max.
+ */
+apr_interval_time_t ap_timer_wheel_timeout(ap_timer_wheel_t *wheel,
+                                           apr_time_t now,
+                                           apr_interval_time_t max)
+{
+    apr_interval_time_t timeout = max;
+    apr_uint64_t tick, end;
+
+    apr_thread_mutex_lock(wheel->mutex);
+    if (wheel->stats.pending) {
+        /* Don't look beyond max nor the next cascade */
+        end = wheel->tick + max / TW_TICK + 1;
+        if (end > (wheel->tick | TW_MASK0) + 1) {
+            end = (wheel->tick | TW_MASK0) + 1;
+        }
+        for (tick = wheel->tick; tick < end; ++tick) {
+            if (!APR_RING_EMPTY(&wheel->level0[tick & TW_MASK0],
+                                timer_event_t, link)) {
+                break;
+            }
+        }
+        timeout = (apr_time_t)(tick * TW_TICK) - now;
+        if (timeout > max) {
+            timeout = max;
+        }
+        else if (timeout <= 0) {
+            timeout = 1;
+        }
+    }
+    apr_thread_mutex_unlock(wheel->mutex);
+
+    return timeout;
+}
+
+void ap_timer_wheel_get_stats(ap_timer_wheel_t *wheel,
+                              ap_timer_wheel_stats_t *stats)
+{
+    apr_thread_mutex_lock(wheel->mutex);
+    *stats = wheel->stats;
+    apr_thread_mutex_unlock(wheel->mutex);
+}
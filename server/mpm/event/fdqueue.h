@@ -63,6 +63,7 @@ struct fd_queue_elem_t
 typedef struct fd_queue_elem_t fd_queue_elem_t;
 
 typedef struct timer_event_t timer_event_t;
+typedef struct ap_timer_wheel_t ap_timer_wheel_t;
 
 struct timer_event_t
 {
@@ -72,16 +73,59 @@ struct timer_event_t
     void *baton;
     int canceled;
     apr_array_header_t *remove;
+    ap_timer_wheel_t *wheel;    /* owner, for recycling */
 };
+APR_RING_HEAD(timers_t, timer_event_t);
 
+typedef struct ap_timer_wheel_stats_t
+{
+    apr_uint32_t pending;       /* timers in the wheel */
+    apr_uint32_t fired;         /* (non canceled) timers expired so far */
+    apr_uint64_t late_total;    /* sum of their lateness (usecs) */
+    apr_interval_time_t late_max;   /* worst lateness (usecs) */
+} ap_timer_wheel_stats_t;
+
+/*
+ * Hierarchical timing wheel (O(1) insertion and expiry), thread-safe.
+ */
+apr_status_t ap_timer_wheel_create(ap_timer_wheel_t **wheel, apr_pool_t *p);
+timer_event_t *ap_timer_wheel_get_event(ap_timer_wheel_t *wheel);
+void ap_timer_wheel_recycle(timer_event_t *te);
+void ap_timer_wheel_insert(ap_timer_wheel_t *wheel, timer_event_t *te);
+apr_uint32_t ap_timer_wheel_expire(ap_timer_wheel_t *wheel, apr_time_t until,
+                                   struct timers_t *expired);
+apr_interval_time_t ap_timer_wheel_timeout(ap_timer_wheel_t *wheel,
+                                           apr_time_t now,
+                                           apr_interval_time_t max);
+void ap_timer_wheel_get_stats(ap_timer_wheel_t *wheel,
+                              ap_timer_wheel_stats_t *stats);
+
+/* One slot of the lock-free ring: seq tells producers and consumers
+ * whether the slot is free for the given lap or holds a published elem.
+ */
+struct fd_queue_cell_t
+{
+    volatile apr_uint32_t seq;
+    fd_queue_elem_t elem;
+};
+typedef struct fd_queue_cell_t fd_queue_cell_t;
+
+/*
+ * Sockets are handed over to the workers through a bounded lock-free
+ * multi-producer/multi-consumer ring, so that several listener threads
+ * can push concurrently without serializing on a mutex.  The mutex and
+ * condition variable are only used to put workers to sleep when the ring
+ * is empty (and to protect the rarely used timers ring).
+ */
 struct fd_queue_t
 {
-    APR_RING_HEAD(timers_t, timer_event_t) timers;
-    fd_queue_elem_t *data;
-    unsigned int nelts;
-    unsigned int bounds;
-    unsigned int in;
-    unsigned int out;
+    struct timers_t timers;
+    fd_queue_cell_t *cells;
+    apr_uint32_t mask;
+    volatile apr_uint32_t in;
+    volatile apr_uint32_t out;
+    volatile apr_uint32_t timers_count;
+    volatile apr_uint32_t waiters;
     apr_thread_mutex_t *one_big_mutex;
     apr_thread_cond_t *not_empty;
     int terminated;
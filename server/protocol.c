@@ -48,6 +48,7 @@
 #include "util_charset.h"
 #include "util_ebcdic.h"
 #include "scoreboard.h"
+#include "ap_mpm.h"
 
 #if APR_HAVE_STDARG_H
 #include <stdarg.h>
@@ -188,6 +189,50 @@ AP_DECLARE(apr_time_t) ap_rationalize_mtime(request_rec *r, apr_time_t mtime)
     return (mtime > now) ? now : mtime;
 }
 
+/* Keep the heap buffer of the given bucket alive until the request's pool
+ * is cleared, so that the line(s) it contains can be used in place instead
+ * of being copied.  The successive lines of a request usually come from the
+ * same socket read, hence a single buffer is pinned for all of them.
+ */
+typedef struct {
+    const void *heap;
+} rgetline_pin_t;
+
+static apr_status_t rgetline_unpin(void *data)
+{
+    apr_bucket_destroy((apr_bucket *)data);
+    return APR_SUCCESS;
+}
+
+static int rgetline_pin(request_rec *r, apr_bucket *e)
+{
+    conn_rec *c = r->connection;
+    rgetline_pin_t *pin = NULL;
+    apr_bucket *copy;
+
+    /* The bucket must be released before its allocator is destroyed */
+    if (!c || e->list != c->bucket_alloc
+            || !apr_pool_is_ancestor(c->pool, r->pool)) {
+        return 0;
+    }
+
+    apr_pool_userdata_get((void **)&pin, "ap_rgetline_pin", r->pool);
+    if (pin && pin->heap == e->data) {
+        return 1;
+    }
+    if (apr_bucket_copy(e, &copy) != APR_SUCCESS) {
+        return 0;
+    }
+    if (!pin) {
+        pin = apr_palloc(r->pool, sizeof *pin);
+        apr_pool_userdata_setn(pin, "ap_rgetline_pin", NULL, r->pool);
+    }
+    pin->heap = e->data;
+    apr_pool_cleanup_register(r->pool, copy, rgetline_unpin,
+                              apr_pool_cleanup_null);
+    return 1;
+}
+
 /* Get a line of protocol input, including any continuation lines
  * caused by MIME folding (or broken clients) if fold != 0, and place it
  * in the buffer s, of size n bytes, without the ending newline.
@@ -196,7 +241,9 @@ AP_DECLARE(apr_time_t) ap_rationalize_mtime(request_rec *r, apr_time_t mtime)
  * stricter protocol adherence and better input filter behavior during
  * chunked trailer processing (for http).
  *
- * If s is NULL, ap_rgetline_core will allocate necessary memory from r->pool.
+ * If s is NULL, ap_rgetline_core will allocate necessary memory from r->pool,
+ * or when the whole line is in a single heap bucket, return it in place (the
+ * bucket's buffer being then kept until r->pool is cleared).
  *
  * Returns APR_SUCCESS if there are no problems and sets *read to be
  * the full length of s.
@@ -289,6 +336,16 @@ AP_DECLARE(apr_status_t) ap_rgetline_core(char **s, apr_size_t n,
 
             /* Do we have to handle the allocation ourselves? */
             if (do_alloc) {
+                /* The common case where the line is in a single heap bucket
+                 * can avoid the allocation and copy altogether.
+                 */
+                if (!*s && str[len - 1] == APR_ASCII_LF
+                        && APR_BUCKET_IS_HEAP(e) && rgetline_pin(r, e)) {
+                    *s = (char *)str;
+                    last_char = *s + len - 1;
+                    bytes_handled = len;
+                    continue;
+                }
                 /* We'll assume the common case where one bucket is enough. */
                 if (!*s) {
                     current_alloc = len;
@@ -477,9 +534,9 @@ AP_DECLARE(int) ap_getline(char *s, int n, request_rec *r, int fold)
     apr_size_t len;
     apr_bucket_brigade *tmp_bb;
 
-    tmp_bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    tmp_bb = ap_acquire_brigade(r->connection);
     rv = ap_rgetline(&tmp_s, n, &len, r, fold, tmp_bb);
-    apr_brigade_destroy(tmp_bb);
+    ap_release_brigade(r->connection, tmp_bb);
 
     /* Map the out-of-space condition to the old API. */
     if (rv == APR_ENOSPC) {
@@ -778,7 +835,7 @@ AP_DECLARE(void) ap_get_mime_headers_core(request_rec *r, apr_bucket_brigade *bb
     char *field;
     char *value;
     apr_size_t len;
-    int fields_read = 0;
+    int fields_read = 0, fields_added;
     char *tmp_field;
     core_server_config *conf = ap_get_core_module_config(r->server->module_config);
 
@@ -894,7 +951,7 @@ AP_DECLARE(void) ap_get_mime_headers_core(request_rec *r, apr_bucket_brigade *bb
                     return;
                 }
 
-                if (!(value = strchr(last_field, ':'))) { /* Find ':' or    */
+                if (!(value = memchr(last_field, ':', last_len))) { /* Find ':' or */
                     r->status = HTTP_BAD_REQUEST;      /* abort bad request */
                     apr_table_setn(r->notes, "error-notes",
                                    apr_psprintf(r->pool,
@@ -989,26 +1046,39 @@ AP_DECLARE(void) ap_get_mime_headers_core(request_rec *r, apr_bucket_brigade *bb
     /* Combine multiple message-header fields with the same
      * field-name, following RFC 2616, 4.2.
      */
+    fields_added = apr_table_elts(r->headers_in)->nelts;
     apr_table_compress(r->headers_in, APR_OVERLAP_TABLES_MERGE);
 
-    /* enforce LimitRequestFieldSize for merged headers */
-    apr_table_do(table_do_fn_check_lengths, r, r->headers_in, NULL);
+    /* enforce LimitRequestFieldSize for merged headers (the single ones
+     * were checked when read, so nothing to do if none was merged)
+     */
+    if (apr_table_elts(r->headers_in)->nelts != fields_added) {
+        apr_table_do(table_do_fn_check_lengths, r, r->headers_in, NULL);
+    }
 }
 
 AP_DECLARE(void) ap_get_mime_headers(request_rec *r)
 {
     apr_bucket_brigade *tmp_bb;
-    tmp_bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    tmp_bb = ap_acquire_brigade(r->connection);
     ap_get_mime_headers_core(r, tmp_bb);
-    apr_brigade_destroy(tmp_bb);
+    ap_release_brigade(r->connection, tmp_bb);
 }
 
 AP_DECLARE(request_rec *) ap_create_request(conn_rec *conn)
 {
     request_rec *r;
     apr_pool_t *p;
+    apr_allocator_t *allocator = NULL;
 
-    apr_pool_create(&p, conn->pool);
+#if APR_HAS_THREADS
+    /* Use the worker thread's allocator if the MPM provides one */
+    if (conn->current_thread) {
+        apr_thread_data_get((void **)&allocator, AP_MPM_THREAD_ALLOCATOR_KEY,
+                            conn->current_thread);
+    }
+#endif
+    apr_pool_create_ex(&p, conn->pool, NULL, allocator);
     apr_pool_tag(p, "request");
     r = apr_pcalloc(p, sizeof(request_rec));
     AP_READ_REQUEST_ENTRY((intptr_t)r, (uintptr_t)conn);
@@ -1070,7 +1140,7 @@ request_rec *ap_read_request(conn_rec *conn)
 
     request_rec *r = ap_create_request(conn);
 
-    tmp_bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    tmp_bb = ap_acquire_brigade(conn);
 
     ap_run_pre_read_request(r, conn);
 
@@ -1096,16 +1166,16 @@ request_rec *ap_read_request(conn_rec *conn)
             ap_update_child_status(conn->sbh, SERVER_BUSY_LOG, r);
             ap_run_log_transaction(r);
             r = NULL;
-            apr_brigade_destroy(tmp_bb);
+            ap_release_brigade(conn, tmp_bb);
             goto traceout;
         case HTTP_REQUEST_TIME_OUT:
             ap_update_child_status(conn->sbh, SERVER_BUSY_LOG, r);
             if (!r->connection->keepalives)
                 ap_run_log_transaction(r);
-            apr_brigade_destroy(tmp_bb);
+            ap_release_brigade(conn, tmp_bb);
             goto traceout;
         default:
-            apr_brigade_destroy(tmp_bb);
+            ap_release_brigade(conn, tmp_bb);
             r = NULL;
             goto traceout;
         }
@@ -1132,7 +1202,7 @@ request_rec *ap_read_request(conn_rec *conn)
             ap_send_error_response(r, 0);
             ap_update_child_status(conn->sbh, SERVER_BUSY_LOG, r);
             ap_run_log_transaction(r);
-            apr_brigade_destroy(tmp_bb);
+            ap_release_brigade(conn, tmp_bb);
             goto traceout;
         }
 
@@ -1154,7 +1224,7 @@ request_rec *ap_read_request(conn_rec *conn)
                 ap_send_error_response(r, 0);
                 ap_update_child_status(conn->sbh, SERVER_BUSY_LOG, r);
                 ap_run_log_transaction(r);
-                apr_brigade_destroy(tmp_bb);
+                ap_release_brigade(conn, tmp_bb);
                 goto traceout;
             }
 
@@ -1182,12 +1252,12 @@ request_rec *ap_read_request(conn_rec *conn)
             ap_send_error_response(r, 0);
             ap_update_child_status(conn->sbh, SERVER_BUSY_LOG, r);
             ap_run_log_transaction(r);
-            apr_brigade_destroy(tmp_bb);
+            ap_release_brigade(conn, tmp_bb);
             goto traceout;
         }
     }
 
-    apr_brigade_destroy(tmp_bb);
+    ap_release_brigade(conn, tmp_bb);
 
     /* update what we think the virtual host is based on the headers we've
      * now read. may update status.
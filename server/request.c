@@ -28,6 +28,11 @@
 #include "apr_strings.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#include "apr_thread_rwlock.h"
+#endif
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -41,6 +46,7 @@
 #include "http_protocol.h"
 #include "http_log.h"
 #include "http_main.h"
+#include "ap_mpm.h"
 #include "util_filter.h"
 #include "util_charset.h"
 #include "util_script.h"
@@ -49,11 +55,18 @@
 
 #include "mod_core.h"
 #include "mod_auth.h"
+#include "mod_status.h"
 
 #if APR_HAVE_STDARG_H
 #include <stdarg.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
 /* we know core's module_index is 0 */
 #undef APLOG_MODULE_INDEX
 #define APLOG_MODULE_INDEX AP_CORE_MODULE_INDEX
@@ -435,6 +448,733 @@ static walk_cache_t *prep_walk_cache(apr_size_t t, request_rec *r)
     return cache;
 }
 
+/*****************************************************************
+ *
+ * Per-child cache of merged per-dir configs.
+ *
+ * The walks merge the same configuration sections in the same order for
+ * every request to a given path, and the result of a merge depends only
+ * on the two vectors merged.  So remember the ap_merge_per_dir_configs()
+ * result for each (base, new) pair, which identifies the ordered list of
+ * sections merged so far, and let the next request pick it up rather than
+ * run every module's merger again.
+ *
+ * Only vectors that live as long as the child take part: the server
+ * defaults and the sections of the configuration (registered at child
+ * init), and the cached results themselves.  Anything derived from a
+ * .htaccess file or otherwise allocated from a request pool is merged per
+ * request as before, so a recycled address can never produce a false hit.
+ * Requests may hold on to a cached vector at any time, so entries are
+ * never evicted; once the cache is full, new combinations are merged per
+ * request.  Since the cache only grows, and quickly stops growing, hits
+ * take a read lock and only the insertion of a new merge writes.
+ */
+
+typedef struct {
+    const ap_conf_vector_t *base;
+    const ap_conf_vector_t *new_conf;
+} merge_key_t;
+
+typedef struct {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_rwlock_t *rwlock;
+#endif
+    apr_hash_t *stable;         /* vectors living as long as the child */
+    apr_hash_t *merged;         /* merge_key_t -> merged vector */
+    unsigned int max;
+} merge_cache_t;
+
+static merge_cache_t *merge_cache = NULL;
+
+static int merge_cache_is_stable(const ap_conf_vector_t *conf)
+{
+    return apr_hash_get(merge_cache->stable, &conf, sizeof(conf)) != NULL;
+}
+
+static void merge_cache_set_stable(const ap_conf_vector_t *conf)
+{
+    const ap_conf_vector_t **key = apr_palloc(merge_cache->pool,
+                                              sizeof(*key));
+    *key = conf;
+    apr_hash_set(merge_cache->stable, key, sizeof(*key), key);
+}
+
+static void merge_cache_add_sections(apr_array_header_t *sections);
+
+static void merge_cache_add_section(ap_conf_vector_t *conf)
+{
+    core_dir_config *dconf;
+
+    if (!conf || merge_cache_is_stable(conf)) {
+        return;
+    }
+    merge_cache_set_stable(conf);
+
+    /* <Files> and <If> sections nest in <Directory>, <Location> and
+     * in each other
+     */
+    dconf = ap_get_core_module_config(conf);
+    if (dconf) {
+        merge_cache_add_sections(dconf->sec_file);
+        merge_cache_add_sections(dconf->sec_if);
+    }
+}
+
+static void merge_cache_add_sections(apr_array_header_t *sections)
+{
+    ap_conf_vector_t **elts;
+    int i;
+
+    if (!sections) {
+        return;
+    }
+    elts = (ap_conf_vector_t **)sections->elts;
+    for (i = 0; i < sections->nelts; ++i) {
+        merge_cache_add_section(elts[i]);
+    }
+}
+
+void ap_merge_cache_child_init(apr_pool_t *pchild, server_rec *s,
+                               unsigned int max)
+{
+    apr_pool_t *pool;
+    server_rec *vs;
+#if APR_HAS_THREADS
+    int threaded_mpm;
+#endif
+
+    merge_cache = NULL;
+    if (!max) {
+        return;
+    }
+
+    apr_pool_create(&pool, pchild);
+    apr_pool_tag(pool, "merge_cache");
+    merge_cache = apr_pcalloc(pool, sizeof(*merge_cache));
+    merge_cache->pool = pool;
+    merge_cache->max = max;
+    merge_cache->stable = apr_hash_make(pool);
+    merge_cache->merged = apr_hash_make(pool);
+#if APR_HAS_THREADS
+    if (ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm) == APR_SUCCESS
+        && threaded_mpm
+        && apr_thread_rwlock_create(&merge_cache->rwlock,
+                                    pool) != APR_SUCCESS) {
+        merge_cache = NULL;
+        return;
+    }
+#endif
+
+    for (vs = s; vs; vs = vs->next) {
+        core_server_config *sconf =
+            ap_get_core_module_config(vs->module_config);
+
+        merge_cache_add_section(vs->lookup_defaults);
+        merge_cache_add_sections(sconf->sec_dir);
+        merge_cache_add_sections(sconf->sec_url);
+    }
+}
+
+static ap_conf_vector_t *merge_per_dir_configs(request_rec *r,
+                                               ap_conf_vector_t *base,
+                                               ap_conf_vector_t *new_conf)
+{
+    ap_conf_vector_t *merged;
+    merge_key_t key;
+    int cacheable;
+
+    if (!merge_cache) {
+        return ap_merge_per_dir_configs(r->pool, base, new_conf);
+    }
+
+    key.base = base;
+    key.new_conf = new_conf;
+
+    /* Readers only, the common case once the cache is warm */
+#if APR_HAS_THREADS
+    if (merge_cache->rwlock) {
+        apr_thread_rwlock_rdlock(merge_cache->rwlock);
+    }
+#endif
+    merged = apr_hash_get(merge_cache->merged, &key, sizeof(key));
+    cacheable = (!merged
+                 && apr_hash_count(merge_cache->merged) < merge_cache->max
+                 && merge_cache_is_stable(base)
+                 && merge_cache_is_stable(new_conf));
+#if APR_HAS_THREADS
+    if (merge_cache->rwlock) {
+        apr_thread_rwlock_unlock(merge_cache->rwlock);
+    }
+#endif
+
+    if (cacheable) {
+#if APR_HAS_THREADS
+        if (merge_cache->rwlock) {
+            apr_thread_rwlock_wrlock(merge_cache->rwlock);
+        }
+#endif
+        /* Another thread may have got there first */
+        merged = apr_hash_get(merge_cache->merged, &key, sizeof(key));
+        if (!merged
+            && apr_hash_count(merge_cache->merged) < merge_cache->max) {
+            merge_key_t *k = apr_pmemdup(merge_cache->pool, &key,
+                                         sizeof(key));
+
+            merged = ap_merge_per_dir_configs(merge_cache->pool, base,
+                                              new_conf);
+            apr_hash_set(merge_cache->merged, k, sizeof(*k), merged);
+            merge_cache_set_stable(merged);
+        }
+#if APR_HAS_THREADS
+        if (merge_cache->rwlock) {
+            apr_thread_rwlock_unlock(merge_cache->rwlock);
+        }
+#endif
+    }
+
+    if (!merged) {
+        merged = ap_merge_per_dir_configs(r->pool, base, new_conf);
+    }
+    return merged;
+}
+
+/*****************************************************************
+ *
+ * Per-child cache of stat() results.
+ *
+ * The directory walk stats every component of the path, resolves
+ * symlinks, and tries to open .htaccess files in every directory when
+ * overrides are allowed.  With StatCacheTTL set, the results, including
+ * failures and the absence of .htaccess files, are remembered for that
+ * long so that hot paths are walked without any syscall.  The cache is
+ * bounded to StatCacheSize entries, the least recently used going first.
+ *
+ * With StatCacheInotify (Linux), the parent directory of every cached
+ * path is watched as well, and changes in there invalidate the entries.
+ * Events are read at most every STATCACHE_INOTIFY_POLL, so a longer TTL
+ * can be used safely.
+ */
+
+/* What apr_stat() gets at no extra cost on the platforms we care about */
+#define STATCACHE_WANTED (APR_FINFO_MIN | APR_FINFO_IDENT | APR_FINFO_NLINK \
+                          | APR_FINFO_OWNER | APR_FINFO_PROT)
+
+#define STATCACHE_INOTIFY_POLL (APR_USEC_PER_SEC / 50)   /* 20ms */
+
+typedef struct statcache_entry_t statcache_entry_t;
+struct statcache_entry_t {
+    statcache_entry_t *prev;    /* LRU list, most recently used first */
+    statcache_entry_t *next;
+    apr_time_t expires;
+    apr_status_t rv;
+    apr_finfo_t finfo;          /* without the pool, fname and name */
+    const char *name;           /* finfo.name if valid */
+    int link;                   /* lstat() rather than stat() */
+    apr_size_t len;
+    char path[1];
+};
+
+typedef struct {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_hash_t *entries[2];     /* path -> entry, for stat() and lstat() */
+    statcache_entry_t *first;
+    statcache_entry_t *last;
+    unsigned int count;
+    unsigned int max;
+    apr_interval_time_t ttl;
+    apr_uint64_t hits;
+    apr_uint64_t misses;
+    apr_uint64_t invalidations;
+#ifdef HAVE_SYS_INOTIFY_H
+    int inotify_fd;
+    apr_time_t inotify_polled;
+    apr_hash_t *watched;        /* directory -> int wd */
+    apr_hash_t *watches;        /* int wd -> directory */
+#endif
+} statcache_t;
+
+static statcache_t *statcache = NULL;
+
+static APR_INLINE void statcache_lock(void)
+{
+#if APR_HAS_THREADS
+    if (statcache->mutex) {
+        apr_thread_mutex_lock(statcache->mutex);
+    }
+#endif
+}
+
+static APR_INLINE void statcache_unlock(void)
+{
+#if APR_HAS_THREADS
+    if (statcache->mutex) {
+        apr_thread_mutex_unlock(statcache->mutex);
+    }
+#endif
+}
+
+static void statcache_remove(statcache_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        statcache->first = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        statcache->last = e->prev;
+    }
+    apr_hash_set(statcache->entries[e->link], e->path, e->len, NULL);
+    statcache->count--;
+    free(e);
+}
+
+static void statcache_flush(void)
+{
+    while (statcache->first) {
+        statcache_remove(statcache->first);
+        statcache->invalidations++;
+    }
+}
+
+static void statcache_invalidate(const char *path, apr_size_t len)
+{
+    statcache_entry_t *e;
+    int link;
+
+    for (link = 0; link < 2; ++link) {
+        e = apr_hash_get(statcache->entries[link], path, len);
+        if (e) {
+            statcache_remove(e);
+            statcache->invalidations++;
+        }
+    }
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define STATCACHE_INOTIFY_MASK (IN_ATTRIB | IN_CREATE | IN_DELETE \
+                                | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO \
+                                | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static void statcache_inotify_watch(const char *path, apr_size_t len)
+{
+    char *dir;
+    int *wd;
+
+    /* Watch the parent directory, which reports changes to its entries */
+    while (len > 1 && path[len - 1] == '/') {
+        --len;
+    }
+    while (len > 1 && path[len - 1] != '/') {
+        --len;
+    }
+    if (len > 1) {
+        --len;
+    }
+    if (!len || apr_hash_get(statcache->watched, path, len)) {
+        return;
+    }
+
+    dir = malloc(len + 1);
+    wd = malloc(sizeof(*wd));
+    if (!dir || !wd) {
+        free(dir);
+        free(wd);
+        return;
+    }
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    *wd = inotify_add_watch(statcache->inotify_fd, dir,
+                            STATCACHE_INOTIFY_MASK);
+    if (*wd < 0) {
+        /* Out of watches (or not a directory); the TTL still applies */
+        free(dir);
+        free(wd);
+        return;
+    }
+    if (apr_hash_get(statcache->watches, wd, sizeof(*wd))) {
+        /* Same directory through another path (symlink) */
+        free(dir);
+        free(wd);
+        return;
+    }
+    apr_hash_set(statcache->watched, dir, len, wd);
+    apr_hash_set(statcache->watches, wd, sizeof(*wd), dir);
+}
+
+static void statcache_inotify_event(const struct inotify_event *ev)
+{
+    const char *dir;
+    char *path;
+    apr_size_t dlen, nlen;
+
+    dir = apr_hash_get(statcache->watches, &ev->wd, sizeof(ev->wd));
+
+    if (ev->mask & IN_IGNORED) {
+        if (dir) {
+            int *wd = apr_hash_get(statcache->watched, dir, strlen(dir));
+
+            apr_hash_set(statcache->watched, dir, strlen(dir), NULL);
+            apr_hash_set(statcache->watches, &ev->wd, sizeof(ev->wd), NULL);
+            free(wd);
+            free((char *)dir);
+        }
+        return;
+    }
+    if (!dir || (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT))) {
+        /* Everything below may have moved */
+        statcache_flush();
+        return;
+    }
+
+    dlen = strlen(dir);
+    nlen = ev->len ? strlen(ev->name) : 0;
+    path = malloc(dlen + nlen + 3);
+    if (!path) {
+        statcache_flush();
+        return;
+    }
+    memcpy(path, dir, dlen);
+    if (nlen) {
+        if (path[dlen - 1] != '/') {
+            path[dlen++] = '/';
+        }
+        memcpy(path + dlen, ev->name, nlen);
+        dlen += nlen;
+    }
+    statcache_invalidate(path, dlen);
+    path[dlen] = '/';
+    statcache_invalidate(path, dlen + 1);
+    free(path);
+}
+
+static void statcache_inotify_poll(apr_time_t now)
+{
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
+    ssize_t n;
+
+    if (statcache->inotify_fd < 0
+        || now - statcache->inotify_polled < STATCACHE_INOTIFY_POLL) {
+        return;
+    }
+    statcache->inotify_polled = now;
+
+    while ((n = read(statcache->inotify_fd, u.buf, sizeof(u.buf))) > 0) {
+        char *p = u.buf;
+
+        while (p < u.buf + n) {
+            const struct inotify_event *ev = (struct inotify_event *)p;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                statcache_flush();
+            }
+            else {
+                statcache_inotify_event(ev);
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+static apr_status_t statcache_cleanup(void *dummy)
+{
+    if (statcache) {
+        statcache_flush();
+#ifdef HAVE_SYS_INOTIFY_H
+        if (statcache->inotify_fd >= 0) {
+            close(statcache->inotify_fd);
+        }
+#endif
+        statcache = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+void ap_statcache_child_init(apr_pool_t *pchild, server_rec *s,
+                             apr_interval_time_t ttl, unsigned int max,
+                             int use_inotify)
+{
+#if APR_HAS_THREADS
+    int threaded_mpm;
+#endif
+
+    statcache = NULL;
+    if (ttl <= 0 || !max) {
+        return;
+    }
+
+    statcache = apr_pcalloc(pchild, sizeof(*statcache));
+    statcache->ttl = ttl;
+    statcache->max = max;
+    statcache->entries[0] = apr_hash_make(pchild);
+    statcache->entries[1] = apr_hash_make(pchild);
+#if APR_HAS_THREADS
+    if (ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm) == APR_SUCCESS
+        && threaded_mpm
+        && apr_thread_mutex_create(&statcache->mutex,
+                                   APR_THREAD_MUTEX_DEFAULT,
+                                   pchild) != APR_SUCCESS) {
+        statcache = NULL;
+        return;
+    }
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+    statcache->inotify_fd = -1;
+    if (use_inotify) {
+        statcache->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (statcache->inotify_fd < 0) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, errno, s, APLOGNO(03395)
+                         "StatCacheInotify: inotify_init1() failed, "
+                         "cached entries expire by StatCacheTTL only");
+        }
+        statcache->watched = apr_hash_make(pchild);
+        statcache->watches = apr_hash_make(pchild);
+    }
+#endif
+    apr_pool_cleanup_register(pchild, NULL, statcache_cleanup,
+                              apr_pool_cleanup_null);
+}
+
+/* Find a live entry, under the lock */
+static statcache_entry_t *statcache_get(const char *fname, apr_size_t len,
+                                        int link, apr_time_t now)
+{
+    statcache_entry_t *e;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    statcache_inotify_poll(now);
+#endif
+
+    e = apr_hash_get(statcache->entries[link], fname, len);
+    if (e && e->expires <= now) {
+        statcache_remove(e);
+        e = NULL;
+    }
+    if (e && e->prev) {
+        /* Move to front */
+        e->prev->next = e->next;
+        if (e->next) {
+            e->next->prev = e->prev;
+        }
+        else {
+            statcache->last = e->prev;
+        }
+        e->prev = NULL;
+        e->next = statcache->first;
+        statcache->first->prev = e;
+        statcache->first = e;
+    }
+    return e;
+}
+
+/* Add (or replace) an entry, under the lock */
+static void statcache_set(const char *fname, apr_size_t len, int link,
+                          apr_time_t now, apr_status_t rv,
+                          const apr_finfo_t *finfo)
+{
+    statcache_entry_t *e;
+    apr_size_t nlen = 0;
+
+    if (finfo && (finfo->valid & APR_FINFO_NAME) && finfo->name) {
+        nlen = strlen(finfo->name) + 1;
+    }
+    e = malloc(sizeof(*e) + len + nlen);
+    if (!e) {
+        return;
+    }
+
+    memset(e, 0, sizeof(*e));
+    memcpy(e->path, fname, len);
+    e->path[len] = '\0';
+    e->len = len;
+    e->link = link;
+    e->rv = rv;
+    e->expires = now + statcache->ttl;
+    if (finfo) {
+        memcpy(&e->finfo, finfo, sizeof(*finfo));
+        e->finfo.pool = NULL;
+        e->finfo.fname = NULL;
+        e->finfo.name = NULL;
+        if (nlen) {
+            e->name = e->path + len + 1;
+            memcpy(e->path + len + 1, finfo->name, nlen);
+        }
+        else {
+            e->finfo.valid &= ~APR_FINFO_NAME;
+        }
+    }
+
+    {
+        statcache_entry_t *old = apr_hash_get(statcache->entries[link],
+                                              fname, len);
+        if (old) {
+            statcache_remove(old);
+        }
+    }
+    while (statcache->count >= statcache->max && statcache->last) {
+        statcache_remove(statcache->last);
+    }
+
+    e->next = statcache->first;
+    if (statcache->first) {
+        statcache->first->prev = e;
+    }
+    else {
+        statcache->last = e;
+    }
+    statcache->first = e;
+    statcache->count++;
+    apr_hash_set(statcache->entries[link], e->path, len, e);
+
+#ifdef HAVE_SYS_INOTIFY_H
+    if (statcache->inotify_fd >= 0) {
+        statcache_inotify_watch(e->path, len);
+    }
+#endif
+}
+
+apr_status_t ap_statcache_stat(apr_finfo_t *finfo, const char *fname,
+                               apr_int32_t wanted, apr_pool_t *p)
+{
+    statcache_entry_t *e;
+    apr_size_t len;
+    apr_time_t now;
+    apr_status_t rv;
+    int link = (wanted & APR_FINFO_LINK) ? 1 : 0;
+
+    if (!statcache
+        || (wanted & ~(STATCACHE_WANTED | APR_FINFO_NAME | APR_FINFO_LINK))) {
+        return apr_stat(finfo, fname, wanted, p);
+    }
+
+    len = strlen(fname);
+    now = apr_time_now();
+
+    statcache_lock();
+    e = statcache_get(fname, len, link, now);
+    if (e) {
+        statcache->hits++;
+        rv = e->rv;
+        if (rv == APR_SUCCESS || rv == APR_INCOMPLETE) {
+            memcpy(finfo, &e->finfo, sizeof(*finfo));
+            if (e->name) {
+                finfo->name = apr_pstrdup(p, e->name);
+            }
+        }
+        statcache_unlock();
+
+        if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+            return rv;
+        }
+        finfo->pool = p;
+        finfo->fname = fname;
+        return (wanted & ~APR_FINFO_LINK & ~finfo->valid) ? APR_INCOMPLETE
+                                                         : APR_SUCCESS;
+    }
+    statcache->misses++;
+    statcache_unlock();
+
+    rv = apr_stat(finfo, fname,
+                  STATCACHE_WANTED | APR_FINFO_NAME | (wanted & APR_FINFO_LINK),
+                  p);
+
+    statcache_lock();
+    if (rv == APR_SUCCESS || rv == APR_INCOMPLETE) {
+        statcache_set(fname, len, link, now, rv, finfo);
+    }
+    else {
+        statcache_set(fname, len, link, now, rv, NULL);
+    }
+    statcache_unlock();
+
+    if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+        return rv;
+    }
+    return (wanted & ~APR_FINFO_LINK & ~finfo->valid) ? APR_INCOMPLETE
+                                                     : APR_SUCCESS;
+}
+
+int ap_statcache_absent(const char *fname, apr_status_t *rv)
+{
+    statcache_entry_t *e;
+    int absent = 0;
+
+    if (!statcache) {
+        return 0;
+    }
+
+    statcache_lock();
+    e = statcache_get(fname, strlen(fname), 0, apr_time_now());
+    if (e && (APR_STATUS_IS_ENOENT(e->rv) || APR_STATUS_IS_ENOTDIR(e->rv))) {
+        statcache->hits++;
+        *rv = e->rv;
+        absent = 1;
+    }
+    statcache_unlock();
+
+    return absent;
+}
+
+void ap_statcache_set_absent(const char *fname, apr_status_t rv)
+{
+    if (!statcache) {
+        return;
+    }
+
+    statcache_lock();
+    statcache->misses++;
+    statcache_set(fname, strlen(fname), 0, apr_time_now(), rv, NULL);
+    statcache_unlock();
+}
+
+int ap_statcache_status_hook(request_rec *r, int flags)
+{
+    apr_uint64_t hits, misses, invalidations;
+    unsigned int count;
+
+    if (!statcache) {
+        return OK;
+    }
+
+    statcache_lock();
+    hits = statcache->hits;
+    misses = statcache->misses;
+    invalidations = statcache->invalidations;
+    count = statcache->count;
+    statcache_unlock();
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rprintf(r, "<hr />\n<h1>Stat Cache (this child)</h1>\n\n"
+                   "<table border=\"0\"><tr><th>Entries</th><th>Hits</th>"
+                   "<th>Misses</th><th>Invalidations</th></tr>\n"
+                   "<tr><td>%u / %u</td><td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td>"
+                   "<td>%" APR_UINT64_T_FMT "</td></tr>\n</table>\n",
+                   count, statcache->max, hits, misses, invalidations);
+    }
+    else {
+        ap_rprintf(r, "StatCacheEntries: %u\n"
+                   "StatCacheHits: %" APR_UINT64_T_FMT "\n"
+                   "StatCacheMisses: %" APR_UINT64_T_FMT "\n"
+                   "StatCacheInvalidations: %" APR_UINT64_T_FMT "\n",
+                   count, hits, misses, invalidations);
+    }
+
+    return OK;
+}
+
 /*****************************************************************
  *
  * Getting and checking directory configuration.  Also checks the
@@ -479,8 +1219,9 @@ static int resolve_symlink(char *d, apr_finfo_t *lfi, int opts, apr_pool_t *p)
 
     /* if OPT_SYM_OWNER is unset, we only need to check target accessible */
     if (!(opts & OPT_SYM_OWNER)) {
-        if (apr_stat(&fi, d, lfi->valid & ~(APR_FINFO_NAME | APR_FINFO_LINK), p)
-            != APR_SUCCESS)
+        if (ap_statcache_stat(&fi, d,
+                              lfi->valid & ~(APR_FINFO_NAME | APR_FINFO_LINK),
+                              p) != APR_SUCCESS)
         {
             return HTTP_FORBIDDEN;
         }
@@ -500,14 +1241,16 @@ static int resolve_symlink(char *d, apr_finfo_t *lfi, int opts, apr_pool_t *p)
      * owner of the symlink, then get the info of the target.
      */
     if (!(lfi->valid & APR_FINFO_OWNER)) {
-        if (apr_stat(lfi, d, lfi->valid | APR_FINFO_LINK | APR_FINFO_OWNER, p)
-            != APR_SUCCESS)
+        if (ap_statcache_stat(lfi, d,
+                              lfi->valid | APR_FINFO_LINK | APR_FINFO_OWNER,
+                              p) != APR_SUCCESS)
         {
             return HTTP_FORBIDDEN;
         }
     }
 
-    if (apr_stat(&fi, d, lfi->valid & ~(APR_FINFO_NAME), p) != APR_SUCCESS) {
+    if (ap_statcache_stat(&fi, d, lfi->valid & ~(APR_FINFO_NAME), p)
+        != APR_SUCCESS) {
         return HTTP_FORBIDDEN;
     }
 
@@ -986,9 +1729,9 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 }
 
                 if (now_merged) {
-                    now_merged = ap_merge_per_dir_configs(r->pool,
-                                                          now_merged,
-                                                          sec_ent[sec_idx]);
+                    now_merged = merge_per_dir_configs(r,
+                                                       now_merged,
+                                                       sec_ent[sec_idx]);
                 }
                 else {
                     now_merged = sec_ent[sec_idx];
@@ -1056,9 +1799,9 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 }
 
                 if (now_merged) {
-                    now_merged = ap_merge_per_dir_configs(r->pool,
-                                                          now_merged,
-                                                          htaccess_conf);
+                    now_merged = merge_per_dir_configs(r,
+                                                       now_merged,
+                                                       htaccess_conf);
                 }
                 else {
                     now_merged = htaccess_conf;
@@ -1294,9 +2037,9 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = merge_per_dir_configs(r,
+                                                   now_merged,
+                                                   sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1373,9 +2116,9 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = merge_per_dir_configs(r,
+                                                  r->per_dir_config,
+                                                  now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1533,9 +2276,9 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = merge_per_dir_configs(r,
+                                                   now_merged,
+                                                   sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1576,9 +2319,9 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = merge_per_dir_configs(r,
+                                                  r->per_dir_config,
+                                                  now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1729,9 +2472,9 @@ AP_DECLARE(int) ap_file_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = merge_per_dir_configs(r,
+                                                   now_merged,
+                                                   sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1772,9 +2515,9 @@ AP_DECLARE(int) ap_file_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = merge_per_dir_configs(r,
+                                                  r->per_dir_config,
+                                                  now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1866,9 +2609,9 @@ AP_DECLARE(int) ap_if_walk(request_rec *r)
         }
 
         if (now_merged) {
-            now_merged = ap_merge_per_dir_configs(r->pool,
-                                                  now_merged,
-                                                  sec_ent[sec_idx]);
+            now_merged = merge_per_dir_configs(r,
+                                               now_merged,
+                                               sec_ent[sec_idx]);
         }
         else {
             now_merged = sec_ent[sec_idx];
@@ -1904,9 +2647,9 @@ AP_DECLARE(int) ap_if_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = merge_per_dir_configs(r,
+                                                  r->per_dir_config,
+                                                  now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -2351,16 +3094,17 @@ AP_DECLARE(request_rec *) ap_sub_req_lookup_dirent(const apr_finfo_t *dirent,
          */
         apr_status_t rv;
         if (ap_allow_options(rnew) & OPT_SYM_LINKS) {
-            if (((rv = apr_stat(&rnew->finfo, rnew->filename,
-                                APR_FINFO_MIN, rnew->pool)) != APR_SUCCESS)
+            if (((rv = ap_statcache_stat(&rnew->finfo, rnew->filename,
+                                         APR_FINFO_MIN, rnew->pool))
+                 != APR_SUCCESS)
                 && (rv != APR_INCOMPLETE)) {
                 rnew->finfo.filetype = APR_NOFILE;
             }
         }
         else {
-            if (((rv = apr_stat(&rnew->finfo, rnew->filename,
-                                APR_FINFO_LINK | APR_FINFO_MIN,
-                                rnew->pool)) != APR_SUCCESS)
+            if (((rv = ap_statcache_stat(&rnew->finfo, rnew->filename,
+                                         APR_FINFO_LINK | APR_FINFO_MIN,
+                                         rnew->pool)) != APR_SUCCESS)
                 && (rv != APR_INCOMPLETE)) {
                 rnew->finfo.filetype = APR_NOFILE;
             }
@@ -2457,16 +3201,17 @@ AP_DECLARE(request_rec *) ap_sub_req_lookup_file(const char *new_file,
         && ap_strchr_c(rnew->filename + fdirlen, '/') == NULL) {
         apr_status_t rv;
         if (ap_allow_options(rnew) & OPT_SYM_LINKS) {
-            if (((rv = apr_stat(&rnew->finfo, rnew->filename,
-                                APR_FINFO_MIN, rnew->pool)) != APR_SUCCESS)
+            if (((rv = ap_statcache_stat(&rnew->finfo, rnew->filename,
+                                         APR_FINFO_MIN, rnew->pool))
+                 != APR_SUCCESS)
                 && (rv != APR_INCOMPLETE)) {
                 rnew->finfo.filetype = APR_NOFILE;
             }
         }
         else {
-            if (((rv = apr_stat(&rnew->finfo, rnew->filename,
-                                APR_FINFO_LINK | APR_FINFO_MIN,
-                                rnew->pool)) != APR_SUCCESS)
+            if (((rv = ap_statcache_stat(&rnew->finfo, rnew->filename,
+                                         APR_FINFO_LINK | APR_FINFO_MIN,
+                                         rnew->pool)) != APR_SUCCESS)
                 && (rv != APR_INCOMPLETE)) {
                 rnew->finfo.filetype = APR_NOFILE;
             }
@@ -15,6 +15,7 @@
  */
 
 #include "apr.h"
+#include "apr_atomic.h"
 #include "apr_strings.h"
 #include "apr_portable.h"
 #include "apr_lib.h"
@@ -107,8 +108,28 @@ static APR_OPTIONAL_FN_TYPE(ap_logio_get_last_bytes)
 struct ap_sb_handle_t {
     int child_num;
     int thread_num;
+    /* Number of copies to the slot with ExtendedStatus, atomic since
+     * the slave connections of HTTP/2 share their master's handle.
+     */
+    apr_uint32_t copies;
 };
 
+/* The request line, client and vhost of a request last copied to the
+ * slot with ExtendedStatus, kept by the request (core_request_config) so
+ * that they are not copied again on each status change, as long as no
+ * other copy was made to the slot since (the copy count is unchanged).
+ */
+struct ap_sb_copy_t {
+    ap_sb_handle_t *sbh;
+    apr_uint32_t copy;
+    const char *the_request;
+    const char *useragent_ip;
+    const server_rec *server;
+};
+
+/* times() is a system call, and mod_status only needs a recent value */
+#define TIMES_SAMPLE_INTERVAL 16
+
 static int server_limit, thread_limit;
 static apr_size_t scoreboard_size;
 
@@ -142,6 +163,8 @@ AP_DECLARE(int) ap_calc_scoreboard_size(void)
 
     scoreboard_size  = SIZE_OF_global_score;
     scoreboard_size += SIZE_OF_process_score * server_limit;
+    /* keep the first worker_score off the last process_score's cache line */
+    scoreboard_size += AP_SCOREBOARD_CACHE_LINE;
     scoreboard_size += SIZE_OF_worker_score * server_limit * thread_limit;
 
     return scoreboard_size;
@@ -165,6 +188,7 @@ AP_DECLARE(void) ap_init_scoreboard(void *shared_score)
     more_storage += SIZE_OF_global_score;
     ap_scoreboard_image->parent = (process_score *)more_storage;
     more_storage += SIZE_OF_process_score * server_limit;
+    more_storage += AP_SCOREBOARD_CACHE_LINE;
     ap_scoreboard_image->servers =
         (worker_score **)((char*)ap_scoreboard_image + SIZE_OF_scoreboard);
     for (i = 0; i < server_limit; i++) {
@@ -384,7 +408,9 @@ AP_DECLARE(void) ap_increment_counts(ap_sb_handle_t *sb, request_rec *r)
     }
 
 #ifdef HAVE_TIMES
-    times(&ws->times);
+    if (ws->my_access_count % TIMES_SAMPLE_INTERVAL == 0) {
+        times(&ws->times);
+    }
 #endif
     ws->access_count++;
     ws->my_access_count++;
@@ -413,11 +439,18 @@ AP_DECLARE(int) ap_find_child_by_pid(apr_proc_t *pid)
 AP_DECLARE(void) ap_create_sb_handle(ap_sb_handle_t **new_sbh, apr_pool_t *p,
                                      int child_num, int thread_num)
 {
-    *new_sbh = (ap_sb_handle_t *)apr_palloc(p, sizeof(ap_sb_handle_t));
+    *new_sbh = (ap_sb_handle_t *)apr_pcalloc(p, sizeof(ap_sb_handle_t));
     (*new_sbh)->child_num = child_num;
     (*new_sbh)->thread_num = thread_num;
 }
 
+AP_DECLARE(void) ap_sb_get_child_thread(ap_sb_handle_t *sbh, int *child_num,
+                                        int *thread_num)
+{
+    *child_num = sbh->child_num;
+    *thread_num = sbh->thread_num;
+}
+
 static void copy_request(char *rbuf, apr_size_t rbuflen, request_rec *r)
 {
     char *p;
@@ -454,7 +487,8 @@ static void copy_request(char *rbuf, apr_size_t rbuflen, request_rec *r)
     }
 }
 
-static int update_child_status_internal(int child_num,
+static int update_child_status_internal(ap_sb_handle_t *sbh,
+                                        int child_num,
                                         int thread_num,
                                         int status,
                                         conn_rec *c,
@@ -480,7 +514,18 @@ static int update_child_status_internal(int child_num,
 
     if (ap_extended_status) {
         const char *val;
-        
+        core_request_config *creq = NULL;
+        struct ap_sb_copy_t *copied = NULL;
+        int same_r = 0, copy = 0;
+
+        if (sbh && r && r->request_config) {
+            creq = ap_get_core_module_config(r->request_config);
+        }
+        if (creq && (copied = creq->sb_copy) != NULL) {
+            same_r = (copied->sbh == sbh
+                      && copied->copy == apr_atomic_read32(&sbh->copies));
+        }
+
         if (status == SERVER_READY || status == SERVER_DEAD) {
             /*
              * Reset individual counters
@@ -496,16 +541,22 @@ static int update_child_status_internal(int child_num,
 
         if (descr) {
             apr_cpystrn(ws->request, descr, sizeof(ws->request));
+            copy = 1;
         }
-        else if (r) {
+        else if (r && !(same_r && copied->the_request == r->the_request)) {
             copy_request(ws->request, sizeof(ws->request), r);
+            copy = 1;
         }
 
         if (r) {
-            if (!(val = ap_get_useragent_host(r, REMOTE_NOLOOKUP, NULL)))
-                apr_cpystrn(ws->client, r->useragent_ip, sizeof(ws->client));
-            else
-                apr_cpystrn(ws->client, val, sizeof(ws->client));
+            if (!(same_r && copied->useragent_ip == r->useragent_ip)) {
+                if (!(val = ap_get_useragent_host(r, REMOTE_NOLOOKUP, NULL)))
+                    apr_cpystrn(ws->client, r->useragent_ip,
+                                sizeof(ws->client));
+                else
+                    apr_cpystrn(ws->client, val, sizeof(ws->client));
+                copy = 1;
+            }
         }
         else if (c) {
             if (!(val = ap_get_remote_host(c, c->base_server->lookup_defaults,
@@ -513,9 +564,11 @@ static int update_child_status_internal(int child_num,
                 apr_cpystrn(ws->client, c->client_ip, sizeof(ws->client));
             else
                 apr_cpystrn(ws->client, val, sizeof(ws->client));
+            copy = 1;
         }
 
-        if (s) {
+        if (s && !(same_r && copied->server == s)) {
+            copy = 1;
             if (c) {
                 apr_snprintf(ws->vhost, sizeof(ws->vhost), "%s:%d",
                              s->server_hostname, c->local_addr->port);
@@ -529,6 +582,22 @@ static int update_child_status_internal(int child_num,
             val = ap_get_protocol(c);
             apr_cpystrn(ws->protocol, val, sizeof(ws->protocol));
         }
+
+        if (sbh && copy) {
+            apr_uint32_t n = apr_atomic_inc32(&sbh->copies) + 1;
+
+            if (creq) {
+                if (!copied) {
+                    copied = apr_palloc(r->pool, sizeof(*copied));
+                    creq->sb_copy = copied;
+                }
+                copied->sbh = sbh;
+                copied->copy = n;
+                copied->the_request = r->the_request;
+                copied->useragent_ip = r->useragent_ip;
+                copied->server = s;
+            }
+        }
     }
 
     return old_status;
@@ -543,7 +612,7 @@ AP_DECLARE(int) ap_update_child_status_from_indexes(int child_num,
         return -1;
     }
 
-    return update_child_status_internal(child_num, thread_num, status,
+    return update_child_status_internal(NULL, child_num, thread_num, status,
                                         r ? r->connection : NULL,
                                         r ? r->server : NULL,
                                         r, NULL);
@@ -555,7 +624,7 @@ AP_DECLARE(int) ap_update_child_status(ap_sb_handle_t *sbh, int status,
     if (!sbh || (sbh->child_num < 0))
         return -1;
 
-    return update_child_status_internal(sbh->child_num, sbh->thread_num,
+    return update_child_status_internal(sbh, sbh->child_num, sbh->thread_num,
                                         status,
                                         r ? r->connection : NULL,
                                         r ? r->server : NULL,
@@ -568,7 +637,7 @@ AP_DECLARE(int) ap_update_child_status_from_conn(ap_sb_handle_t *sbh, int status
     if (!sbh || (sbh->child_num < 0))
         return -1;
 
-    return update_child_status_internal(sbh->child_num, sbh->thread_num,
+    return update_child_status_internal(sbh, sbh->child_num, sbh->thread_num,
                                         status, c, NULL, NULL, NULL);
 }
 
@@ -578,7 +647,7 @@ AP_DECLARE(int) ap_update_child_status_from_server(ap_sb_handle_t *sbh, int stat
     if (!sbh || (sbh->child_num < 0))
         return -1;
 
-    return update_child_status_internal(sbh->child_num, sbh->thread_num,
+    return update_child_status_internal(sbh, sbh->child_num, sbh->thread_num,
                                         status, c, s, NULL, NULL);
 }
 
@@ -587,7 +656,7 @@ AP_DECLARE(int) ap_update_child_status_descr(ap_sb_handle_t *sbh, int status, co
     if (!sbh || (sbh->child_num < 0))
         return -1;
 
-    return update_child_status_internal(sbh->child_num, sbh->thread_num,
+    return update_child_status_internal(sbh, sbh->child_num, sbh->thread_num,
                                         status, NULL, NULL, NULL, descr);
 }
 
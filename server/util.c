@@ -2051,19 +2051,62 @@ AP_DECLARE(char *) ap_escape_html2(apr_pool_t *p, const char *s, int toasc)
     x[j] = '\0';
     return x;
 }
+
+#if !APR_CHARSET_EBCDIC
+#define LOGITEM_ONES          ((apr_uint64_t)-1 / 0xff)
+#define LOGITEM_HIGHS         (LOGITEM_ONES * 0x80)
+#define LOGITEM_LESS(w, n)    (((w) - LOGITEM_ONES * (n)) & ~(w) & LOGITEM_HIGHS)
+#define LOGITEM_HAS(w, c)     LOGITEM_LESS((w) ^ (LOGITEM_ONES * (c)), 1)
+#endif
+
+/* Return the first character of s which must be escaped in the logs, or
+ * its terminating NUL.  Log items are mostly clean, so (in ASCII) they
+ * are scanned eight bytes at a time, and bytewise only from a word which
+ * may have a control, 8-bit, DEL, quote or backslash byte, or the NUL.
+ */
+static const unsigned char *scan_logitem(const unsigned char *s)
+{
+#if !APR_CHARSET_EBCDIC
+    while (((apr_uintptr_t)s & (sizeof(apr_uint64_t) - 1)) != 0) {
+        if (!*s || TEST_CHAR(*s, T_ESCAPE_LOGITEM)) {
+            return s;
+        }
+        ++s;
+    }
+    for (;; s += sizeof(apr_uint64_t)) {
+        apr_uint64_t w;
+
+        /* Aligned, so the word does not cross a page; memcpy() rather
+         * than a cast, which would break the aliasing rules.  A NUL is
+         * less than 0x20, so no word after the one holding it is read.
+         */
+        memcpy(&w, s, sizeof(w));
+        if ((w & LOGITEM_HIGHS) || LOGITEM_LESS(w, 0x20)
+            || LOGITEM_HAS(w, 0x7f) || LOGITEM_HAS(w, '"')
+            || LOGITEM_HAS(w, '\\')) {
+            break;
+        }
+    }
+#endif
+    while (*s && !TEST_CHAR(*s, T_ESCAPE_LOGITEM)) {
+        ++s;
+    }
+    return s;
+}
+
 AP_DECLARE(char *) ap_escape_logitem(apr_pool_t *p, const char *str)
 {
     char *ret;
     unsigned char *d;
-    const unsigned char *s;
+    const unsigned char *s, *first;
     apr_size_t length, escapes = 0;
 
     if (!str) {
         return NULL;
     }
 
-    /* Compute how many characters need to be escaped */
-    s = (const unsigned char *)str;
+    /* Compute how many characters need to be escaped, from the first */
+    first = s = scan_logitem((const unsigned char *)str);
     for (; *s; ++s) {
         if (TEST_CHAR(*s, T_ESCAPE_LOGITEM)) {
             escapes++;
@@ -2080,8 +2123,9 @@ AP_DECLARE(char *) ap_escape_logitem(apr_pool_t *p, const char *str)
     
     /* Each escaped character needs up to 3 extra bytes (0 --> \x00) */
     ret = apr_palloc(p, length + 3 * escapes);
-    d = (unsigned char *)ret;
-    s = (const unsigned char *)str;
+    memcpy(ret, str, first - (const unsigned char *)str);
+    d = (unsigned char *)ret + (first - (const unsigned char *)str);
+    s = first;
     for (; *s; ++s) {
         if (TEST_CHAR(*s, T_ESCAPE_LOGITEM)) {
             *d++ = '\\';
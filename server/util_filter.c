@@ -37,6 +37,13 @@
 #define THRESHOLD_MAX_BUFFER 65536
 #define MAX_REQUESTS_IN_PIPELINE 5
 
+/* When set aside, runs of in-memory buckets smaller than
+ * SETASIDE_COALESCE_MAX are copied into heap buckets of
+ * APR_BUCKET_BUFF_SIZE allocated from the connection's bucket allocator,
+ * which recycles them.
+ */
+#define SETASIDE_COALESCE_MAX (APR_BUCKET_BUFF_SIZE / 2)
+
 /*
 ** This macro returns true/false if a given filter should be inserted BEFORE
 ** another filter. This will happen when one of: 1) there isn't another
@@ -695,6 +702,44 @@ AP_DECLARE(apr_status_t) ap_save_brigade(ap_filter_t *f,
     return srv;
 }
 
+AP_DECLARE(apr_bucket_brigade *) ap_acquire_brigade(conn_rec *c)
+{
+    if (c->spare_brigades && c->spare_brigades->nelts) {
+        return *(apr_bucket_brigade **)apr_array_pop(c->spare_brigades);
+    }
+    return apr_brigade_create(c->pool, c->bucket_alloc);
+}
+
+AP_DECLARE(void) ap_release_brigade(conn_rec *c, apr_bucket_brigade *bb)
+{
+    AP_DEBUG_ASSERT(bb->p == c->pool);
+
+    apr_brigade_cleanup(bb);
+    if (!c->spare_brigades) {
+        c->spare_brigades = apr_array_make(c->pool, 4,
+                                           sizeof(apr_bucket_brigade *));
+    }
+    *(apr_bucket_brigade **)apr_array_push(c->spare_brigades) = bb;
+}
+
+AP_DECLARE(apr_bucket_brigade *) ap_reuse_brigade_from_pool(const char *key,
+                                                      apr_pool_t *pool,
+                                                      apr_bucket_alloc_t *ba)
+{
+    apr_bucket_brigade *bb = NULL;
+
+    apr_pool_userdata_get((void **)&bb, key, pool);
+    if (bb == NULL) {
+        bb = apr_brigade_create(pool, ba);
+        apr_pool_userdata_setn(bb, key, NULL, pool);
+    }
+    else {
+        apr_brigade_cleanup(bb);
+    }
+
+    return bb;
+}
+
 static apr_status_t filters_cleanup(void *data)
 {
     ap_filter_t **key = data;
@@ -730,6 +775,73 @@ AP_DECLARE(int) ap_filter_prepare_brigade(ap_filter_t *f, apr_pool_t **p)
     return DECLINED;
 }
 
+static APR_INLINE int is_coalescable(apr_bucket *e)
+{
+    return (APR_BUCKET_IS_TRANSIENT(e) || APR_BUCKET_IS_HEAP(e)
+            || APR_BUCKET_IS_POOL(e) || APR_BUCKET_IS_IMMORTAL(e))
+           && e->length < SETASIDE_COALESCE_MAX;
+}
+
+/* Copy the runs of small in-memory buckets of bb into heap buckets of
+ * APR_BUCKET_BUFF_SIZE, the way apr_brigade_write() buffers data.  This
+ * turns transient data into heap data and leaves fewer buckets to set
+ * aside and write.
+ */
+static apr_status_t coalesce_brigade(apr_bucket_brigade *bb)
+{
+    apr_bucket *e, *next, *block = NULL;
+
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb); e = next) {
+        apr_bucket_heap *h;
+        const char *data;
+        apr_size_t len;
+        apr_status_t rv;
+
+        next = APR_BUCKET_NEXT(e);
+
+        if (!is_coalescable(e)) {
+            block = NULL;
+            continue;
+        }
+        if (!e->length) {
+            apr_bucket_delete(e);
+            continue;
+        }
+        if (block) {
+            h = block->data;
+            if (h->alloc_len - block->length < e->length) {
+                block = NULL;
+            }
+        }
+        if (!block) {
+            char *buf;
+
+            /* Copying a lone heap or pool bucket gains nothing */
+            if (!APR_BUCKET_IS_TRANSIENT(e)
+                && (next == APR_BRIGADE_SENTINEL(bb)
+                    || !is_coalescable(next))) {
+                continue;
+            }
+            buf = apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, bb->bucket_alloc);
+            block = apr_bucket_heap_create(buf, APR_BUCKET_BUFF_SIZE,
+                                           apr_bucket_free, bb->bucket_alloc);
+            block->length = 0;
+            APR_BUCKET_INSERT_BEFORE(e, block);
+        }
+
+        rv = apr_bucket_read(e, &data, &len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        h = block->data;
+        memcpy(h->base + block->start + block->length, data, len);
+        block->length += len;
+        apr_bucket_delete(e);
+    }
+
+    return APR_SUCCESS;
+}
+
 AP_DECLARE(apr_status_t) ap_filter_setaside_brigade(ap_filter_t *f,
         apr_bucket_brigade *bb)
 {
@@ -745,18 +857,27 @@ AP_DECLARE(apr_status_t) ap_filter_setaside_brigade(ap_filter_t *f,
 
     if (!APR_BRIGADE_EMPTY(bb)) {
         apr_pool_t *pool = NULL;
+        apr_status_t rv;
         /*
          * Set aside the brigade bb within f->bb.
          */
         ap_filter_prepare_brigade(f, &pool);
 
+        /* Small writes are packed into recycled heap blocks rather than
+         * copied one by one into the pool.
+         */
+        rv = coalesce_brigade(bb);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
         /* decide what pool we setaside to, request pool or deferred pool? */
         if (f->r) {
             apr_bucket *e;
             for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb); e =
                     APR_BUCKET_NEXT(e)) {
                 if (APR_BUCKET_IS_TRANSIENT(e)) {
-                    int rv = apr_bucket_setaside(e, f->r->pool);
+                    rv = apr_bucket_setaside(e, f->r->pool);
                     if (rv != APR_SUCCESS) {
                         return rv;
                     }
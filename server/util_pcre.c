@@ -46,10 +46,18 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "httpd.h"
 #include "apr_strings.h"
 #include "apr_tables.h"
+
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include "pcre2.h"
+#define PCREn(x) PCRE2_ ## x
+#else
 #include "pcre.h"
+#define PCREn(x) PCRE_ ## x
+#endif
 
 /* PCRE_DUPNAMES is only present since version 6.7 of PCRE */
-#ifndef PCRE_DUPNAMES
+#if !defined(PCRE_DUPNAMES) && !defined(HAVE_PCRE2)
 #error PCRE Version 6.7 or later required!
 #else
 
@@ -72,13 +80,31 @@ static const char *const pstring[] = {
     "match failed"              /* AP_REG_NOMATCH */
 };
 
+#ifndef HAVE_PCRE2
+/* With PCRE, ap_regex_t's re_pcre points to the compiled pattern and its
+ * study data (including the JIT compiled code, if any).
+ */
+typedef struct {
+    pcre *re;
+    pcre_extra *extra;
+} ap_pcre_t;
+#endif
+
 AP_DECLARE(const char *) ap_pcre_version_string(int which)
 {
+#ifdef HAVE_PCRE2
+    static char buf[80];
+#endif
     switch (which) {
     case AP_REG_PCRE_COMPILED:
-        return APR_STRINGIFY(PCRE_MAJOR) "." APR_STRINGIFY(PCRE_MINOR) " " APR_STRINGIFY(PCRE_DATE);
+        return APR_STRINGIFY(PCREn(MAJOR)) "." APR_STRINGIFY(PCREn(MINOR)) " " APR_STRINGIFY(PCREn(DATE));
     case AP_REG_PCRE_LOADED:
+#ifdef HAVE_PCRE2
+        pcre2_config(PCRE2_CONFIG_VERSION, buf);
+        return buf;
+#else
         return pcre_version();
+#endif
     default:
         return "Unknown";
     }
@@ -118,7 +144,21 @@ AP_DECLARE(apr_size_t) ap_regerror(int errcode, const ap_regex_t *preg,
 
 AP_DECLARE(void) ap_regfree(ap_regex_t *preg)
 {
-    (pcre_free)(preg->re_pcre);
+#ifdef HAVE_PCRE2
+    pcre2_code_free(preg->re_pcre);
+#else
+    ap_pcre_t *rx = preg->re_pcre;
+
+    if (rx->extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_free_study(rx->extra);
+#else
+        (pcre_free)(rx->extra);
+#endif
+    }
+    (pcre_free)(rx->re);
+    free(rx);
+#endif
 }
 
 
@@ -136,26 +176,55 @@ AP_DECLARE(void) ap_regfree(ap_regex_t *preg)
  *
  * Returns:      0 on success
  *               various non-zero codes on failure
+ *
+ * The pattern is JIT compiled when PCRE supports it, the interpreter being
+ * used otherwise (or if JIT compilation fails, e.g. with no executable
+ * memory).
 */
 AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
 {
+#ifdef HAVE_PCRE2
+    uint32_t capcount;
+    PCRE2_SIZE erroffset;
+#else
     const char *errorptr;
     int erroffset;
+    ap_pcre_t *rx;
+    pcre *re;
+#endif
     int errcode = 0;
-    int options = PCRE_DUPNAMES;
+    int options = PCREn(DUPNAMES);
 
     if ((cflags & AP_REG_ICASE) != 0)
-        options |= PCRE_CASELESS;
+        options |= PCREn(CASELESS);
     if ((cflags & AP_REG_NEWLINE) != 0)
-        options |= PCRE_MULTILINE;
+        options |= PCREn(MULTILINE);
     if ((cflags & AP_REG_DOTALL) != 0)
-        options |= PCRE_DOTALL;
+        options |= PCREn(DOTALL);
 
-    preg->re_pcre =
-        pcre_compile2(pattern, options, &errcode, &errorptr, &erroffset, NULL);
+#ifdef HAVE_PCRE2
+    preg->re_pcre = pcre2_compile((const unsigned char *)pattern,
+                                  PCRE2_ZERO_TERMINATED, options, &errcode,
+                                  &erroffset, NULL);
     preg->re_erroffset = erroffset;
 
     if (preg->re_pcre == NULL) {
+        /* ERR21, "failed to get memory" according to pcre2api(3) */
+        if (errcode == 121)
+            return AP_REG_ESPACE;
+        return AP_REG_INVARG;
+    }
+
+    pcre2_jit_compile(preg->re_pcre, PCRE2_JIT_COMPLETE);
+
+    pcre2_pattern_info((const pcre2_code *)preg->re_pcre,
+                       PCRE2_INFO_CAPTURECOUNT, &capcount);
+    preg->re_nsub = capcount;
+#else
+    re = pcre_compile2(pattern, options, &errcode, &errorptr, &erroffset, NULL);
+    preg->re_erroffset = erroffset;
+
+    if (re == NULL) {
         /*
          * There doesn't seem to be constants defined for compile time error
          * codes. 21 is "failed to get memory" according to pcreapi(3).
@@ -165,8 +234,21 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
         return AP_REG_INVARG;
     }
 
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
-                   PCRE_INFO_CAPTURECOUNT, &(preg->re_nsub));
+    rx = malloc(sizeof(*rx));
+    if (rx == NULL) {
+        (pcre_free)(re);
+        return AP_REG_ESPACE;
+    }
+    rx->re = re;
+#ifdef PCRE_STUDY_JIT_COMPILE
+    rx->extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE, &errorptr);
+#else
+    rx->extra = pcre_study(re, 0, &errorptr);
+#endif
+    preg->re_pcre = rx;
+
+    pcre_fullinfo(re, rx->extra, PCRE_INFO_CAPTURECOUNT, &(preg->re_nsub));
+#endif
     return 0;
 }
 
@@ -177,6 +259,47 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
  *              Match a regular expression       *
  *************************************************/
 
+#ifdef HAVE_PCRE2
+/* PCRE2 needs match data to be allocated for each match. To avoid the cost
+ * of malloc/free, and not to have to keep it per thread, the match data
+ * (and the general context used to allocate it) come from a buffer on the
+ * stack of the caller when they fit in, the heap otherwise.
+ */
+#ifndef AP_PCRE_STACKBUF_SIZE
+#define AP_PCRE_STACKBUF_SIZE (256 + POSIX_MALLOC_THRESHOLD * 2 * sizeof(PCRE2_SIZE))
+#endif
+
+typedef struct {
+    char *start;
+    char *buf;
+    apr_size_t avail;
+} match_buf;
+
+static void *match_buf_malloc(size_t size, void *ctx)
+{
+    match_buf *mb = ctx;
+
+    size = APR_ALIGN_DEFAULT(size);
+    if (size <= mb->avail) {
+        void *block = mb->buf;
+        mb->buf += size;
+        mb->avail -= size;
+        return block;
+    }
+    return malloc(size);
+}
+
+static void match_buf_free(void *block, void *ctx)
+{
+    match_buf *mb = ctx;
+
+    if ((char *)block >= mb->start && (char *)block < mb->buf) {
+        return;
+    }
+    free(block);
+}
+#endif /* HAVE_PCRE2 */
+
 /* Unfortunately, PCRE requires 3 ints of working space for each captured
  * substring, so we have to get and release working store instead of just using
  * the POSIX structures as was done in earlier releases when PCRE needed only 2
@@ -198,17 +321,51 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
 {
     int rc;
     int options = 0;
+#ifdef HAVE_PCRE2
+    apr_uint64_t stackbuf[AP_PCRE_STACKBUF_SIZE / sizeof(apr_uint64_t)];
+    match_buf mb;
+    pcre2_general_context *gctx;
+    pcre2_match_data *matchdata;
+    PCRE2_SIZE *ovector;
+#else
+    const ap_pcre_t *rx = preg->re_pcre;
     int *ovector = NULL;
     int small_ovector[POSIX_MALLOC_THRESHOLD * 3];
     int allocated_ovector = 0;
+#endif
 
     if ((eflags & AP_REG_NOTBOL) != 0)
-        options |= PCRE_NOTBOL;
+        options |= PCREn(NOTBOL);
     if ((eflags & AP_REG_NOTEOL) != 0)
-        options |= PCRE_NOTEOL;
+        options |= PCREn(NOTEOL);
 
     ((ap_regex_t *)preg)->re_erroffset = (apr_size_t)(-1);    /* Only has meaning after compile */
 
+#ifdef HAVE_PCRE2
+    mb.start = mb.buf = (char *)stackbuf;
+    mb.avail = sizeof(stackbuf);
+    gctx = pcre2_general_context_create(match_buf_malloc, match_buf_free, &mb);
+    if (gctx == NULL)
+        return AP_REG_ESPACE;
+    matchdata = pcre2_match_data_create(nmatch ? nmatch : 1, gctx);
+    if (matchdata == NULL) {
+        pcre2_general_context_free(gctx);
+        return AP_REG_ESPACE;
+    }
+
+    rc = pcre2_match((const pcre2_code *)preg->re_pcre,
+                     (const unsigned char *)buff, len,
+                     0, options, matchdata, NULL);
+    if (rc == PCRE2_ERROR_JIT_STACKLIMIT) {
+        /* The pattern needs more than the default JIT stack for this
+         * subject, let the interpreter (which uses the heap) do it.
+         */
+        rc = pcre2_match((const pcre2_code *)preg->re_pcre,
+                         (const unsigned char *)buff, len,
+                         0, options | PCRE2_NO_JIT, matchdata, NULL);
+    }
+    ovector = pcre2_get_ovector_pointer(matchdata);
+#else
     if (nmatch > 0) {
         if (nmatch <= POSIX_MALLOC_THRESHOLD) {
             ovector = &(small_ovector[0]);
@@ -221,8 +378,20 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
         }
     }
 
-    rc = pcre_exec((const pcre *)preg->re_pcre, NULL, buff, (int)len,
+    rc = pcre_exec(rx->re, rx->extra, buff, (int)len,
                    0, options, ovector, nmatch * 3);
+#ifdef PCRE_ERROR_JITSTACKLIMIT
+    if (rc == PCRE_ERROR_JITSTACKLIMIT) {
+        /* The pattern needs more than the default JIT stack for this
+         * subject, let the interpreter do it.
+         */
+        pcre_extra extra = *rx->extra;
+        extra.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+        rc = pcre_exec(rx->re, &extra, buff, (int)len,
+                       0, options, ovector, nmatch * 3);
+    }
+#endif
+#endif
 
     if (rc == 0)
         rc = nmatch;            /* All captured slots were filled in */
@@ -233,31 +402,45 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
             pmatch[i].rm_so = ovector[i * 2];
             pmatch[i].rm_eo = ovector[i * 2 + 1];
         }
+#ifdef HAVE_PCRE2
+        pcre2_match_data_free(matchdata);
+        pcre2_general_context_free(gctx);
+#else
         if (allocated_ovector)
             free(ovector);
+#endif
         for (; i < nmatch; i++)
             pmatch[i].rm_so = pmatch[i].rm_eo = -1;
         return 0;
     }
 
     else {
+#ifdef HAVE_PCRE2
+        pcre2_match_data_free(matchdata);
+        pcre2_general_context_free(gctx);
+        if (rc <= PCRE2_ERROR_UTF8_ERR1 && rc >= PCRE2_ERROR_UTF8_ERR21)
+            return AP_REG_INVARG;
+#else
         if (allocated_ovector)
             free(ovector);
+#endif
         switch (rc) {
-        case PCRE_ERROR_NOMATCH:
+        case PCREn(ERROR_NOMATCH):
             return AP_REG_NOMATCH;
-        case PCRE_ERROR_NULL:
+        case PCREn(ERROR_NULL):
             return AP_REG_INVARG;
-        case PCRE_ERROR_BADOPTION:
+        case PCREn(ERROR_BADOPTION):
             return AP_REG_INVARG;
-        case PCRE_ERROR_BADMAGIC:
+        case PCREn(ERROR_BADMAGIC):
             return AP_REG_INVARG;
+#ifndef HAVE_PCRE2
         case PCRE_ERROR_UNKNOWN_NODE:
             return AP_REG_ASSERT;
-        case PCRE_ERROR_NOMEMORY:
+#endif
+        case PCREn(ERROR_NOMEMORY):
             return AP_REG_ESPACE;
-#ifdef PCRE_ERROR_MATCHLIMIT
-        case PCRE_ERROR_MATCHLIMIT:
+#if defined(PCRE_ERROR_MATCHLIMIT) || defined(HAVE_PCRE2)
+        case PCREn(ERROR_MATCHLIMIT):
             return AP_REG_ESPACE;
 #endif
 #ifdef PCRE_ERROR_BADUTF8
@@ -283,12 +466,29 @@ AP_DECLARE(int) ap_regname(const ap_regex_t *preg,
     int i;
     char *nametable;
 
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
+#ifdef HAVE_PCRE2
+    uint32_t count, entrysize;
+    PCRE2_SPTR table;
+
+    pcre2_pattern_info((const pcre2_code *)preg->re_pcre,
+                       PCRE2_INFO_NAMECOUNT, &count);
+    pcre2_pattern_info((const pcre2_code *)preg->re_pcre,
+                       PCRE2_INFO_NAMEENTRYSIZE, &entrysize);
+    pcre2_pattern_info((const pcre2_code *)preg->re_pcre,
+                       PCRE2_INFO_NAMETABLE, &table);
+    namecount = count;
+    nameentrysize = entrysize;
+    nametable = (char *)table;
+#else
+    const ap_pcre_t *rx = preg->re_pcre;
+
+    pcre_fullinfo(rx->re, rx->extra,
                        PCRE_INFO_NAMECOUNT, &namecount);
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
+    pcre_fullinfo(rx->re, rx->extra,
                        PCRE_INFO_NAMEENTRYSIZE, &nameentrysize);
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
+    pcre_fullinfo(rx->re, rx->extra,
                        PCRE_INFO_NAMETABLE, &nametable);
+#endif
 
     for (i = 0; i < namecount; i++) {
         const char *offset = nametable + i * nameentrysize;
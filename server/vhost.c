@@ -23,6 +23,7 @@
 #include "apr.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
+#include "apr_hash.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -52,13 +53,33 @@
  * lists of name-vhosts.
  */
 typedef struct name_chain name_chain;
+typedef struct name_index name_index;
 struct name_chain {
     name_chain *next;
     server_addr_rec *sar;       /* the record causing it to be in
                                  * this chain (needed for port comparisons) */
     server_rec *server;         /* the server to use on a match */
+    int pos;                    /* position in the chain */
+    name_index *index;          /* lookup index, for the chain's head only */
 };
 
+/* Index of the names of a name-vhosts chain, so that finding the first
+ * server matching a Host does not require walking the whole chain.  Each
+ * entry is an array of the name_chain elements (in chain order) matching
+ * the key, the port still has to be checked at lookup time.
+ */
+struct name_index {
+    apr_hash_t *names;          /* ServerName and ServerAlias (lowercase) */
+    apr_hash_t *suffixes;       /* ".suffix" of "*.suffix" ServerAlias */
+    apr_array_header_t *wilds;  /* other wildcard ServerAlias, in order */
+    apr_hash_t *virthosts;      /* VirtualHost addresses (lowercase) */
+};
+
+typedef struct {
+    const char *pattern;
+    name_chain *src;
+} name_wild;
+
 /* meta-list of ip addresses.  Each server_rec can be in possibly multiple
  * hash chains since it can have multiple ips.
  */
@@ -373,6 +394,8 @@ static name_chain *new_name_chain(apr_pool_t *p,
     new->server = s;
     new->sar = sar;
     new->next = NULL;
+    new->pos = 0;
+    new->index = NULL;
     return new;
 }
 
@@ -551,6 +574,142 @@ static void add_name_vhost_config(apr_pool_t *p, server_rec *main_s,
    }
 }
 
+static void name_index_add(apr_pool_t *p, apr_hash_t *h, const char *key,
+                           name_chain *src)
+{
+    apr_array_header_t *srcs;
+    char *lkey = apr_pstrdup(p, key);
+
+    ap_str_tolower(lkey);
+    srcs = apr_hash_get(h, lkey, APR_HASH_KEY_STRING);
+    if (!srcs) {
+        srcs = apr_array_make(p, 1, sizeof(name_chain *));
+        apr_hash_set(h, lkey, APR_HASH_KEY_STRING, srcs);
+    }
+    else if (APR_ARRAY_IDX(srcs, srcs->nelts - 1, name_chain *) == src) {
+        /* same name given twice for this server */
+        return;
+    }
+    APR_ARRAY_PUSH(srcs, name_chain *) = src;
+}
+
+/* Index all the names of the name-vhosts chain (ServerName, ServerAlias
+ * and VirtualHost addresses), keeping track of each element's position so
+ * that the first match in chain order can still be determined.
+ */
+static void build_name_index(apr_pool_t *p, name_chain *names)
+{
+    name_index *idx = apr_pcalloc(p, sizeof *idx);
+    name_chain *src;
+    int pos = 0, i;
+
+    idx->names = apr_hash_make(p);
+    idx->suffixes = apr_hash_make(p);
+    idx->wilds = apr_array_make(p, 0, sizeof(name_wild));
+    idx->virthosts = apr_hash_make(p);
+
+    for (src = names; src; src = src->next) {
+        server_rec *s = src->server;
+        char **name;
+
+        src->pos = pos++;
+        if (src->sar->virthost) {
+            name_index_add(p, idx->virthosts, src->sar->virthost, src);
+        }
+        if (s->server_hostname) {
+            name_index_add(p, idx->names, s->server_hostname, src);
+        }
+        if (s->names) {
+            name = (char **)s->names->elts;
+            for (i = 0; i < s->names->nelts; ++i) {
+                if (name[i]) {
+                    name_index_add(p, idx->names, name[i], src);
+                }
+            }
+        }
+        if (s->wild_names) {
+            name = (char **)s->wild_names->elts;
+            for (i = 0; i < s->wild_names->nelts; ++i) {
+                if (!name[i]) {
+                    continue;
+                }
+                /* "*.example.com" matches exactly the hosts ending with
+                 * ".example.com", which can be looked up by suffix.
+                 */
+                if (name[i][0] == '*' && name[i][1] == '.'
+                        && !strpbrk(name[i] + 1, "*?")) {
+                    name_index_add(p, idx->suffixes, name[i] + 1, src);
+                }
+                else {
+                    name_wild *w = apr_array_push(idx->wilds);
+                    w->pattern = name[i];
+                    w->src = src;
+                }
+            }
+        }
+    }
+
+    names->index = idx;
+}
+
+/* Find the first element (in chain order) of srcs whose port matches */
+static APR_INLINE name_chain *name_index_first(apr_hash_t *h, const char *key,
+                                               apr_port_t port)
+{
+    apr_array_header_t *srcs = apr_hash_get(h, key, APR_HASH_KEY_STRING);
+
+    if (srcs) {
+        name_chain **src = (name_chain **)srcs->elts;
+        int i;
+        for (i = 0; i < srcs->nelts; ++i) {
+            if (src[i]->sar->host_port == 0 || port == src[i]->sar->host_port) {
+                return src[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Lookup the server for host (lowercase) in the index, with the same
+ * result as walking the chain in check_hostalias().
+ */
+static server_rec *name_index_lookup(name_index *idx, const char *host,
+                                     apr_port_t port)
+{
+    name_chain *found, *src;
+    const char *dot;
+    int i;
+
+    found = name_index_first(idx->names, host, port);
+
+    for (dot = strchr(host, '.'); dot; dot = strchr(dot + 1, '.')) {
+        src = name_index_first(idx->suffixes, dot, port);
+        if (src && (!found || src->pos < found->pos)) {
+            found = src;
+        }
+    }
+
+    for (i = 0; i < idx->wilds->nelts; ++i) {
+        name_wild *w = &APR_ARRAY_IDX(idx->wilds, i, name_wild);
+        src = w->src;
+        if (found && src->pos >= found->pos) {
+            break;
+        }
+        if ((src->sar->host_port == 0 || port == src->sar->host_port)
+                && !ap_strcasecmp_match(host, w->pattern)) {
+            found = src;
+            break;
+        }
+    }
+
+    if (!found) {
+        /* Fallback: does it match the virthost from the sar? */
+        found = name_index_first(idx->virthosts, host, port);
+    }
+
+    return found ? found->server : NULL;
+}
+
 /* compile the tables and such we need to do the run-time vhost lookups */
 AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
 {
@@ -667,6 +826,17 @@ AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
         }
     }
 
+    /* Now that the chains are complete, index the name-vhosts */
+    for (i = 0; i <= IPHASH_TABLE_SIZE; ++i) {
+        ipaddr_chain *ic = (i < IPHASH_TABLE_SIZE) ? iphash_table[i]
+                                                    : default_list;
+        for (; ic; ic = ic->next) {
+            if (ic->names) {
+                build_name_index(p, ic->names);
+            }
+        }
+    }
+
 #ifdef IPHASH_STATISTICS
     dump_iphash_statistics(main_s);
 #endif
@@ -1008,6 +1178,25 @@ static void check_hostalias(request_rec *r)
 
     port = r->connection->local_addr->port;
 
+    src = r->connection->vhost_lookup_data;
+    if (src->index) {
+        const char *c;
+
+        /* the index is lowercase, so should be the host */
+        for (c = host; *c && !apr_isupper(*c); ++c)
+            ;
+        if (*c) {
+            char *lhost = apr_pstrdup(r->pool, host);
+            ap_str_tolower(lhost);
+            host = lhost;
+        }
+        s = name_index_lookup(src->index, host, port);
+        if (s) {
+            goto found;
+        }
+        return;
+    }
+
     /* Recall that the name_chain is a list of server_addr_recs, some of
      * whose ports may not match.  Also each server may appear more than
      * once in the chain -- specifically, it will appear once for each
@@ -446,7 +446,7 @@ static int list_urls(char *path, apr_pool_t *pool, apr_off_t round)
                     len = sizeof(format);
                     if (apr_file_read_full(fd, &format, len, &len)
                             == APR_SUCCESS) {
-                        if (format == DISK_FORMAT_VERSION) {
+                        if (DISK_FORMAT_KNOWN(format)) {
                             apr_off_t offset = 0;
 
                             apr_file_seek(fd, APR_SET, &offset);
@@ -763,7 +763,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
                 len = sizeof(format);
                 if (apr_file_read_full(fd, &format, len,
                                        &len) == APR_SUCCESS) {
-                    if (format == DISK_FORMAT_VERSION) {
+                    if (DISK_FORMAT_KNOWN(format)) {
                         apr_off_t offset = 0;
 
                         apr_file_seek(fd, APR_SET, &offset);
@@ -793,7 +793,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
                             apr_file_close(fd);
                         }
                     }
-                    else if (format == VARY_FORMAT_VERSION) {
+                    else if (VARY_FORMAT_KNOWN(format)) {
                         apr_finfo_t finfo;
 
                         /* This must be a URL that added Vary headers later,
@@ -856,7 +856,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
                 len = sizeof(format);
                 if (apr_file_read_full(fd, &format, len,
                                        &len) == APR_SUCCESS) {
-                    if (format == VARY_FORMAT_VERSION) {
+                    if (VARY_FORMAT_KNOWN(format)) {
                         apr_time_t expires;
 
                         len = sizeof(expires);
@@ -879,7 +879,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
                             break;
                         }
                     }
-                    else if (format == DISK_FORMAT_VERSION) {
+                    else if (DISK_FORMAT_KNOWN(format)) {
                         apr_off_t offset = 0;
 
                         apr_file_seek(fd, APR_SET, &offset);
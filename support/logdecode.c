@@ -0,0 +1,778 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * logdecode: decode binary access logs
+ *
+ * Usage: logdecode [-j] [-f filter]... [-s] [file...]
+ *
+ * Reads the binary access logs written by mod_log_config with
+ * "CustomLog ... encoding=binary" (directly or through rotatelogs -b)
+ * from the files given, one after the other, or from stdin, and writes
+ * their entries to stdout: as the text lines the log format would have
+ * produced, or as JSON objects, one per line.
+ *
+ * Arguments:
+ *    -j              write JSON instead of text lines.
+ *    -f filter       only write the entries matching filter, which is
+ *                    field=value, field!=value or field~text (contains
+ *                    text).  A field is named as in the JSON output, or
+ *                    by its format item ("%>s").  Repeat for entries
+ *                    matching all of them.
+ *    -s              write statistics to stderr when finished.
+ *
+ * The record format is described in modules/loggers/log_binary_common.h.
+ * Entries are decoded with the schema which their writer sent before
+ * them; entries whose schema was not seen are counted and skipped.  So
+ * are the bytes which are not records with a good checksum, such as
+ * records interleaved by a pipe, and decoding goes on after them.
+ */
+
+#include "apr.h"
+#include "apr_lib.h"
+#include "apr_hash.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_file_io.h"
+#include "apr_time.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+#include "../modules/loggers/log_binary_common.h"
+
+#define READ_BUF_SIZE  64*1024
+#define WRITE_BUF_SIZE 128*1024
+
+/* a larger record is taken for garbage */
+#define RECORD_MAX     (16*1024*1024)
+
+static apr_file_t *errfile;
+static apr_file_t *outfile;
+static const char *shortname = "logdecode";
+
+typedef struct {
+    int type;
+    /* the constant, or the format item */
+    const char *spec;
+    apr_size_t spec_len;
+    /* the name in JSON and filters */
+    const char *name;
+} field_t;
+
+typedef struct {
+    int nfields;
+    field_t *fields;
+    /* the record, to recognize its copies */
+    const char *raw;
+    apr_size_t raw_len;
+} schema_t;
+
+typedef struct {
+    int set;
+    const char *str;
+    apr_size_t len;
+    apr_uint64_t num;
+    int minutes;
+} value_t;
+
+#define FILTER_EQ  0
+#define FILTER_NE  1
+#define FILTER_HAS 2
+
+typedef struct {
+    const char *field;
+    int op;
+    const char *value;
+    apr_size_t len;
+} filter_t;
+
+static apr_hash_t *schemas;
+static apr_array_header_t *filters;
+static int json = 0;
+
+/* Statistics */
+static apr_uint64_t records = 0;
+static apr_uint64_t schema_records = 0;
+static apr_uint64_t entries = 0;
+static apr_uint64_t written = 0;
+static apr_uint64_t unknown = 0;
+static apr_uint64_t malformed = 0;
+static apr_uint64_t skipped = 0;
+
+/*
+ * prints various statistics to output
+ */
+#define NL APR_EOL_STR
+static void print_statistics (apr_file_t *output)
+{
+    apr_file_printf(output, "logdecode Statistics:" NL);
+    apr_file_printf(output, "Records: %" APR_UINT64_T_FMT NL, records);
+    apr_file_printf(output, "    Schemas      : %" APR_UINT64_T_FMT NL,
+                    schema_records);
+    apr_file_printf(output, "    Entries      : %" APR_UINT64_T_FMT NL,
+                    entries);
+    apr_file_printf(output, "    - Written    : %" APR_UINT64_T_FMT NL,
+                    written);
+
+    if (unknown) {
+        apr_file_printf(output, "    - No schema  : %" APR_UINT64_T_FMT NL,
+                        unknown);
+    }
+
+    if (malformed) {
+        apr_file_printf(output, "    Malformed    : %" APR_UINT64_T_FMT NL,
+                        malformed);
+    }
+
+    if (skipped) {
+        apr_file_printf(output, "Bytes skipped: %" APR_UINT64_T_FMT NL,
+                        skipped);
+    }
+}
+
+/*
+ * usage info
+ */
+static void usage(void)
+{
+    apr_file_printf(errfile,
+    "%s -- Decode binary Apache access logs."                                NL
+    "Usage: %s [-j] [-f FILTER]... [-s] [FILE]..."                           NL
+                                                                             NL
+    "Options:"                                                               NL
+    "  -j   Write JSON objects instead of text lines."                       NL
+                                                                             NL
+    "  -f   Only write entries matching FILTER, one of field=value,"         NL
+    "       field!=value or field~text.  Fields are named as in JSON,"       NL
+    "       or by their format item, e.g. %%>s."                             NL
+                                                                             NL
+    "  -s   Write statistics to stderr when finished."                       NL,
+    shortname, shortname);
+    exit(1);
+}
+#undef NL
+
+/*
+ * The name of a format item in JSON: "%>s" is "status",
+ * "%{User-Agent}i" is "user_agent"
+ */
+static const struct {
+    char letter;
+    const char *name;
+} item_names[] = {
+    { 'a', "client_ip" },
+    { 'A', "local_ip" },
+    { 'b', "bytes" },
+    { 'B', "bytes" },
+    { 'D', "duration_us" },
+    { 'f', "filename" },
+    { 'h', "host" },
+    { 'H', "protocol" },
+    { 'I', "bytes_in" },
+    { 'k', "keepalives" },
+    { 'l', "logname" },
+    { 'L', "log_id" },
+    { 'm', "method" },
+    { 'O', "bytes_out" },
+    { 'p', "port" },
+    { 'P', "pid" },
+    { 'q', "query" },
+    { 'r', "request" },
+    { 'R', "handler" },
+    { 's', "status" },
+    { 'S', "bytes_transferred" },
+    { 't', "time" },
+    { 'T', "duration" },
+    { 'u', "user" },
+    { 'U', "path" },
+    { 'v', "vhost" },
+    { 'V', "server_name" },
+    { 'X', "connection_status" },
+    { '\0', NULL }
+};
+
+static const char *field_name(apr_pool_t *p, const char *spec)
+{
+    const char *s = spec + 1;
+    const char *arg = NULL;
+    apr_size_t arg_len = 0;
+    char *name, *d;
+    int i;
+
+    if (*spec != '%') {
+        return spec;
+    }
+    while (*s == '!' || *s == ',' || *s == '<' || *s == '>'
+           || apr_isdigit(*s)) {
+        ++s;
+    }
+    if (*s == '{') {
+        arg = ++s;
+        while (*s && *s != '}') {
+            ++s;
+        }
+        arg_len = s - arg;
+        if (*s) {
+            ++s;
+        }
+    }
+    if (!*s || s[1]) {
+        return spec;
+    }
+
+    if (!arg) {
+        for (i = 0; item_names[i].letter; ++i) {
+            if (item_names[i].letter == *s) {
+                return item_names[i].name;
+            }
+        }
+        return spec;
+    }
+    if (*s != 'i' && *s != 'o') {
+        return spec;
+    }
+
+    /* request headers by their name, response ones prefixed */
+    name = d = apr_palloc(p, arg_len + sizeof("response_"));
+    if (*s == 'o') {
+        memcpy(d, "response_", sizeof("response_") - 1);
+        d += sizeof("response_") - 1;
+    }
+    for (i = 0; i < (int)arg_len; ++i) {
+        *d++ = (arg[i] == '-') ? '_' : apr_tolower(arg[i]);
+    }
+    *d = '\0';
+    return name;
+}
+
+static void add_filter(apr_pool_t *p, const char *arg)
+{
+    filter_t *filter = apr_array_push(filters);
+    const char *op;
+
+    if ((op = strstr(arg, "!=")) != NULL) {
+        filter->op = FILTER_NE;
+        filter->value = op + 2;
+    }
+    else if ((op = strchr(arg, '~')) != NULL) {
+        filter->op = FILTER_HAS;
+        filter->value = op + 1;
+    }
+    else if ((op = strchr(arg, '=')) != NULL) {
+        filter->op = FILTER_EQ;
+        filter->value = op + 1;
+    }
+    else {
+        usage();
+    }
+    if (op == arg) {
+        usage();
+    }
+    filter->field = apr_pstrmemdup(p, arg, op - arg);
+    filter->len = strlen(filter->value);
+}
+
+static void add_schema(const unsigned char *rec, const unsigned char *s,
+                       const unsigned char *end)
+{
+    apr_pool_t *p = apr_hash_pool_get(schemas);
+    apr_uint64_t id, count, len;
+    apr_uint64_t *key;
+    schema_t *schema;
+    int i;
+
+    schema_records++;
+    s += 1 + LOG_BINARY_MAGIC_LEN;
+    if (s >= end || *s++ != LOG_BINARY_VERSION
+        || !log_binary_get_varint(&s, end, &id)
+        || !log_binary_get_varint(&s, end, &count)
+        || count > (apr_uint64_t)(end - s)) {
+        malformed++;
+        return;
+    }
+
+    /* writers send their schemas again from time to time */
+    schema = apr_hash_get(schemas, &id, sizeof(id));
+    if (schema && schema->raw_len == (apr_size_t)(end - rec)
+        && !memcmp(schema->raw, rec, end - rec)) {
+        return;
+    }
+
+    schema = apr_palloc(p, sizeof(*schema));
+    schema->nfields = (int)count;
+    schema->fields = apr_pcalloc(p, sizeof(field_t) * schema->nfields);
+    for (i = 0; i < schema->nfields; ++i) {
+        field_t *f = &schema->fields[i];
+
+        if (s >= end) {
+            malformed++;
+            return;
+        }
+        f->type = *s++;
+        if (!log_binary_get_varint(&s, end, &len)
+            || len > (apr_uint64_t)(end - s)) {
+            malformed++;
+            return;
+        }
+        f->spec = apr_pstrmemdup(p, (const char *)s, (apr_size_t)len);
+        f->spec_len = (apr_size_t)len;
+        s += len;
+        if (f->type != LOG_BINARY_CONST) {
+            f->name = field_name(p, f->spec);
+        }
+    }
+    schema->raw_len = end - rec;
+    schema->raw = apr_pmemdup(p, rec, schema->raw_len);
+
+    key = apr_pmemdup(p, &id, sizeof(id));
+    apr_hash_set(schemas, key, sizeof(*key), schema);
+}
+
+static int decode_entry(const schema_t *schema, const unsigned char *s,
+                        const unsigned char *end, value_t *values)
+{
+    apr_uint64_t n, z;
+    int i;
+
+    for (i = 0; i < schema->nfields; ++i) {
+        value_t *v = &values[i];
+
+        v->set = 0;
+        switch (schema->fields[i].type) {
+        case LOG_BINARY_CONST:
+            continue;
+        case LOG_BINARY_STRING:
+            if (!log_binary_get_varint(&s, end, &n)
+                || (n && n - 1 > (apr_uint64_t)(end - s))) {
+                return 0;
+            }
+            if (n) {
+                v->str = (const char *)s;
+                v->len = (apr_size_t)(n - 1);
+                s += v->len;
+                v->set = 1;
+            }
+            break;
+        case LOG_BINARY_NUMBER:
+            if (!log_binary_get_varint(&s, end, &n)) {
+                return 0;
+            }
+            if (n) {
+                v->num = n - 1;
+                v->set = 1;
+            }
+            break;
+        case LOG_BINARY_TIME:
+            if (!log_binary_get_varint(&s, end, &n)) {
+                return 0;
+            }
+            if (n) {
+                if (!log_binary_get_varint(&s, end, &z)) {
+                    return 0;
+                }
+                v->num = n - 1;
+                v->minutes = (z & 1) ? -(int)((z + 1) / 2) : (int)(z / 2);
+                v->set = 1;
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return s == end;
+}
+
+/* The text of a value, as the log format would have written it */
+static const char *value_text(apr_pool_t *p, const field_t *f,
+                              const value_t *v, apr_size_t *len)
+{
+    const char *text;
+
+    if (!v->set) {
+        *len = 1;
+        return "-";
+    }
+    switch (f->type) {
+    case LOG_BINARY_STRING:
+        *len = v->len;
+        return v->str;
+    case LOG_BINARY_TIME: {
+        apr_time_exp_t xt;
+        int timz = v->minutes < 0 ? -v->minutes : v->minutes;
+
+        apr_time_exp_tz(&xt, apr_time_from_sec((apr_time_t)v->num),
+                        v->minutes * 60);
+        text = apr_psprintf(p, "[%02d/%s/%d:%02d:%02d:%02d %c%.2d%.2d]",
+                            xt.tm_mday, apr_month_snames[xt.tm_mon],
+                            xt.tm_year+1900, xt.tm_hour, xt.tm_min,
+                            xt.tm_sec, v->minutes < 0 ? '-' : '+',
+                            timz / 60, timz % 60);
+        break;
+    }
+    default:
+        text = apr_psprintf(p, "%" APR_UINT64_T_FMT, v->num);
+        break;
+    }
+    *len = strlen(text);
+    return text;
+}
+
+static int matches(apr_pool_t *p, const schema_t *schema,
+                   const value_t *values)
+{
+    const filter_t *filter = (const filter_t *)filters->elts;
+    int i, j;
+
+    for (i = 0; i < filters->nelts; ++i, ++filter) {
+        const char *text = NULL;
+        apr_size_t len = 0, k;
+        int found = 0;
+
+        for (j = 0; j < schema->nfields; ++j) {
+            const field_t *f = &schema->fields[j];
+
+            if (f->type != LOG_BINARY_CONST
+                && (!strcmp(f->name, filter->field)
+                    || !strcmp(f->spec, filter->field))) {
+                text = value_text(p, f, &values[j], &len);
+                break;
+            }
+        }
+        if (!text) {
+            return 0;
+        }
+
+        switch (filter->op) {
+        case FILTER_EQ:
+        case FILTER_NE:
+            found = (len == filter->len && !memcmp(text, filter->value, len));
+            if (found != (filter->op == FILTER_EQ)) {
+                return 0;
+            }
+            break;
+        case FILTER_HAS:
+            for (k = 0; !found && k + filter->len <= len; ++k) {
+                found = !memcmp(text + k, filter->value, filter->len);
+            }
+            if (!found) {
+                return 0;
+            }
+            break;
+        }
+    }
+
+    return 1;
+}
+
+static void write_json_string(const char *s, apr_size_t len)
+{
+    apr_size_t i;
+
+    apr_file_putc('"', outfile);
+    for (i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c == '"' || c == '\\') {
+            apr_file_putc('\\', outfile);
+            apr_file_putc(c, outfile);
+        }
+        else if (c < 0x20) {
+            apr_file_printf(outfile, "\\u%04x", c);
+        }
+        else {
+            apr_file_putc(c, outfile);
+        }
+    }
+    apr_file_putc('"', outfile);
+}
+
+static void write_entry(apr_pool_t *p, const schema_t *schema,
+                        const value_t *values)
+{
+    const char *text;
+    apr_size_t len;
+    int i, first = 1;
+
+    if (!json) {
+        for (i = 0; i < schema->nfields; ++i) {
+            const field_t *f = &schema->fields[i];
+
+            if (f->type == LOG_BINARY_CONST) {
+                apr_file_write_full(outfile, f->spec, f->spec_len, NULL);
+            }
+            else {
+                text = value_text(p, f, &values[i], &len);
+                apr_file_write_full(outfile, text, len, NULL);
+            }
+        }
+        return;
+    }
+
+    apr_file_putc('{', outfile);
+    for (i = 0; i < schema->nfields; ++i) {
+        const field_t *f = &schema->fields[i];
+        const value_t *v = &values[i];
+
+        if (f->type == LOG_BINARY_CONST) {
+            continue;
+        }
+        if (!first) {
+            apr_file_putc(',', outfile);
+        }
+        first = 0;
+        write_json_string(f->name, strlen(f->name));
+        apr_file_putc(':', outfile);
+
+        if (!v->set) {
+            apr_file_puts("null", outfile);
+        }
+        else if (f->type == LOG_BINARY_NUMBER) {
+            apr_file_printf(outfile, "%" APR_UINT64_T_FMT, v->num);
+        }
+        else if (f->type == LOG_BINARY_TIME) {
+            apr_time_exp_t xt;
+            int timz = v->minutes < 0 ? -v->minutes : v->minutes;
+
+            apr_time_exp_tz(&xt, apr_time_from_sec((apr_time_t)v->num),
+                            v->minutes * 60);
+            apr_file_printf(outfile,
+                            "\"%d-%02d-%02dT%02d:%02d:%02d%c%02d:%02d\"",
+                            xt.tm_year+1900, xt.tm_mon+1, xt.tm_mday,
+                            xt.tm_hour, xt.tm_min, xt.tm_sec,
+                            v->minutes < 0 ? '-' : '+',
+                            timz / 60, timz % 60);
+        }
+        else {
+            write_json_string(v->str, v->len);
+        }
+    }
+    apr_file_puts("}" APR_EOL_STR, outfile);
+}
+
+static void decode_record(apr_pool_t *p, const unsigned char *rec,
+                          const unsigned char *s, const unsigned char *end)
+{
+    const schema_t *schema;
+    apr_uint64_t id;
+    value_t *values;
+
+    records++;
+    if (s == end) {
+        malformed++;
+        return;
+    }
+    if (*s == 0) {
+        if (end - s > LOG_BINARY_MAGIC_LEN
+            && !memcmp(s + 1, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LEN)) {
+            add_schema(rec, s, end);
+        }
+        else {
+            malformed++;
+        }
+        return;
+    }
+
+    entries++;
+    if (!log_binary_get_varint(&s, end, &id)) {
+        malformed++;
+        return;
+    }
+    schema = apr_hash_get(schemas, &id, sizeof(id));
+    if (!schema) {
+        unknown++;
+        return;
+    }
+
+    values = apr_palloc(p, sizeof(value_t) * schema->nfields);
+    if (!decode_entry(schema, s, end, values)) {
+        malformed++;
+        return;
+    }
+    if (filters->nelts && !matches(p, schema, values)) {
+        return;
+    }
+    write_entry(p, schema, values);
+    written++;
+}
+
+/*
+ * Decode the records of a file, returns 0 if it cannot be read or holds
+ * no records at all
+ */
+static int decode_file(apr_pool_t *pool, apr_file_t *infile, const char *name)
+{
+    apr_pool_t *precord;
+    apr_size_t size = READ_BUF_SIZE, len = 0;
+    apr_uint64_t found = 0, skip = 0;
+    unsigned char *buf;
+    apr_status_t rv;
+    int eof;
+
+    apr_pool_create(&precord, pool);
+    buf = apr_palloc(pool, size);
+
+    do {
+        const unsigned char *s, *end, *from, *rec, *body;
+        apr_size_t n, rlen;
+
+        if (len == size) {
+            /* a record larger than the buffer */
+            unsigned char *larger = apr_palloc(pool, size * 2);
+
+            memcpy(larger, buf, len);
+            buf = larger;
+            size *= 2;
+        }
+        n = size - len;
+        rv = apr_file_read(infile, buf + len, &n);
+        eof = APR_STATUS_IS_EOF(rv);
+        if (eof) {
+            n = 0;
+        }
+        else if (rv != APR_SUCCESS) {
+            apr_file_printf(errfile, "%s: Could not read %s: %pm"
+                            APR_EOL_STR, shortname, name, &rv);
+            return 0;
+        }
+        len += n;
+
+        s = buf;
+        end = buf + len;
+        for (;;) {
+            from = s;
+            if (!log_binary_next_record(&s, end, RECORD_MAX, eof,
+                                        &rec, &body, &rlen)) {
+                skip += s - from;
+                break;
+            }
+            skip += rec - from;
+            found++;
+            decode_record(precord, rec, body, body + rlen);
+            apr_pool_clear(precord);
+        }
+        len = end - s;
+        memmove(buf, s, len);
+    } while (!eof);
+
+    apr_pool_destroy(precord);
+    skipped += skip;
+    if (skip && !found) {
+        apr_file_printf(errfile, "%s: %s is not a binary log" APR_EOL_STR,
+                        shortname, name);
+        return 0;
+    }
+    if (skip) {
+        apr_file_printf(errfile, "%s: %s has %" APR_UINT64_T_FMT
+                        " bytes which are not whole records, skipped"
+                        APR_EOL_STR, shortname, name, skip);
+    }
+    return 1;
+}
+
+int main(int argc, const char * const argv[])
+{
+    apr_file_t * infile;
+    apr_getopt_t * o;
+    apr_pool_t * pool;
+    apr_status_t status;
+    const char * arg;
+    char * outbuffer;
+    int stats = 0;
+    int ok = 1;
+
+    if (apr_app_initialize(&argc, &argv, NULL) != APR_SUCCESS) {
+        return 1;
+    }
+    atexit(apr_terminate);
+
+    if (argc) {
+        shortname = apr_filepath_name_get(argv[0]);
+    }
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS) {
+        return 1;
+    }
+    apr_file_open_stderr(&errfile, pool);
+    apr_getopt_init(&o, pool, argc, argv);
+
+    schemas = apr_hash_make(pool);
+    filters = apr_array_make(pool, 4, sizeof(filter_t));
+
+    while (1) {
+        char opt;
+        status = apr_getopt(o, "jf:s", &opt, &arg);
+        if (status == APR_EOF) {
+            break;
+        }
+        else if (status != APR_SUCCESS) {
+            usage();
+        }
+        else {
+            switch (opt) {
+            case 'j':
+                json = 1;
+                break;
+            case 'f':
+                add_filter(pool, arg);
+                break;
+            case 's':
+                stats = 1;
+                break;
+            } /* switch */
+        } /* else */
+    } /* while */
+
+    apr_file_open_stdout(&outfile, pool);
+    if ((outbuffer = apr_palloc(pool, WRITE_BUF_SIZE)) == NULL) {
+        return 1;
+    }
+    apr_file_buffer_set(outfile, outbuffer, WRITE_BUF_SIZE);
+
+    if (o->ind == argc) {
+        apr_file_open_stdin(&infile, pool);
+        ok = decode_file(pool, infile, "stdin");
+    }
+    for (; o->ind < argc; o->ind++) {
+        const char *name = argv[o->ind];
+
+        status = apr_file_open(&infile, name, APR_FOPEN_READ,
+                               APR_OS_DEFAULT, pool);
+        if (status != APR_SUCCESS) {
+            apr_file_printf(errfile, "%s: Could not open %s: %pm"
+                            APR_EOL_STR, shortname, name, &status);
+            ok = 0;
+            continue;
+        }
+        if (!decode_file(pool, infile, name)) {
+            ok = 0;
+        }
+        apr_file_close(infile);
+    }
+
+    /* Flush any remaining output */
+    apr_file_flush(outfile);
+
+    if (stats) {
+        print_statistics(errfile);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -23,12 +23,15 @@
 #include "apr_general.h"
 #include "apr_time.h"
 #include "apr_getopt.h"
+#include "apr_hash.h"
 #include "apr_thread_proc.h"
 #include "apr_signal.h"
 #if APR_FILES_AS_SOCKETS
 #include "apr_poll.h"
 #endif
 
+#include "../modules/loggers/log_binary_common.h"
+
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -72,6 +75,7 @@ struct rotate_config {
 #endif
     int num_files;
     int create_path;
+    int binary;
 };
 
 typedef struct rotate_status rotate_status_t;
@@ -102,6 +106,20 @@ struct rotate_status {
 static rotate_config_t config;
 static rotate_status_t status;
 
+/* A schema record of a binary log */
+typedef struct {
+    apr_size_t len;
+    char *data;
+} binary_schema_t;
+
+/* With -b, what is left of stdin after the last whole record, and the
+ * schemas seen so far by id
+ */
+static char binary_pending[2 * BUFSIZE + LOG_BINARY_FRAME_MAX];
+static apr_size_t binary_pending_len;
+static apr_size_t binary_consumed;
+static apr_hash_t *binary_schemas;
+
 static void usage(const char *argv0, const char *reason)
 {
     if (reason) {
@@ -109,9 +127,9 @@ static void usage(const char *argv0, const char *reason)
     }
     fprintf(stderr,
 #if APR_FILES_AS_SOCKETS
-            "Usage: %s [-v] [-l] [-L linkname] [-p prog] [-f] [-D] [-t] [-e] [-c] [-n number] <logfile> "
+            "Usage: %s [-v] [-l] [-L linkname] [-p prog] [-f] [-D] [-t] [-e] [-c] [-n number] [-b] <logfile> "
 #else
-            "Usage: %s [-v] [-l] [-L linkname] [-p prog] [-f] [-D] [-t] [-e] [-n number] <logfile> "
+            "Usage: %s [-v] [-l] [-L linkname] [-p prog] [-f] [-D] [-t] [-e] [-n number] [-b] <logfile> "
 #endif
             "{<rotation time in seconds>|<rotation size>(B|K|M|G)} "
             "[offset minutes from UTC]\n\n",
@@ -150,6 +168,7 @@ static void usage(const char *argv0, const char *reason)
             "  -c       Create log even if it is empty.\n"
 #endif
             "  -n num   Rotate file by adding suffixes '.0', '.1', ..., '.(num-1)'.\n"
+            "  -b       Input is a binary log (CustomLog encoding=binary).\n"
             "\n"
             "The program for '-p' is invoked as \"[prog] <curfile> [<prevfile>]\"\n"
             "where <curfile> is the filename of the newly opened logfile, and\n"
@@ -213,6 +232,7 @@ static void dumpConfig (rotate_config_t *config)
 #if APR_FILES_AS_SOCKETS
     fprintf(stderr, "Rotation create empty logs:  %12s\n", config->create_empty ? "yes" : "no");
 #endif
+    fprintf(stderr, "Binary log records:          %12s\n", config->binary ? "yes" : "no");
     fprintf(stderr, "Rotation file name: %21s\n", config->szLogRoot);
     fprintf(stderr, "Post-rotation prog: %21s\n", config->postrotate_prog ? config->postrotate_prog : "not used");
 }
@@ -501,6 +521,78 @@ static void doRotate(rotate_config_t *config, rotate_status_t *status)
     status->nMessCount = 0;
 }
 
+/*
+ * With -b, stdin carries the framed records of a binary access log (see
+ * modules/loggers/log_binary_common.h).  Append what was read to the
+ * pending data, remember the schemas, and return the length of the
+ * whole records at its start, which are all that is written out.  Data
+ * which is not a record is passed through as it is, for readers to skip,
+ * up to where a record could start.
+ */
+static apr_size_t frame_binary(const char *data, apr_size_t len)
+{
+    const unsigned char *s, *end, *rec, *body;
+    apr_size_t rlen;
+    apr_uint64_t id;
+
+    if (binary_consumed) {
+        binary_pending_len -= binary_consumed;
+        memmove(binary_pending, binary_pending + binary_consumed,
+                binary_pending_len);
+        binary_consumed = 0;
+    }
+    memcpy(binary_pending + binary_pending_len, data, len);
+    binary_pending_len += len;
+
+    s = (const unsigned char *)binary_pending;
+    end = s + binary_pending_len;
+    while (log_binary_next_record(&s, end, BUFSIZE, 0, &rec, &body, &rlen)) {
+        if (rlen > 2 + LOG_BINARY_MAGIC_LEN && body[0] == 0
+            && !memcmp(body + 1, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LEN)) {
+            const unsigned char *p = body + 2 + LOG_BINARY_MAGIC_LEN;
+
+            if (log_binary_get_varint(&p, s, &id)) {
+                binary_schema_t *schema;
+                apr_size_t slen = s - rec;
+
+                schema = apr_hash_get(binary_schemas, &id, sizeof(id));
+                if (!schema || schema->len != slen
+                    || memcmp(schema->data, rec, slen)) {
+                    apr_uint64_t *key = apr_pmemdup(status.pool, &id,
+                                                    sizeof(id));
+
+                    schema = apr_palloc(status.pool, sizeof(*schema));
+                    schema->len = slen;
+                    schema->data = apr_pmemdup(status.pool, rec, slen);
+                    apr_hash_set(binary_schemas, key, sizeof(*key), schema);
+                }
+            }
+        }
+    }
+
+    binary_consumed = s - (const unsigned char *)binary_pending;
+    return binary_consumed;
+}
+
+/*
+ * Start a new file of a binary log with the schemas seen so far.
+ */
+static void write_binary_schemas(rotate_status_t *status)
+{
+    apr_hash_index_t *hi;
+
+    for (hi = apr_hash_first(NULL, binary_schemas); hi;
+         hi = apr_hash_next(hi)) {
+        void *val;
+        binary_schema_t *schema;
+
+        apr_hash_this(hi, NULL, NULL, &val);
+        schema = val;
+        apr_file_write_full(status->current.fd, schema->data, schema->len,
+                            NULL);
+    }
+}
+
 /*
  * Get a size or time param from a string.
  * Parameter 'last' indicates, whether the
@@ -559,6 +651,7 @@ static const char *get_time_or_size(rotate_config_t *config,
 int main (int argc, const char * const argv[])
 {
     char buf[BUFSIZE];
+    const char *data;
     apr_size_t nRead, nWrite;
     apr_file_t *f_stdin;
     apr_file_t *f_stdout;
@@ -583,9 +676,9 @@ int main (int argc, const char * const argv[])
     apr_pool_create(&status.pool, NULL);
     apr_getopt_init(&opt, status.pool, argc, argv);
 #if APR_FILES_AS_SOCKETS
-    while ((rv = apr_getopt(opt, "lL:p:fDtvecn:", &c, &opt_arg)) == APR_SUCCESS) {
+    while ((rv = apr_getopt(opt, "lL:p:fDtvecn:b", &c, &opt_arg)) == APR_SUCCESS) {
 #else
-    while ((rv = apr_getopt(opt, "lL:p:fDtven:", &c, &opt_arg)) == APR_SUCCESS) {
+    while ((rv = apr_getopt(opt, "lL:p:fDtven:b", &c, &opt_arg)) == APR_SUCCESS) {
 #endif
         switch (c) {
         case 'l':
@@ -625,6 +718,10 @@ int main (int argc, const char * const argv[])
             config.num_files = atoi(opt_arg);
             status.fileNum = -1;
             break;
+        case 'b':
+            config.binary = 1;
+            binary_schemas = apr_hash_make(status.pool);
+            break;
         }
     }
 
@@ -739,13 +836,24 @@ int main (int argc, const char * const argv[])
             exit(3);
         }
 #endif /* APR_FILES_AS_SOCKETS */
+        data = buf;
+        if (config.binary) {
+            nRead = frame_binary(buf, nRead);
+            data = binary_pending;
+        }
+
         checkRotate(&config, &status);
         if (status.rotateReason != ROTATE_NONE) {
+            apr_file_t *fd = status.current.fd;
+
             doRotate(&config, &status);
+            if (config.binary && status.current.fd != fd) {
+                write_binary_schemas(&status);
+            }
         }
 
         nWrite = nRead;
-        rv = apr_file_write_full(status.current.fd, buf, nWrite, &nWrite);
+        rv = apr_file_write_full(status.current.fd, data, nWrite, &nWrite);
         if (nWrite != nRead) {
             apr_off_t cur_offset;
             apr_pool_t *pool;
@@ -768,12 +876,20 @@ int main (int argc, const char * const argv[])
             status.nMessCount++;
         }
         if (config.echo) {
-            if (apr_file_write_full(f_stdout, buf, nRead, NULL)) {
+            if (apr_file_write_full(f_stdout, data, nRead, NULL)) {
                 fprintf(stderr, "Unable to write to stdout\n");
                 exit(4);
             }
         }
     }
 
+    if (config.binary && binary_pending_len > binary_consumed
+        && status.current.fd) {
+        /* what was held back for the rest of a record goes out as well */
+        apr_file_write_full(status.current.fd,
+                            binary_pending + binary_consumed,
+                            binary_pending_len - binary_consumed, NULL);
+    }
+
     return 0; /* reached only at stdin EOF. */
 }
@@ -0,0 +1,246 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* dummy-server.c: the parts of the server that the test programs don't
+ * link
+ *
+ * The test programs link the real util.lo, util_time.lo, util_pcre.lo,
+ * util_filter.lo, eor_bucket.lo and provider.lo from server/ (see
+ * TEST_SERVER_OBJECTS in Makefile.in), so that what they time or check
+ * is the code the server runs.  Those objects, and the modules some
+ * tests include, call into the logging, the configuration, the
+ * scoreboard, the MPM and the request processing, which would pull in
+ * the whole server: this file dummies just these calls, doing nothing or
+ * the least the tests need.  Nothing defined in the linked objects may
+ * be dummied here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apr_strings.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_log.h"
+#include "http_main.h"
+#include "http_protocol.h"
+#include "http_request.h"
+#include "ap_expr.h"
+#include "ap_mpm.h"
+#include "scoreboard.h"
+
+AP_DECLARE_DATA const char *ap_server_argv0 = "test";
+AP_DECLARE_DATA scoreboard *ap_scoreboard_image = NULL;
+AP_DECLARE_DATA int ap_extended_status = 0;
+
+/* log.c */
+AP_DECLARE(void) ap_log_error_(const char *file, int line, int module_index,
+                               int level, apr_status_t status,
+                               const server_rec *s, const char *fmt, ...)
+{
+}
+
+AP_DECLARE(void) ap_log_perror_(const char *file, int line, int module_index,
+                                int level, apr_status_t status, apr_pool_t *p,
+                                const char *fmt, ...)
+{
+}
+
+AP_DECLARE(void) ap_log_cerror_(const char *file, int line, int module_index,
+                                int level, apr_status_t status,
+                                const conn_rec *c, const char *fmt, ...)
+{
+}
+
+AP_DECLARE(void) ap_log_rerror_(const char *file, int line, int module_index,
+                                int level, apr_status_t status,
+                                const request_rec *r, const char *fmt, ...)
+{
+}
+
+AP_DECLARE(void) ap_log_assert(const char *szExp, const char *szFile,
+                               int nLine)
+{
+    fprintf(stderr, "%s:%d: assertion \"%s\" failed\n", szFile, nLine, szExp);
+    abort();
+}
+
+AP_DECLARE(piped_log *) ap_open_piped_log(apr_pool_t *p, const char *program)
+{
+    return NULL;
+}
+
+AP_DECLARE(apr_file_t *) ap_piped_log_write_fd(piped_log *pl)
+{
+    return NULL;
+}
+
+/* core.c */
+AP_DECLARE(const char *) ap_resolve_env(apr_pool_t *p, const char *word)
+{
+    return word;
+}
+
+AP_DECLARE(const char *) ap_check_cmd_context(cmd_parms *cmd,
+                                              unsigned forbidden)
+{
+    return NULL;
+}
+
+AP_DECLARE(const char *) ap_get_remote_host(conn_rec *conn, void *dir_config,
+                                            int type, int *str_is_ip)
+{
+    return conn->client_ip;
+}
+
+AP_DECLARE(const char *) ap_get_useragent_host(request_rec *r, int type,
+                                               int *str_is_ip)
+{
+    return r->useragent_ip;
+}
+
+AP_DECLARE(const char *) ap_get_remote_logname(request_rec *r)
+{
+    return NULL;
+}
+
+AP_DECLARE(const char *) ap_get_server_name(request_rec *r)
+{
+    return r->hostname;
+}
+
+/* config.c */
+AP_DECLARE(char *) ap_server_root_relative(apr_pool_t *p, const char *fname)
+{
+    return apr_pstrdup(p, fname);
+}
+
+AP_DECLARE(char *) ap_runtime_dir_relative(apr_pool_t *p, const char *fname)
+{
+    return apr_pstrdup(p, fname);
+}
+
+AP_DECLARE(void) ap_hook_pre_config(ap_HOOK_pre_config_t *pf,
+                                    const char * const *aszPre,
+                                    const char * const *aszSucc, int nOrder)
+{
+}
+
+AP_DECLARE(void) ap_hook_check_config(ap_HOOK_check_config_t *pf,
+                                      const char * const *aszPre,
+                                      const char * const *aszSucc, int nOrder)
+{
+}
+
+AP_DECLARE(void) ap_hook_open_logs(ap_HOOK_open_logs_t *pf,
+                                   const char * const *aszPre,
+                                   const char * const *aszSucc, int nOrder)
+{
+}
+
+AP_DECLARE(void) ap_hook_child_init(ap_HOOK_child_init_t *pf,
+                                    const char * const *aszPre,
+                                    const char * const *aszSucc, int nOrder)
+{
+}
+
+/* util_expr_eval.c */
+AP_DECLARE(ap_expr_info_t *) ap_expr_parse_cmd_mi(const cmd_parms *cmd,
+                                                  const char *expr,
+                                                  unsigned int flags,
+                                                  const char **err,
+                                                  ap_expr_lookup_fn_t *lookup_fn,
+                                                  int module_index)
+{
+    *err = "not supported";
+    return NULL;
+}
+
+AP_DECLARE(int) ap_expr_exec(request_rec *r, const ap_expr_info_t *expr,
+                             const char **err)
+{
+    return 1;
+}
+
+/* mpm_common.c */
+AP_DECLARE(apr_status_t) ap_mpm_query(int query_code, int *result)
+{
+    *result = 0;
+    return APR_SUCCESS;
+}
+
+/* scoreboard.c */
+AP_DECLARE(process_score *) ap_get_scoreboard_process(int x)
+{
+    return NULL;
+}
+
+AP_DECLARE(int) ap_update_child_status(ap_sb_handle_t *sbh, int status,
+                                       request_rec *r)
+{
+    return 0;
+}
+
+AP_DECLARE(void) ap_increment_counts(ap_sb_handle_t *sbh, request_rec *r)
+{
+}
+
+/* protocol.c, http_filters.c and request.c */
+AP_DECLARE(apr_port_t) ap_run_default_port(const request_rec *r)
+{
+    return DEFAULT_HTTP_PORT;
+}
+
+AP_DECLARE(int) ap_run_log_transaction(request_rec *r)
+{
+    return DECLINED;
+}
+
+AP_DECLARE(void) ap_hook_log_transaction(ap_HOOK_log_transaction_t *pf,
+                                         const char * const *aszPre,
+                                         const char * const *aszSucc,
+                                         int nOrder)
+{
+}
+
+AP_DECLARE(int) ap_rwrite(const void *buf, int nbyte, request_rec *r)
+{
+    return nbyte;
+}
+
+AP_DECLARE_NONSTD(int) ap_rprintf(request_rec *r, const char *fmt, ...)
+{
+    return 0;
+}
+
+AP_DECLARE(int) ap_discard_request_body(request_rec *r)
+{
+    return OK;
+}
+
+AP_DECLARE(int) ap_map_http_request_error(apr_status_t rv, int status)
+{
+    return status;
+}
+
+AP_DECLARE(request_rec *) ap_sub_req_lookup_dirent(const apr_finfo_t *finfo,
+                                                   const request_rec *r,
+                                                   int subtype,
+                                                   ap_filter_t *next_filter)
+{
+    return NULL;
+}
@@ -0,0 +1,179 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* test-async-log.c: check the ring buffer of BufferedLogs Async
+ *
+ * RECORDS records of varying lengths, most short and some of a few
+ * kilobytes, are appended to the smallest ring mod_log_config allows by
+ * ap_async_log_writer(), and drained to a temporary file by
+ * async_log_drain() at varying intervals, so that the ring wraps many
+ * times with records and padding falling at every offset.  The file is
+ * then read back and checked to hold every record, in order.  A
+ * mismatch is reported with the number of the record, and the exit
+ * status is non zero.
+ *
+ *     cd test && make test-async-log && ./test-async-log [records]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the module is included to reach its static functions */
+#include "mod_log_config.c"
+
+#include "apr_general.h"
+#include "apr_file_io.h"
+
+#define RECORDS     200000
+#define MAX_LEN     3000
+
+#if APR_HAS_THREADS
+
+/* Record i, in up to two pieces: its number, then filler up to its length */
+static apr_size_t make_record(char *buf, long i, unsigned int seed,
+                              const char **strs, int *strl, int *nelts)
+{
+    apr_size_t len;
+    int head;
+
+    /* mostly short lines, some long ones to make padding */
+    len = (seed % 16 == 0) ? 16 + (seed >> 4) % (MAX_LEN - 16)
+                           : 16 + (seed >> 4) % 200;
+    head = sprintf(buf, "%08ld ", i);
+    memset(buf + head, 'a' + (int)(i % 26), len - head - 1);
+    buf[len - 1] = '\n';
+
+    strs[0] = buf;
+    strl[0] = head;
+    strs[1] = buf + head;
+    strl[1] = (int)(len - head);
+    *nelts = 2;
+
+    return len;
+}
+
+int main(int argc, const char *const *argv)
+{
+    long records = RECORDS;
+    apr_pool_t *pool;
+    apr_file_t *f;
+    default_log_writer *writer;
+    async_log *log;
+    const char *tmpdir;
+    char *path;
+    char buf[MAX_LEN], got[MAX_LEN];
+    const char *strs[2];
+    int strl[2], nelts;
+    unsigned int seed = 1;
+    apr_uint32_t wraps = 0;
+    apr_size_t len;
+    long i;
+
+    if (argc > 1) {
+        records = atol(argv[1]);
+    }
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    if (apr_temp_dir_get(&tmpdir, pool) != APR_SUCCESS) {
+        fprintf(stderr, "no temporary directory\n");
+        return 1;
+    }
+    path = apr_pstrcat(pool, tmpdir, "/test-async-log.XXXXXX", NULL);
+    if (apr_file_mktemp(&f, path, APR_FOPEN_CREATE | APR_FOPEN_READ
+                                  | APR_FOPEN_WRITE | APR_FOPEN_EXCL
+                                  | APR_FOPEN_DELONCLOSE, pool)
+            != APR_SUCCESS) {
+        fprintf(stderr, "cannot create %s\n", path);
+        return 1;
+    }
+
+    writer = apr_pcalloc(pool, sizeof(*writer));
+    writer->type = LOG_WRITER_FD;
+    writer->log_writer = f;
+    log = apr_pcalloc(pool, sizeof(*log));
+    log->writer = writer;
+    log->name = path;
+    log->size = ASYNC_LOG_MIN_SIZE;
+    log->ring = apr_pcalloc(pool, log->size);
+    /* single threaded: a full ring is a failure, not a wait */
+    async_log_overflow = ASYNC_LOG_OVERFLOW_DROP;
+
+    for (i = 0; i < records; i++) {
+        apr_uint32_t head = log->head;
+
+        seed = seed * 1103515245 + 12345;
+        len = make_record(buf, i, seed >> 8, strs, strl, &nelts);
+
+        /* drain when the next records may not fit, or now and then */
+        if (log->size - (log->head - log->tail)
+                < 2 * ASYNC_LOG_RECORD(MAX_LEN)
+            || (seed >> 20) % 61 == 0) {
+            async_log_drain(log);
+        }
+        ap_async_log_writer(NULL, log, strs, strl, nelts, len);
+        if ((head ^ log->head) & ~(log->size - 1)) {
+            wraps++;
+        }
+    }
+    async_log_drain(log);
+
+    if (log->dropped || log->head != log->tail) {
+        fprintf(stderr, "%u records dropped, %u bytes left in the ring\n",
+                log->dropped, log->head - log->tail);
+        return 1;
+    }
+
+    /* read it all back */
+    {
+        apr_off_t off = 0;
+        apr_size_t n;
+
+        apr_file_seek(f, APR_SET, &off);
+        seed = 1;
+        for (i = 0; i < records; i++) {
+            seed = seed * 1103515245 + 12345;
+            len = make_record(buf, i, seed >> 8, strs, strl, &nelts);
+            if (apr_file_read_full(f, got, len, &n) != APR_SUCCESS
+                || n != len || memcmp(got, buf, len)) {
+                fprintf(stderr, "record %ld is missing or corrupted\n", i);
+                return 1;
+            }
+        }
+        if (apr_file_read_full(f, got, 1, &n) != APR_EOF) {
+            fprintf(stderr, "trailing garbage after the last record\n");
+            return 1;
+        }
+    }
+
+    printf("%ld records through a %u byte ring, %u wraps, %"
+           APR_UINT64_T_FMT " writes: ok\n", records, log->size, wraps,
+           log->writes);
+
+    apr_file_close(f);
+    apr_terminate();
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(int argc, const char *const *argv)
+{
+    printf("BufferedLogs Async needs threads\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,320 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* test-logbinary.c: check that binary access logs decode to their text
+ *
+ * Requests are logged with a few formats by mod_log_config, both as the
+ * text lines and as the binary records, and the records are written to
+ * a temporary file.  The file is decoded by logdecode's decode_file(),
+ * which must give back the same text lines, and JSON objects with the
+ * expected values.  Then a record is cut in two by another one, as a
+ * pipe may do with records over PIPE_BUF, and followed by garbage and
+ * an incomplete record: the other records must still be decoded, and
+ * exactly the bytes of the damaged ones skipped.  Last, many formats
+ * are given ids, which must all differ, while a format parsed again must
+ * get the id it had.  Failures are printed, and the exit status is non
+ * zero.
+ *
+ *     cd test && make test-logbinary && ./test-logbinary
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the module and the program are included to reach their static
+ * functions
+ */
+#include "mod_log_config.c"
+
+#define main logdecode_main
+#include "../support/logdecode.c"
+#undef main
+
+#include "apr_general.h"
+#include "apr_file_io.h"
+
+static const char *const text_formats[] = {
+    "%h %l %u %t \"%r\" %>s %b",
+    "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-Agent}i\"",
+};
+
+#define JSON_FORMAT "%h %u \"%r\" %>s %b \"%{User-Agent}i\""
+
+static const char *const json_lines[] = {
+    "{\"host\":\"192.0.2.10\",\"user\":null,"
+    "\"request\":\"GET /images/banner-large.png?v=20160315 HTTP/1.1\","
+    "\"status\":200,\"bytes\":48213,"
+    "\"user_agent\":\"Mozilla/5.0 (X11; Linux x86_64; rv:45.0) "
+    "Gecko/20100101 Firefox/45.0\"}" APR_EOL_STR,
+    "{\"host\":\"192.0.2.10\",\"user\":\"alice\","
+    "\"request\":\"GET /missing HTTP/1.1\","
+    "\"status\":404,\"bytes\":null,"
+    "\"user_agent\":\"say \\\"hi\\\" \\\\o/\"}" APR_EOL_STR,
+};
+
+/* enough formats for the hashes of some to give the same id */
+#define ID_FORMATS 500
+
+#define REQUESTS 2
+
+/* Request i: a plain one, or one with a user, no body and quotes */
+static request_rec *make_request(apr_pool_t *pool, int i)
+{
+    request_rec *r;
+    conn_rec *c;
+
+    c = apr_pcalloc(pool, sizeof(*c));
+    c->pool = pool;
+    c->client_ip = "192.0.2.10";
+
+    r = apr_pcalloc(pool, sizeof(*r));
+    r->pool = pool;
+    r->connection = c;
+    r->useragent_ip = c->client_ip;
+    r->hostname = "www.example.com";
+    r->method = "GET";
+    r->protocol = "HTTP/1.1";
+    r->request_time = apr_time_from_sec(1458000000 + i);
+    r->headers_in = apr_table_make(pool, 4);
+    if (i == 0) {
+        r->the_request = "GET /images/banner-large.png?v=20160315 HTTP/1.1";
+        r->status = HTTP_OK;
+        r->sent_bodyct = 1;
+        r->bytes_sent = 48213;
+        apr_table_setn(r->headers_in, "Referer",
+                       "https://www.example.com/news/2016/03/index.html");
+        apr_table_setn(r->headers_in, "User-Agent",
+                       "Mozilla/5.0 (X11; Linux x86_64; rv:45.0) "
+                       "Gecko/20100101 Firefox/45.0");
+    }
+    else {
+        r->the_request = "GET /missing HTTP/1.1";
+        r->user = "alice";
+        r->status = HTTP_NOT_FOUND;
+        apr_table_setn(r->headers_in, "User-Agent", "say \"hi\" \\o/");
+    }
+    /* room for log_config_module's request state */
+    r->request_config = apr_pcalloc(pool, sizeof(void *));
+
+    return r;
+}
+
+static apr_file_t *make_temp(apr_pool_t *pool, const char *tmpdir)
+{
+    apr_file_t *f;
+    char *path;
+
+    path = apr_pstrcat(pool, tmpdir, "/test-logbinary.XXXXXX", NULL);
+    if (apr_file_mktemp(&f, path, APR_FOPEN_CREATE | APR_FOPEN_READ
+                                  | APR_FOPEN_WRITE | APR_FOPEN_EXCL
+                                  | APR_FOPEN_DELONCLOSE, pool)
+            != APR_SUCCESS) {
+        fprintf(stderr, "cannot create %s\n", path);
+        exit(1);
+    }
+    return f;
+}
+
+static void put(apr_file_t *f, const void *data, apr_size_t len)
+{
+    apr_file_write_full(f, data, len, NULL);
+}
+
+/* Decode the binary log in f to text or JSON, and return the output */
+static char *decode(apr_pool_t *pool, const char *tmpdir, apr_file_t *f,
+                    int as_json)
+{
+    apr_off_t off = 0;
+    apr_size_t len;
+    char *buf;
+
+    apr_file_seek(f, APR_SET, &off);
+    outfile = make_temp(pool, tmpdir);
+    json = as_json;
+    if (!decode_file(pool, f, "test")) {
+        fprintf(stderr, "decode_file() failed\n");
+        exit(1);
+    }
+
+    off = 0;
+    apr_file_seek(outfile, APR_END, &off);
+    len = (apr_size_t)off;
+    buf = apr_palloc(pool, len + 1);
+    off = 0;
+    apr_file_seek(outfile, APR_SET, &off);
+    apr_file_read_full(outfile, buf, len, NULL);
+    buf[len] = '\0';
+    apr_file_close(outfile);
+
+    return buf;
+}
+
+static int check(const char *what, const char *got, const char *expected)
+{
+    if (strcmp(got, expected)) {
+        printf("FAIL: %s: got\n%sexpected\n%s", what, got, expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char *const *argv)
+{
+    apr_pool_t *pool;
+    apr_file_t *f;
+    apr_array_header_t *format;
+    request_rec *r[REQUESTS];
+    const binary_schema *bs;
+    const char *tmpdir, *err = NULL, *rec;
+    const char *expected = "";
+    apr_size_t len, cut;
+    apr_uint64_t skip;
+    apr_hash_t *ids;
+    unsigned int id = 0;
+    int failed = 0;
+    int i, j;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+    apr_hook_global_pool = pool;
+
+    log_config_module.module_index = 0;
+    register_hooks(pool);
+    log_pre_config(pool, pool, pool);
+    for (j = 0; j < REQUESTS; j++) {
+        r[j] = make_request(pool, j);
+    }
+
+    apr_file_open_stderr(&errfile, pool);
+    schemas = apr_hash_make(pool);
+    filters = apr_array_make(pool, 4, sizeof(filter_t));
+
+    if (apr_temp_dir_get(&tmpdir, pool) != APR_SUCCESS) {
+        fprintf(stderr, "no temporary directory\n");
+        return 1;
+    }
+
+    /* text lines: the schema and entries of each format, one after the
+     * other
+     */
+    f = make_temp(pool, tmpdir);
+    for (i = 0; i < (int)(sizeof(text_formats) / sizeof(text_formats[0]));
+         i++) {
+        format = parse_log_string(pool, text_formats[i], &err);
+        if (!format) {
+            fprintf(stderr, "%s: cannot parse: %s\n", text_formats[i], err);
+            return 1;
+        }
+        bs = binary_log_schema(pool, format);
+        put(f, bs->schema, bs->schema_len);
+        for (j = 0; j < REQUESTS; j++) {
+            rec = render_log_binary(r[j], r[j], format, bs->id, &len);
+            put(f, rec, len);
+            expected = apr_pstrcat(pool, expected,
+                                   render_log_items(r[j], r[j], format, &len),
+                                   NULL);
+        }
+    }
+    failed += check("text", decode(pool, tmpdir, f, 0), expected);
+    apr_file_close(f);
+
+    /* JSON objects */
+    f = make_temp(pool, tmpdir);
+    format = parse_log_string(pool, JSON_FORMAT, &err);
+    bs = binary_log_schema(pool, format);
+    put(f, bs->schema, bs->schema_len);
+    expected = "";
+    for (j = 0; j < REQUESTS; j++) {
+        rec = render_log_binary(r[j], r[j], format, bs->id, &len);
+        put(f, rec, len);
+        expected = apr_pstrcat(pool, expected, json_lines[j], NULL);
+    }
+    failed += check("JSON", decode(pool, tmpdir, f, 1), expected);
+    apr_file_close(f);
+
+    /* a long entry with another one written in its middle, garbage with
+     * a sync byte, an entry, and an incomplete one
+     */
+    f = make_temp(pool, tmpdir);
+    format = parse_log_string(pool, text_formats[0], &err);
+    bs = binary_log_schema(pool, format);
+    put(f, bs->schema, bs->schema_len);
+    {
+        char *long_request = apr_palloc(pool, 3 * LOG_BUFSIZE);
+        const char *long_rec, *garbage = "junk\xb1\x03" "abc";
+
+        memset(long_request, 'x', 3 * LOG_BUFSIZE - 1);
+        long_request[3 * LOG_BUFSIZE - 1] = '\0';
+        r[0]->the_request = long_request;
+        long_rec = render_log_binary(r[0], r[0], format, bs->id, &len);
+        skip = len;
+        cut = len / 2;
+        put(f, long_rec, cut);
+        rec = render_log_binary(r[1], r[1], format, bs->id, &len);
+        put(f, rec, len);
+        expected = render_log_items(r[1], r[1], format, &len);
+        put(f, long_rec + cut, skip - cut);
+
+        put(f, garbage, strlen(garbage));
+        skip += strlen(garbage);
+
+        rec = render_log_binary(r[1], r[1], format, bs->id, &len);
+        put(f, rec, len);
+        expected = apr_pstrcat(pool, expected,
+                               render_log_items(r[1], r[1], format, &len),
+                               NULL);
+
+        rec = render_log_binary(r[0], r[0], format, bs->id, &len);
+        put(f, rec, len - 3);
+        skip += len - 3;
+    }
+    skipped = 0;
+    failed += check("damaged", decode(pool, tmpdir, f, 0), expected);
+    if (skipped != skip) {
+        printf("FAIL: damaged: %" APR_UINT64_T_FMT " bytes skipped, "
+               "expected %" APR_UINT64_T_FMT "\n", skipped, skip);
+        failed++;
+    }
+    apr_file_close(f);
+
+    /* ids */
+    ids = apr_hash_make(pool);
+    for (i = 0; i < ID_FORMATS; i++) {
+        format = parse_log_string(pool, apr_psprintf(pool, "x%d %%h", i),
+                                  &err);
+        bs = binary_log_schema(pool, format);
+        if (!bs || apr_hash_get(ids, &bs->id, sizeof(bs->id))) {
+            printf("FAIL: ids: format %d got an id already given\n", i);
+            failed++;
+            break;
+        }
+        apr_hash_set(ids, &bs->id, sizeof(bs->id), "");
+        if (!i) {
+            id = bs->id;
+        }
+    }
+    format = parse_log_string(pool, "x0 %h", &err);
+    bs = binary_log_schema(pool, format);
+    if (!bs || bs->id != id) {
+        printf("FAIL: ids: the same format got another id\n");
+        failed++;
+    }
+
+    printf("%s\n", failed ? "FAILED" : "ok");
+
+    apr_terminate();
+    return failed;
+}
@@ -0,0 +1,128 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* test-rewrite-prefix.c: check the literal prefixes of RewriteRule patterns
+ *
+ * mod_rewrite only evaluates a rule whose pattern has a literal prefix
+ * against the subjects starting with it, so a prefix which is too long
+ * makes rules silently stop matching.  Each pattern below is given with
+ * the prefix expected from pattern_literal_prefix(), or none.  Failures
+ * are printed, and the exit status is the number of failures.
+ *
+ *     cd test && make test-rewrite-prefix && ./test-rewrite-prefix
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "apr_general.h"
+
+#include "rewrite_prefix.h"
+
+static const struct {
+    const char *pattern;
+    int nocase;
+    const char *prefix;     /* NULL for none */
+} cases[] = {
+    /* plain literals, up to the first metacharacter */
+    { "^/images/(.*)$",         0, "/images/" },
+    { "^/foo$",                 0, "/foo" },
+    { "^/foo/bar",              0, "/foo/bar" },
+    { "^/a.b",                  0, "/a" },
+
+    /* escaped metacharacters are literals */
+    { "^/a\\.b/",               0, "/a.b/" },
+    { "^/a\\(x\\)/",            0, "/a(x)/" },
+    { "^/a\\$x",                0, "/a$x" },
+    { "^/a\\|b",                0, "/a|b" },
+    { "^/a\\\\b",               0, "/a\\b" },
+
+    /* escape classes and backreferences end the prefix */
+    { "^/a\\d+",                0, "/a" },
+    { "^/(x)\\1",               0, "/" },
+
+    /* quantified literals may be absent */
+    { "^/ab*",                  0, "/a" },
+    { "^/ab?",                  0, "/a" },
+    { "^/ab{2}",                0, "/a" },
+    { "^/ab+",                  0, "/ab" },
+
+    /* only anchored patterns have a prefix */
+    { "/foo",                   0, NULL },
+    { "foo$",                   0, NULL },
+    { "^$",                     0, NULL },
+    { "^.*",                    0, NULL },
+    { "^(.*)",                  0, NULL },
+
+    /* top level alternation is not anchored */
+    { "^/a|/b",                 0, NULL },
+    { "^/x$|^/y",               0, NULL },
+    { "^/a|b)",                 0, NULL },
+    { "^(/a|/b)",               0, NULL },
+    { "^(?:/a|/b)",             0, NULL },
+    { "^/x(a|b)",               0, "/x" },
+    { "^/a[|]b",                0, "/a" },
+    { "^/a[^]|]b",              0, "/a" },
+
+    /* inline options and quoting could change what the prefix means */
+    { "(?i)^/foo",              0, NULL },
+    { "^(?i)/foo",              0, NULL },
+    { "^/foo(?i)bar",           0, NULL },
+    { "^/foo(?-i)bar",          0, NULL },
+    { "^/a\\Qx|y\\E",           0, NULL },
+    { "^/a\\",                  0, NULL },
+
+    /* caseless prefixes stop at bytes whose case depends on the locale */
+    { "^/foo/",                 1, "/foo/" },
+    { "^/caf\xc3\xa9/",         1, "/caf" },
+    { "^/caf\xc3\xa9/",         0, "/caf\xc3\xa9/" },
+};
+
+int main(int argc, const char *const *argv)
+{
+    apr_pool_t *pool;
+    apr_size_t i, len;
+    int failed = 0;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const char *prefix;
+
+        len = 0;
+        prefix = pattern_literal_prefix(pool, cases[i].pattern,
+                                        cases[i].nocase, &len);
+        if (cases[i].prefix == NULL
+            ? prefix != NULL
+            : (prefix == NULL || strcmp(prefix, cases[i].prefix)
+               || len != strlen(cases[i].prefix))) {
+            printf("FAIL: %s%s: got %s%s%s, expected %s%s%s\n",
+                   cases[i].pattern, cases[i].nocase ? " [NC]" : "",
+                   prefix ? "\"" : "", prefix ? prefix : "none",
+                   prefix ? "\"" : "",
+                   cases[i].prefix ? "\"" : "",
+                   cases[i].prefix ? cases[i].prefix : "none",
+                   cases[i].prefix ? "\"" : "");
+            failed++;
+        }
+    }
+    printf("%d of %d patterns failed\n", failed,
+           (int)(sizeof(cases) / sizeof(cases[0])));
+
+    apr_terminate();
+    return failed;
+}
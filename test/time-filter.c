@@ -0,0 +1,228 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* time-filter.c: time responses through a minimal output filter chain
+ *
+ * A handler passes WRITES small transient writes and an EOS through a
+ * content filter to a network filter which sets its data aside with
+ * ap_filter_setaside_brigade() and "writes" it once THRESHOLD bytes are
+ * pending, like the core output filter does.  The content filter either
+ * creates a new brigade on each invocation or reuses one with
+ * ap_reuse_brigade_from_pool().  For each variant the time, the number of
+ * malloc() calls (glibc only) and the number of buckets set aside are
+ * reported per response.  The pools use an allocator which keeps no free
+ * memory, so that pool growth shows up as malloc() calls.
+ *
+ *     cd test && make time-filter && ./time-filter [responses]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "httpd.h"
+#include "http_config.h"
+#include "http_log.h"
+#include "http_request.h"
+#include "util_filter.h"
+#include "apr_general.h"
+#include "apr_hash.h"
+#include "apr_time.h"
+
+#define RESPONSES 100000
+#define WRITES    64
+#define THRESHOLD 16384
+
+#if defined(__GLIBC__)
+#define COUNT_MALLOC 1
+extern void *__libc_malloc(size_t size);
+static unsigned long mallocs;
+
+void *malloc(size_t size)
+{
+    mallocs++;
+    return __libc_malloc(size);
+}
+#endif
+
+static int reuse;
+static apr_size_t setaside;
+
+static apr_status_t content_filter(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    apr_bucket_brigade *out;
+
+    if (reuse) {
+        out = ap_reuse_brigade_from_pool("time_filter_content", f->r->pool,
+                                         f->c->bucket_alloc);
+    }
+    else {
+        out = apr_brigade_create(f->r->pool, f->c->bucket_alloc);
+    }
+    APR_BRIGADE_CONCAT(out, bb);
+
+    return ap_pass_brigade(f->next, out);
+}
+
+static apr_status_t network_filter(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    apr_bucket *flush_upto, *e;
+    apr_off_t pending = 0;
+    apr_status_t rv;
+
+    rv = ap_filter_reinstate_brigade(f, bb, &flush_upto);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        if (APR_BUCKET_IS_EOS(e)) {
+            flush_upto = APR_BRIGADE_SENTINEL(bb);
+            break;
+        }
+        pending += e->length;
+    }
+    if (flush_upto || pending >= THRESHOLD) {
+        /* pretend it was all written, and let the filter clear its
+         * deferred pool
+         */
+        apr_brigade_cleanup(bb);
+        return ap_filter_setaside_brigade(f, bb);
+    }
+
+    rv = ap_filter_setaside_brigade(f, bb);
+    for (e = APR_BRIGADE_FIRST(f->bb); e != APR_BRIGADE_SENTINEL(f->bb);
+         e = APR_BUCKET_NEXT(e)) {
+        setaside++;
+    }
+
+    return rv;
+}
+
+static void handler(request_rec *r)
+{
+    static const char line[] = "<tr><td>some small piece of markup</td></tr>\n";
+    apr_bucket_brigade *bb;
+    int i;
+
+    bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    for (i = 0; i < WRITES; i++) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create(line,
+                                sizeof(line) - 1, bb->bucket_alloc));
+        ap_pass_brigade(r->output_filters, bb);
+        apr_brigade_cleanup(bb);
+    }
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(bb->bucket_alloc));
+    ap_pass_brigade(r->output_filters, bb);
+}
+
+static void run(conn_rec *c, ap_filter_t *network, long responses)
+{
+    static ap_filter_rec_t content_rec;
+    apr_time_t start, elapsed;
+    unsigned long count = 0;
+    long n;
+
+    content_rec.name = "CONTENT";
+    content_rec.filter_func.out_func = content_filter;
+    content_rec.ftype = AP_FTYPE_RESOURCE;
+
+    setaside = 0;
+    start = apr_time_now();
+    for (n = 0; n < responses; n++) {
+        ap_filter_t *content;
+        request_rec *r;
+        apr_pool_t *p;
+
+        apr_pool_create(&p, c->pool);
+#ifdef COUNT_MALLOC
+        count -= mallocs;
+#endif
+        r = apr_pcalloc(p, sizeof(*r));
+        r->pool = p;
+        r->connection = c;
+
+        content = apr_pcalloc(p, sizeof(*content));
+        content->frec = &content_rec;
+        content->next = network;
+        content->r = r;
+        content->c = c;
+        r->output_filters = content;
+
+        handler(r);
+
+#ifdef COUNT_MALLOC
+        count += mallocs;
+#endif
+        apr_pool_destroy(p);
+    }
+    elapsed = apr_time_now() - start;
+
+    printf("%-8s %8.1f ns/response", reuse ? "reuse" : "create",
+           (double)elapsed * 1000.0 / responses);
+#ifdef COUNT_MALLOC
+    printf("   %6.2f mallocs/response", (double)count / responses);
+#endif
+    printf("   %6.2f buckets set aside/write\n",
+           (double)setaside / responses / WRITES);
+}
+
+int main(int argc, const char *const *argv)
+{
+    long responses = RESPONSES;
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    ap_logconf log = { NULL, APLOG_WARNING };
+    static ap_filter_rec_t network_rec;
+    ap_filter_t *network;
+    conn_rec *c;
+
+    if (argc > 1) {
+        responses = atol(argv[1]);
+    }
+    apr_app_initialize(&argc, &argv, NULL);
+
+    apr_allocator_create(&allocator);
+    apr_allocator_max_free_set(allocator, 1);
+    apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    apr_allocator_owner_set(allocator, pool);
+
+    c = apr_pcalloc(pool, sizeof(*c));
+    c->pool = pool;
+    c->bucket_alloc = apr_bucket_alloc_create(pool);
+    c->filters = apr_hash_make(pool);
+    c->log = &log;
+
+    /* The connection filter outlives the requests, as its set aside
+     * brigade does
+     */
+    network_rec.name = "NETWORK";
+    network_rec.filter_func.out_func = network_filter;
+    network_rec.ftype = AP_FTYPE_NETWORK;
+    network = apr_pcalloc(pool, sizeof(*network));
+    network->frec = &network_rec;
+    network->c = c;
+
+    printf("%d writes of %d bytes per response, %ld responses\n", WRITES,
+           (int)sizeof("<tr><td>some small piece of markup</td></tr>\n") - 1,
+           responses);
+
+    reuse = 0;
+    run(c, network, responses);
+    reuse = 1;
+    run(c, network, responses);
+
+    apr_terminate();
+    return 0;
+}
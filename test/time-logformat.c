@@ -0,0 +1,336 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* time-logformat.c: time the rendering of access log lines
+ *
+ * The common and combined formats are parsed by mod_log_config, then a
+ * line is rendered ITERATIONS times for the same request, either the way
+ * it was before render plans (each item processed to a string, then the
+ * strings measured and concatenated, as ap_default_log_writer() did) or
+ * with render_log_items().  The lines are checked to be the same.  Then
+ * the binary entry records of the same format are timed, and the bytes
+ * per line of both encodings reported.
+ *
+ * The escaping is that of the real ap_escape_logitem() from util.c.
+ * Beforehand, it is checked to give the same strings as a copy of the
+ * byte at a time version it replaced, and both are timed on the items
+ * of the request and on strings with characters to escape.
+ *
+ *     cd test && make time-logformat && ./time-logformat [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the module is included to reach its static functions */
+#include "mod_log_config.c"
+
+#include "apr_general.h"
+#include "apr_lib.h"
+
+#define ITERATIONS 1000000
+
+/* ap_escape_logitem() as it was before it scanned words at a time */
+static unsigned char old_escape[256];
+
+static void old_escape_init(void)
+{
+    int c;
+
+    for (c = 1; c < 256; c++) {
+        old_escape[c] = (!apr_isprint(c) || c == '"' || c == '\\'
+                         || apr_iscntrl(c));
+    }
+}
+
+static char *old_escape_logitem(apr_pool_t *p, const char *str)
+{
+    static const char c2x_table[] = "0123456789abcdef";
+    char *ret;
+    unsigned char *d;
+    const unsigned char *s;
+    apr_size_t length, escapes = 0;
+
+    if (!str) {
+        return NULL;
+    }
+
+    for (s = (const unsigned char *)str; *s; ++s) {
+        if (old_escape[*s]) {
+            escapes++;
+        }
+    }
+    length = s - (const unsigned char *)str + 1;
+    if (escapes == 0) {
+        return apr_pmemdup(p, str, length);
+    }
+
+    ret = apr_palloc(p, length + 3 * escapes);
+    d = (unsigned char *)ret;
+    for (s = (const unsigned char *)str; *s; ++s) {
+        if (old_escape[*s]) {
+            *d++ = '\\';
+            switch (*s) {
+            case '\b':
+                *d++ = 'b';
+                break;
+            case '\n':
+                *d++ = 'n';
+                break;
+            case '\r':
+                *d++ = 'r';
+                break;
+            case '\t':
+                *d++ = 't';
+                break;
+            case '\v':
+                *d++ = 'v';
+                break;
+            case '\\':
+            case '"':
+                *d++ = *s;
+                break;
+            default:
+                *d++ = 'x';
+                *d++ = c2x_table[*s >> 4];
+                *d++ = c2x_table[*s & 0xf];
+            }
+        }
+        else {
+            *d++ = *s;
+        }
+    }
+    *d = '\0';
+
+    return ret;
+}
+
+static const char *const escape_items[] = {
+    "GET /images/banner-large.png?v=20160315 HTTP/1.1",
+    "Mozilla/5.0 (X11; Linux x86_64; rv:45.0) Gecko/20100101 Firefox/45.0",
+    "https://www.example.com/news/2016/03/index.html",
+    "192.0.2.10",
+    "",
+    "GET /search?q=\"quoted\"+and+back\\slashed HTTP/1.1",
+    "bell\a backspace\b tab\t newline\n vtab\v cr\r esc\033 del\177",
+    "8 bits \xc3\xa9t\xc3\xa9, \x80 and \xff",
+};
+
+/* Check the old and new escapers against each other, then time them */
+static int time_escape(apr_pool_t *pool, long iterations)
+{
+    apr_pool_t *p;
+    apr_size_t i;
+    long n;
+
+    apr_pool_create(&p, pool);
+    old_escape_init();
+    for (i = 0; i < sizeof(escape_items) / sizeof(escape_items[0]); i++) {
+        const char *item = escape_items[i];
+        const char *old = old_escape_logitem(p, item);
+        const char *new = ap_escape_logitem(p, item);
+        apr_time_t start, told, tnew;
+
+        if (strcmp(old, new)) {
+            fprintf(stderr, "escaped items differ:\n%s\n%s\n", old, new);
+            return 1;
+        }
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            if (n % 1024 == 0) {
+                apr_pool_clear(p);
+            }
+            old_escape_logitem(p, item);
+        }
+        told = apr_time_now() - start;
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            if (n % 1024 == 0) {
+                apr_pool_clear(p);
+            }
+            ap_escape_logitem(p, item);
+        }
+        tnew = apr_time_now() - start;
+
+        printf("escape %3" APR_SIZE_T_FMT " bytes   old %8.1f ns   "
+               "new %8.1f ns   %.40s\n", strlen(item),
+               (double)told * 1000.0 / iterations,
+               (double)tnew * 1000.0 / iterations, new);
+    }
+    apr_pool_destroy(p);
+
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    const char *format;
+} formats[] = {
+    { "common",   "%h %l %u %t \"%r\" %>s %b" },
+    { "combined", "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" "
+                  "\"%{User-Agent}i\"" },
+};
+
+/* The line as it was rendered before render_log_items() */
+static char *render_concat(request_rec *r, apr_array_header_t *format,
+                           apr_size_t *len)
+{
+    log_format_item *items = (log_format_item *) format->elts;
+    const char **strs;
+    int *strl;
+    char *str, *s;
+    int i;
+
+    strs = apr_palloc(r->pool, sizeof(char *) * (format->nelts));
+    strl = apr_palloc(r->pool, sizeof(int) * (format->nelts));
+    for (i = 0; i < format->nelts; ++i) {
+        strs[i] = process_item(r, r, &items[i]);
+    }
+    *len = 0;
+    for (i = 0; i < format->nelts; ++i) {
+        *len += strl[i] = strlen(strs[i]);
+    }
+
+    str = apr_palloc(r->pool, *len + 1);
+    for (i = 0, s = str; i < format->nelts; ++i) {
+        memcpy(s, strs[i], strl[i]);
+        s += strl[i];
+    }
+    *s = '\0';
+
+    return str;
+}
+
+static request_rec *make_request(apr_pool_t *pool)
+{
+    request_rec *r;
+    conn_rec *c;
+
+    c = apr_pcalloc(pool, sizeof(*c));
+    c->pool = pool;
+    c->client_ip = "192.0.2.10";
+
+    r = apr_pcalloc(pool, sizeof(*r));
+    r->connection = c;
+    r->useragent_ip = c->client_ip;
+    r->hostname = "www.example.com";
+    r->the_request = "GET /images/banner-large.png?v=20160315 HTTP/1.1";
+    r->method = "GET";
+    r->protocol = "HTTP/1.1";
+    r->status = HTTP_OK;
+    r->sent_bodyct = 1;
+    r->bytes_sent = 48213;
+    r->request_time = apr_time_now();
+    r->headers_in = apr_table_make(pool, 4);
+    apr_table_setn(r->headers_in, "Referer",
+                   "https://www.example.com/news/2016/03/index.html");
+    apr_table_setn(r->headers_in, "User-Agent",
+                   "Mozilla/5.0 (X11; Linux x86_64; rv:45.0) "
+                   "Gecko/20100101 Firefox/45.0");
+    /* room for log_config_module's request state */
+    r->request_config = apr_pcalloc(pool, sizeof(void *));
+
+    return r;
+}
+
+int main(int argc, const char *const *argv)
+{
+    long iterations = ITERATIONS;
+    apr_pool_t *pool;
+    request_rec *r;
+    apr_size_t i;
+    long n;
+
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+    apr_hook_global_pool = pool;
+
+    log_config_module.module_index = 0;
+    register_hooks(pool);
+    log_pre_config(pool, pool, pool);
+    r = make_request(pool);
+
+    printf("%ld iterations per item and format\n", iterations);
+    if (time_escape(pool, iterations)) {
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        apr_array_header_t *format;
+        apr_time_t start, concat, render, binary;
+        const char *err = NULL;
+        char *line1, *line2;
+        apr_size_t len1, len2, len3;
+        unsigned int id;
+
+        format = parse_log_string(pool, formats[i].format, &err);
+        if (!format) {
+            fprintf(stderr, "%s: cannot parse: %s\n", formats[i].name, err);
+            return 1;
+        }
+
+        apr_pool_create(&r->pool, pool);
+        line1 = render_concat(r, format, &len1);
+        line2 = render_log_items(r, r, format, &len2);
+        if (len1 != len2 || memcmp(line1, line2, len1)) {
+            fprintf(stderr, "%s: lines differ:\n%s%s", formats[i].name,
+                    line1, line2);
+            return 1;
+        }
+        apr_pool_destroy(r->pool);
+        id = binary_log_schema(pool, format)->id;
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            apr_pool_create(&r->pool, pool);
+            render_concat(r, format, &len1);
+            apr_pool_destroy(r->pool);
+        }
+        concat = apr_time_now() - start;
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            apr_pool_create(&r->pool, pool);
+            render_log_items(r, r, format, &len2);
+            apr_pool_destroy(r->pool);
+        }
+        render = apr_time_now() - start;
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            apr_pool_create(&r->pool, pool);
+            render_log_binary(r, r, format, id, &len3);
+            apr_pool_destroy(r->pool);
+        }
+        binary = apr_time_now() - start;
+
+        printf("%-9s concat %8.1f ns/line   render %8.1f ns/line   "
+               "binary %8.1f ns/line\n", formats[i].name,
+               (double)concat * 1000.0 / iterations,
+               (double)render * 1000.0 / iterations,
+               (double)binary * 1000.0 / iterations);
+        printf("%-9s text %4" APR_SIZE_T_FMT " bytes/line   binary %4"
+               APR_SIZE_T_FMT " bytes/line\n", "", len2, len3);
+    }
+
+    apr_terminate();
+    return 0;
+}
@@ -0,0 +1,115 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* time-regex.c: time ap_regexec() on patterns typical of httpd configs
+ *
+ * Each pattern is compiled once and then matched ITERATIONS times against
+ * a matching and a non-matching subject, the way <LocationMatch>,
+ * <FilesMatch>, RewriteRule and BrowserMatch use the regex engine on
+ * every request.  Run it against util_pcre.lo built with and without
+ * JIT support (or with HAVE_PCRE2) to compare.
+ *
+ *     cd test && make time-regex && ./time-regex [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "httpd.h"
+#include "ap_regex.h"
+#include "apr_general.h"
+#include "apr_time.h"
+
+#define ITERATIONS 1000000
+
+static const struct {
+    const char *name;
+    const char *pattern;
+    int cflags;
+    const char *hit;
+    const char *miss;
+} tests[] = {
+    { "LocationMatch",
+      "^/(app|api)/v[0-9]+/", 0,
+      "/api/v2/users/1234", "/static/css/site.css" },
+    { "FilesMatch",
+      "\\.(gif|jpe?g|png|webp|ico)$", AP_REG_ICASE,
+      "/images/banner-large.JPEG", "/index.html" },
+    { "RewriteRule",
+      "^/blog/([0-9]{4})/([0-9]{2})/([a-z0-9-]+)/?$", 0,
+      "/blog/2016/03/introducing-the-new-site/", "/blog/feed.xml" },
+    { "BrowserMatch",
+      "(googlebot|bingbot|yandex|baiduspider|slurp)", AP_REG_ICASE,
+      "Mozilla/5.0 (compatible; Googlebot/2.1; "
+      "+http://www.google.com/bot.html)",
+      "Mozilla/5.0 (X11; Linux x86_64; rv:45.0) Gecko/20100101 "
+      "Firefox/45.0" },
+};
+
+int main(int argc, const char *const *argv)
+{
+    ap_regmatch_t pmatch[AP_MAX_REG_MATCH];
+    long iterations = ITERATIONS;
+    apr_size_t i;
+    long n;
+
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+    apr_app_initialize(&argc, &argv, NULL);
+
+    printf("%s, %ld iterations per subject\n",
+           ap_pcre_version_string(AP_REG_PCRE_LOADED), iterations);
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        ap_regex_t re;
+        apr_time_t start, hit, miss;
+        int rc;
+
+        rc = ap_regcomp(&re, tests[i].pattern, tests[i].cflags);
+        if (rc != 0) {
+            char buf[256];
+            ap_regerror(rc, &re, buf, sizeof(buf));
+            fprintf(stderr, "%s: cannot compile: %s\n", tests[i].name, buf);
+            return 1;
+        }
+        if (ap_regexec(&re, tests[i].hit, AP_MAX_REG_MATCH, pmatch, 0) != 0
+            || ap_regexec(&re, tests[i].miss, AP_MAX_REG_MATCH, pmatch,
+                          0) != AP_REG_NOMATCH) {
+            fprintf(stderr, "%s: unexpected match result\n", tests[i].name);
+            return 1;
+        }
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            ap_regexec(&re, tests[i].hit, AP_MAX_REG_MATCH, pmatch, 0);
+        }
+        hit = apr_time_now() - start;
+
+        start = apr_time_now();
+        for (n = 0; n < iterations; n++) {
+            ap_regexec(&re, tests[i].miss, AP_MAX_REG_MATCH, pmatch, 0);
+        }
+        miss = apr_time_now() - start;
+
+        printf("%-14s hit %8.1f ns/op   miss %8.1f ns/op\n", tests[i].name,
+               (double)hit * 1000.0 / iterations,
+               (double)miss * 1000.0 / iterations);
+        ap_regfree(&re);
+    }
+
+    apr_terminate();
+    return 0;
+}
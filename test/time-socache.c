@@ -0,0 +1,214 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* time-socache.c: time the shmcb socache from many threads
+ *
+ * A shmcb cache is created and filled with KEYS entries, then THREADS
+ * threads each make ITERATIONS operations on random keys, nine retrieves
+ * for each store.  This is done first with one mutex held around every
+ * operation, as callers did before shmcb had its per-subcache locks, then
+ * without it where shmcb has them (see SHMCB_SUBCACHE_LOCKS).  Every entry
+ * retrieved is checked to hold the data stored for its key, so that a
+ * broken lock shows up as errors rather than just as a good time.
+ *
+ *     cd test && make time-socache && ./time-socache [threads [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the module is included to reach its static functions */
+#include "mod_socache_shmcb.c"
+
+#include "apr_general.h"
+#include "apr_thread_mutex.h"
+
+#define THREADS     8
+#define ITERATIONS  200000
+#define KEYS        4096
+
+typedef struct {
+    ap_socache_instance_t *instance;
+    server_rec *s;
+    apr_pool_t *pool;
+    apr_thread_mutex_t *mutex;
+    unsigned int seed;
+    long iterations;
+    long hits, misses, errors;
+} worker_t;
+
+static int make_id(unsigned char *id, unsigned int key)
+{
+    return sprintf((char *)id, "id-%05u", key);
+}
+
+static int make_data(unsigned char *data, unsigned int key)
+{
+    return sprintf((char *)data, "data for key %05u, padded up to the "
+                   "size of a small session", key);
+}
+
+static void * APR_THREAD_FUNC worker(apr_thread_t *thd, void *arg)
+{
+    worker_t *w = arg;
+    unsigned char id[16], data[128], dest[128];
+    unsigned int key, destlen;
+    int idlen, datalen;
+    apr_status_t rv;
+    long n;
+
+    for (n = 0; n < w->iterations; n++) {
+        /* a plain LCG is all the randomness needed */
+        w->seed = w->seed * 1103515245 + 12345;
+        key = (w->seed >> 8) % KEYS;
+        idlen = make_id(id, key);
+        datalen = make_data(data, key);
+
+        if (w->mutex) {
+            apr_thread_mutex_lock(w->mutex);
+        }
+        if ((w->seed >> 4) % 10 == 0) {
+            socache_shmcb_store(w->instance, w->s, id, idlen,
+                                apr_time_now() + apr_time_from_sec(3600),
+                                data, datalen, w->pool);
+        }
+        else {
+            destlen = sizeof(dest);
+            rv = socache_shmcb_retrieve(w->instance, w->s, id, idlen,
+                                        dest, &destlen, w->pool);
+            if (rv != APR_SUCCESS) {
+                w->misses++;
+            }
+            else if (destlen != (unsigned int)datalen
+                     || memcmp(dest, data, datalen)) {
+                w->errors++;
+            }
+            else {
+                w->hits++;
+            }
+        }
+        if (w->mutex) {
+            apr_thread_mutex_unlock(w->mutex);
+        }
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static int run(const char *name, ap_socache_instance_t *instance,
+               server_rec *s, apr_thread_mutex_t *mutex, int threads,
+               long iterations, apr_pool_t *pool)
+{
+    apr_thread_t **thds;
+    worker_t *workers;
+    long hits = 0, misses = 0, errors = 0;
+    apr_time_t start, elapsed;
+    apr_status_t rv;
+    int i;
+
+    thds = apr_pcalloc(pool, threads * sizeof(*thds));
+    workers = apr_pcalloc(pool, threads * sizeof(*workers));
+    for (i = 0; i < threads; i++) {
+        workers[i].instance = instance;
+        workers[i].s = s;
+        workers[i].mutex = mutex;
+        workers[i].seed = i + 1;
+        workers[i].iterations = iterations;
+        apr_pool_create(&workers[i].pool, pool);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < threads; i++) {
+        rv = apr_thread_create(&thds[i], NULL, worker, &workers[i], pool);
+        if (rv != APR_SUCCESS) {
+            fprintf(stderr, "cannot create thread %d\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        apr_thread_join(&rv, thds[i]);
+        hits += workers[i].hits;
+        misses += workers[i].misses;
+        errors += workers[i].errors;
+    }
+    elapsed = apr_time_now() - start;
+
+    printf("%-9s %10.0f ops/s   %ld hits, %ld misses, %ld errors\n", name,
+           (double)threads * iterations * APR_USEC_PER_SEC
+           / (elapsed ? elapsed : 1), hits, misses, errors);
+
+    return errors != 0;
+}
+
+int main(int argc, const char *const *argv)
+{
+    static struct ap_socache_hints hints = {16, 64, 0};
+    int threads = THREADS;
+    long iterations = ITERATIONS;
+    ap_socache_instance_t *instance;
+    apr_thread_mutex_t *mutex;
+    unsigned char id[16], data[128];
+    unsigned int key;
+    const char *err;
+    apr_pool_t *pool;
+    server_rec *s;
+    int failed;
+
+    if (argc > 1) {
+        threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        iterations = atol(argv[2]);
+    }
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+    s = apr_pcalloc(pool, sizeof(*s));
+
+    err = socache_shmcb_create(&instance, "time-socache(4194304)", pool,
+                               pool);
+    if (err) {
+        fprintf(stderr, "cannot create cache: %s\n", err);
+        return 1;
+    }
+    if (socache_shmcb_init(instance, "time-socache", &hints, s, pool)
+            != APR_SUCCESS) {
+        fprintf(stderr, "cannot initialise cache\n");
+        return 1;
+    }
+    for (key = 0; key < KEYS; key++) {
+        socache_shmcb_store(instance, s, id, make_id(id, key),
+                            apr_time_now() + apr_time_from_sec(3600),
+                            data, make_data(data, key), pool);
+    }
+    apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+
+    printf("%d threads, %ld operations each, %u subcaches\n", threads,
+           iterations, instance->header->subcache_num);
+
+    failed = run("mutex", instance, s, mutex, threads, iterations, pool);
+    if (socache_shmcb.flags & AP_SOCACHE_FLAG_NOTMPSAFE) {
+        printf("no subcache locks here, skipping the run without mutex\n");
+    }
+    else {
+        failed |= run("subcache", instance, s, NULL, threads, iterations,
+                      pool);
+    }
+
+    socache_shmcb_destroy(instance, s);
+    apr_terminate();
+    return failed;
+}